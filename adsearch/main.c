@@ -0,0 +1,356 @@
+/*
+    Info:
+
+        Auto Drive parameter search.
+
+        Tunes the four `ad_*` variables of the side winder 2 expert that
+        generates all of the datasets, using random search and successive
+        halving over seeded rounds of the headless simulator
+        (inc/porysim.h) in virtual time.
+
+        > candidates are drawn uniformly from the same ranges as
+          randAutoDrive(), the defaults are always candidate 0.
+
+        > every rung evaluates the surviving candidates on the same seeds
+          (common random numbers), the better half survives and the round
+          budget per candidate doubles. Rounds from earlier rungs are kept.
+
+        > a round starts from a fresh state and ends when the porygon is
+          collected or after 60 seconds, its score is the round score the
+          capture tools log with, 0 if it timed out or did not qualify.
+
+        The score distribution of every tuple is written to a CSV report
+        and the best tuple is written as a config.txt with the ScarletFast
+        car physics, which porydrive and porydrivecli both load.
+
+    Usage:
+
+        ./adsearch <candidates> <rounds at first rung> [rungs] [out config] [report csv] [seed]
+        ./adsearch 64 8 7 config.txt adsearch.csv
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define f32 float
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#include "../inc/vec.h"
+#include "../inc/porysim.h"
+
+#define DT (1.f/144.f)
+
+typedef struct
+{
+    psimcfg cfg;
+    f32* scores;       // [max rounds]
+    uint32_t* cc;      // [max rounds] collisions, 0 for timeouts
+    uint32_t rounds;   // evaluated so far
+    uint32_t timeouts;
+    f32 mean;
+    uint32_t alive;
+} candidate;
+
+candidate* cands;
+uint32_t ncands = 64;
+uint32_t* seeds;       // [max rounds] shared by every candidate
+
+// jobs of the current rung
+typedef struct
+{
+    uint32_t c, r; // candidate, round index
+} job;
+job* jobs;
+uint32_t njobs = 0;
+volatile uint32_t next_job = 0;
+
+double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t xrand(uint64_t* s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static inline f32 xrandFloat(uint64_t* s, const f32 min, const f32 max)
+{
+    return min + (f32)(xrand(s) >> 40) * 5.9604645e-08f * (max-min);
+}
+
+void* workerThread(void* arg)
+{
+    (void)arg;
+    while(1)
+    {
+        const uint32_t j = __sync_fetch_and_add(&next_job, 1);
+        if(j >= njobs)
+            break;
+        candidate* c = &cands[jobs[j].c];
+        const uint32_t r = jobs[j].r;
+
+        const psimprofile* p = psimProfile(&c->cfg);
+        psim s;
+        psimReset(&s, c->cfg.world, seeds[r], 0.0);
+        p->collide(&s, &c->cfg); // directions for the first decision
+        f32 score = 0.f;
+        uint32_t cc = 0;
+        while(1)
+        {
+            p->autodrive(&s, &c->cfg);
+            const int e = psimStepP(p, &s, &c->cfg, DT);
+            if(e == PSIM_COLLECTED)
+            {
+                score = psimRoundScore(&s);
+                cc = s.rcc;
+                break;
+            }
+            if(e == PSIM_TIMEOUT)
+            {
+                __sync_fetch_and_add(&c->timeouts, 1);
+                break;
+            }
+        }
+        c->scores[r] = score;
+        c->cc[r] = cc;
+    }
+    return NULL;
+}
+
+int cmpf(const void* a, const void* b)
+{
+    const f32 fa = *(const f32*)a, fb = *(const f32*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+int cmpCand(const void* a, const void* b)
+{
+    const f32 fa = cands[*(const uint32_t*)a].mean;
+    const f32 fb = cands[*(const uint32_t*)b].mean;
+    return (fa < fb) - (fa > fb);
+}
+
+int main(int argc, char** argv)
+{
+    printf("----\n");
+    printf("PoryDrive Auto Drive Search\n");
+    printf("----\n");
+
+    if(argc < 3)
+    {
+        printf("Usage: ./adsearch <candidates> <rounds at first rung> [rungs] [out config] [report csv] [seed]\n");
+        return 0;
+    }
+    ncands = atoi(argv[1]);
+    uint32_t r0 = atoi(argv[2]);
+    if(ncands < 1){ncands = 1;}
+    if(r0 < 1){r0 = 1;}
+    uint32_t rungs = 1;
+    while((1u << rungs) < ncands){rungs++;}
+    rungs++; // until one survivor
+    if(argc >= 4){rungs = atoi(argv[3]);}
+    if(rungs < 1){rungs = 1;}
+    if(rungs > 24){rungs = 24;}
+    const char* fn_config = argc >= 5 ? argv[4] : "config.txt";
+    const char* fn_report = argc >= 6 ? argv[5] : "adsearch.csv";
+    uint64_t rs = argc >= 7 ? strtoull(argv[6], NULL, 10) : (uint64_t)time(0);
+    if(rs == 0){rs = 1;}
+
+    const uint32_t max_rounds = r0 << (rungs-1);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    const uint32_t nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+    printf("Candidates: %u | Rungs: %u | Rounds: %u to %u per candidate | Threads: %u\n", ncands, rungs, r0, max_rounds, nthreads);
+
+    cands = calloc(ncands, sizeof(candidate));
+    seeds = malloc(max_rounds * sizeof(uint32_t));
+    jobs = malloc((size_t)ncands * max_rounds * sizeof(job));
+    uint32_t* order = malloc(ncands * sizeof(uint32_t));
+    f32* sorted = malloc(max_rounds * sizeof(f32));
+    if(cands == NULL || seeds == NULL || jobs == NULL || order == NULL || sorted == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    for(uint32_t i = 0; i < max_rounds; i++)
+        seeds[i] = (uint32_t)xrand(&rs);
+
+    // random search space, the randAutoDrive() ranges
+    for(uint32_t i = 0; i < ncands; i++)
+    {
+        candidate* c = &cands[i];
+        psimConfigScarletFast(&c->cfg);
+        if(i > 0)
+        {
+            c->cfg.ad_min_dstep = xrandFloat(&rs, 0.01f, 0.03f);
+            c->cfg.ad_max_dstep = xrandFloat(&rs, 0.03f, 0.09f);
+            c->cfg.ad_min_speedswitch = xrandFloat(&rs, 2.f, 4.f);
+            c->cfg.ad_maxspeed_reductor = xrandFloat(&rs, 0.1f, 0.5f);
+        }
+        c->scores = malloc(max_rounds * sizeof(f32));
+        c->cc = malloc(max_rounds * sizeof(uint32_t));
+        if(c->scores == NULL || c->cc == NULL)
+        {
+            printf("Out of memory.\n");
+            return 1;
+        }
+        c->alive = 1;
+        order[i] = i;
+    }
+
+    // successive halving
+    const double st = getTime();
+    uint32_t alive = ncands;
+    pthread_t th[nthreads];
+    printf("----\n");
+    for(uint32_t g = 0; g < rungs && alive > 0; g++)
+    {
+        const double rst = getTime();
+        const uint32_t budget = r0 << g;
+
+        njobs = 0;
+        for(uint32_t i = 0; i < ncands; i++)
+        {
+            if(cands[i].alive == 0)
+                continue;
+            for(uint32_t r = cands[i].rounds; r < budget; r++)
+                jobs[njobs++] = (job){i, r};
+        }
+        next_job = 0;
+        for(uint32_t i = 0; i < nthreads; i++)
+            pthread_create(&th[i], NULL, workerThread, NULL);
+        for(uint32_t i = 0; i < nthreads; i++)
+            pthread_join(th[i], NULL);
+
+        for(uint32_t i = 0; i < ncands; i++)
+        {
+            candidate* c = &cands[i];
+            if(c->alive == 0)
+                continue;
+            c->rounds = budget;
+            f32 sum = 0.f;
+            for(uint32_t r = 0; r < budget; r++)
+                sum += c->scores[r];
+            c->mean = sum / (f32)budget;
+        }
+
+        // survivors are sorted first
+        qsort(order, alive, sizeof(uint32_t), cmpCand);
+        const candidate* b = &cands[order[0]];
+        printf("[rung %u] %u candidates x %u rounds in %.2f sec | best %.4f (%g %g %g %g)\n", g, alive, budget, getTime()-rst,
+            b->mean, b->cfg.ad_min_dstep, b->cfg.ad_max_dstep, b->cfg.ad_min_speedswitch, b->cfg.ad_maxspeed_reductor);
+
+        if(g+1 < rungs)
+        {
+            const uint32_t keep = alive > 1 ? (alive + 1) / 2 : 1;
+            for(uint32_t i = keep; i < alive; i++)
+                cands[order[i]].alive = 0;
+            alive = keep;
+        }
+    }
+    printf("Search took %.2f seconds.\n", getTime()-st);
+
+    // per tuple score distribution, everything that was evaluated ranked by rounds survived then mean
+    FILE* f = fopen(fn_report, "w");
+    if(f != NULL)
+    {
+        fprintf(f, "ad_min_dstep,ad_max_dstep,ad_min_speedswitch,ad_maxspeed_reductor,rounds,timeouts,mean,std,min,p10,p25,p50,p75,p90,max,mean_collisions");
+        for(int k = 0; k <= 10; k++)
+            fprintf(f, ",b%.1f", k * 0.1f);
+        fprintf(f, "\n");
+        for(uint32_t i = 0; i < ncands; i++)
+            order[i] = i;
+        for(uint32_t i = 0; i < ncands; i++) // insertion sort; rounds desc, mean desc
+        {
+            const uint32_t o = order[i];
+            uint32_t j = i;
+            while(j > 0 && (cands[order[j-1]].rounds < cands[o].rounds ||
+                (cands[order[j-1]].rounds == cands[o].rounds && cands[order[j-1]].mean < cands[o].mean)))
+            {
+                order[j] = order[j-1];
+                j--;
+            }
+            order[j] = o;
+        }
+        for(uint32_t i = 0; i < ncands; i++)
+        {
+            const candidate* c = &cands[order[i]];
+            const uint32_t n = c->rounds;
+            if(n == 0)
+                continue;
+            memcpy(sorted, c->scores, n * sizeof(f32));
+            qsort(sorted, n, sizeof(f32), cmpf);
+            double var = 0.0, mcc = 0.0;
+            uint32_t hist[11] = {0};
+            for(uint32_t r = 0; r < n; r++)
+            {
+                var += (c->scores[r] - c->mean) * (c->scores[r] - c->mean);
+                mcc += c->cc[r];
+                char b[8];
+                sprintf(b, "%.1f", c->scores[r]); // same rounding as the bucket file names
+                int k = (int)(atof(b) * 10.f + 0.5f);
+                if(k < 0){k = 0;}
+                if(k > 10){k = 10;}
+                hist[k]++;
+            }
+            #define PCT(p) sorted[(uint32_t)((p) * (n-1) + 0.5f)]
+            fprintf(f, "%g,%g,%g,%g,%u,%u,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g",
+                c->cfg.ad_min_dstep, c->cfg.ad_max_dstep, c->cfg.ad_min_speedswitch, c->cfg.ad_maxspeed_reductor,
+                n, c->timeouts, c->mean, sqrt(var / n), sorted[0], PCT(0.1f), PCT(0.25f), PCT(0.5f), PCT(0.75f), PCT(0.9f), sorted[n-1],
+                mcc / (n - c->timeouts > 0 ? n - c->timeouts : 1));
+            #undef PCT
+            for(int k = 0; k <= 10; k++)
+                fprintf(f, ",%u", hist[k]);
+            fprintf(f, "\n");
+        }
+        fclose(f);
+        printf("Wrote: %s\n", fn_report);
+    }
+    else
+        printf("Failed to write: %s\n", fn_report);
+
+    // best tuple as a loadable config
+    const candidate* b = &cands[order[0]];
+    f = fopen(fn_config, "w");
+    if(f == NULL)
+    {
+        printf("Failed to write: %s\n", fn_config);
+        return 1;
+    }
+    const psimcfg* c = &b->cfg;
+    fprintf(f, "maxspeed %g\n", c->maxspeed);
+    fprintf(f, "acceleration %g\n", c->acceleration);
+    fprintf(f, "inertia %g\n", c->inertia);
+    fprintf(f, "drag %g\n", c->drag);
+    fprintf(f, "steeringspeed %g\n", c->steeringspeed);
+    fprintf(f, "steerinertia %g\n", c->steerinertia);
+    fprintf(f, "minsteer %g\n", c->minsteer);
+    fprintf(f, "maxsteer %g\n", c->maxsteer);
+    fprintf(f, "steering_deadzone %g\n", c->steering_deadzone);
+    fprintf(f, "steeringtransfer %g\n", c->steeringtransfer);
+    fprintf(f, "steeringtransferinertia %g\n", c->steeringtransferinertia);
+    fprintf(f, "sticky_collisions %u\n", c->sticky_collisions);
+    fprintf(f, "\n");
+    fprintf(f, "ad_min_dstep %g\n", c->ad_min_dstep);
+    fprintf(f, "ad_max_dstep %g\n", c->ad_max_dstep);
+    fprintf(f, "ad_min_speedswitch %g\n", c->ad_min_speedswitch);
+    fprintf(f, "ad_maxspeed_reductor %g\n", c->ad_maxspeed_reductor);
+    fclose(f);
+    printf("Wrote: %s (mean score %.4f over %u rounds, defaults %.4f over %u rounds)\n", fn_config, b->mean, b->rounds, cands[0].mean, cands[0].rounds);
+    return 0;
+}
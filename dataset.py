@@ -0,0 +1,520 @@
+# Dataset file loader shared by the training scripts.
+#
+# Reads headerless float32 dataset files and the quantized fp16 / scaled
+# int16 files that porydrivecli --encode and dsconv write (see inc/qenc.h);
+# a quantized file starts with a 48 byte header declaring the encoding and a
+# scale per column. The decode is one vectorised NumPy multiply over the
+# whole memory-mapped file. Compressed .pdb block files (porydrivecli
+# --compress, see inc/dsblock.h) are decoded by pdbdec through load_blocks().
+# ShardReader trains from the shards of a dsmerge --shards manifest in place.
+# Windows cuts [T, 6] sequences out of the rounds of a file as views into it,
+# the rounds coming from the .idx round index beside it (see inc/rindex.h).
+# augment() mirrors and rotates minibatches as they are read, the arena and
+# the cube lattice being symmetric about the origin; ShardReader, Windows and
+# batches() take the number of symmetries to draw from. load_rays() reads the
+# ray sensor sidecar that porydrivecli --rays writes beside a bucket's X file
+# (see inc/psimrays.h), dsmerge and rquery carry it through and ShardReader
+# and Windows put the rays after the 6 inputs.
+import os
+import itertools
+import numpy as np
+
+QENC_MAGIC = 0x31535150 # "PQS1"
+QENC_F16 = 1
+QENC_I16 = 2
+HEADER_SIZE = 48
+
+RIDX_MAGIC = 0x31584952 # "RIX1"
+RIDX_DTYPE = np.dtype([('magic', '<u4'), ('format', '<u4'), ('rows', '<u4'), ('cc', '<u4'), ('x_off', '<u8'), ('y_off', '<u8'), ('seed', '<u8'),
+                       ('score', '<f4'), ('start_dist', '<f4'), ('zs', '<f4'), ('zt', '<f4'), ('rtime', '<f4'), ('round', '<u4')])
+
+RAYS_MAGIC = 0x31595250 # "PRY1"
+RAYS_HEADER_SIZE = 32
+
+# The symmetries of the arena, as what they do to a direction (x, y): swap x
+# and y, then multiply by sx and sy. A reflection (det -1) turns the car the
+# other way, so the steering target sr is negated with it.
+SYM_SWAP = np.array([0, 0, 0, 0, 1, 1, 1, 1], np.bool_)
+SYM_SX = np.array([1, -1, -1, 1, -1, 1, 1, -1], np.float32)
+SYM_SY = np.array([1, 1, -1, -1, 1, -1, 1, -1], np.float32)
+SYM_DET = SYM_SX * SYM_SY * np.where(SYM_SWAP, -1, 1).astype(np.float32)
+# as multipliers of the row and of the row with pbd and lad swapped to (y, x)
+SYM_PAIRS = np.array([1, 0, 3, 2, 4, 5, 6, 7])
+SYM_A = np.concatenate([np.stack([SYM_SX, SYM_SY, SYM_SX, SYM_SY], 1) * ~SYM_SWAP[:, None], np.ones([8, 4], np.float32)], 1)
+SYM_B = np.concatenate([np.stack([SYM_SX, SYM_SY, SYM_SX, SYM_SY], 1) * SYM_SWAP[:, None], np.zeros([8, 4], np.float32)], 1)
+# identity; identity and the mirror in x; the 4 rotations; all 8
+SYM_GROUPS = {1: np.array([0]), 2: np.array([0, 1]), 4: np.array([0, 2, 4, 5]), 8: np.arange(8)}
+
+def header(path):
+    """(encoding, columns, scales) of a quantized file, None for float32."""
+    with open(path, 'rb') as f:
+        h = f.read(HEADER_SIZE)
+    if len(h) < HEADER_SIZE:
+        return None
+    magic, version, encoding, columns = np.frombuffer(h[:12], dtype='<u4,<u2,<u2,<u4')[0]
+    if magic != QENC_MAGIC:
+        return None
+    if version != 1 or encoding not in (QENC_F16, QENC_I16) or columns < 1 or columns > 8:
+        raise ValueError(path + ": unsupported dataset header")
+    scales = np.frombuffer(h[16:16+4*columns], dtype='<f4').copy()
+    return int(encoding), int(columns), scales
+
+def rows(path, columns):
+    """Number of rows in a dataset file without reading it."""
+    h = header(path)
+    if h is None:
+        return int(os.stat(path).st_size / (4*columns))
+    return int((os.stat(path).st_size - HEADER_SIZE) / (2*h[1]))
+
+def load(path, columns):
+    """A [rows, columns] float32 array of any dataset file."""
+    h = header(path)
+    if h is None:
+        with open(path, 'rb') as f:
+            data = np.fromfile(f, dtype=np.float32)
+        return np.reshape(data, [-1, columns])
+    encoding, hcolumns, scales = h
+    if hcolumns != columns:
+        raise ValueError(path + ": has " + str(hcolumns) + " columns, expected " + str(columns))
+    q = np.memmap(path, dtype='<f2' if encoding == QENC_F16 else '<i2', mode='r', offset=HEADER_SIZE)
+    q = np.reshape(q, [-1, columns])
+    out = np.empty(q.shape, dtype=np.float32)
+    np.multiply(q, scales, out=out, casting='unsafe')
+    return out
+
+def mmap(path, columns):
+    """(rows, scales, header bytes) of a dataset file without reading it; rows is a read-only [rows, columns] memmap of
+    the stored values, scales None for float32 or the per-column scales that decode a quantized file."""
+    h = header(path)
+    if os.stat(path).st_size <= (0 if h is None else HEADER_SIZE):
+        return np.empty([0, columns], np.float32), None if h is None else h[2], 0 if h is None else HEADER_SIZE
+    if h is None:
+        return np.memmap(path, dtype='<f4', mode='r').reshape(-1, columns), None, 0
+    encoding, hcolumns, scales = h
+    if hcolumns != columns:
+        raise ValueError(path + ": has " + str(hcolumns) + " columns, expected " + str(columns))
+    q = np.memmap(path, dtype='<f2' if encoding == QENC_F16 else '<i2', mode='r', offset=HEADER_SIZE)
+    return q.reshape(-1, columns), scales, HEADER_SIZE
+
+def augment(x, y, symmetries=8, rng=None, mirror=None):
+    """Applies a random one of `symmetries` (1, 2, 4 or 8) symmetries of the arena to every sample of a float32
+    minibatch in place and returns it; x is [batch, 6] or [batch, T, 6], a window keeping one symmetry for all its
+    rows. pbd (0, 1) and lad (2, 3) turn together, their dot product and the distance do not change. Rays after the 6
+    inputs are relative to the heading, a rotation leaves them be and a reflection swaps them by `mirror`, see
+    rays_mirror()."""
+    g = SYM_GROUPS[symmetries]
+    if len(g) == 1 or len(x) == 0:
+        return x, y
+    if x.shape[-1] > 6 and mirror is None:
+        raise ValueError("rays after the 6 inputs need their mirror, see rays_mirror()")
+    rng = rng if rng is not None else np.random.default_rng()
+    t = g[rng.integers(len(g), size=len(x))]
+    v = x[..., :6]
+    c = v.shape[-1]
+    shape = (len(x),) + (1,) * (x.ndim - 2) + (c,)
+    # whole rows at a time, as strided column pairs are several times slower
+    sw = np.take(v, SYM_PAIRS[:c], axis=-1)
+    sw *= np.take(SYM_B[:, :c], t, axis=0).reshape(shape)
+    v *= np.take(SYM_A[:, :c], t, axis=0).reshape(shape)
+    v += sw
+    if x.shape[-1] > 6:
+        f = SYM_DET[t] < 0
+        x[f, ..., 6:] = x[f][..., 6 + mirror]
+    y[..., 0] *= SYM_DET[t].reshape((len(y),) + (1,) * (y.ndim - 2))
+    return x, y
+
+def augment_stats(mean, var, symmetries):
+    """The input means and variances of a dataset once augment() draws from `symmetries`, from those of the dataset."""
+    mean = np.array(mean, np.float32)
+    var = np.array(var, np.float32)
+    sq = var[:4] + mean[:4]**2 # E[v^2] of each direction component
+    if symmetries == 2:
+        var[0:4:2] = sq[0::2]
+        mean[0:4:2] = 0
+    elif symmetries >= 4:
+        var[0:2] = (sq[0] + sq[1]) * 0.5
+        var[2:4] = (sq[2] + sq[3]) * 0.5
+        mean[0:4] = 0
+    return mean, var
+
+def batches(x, y, batch_size, epochs=1, symmetries=1, seed=None, mirror=None):
+    """Shuffled (x, y) minibatches of in-memory arrays, augmented with `symmetries` symmetries of the arena."""
+    rng = np.random.default_rng(seed)
+    for e in range(epochs):
+        order = rng.permutation(len(x))
+        for i in range(0, len(order), batch_size):
+            s = order[i:i+batch_size]
+            yield augment(x[s].astype(np.float32), y[s].astype(np.float32), symmetries, rng, mirror)
+
+def load_blocks(paths, decoder='./pdbdec/pdbdec', min_score=None, max_score=None):
+    """(x, y) float32 arrays of compressed .pdb block files, decoded on every core by pdbdec."""
+    import subprocess
+    cmd = [decoder, '--stdout'] + list(paths)
+    if min_score is not None: cmd += ['--min-score', str(min_score)]
+    if max_score is not None: cmd += ['--max-score', str(max_score)]
+    p = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+    xs, ys = [], []
+    while True:
+        n = np.frombuffer(p.stdout.read(4), dtype='<u4')
+        if len(n) == 0 or n[0] == 0:
+            break
+        n = int(n[0])
+        xs.append(np.frombuffer(p.stdout.read(n*24), dtype=np.float32).reshape(n, 6))
+        ys.append(np.frombuffer(p.stdout.read(n*8), dtype=np.float32).reshape(n, 2))
+    if p.wait() != 0:
+        raise IOError("pdbdec failed")
+    if len(xs) == 0:
+        return np.empty([0, 6], np.float32), np.empty([0, 2], np.float32)
+    return np.concatenate(xs), np.concatenate(ys)
+
+def read_manifest(path):
+    """The shards of a dsmerge --shards manifest, as (x, y, rows, encoding, score, crc_x, crc_y, r, crc_r) tuples; r is
+    the ray sidecar, None for a shard without one."""
+    base = os.path.dirname(os.path.abspath(path))
+    shards = []
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if line == '' or line[0] == '#':
+                continue
+            p = line.split('\t')
+            if len(p) != 7 and len(p) != 9:
+                continue # columns / rows totals
+            score = None if p[2] == '-' else float(p[2])
+            x, y = (v if os.path.isabs(v) else os.path.join(base, v) for v in p[5:7])
+            r, crc_r = None, 0
+            if len(p) == 9:
+                r = p[8] if os.path.isabs(p[8]) else os.path.join(base, p[8])
+                crc_r = int(p[7], 16)
+            shards.append((x, y, int(p[0]), p[1], score, int(p[3], 16), int(p[4], 16), r, crc_r))
+    return shards
+
+class ShardReader:
+    """Minibatches from the shards of a manifest, read ahead on a thread pool.
+
+    Each loader thread takes the next shard of a shuffled order, tells the
+    kernel to read it ahead with posix_fadvise, and reads and decodes it a
+    chunk at a time into a bounded chunk queue, checking its CRC-32 on the
+    way. A mixer thread shuffles together the chunks of as many shards as
+    there are loaders and cuts them into minibatches on a bounded queue, so
+    rows are interleaved across shards and the trainer only waits on I/O if
+    the disks can not keep up at all. With symmetries the mixer augments
+    the shuffled rows, see augment().
+
+    A shard's CRC-32 is only known once its last chunk is read, after the
+    first ones have gone into batches. A shard that does not match it, or
+    fails to read, ends the reader: the batches not yet handed out are
+    dropped and iterating raises IOError, so a training run on corrupt
+    rows stops instead of finishing with the error in `errors`.
+
+    When every shard has a ray sidecar of the same rays, the rays follow
+    the inputs of every row; rays=True insists on them and rays=False
+    leaves them out. `rays` is then their load_rays() meta and `columns`
+    the width of x, inputsize + k.
+    """
+    def __init__(self, manifest, batch_size, threads=4, epochs=1, chunk_rows=65536, queue_batches=256, seed=None, inputsize=6, outputsize=2, symmetries=1, rays=None):
+        import threading, queue
+        self.shards = read_manifest(manifest)
+        self.rows = sum(s[2] for s in self.shards)
+        self.rays = None
+        self.mirror = None
+        if rays is not False:
+            metas = [load_rays(s[7])[1] if s[7] is not None else None for s in self.shards]
+            if len(metas) > 0 and all(m is not None and m == metas[0] for m in metas):
+                self.rays = metas[0]
+                self.mirror = rays_mirror(self.rays)
+            elif rays is True:
+                raise ValueError(manifest + ": not every shard has a ray sidecar of the same rays")
+        self.columns = inputsize + (self.rays['k'] if self.rays is not None else 0)
+        self.batch_size = batch_size
+        self.inputsize = inputsize
+        self.outputsize = outputsize
+        self.chunk_rows = chunk_rows
+        self.epochs = epochs
+        self.symmetries = symmetries
+        self.rng = np.random.default_rng(seed)
+        self.errors = []
+        self.order = []
+        for e in range(epochs):
+            self.order += list(self.rng.permutation(len(self.shards)))
+        self.lock = threading.Lock()
+        self.chunks = queue.Queue(max(2, threads*2))
+        self.batches = queue.Queue(queue_batches)
+        self.loaders = [threading.Thread(target=self._load, daemon=True) for i in range(max(1, threads))]
+        self.running = len(self.loaders)
+        self.closed = False
+        self.failed = None
+        for t in self.loaders:
+            t.start()
+        threading.Thread(target=self._mix, daemon=True).start()
+
+    def _read(self, path, columns, encoding, rows, hs=None):
+        import zlib
+        with open(path, 'rb', buffering=0) as f:
+            fd = f.fileno()
+            os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_SEQUENTIAL)
+            hs = hs if hs is not None else 0 if encoding == 'f32' else HEADER_SIZE
+            crc = 0
+            scales = None
+            if hs > 0:
+                h = f.read(hs)
+                crc = zlib.crc32(h)
+                if encoding != 'f32':
+                    scales = np.frombuffer(h[16:16+4*columns], dtype='<f4')
+            vs = 4 if encoding == 'f32' else 2
+            dtype = '<f4' if encoding == 'f32' else '<f2' if encoding == 'f16' else '<i2'
+            r = 0
+            while r < rows and not self.closed:
+                n = min(self.chunk_rows, rows - r)
+                # the chunk after this one is read by the kernel while this one is decoded
+                os.posix_fadvise(fd, hs + (r + n)*columns*vs, self.chunk_rows*columns*vs, os.POSIX_FADV_WILLNEED)
+                q = np.empty([n, columns], dtype=dtype)
+                if f.readinto(memoryview(q).cast('B')) != q.nbytes:
+                    raise IOError(path + ": shorter than its manifest")
+                crc = zlib.crc32(q, crc)
+                if scales is None:
+                    yield q
+                else:
+                    out = np.empty(q.shape, dtype=np.float32)
+                    np.multiply(q, scales, out=out, casting='unsafe')
+                    yield out
+                r += n
+            if r == rows:
+                yield crc
+
+    def _load(self):
+        while not self.closed and self.failed is None:
+            with self.lock:
+                if len(self.order) == 0:
+                    break
+                i = self.order.pop(0)
+            x, y, rows, encoding, score, crc_x, crc_y, r, crc_r = self.shards[i]
+            try:
+                rr = self._read(r, self.rays['k'], 'f32', rows, RAYS_HEADER_SIZE) if self.rays is not None else itertools.repeat(None)
+                for cx, cy, cr in zip(self._read(x, self.inputsize, encoding, rows), self._read(y, self.outputsize, encoding, rows), rr):
+                    if isinstance(cx, int):
+                        if cx != crc_x or cy != crc_y or (self.rays is not None and cr != crc_r):
+                            raise IOError(x + ": does not match its checksum")
+                        break
+                    if self.rays is not None:
+                        cx = np.concatenate([cx.astype(np.float32, copy=False), cr], 1)
+                    self.chunks.put((cx, cy))
+            except (IOError, OSError) as e:
+                self.errors.append(str(e))
+                print("ShardReader:", e)
+                with self.lock:
+                    if self.failed is None:
+                        self.failed = e
+                        self.chunks.put(e)
+        with self.lock:
+            self.running -= 1
+            if self.running == 0:
+                self.chunks.put(None)
+
+    def _mix(self):
+        mix = max(1, len(self.loaders))
+        rx = np.empty([0, self.columns], np.float32)
+        ry = np.empty([0, self.outputsize], np.float32)
+        done = False
+        while not done and not self.closed:
+            xs, ys = [rx], [ry]
+            for i in range(mix):
+                c = self.chunks.get()
+                if isinstance(c, Exception):
+                    # what is still queued may hold rows of the failed shard
+                    self.closed = True
+                    while not self.batches.empty():
+                        self.batches.get_nowait()
+                    self.batches.put(c)
+                    return
+                if c is None:
+                    done = True
+                    break
+                xs.append(c[0].astype(np.float32, copy=False))
+                ys.append(c[1].astype(np.float32, copy=False))
+            bx = np.concatenate(xs)
+            by = np.concatenate(ys)
+            p = self.rng.permutation(len(bx))
+            bx = bx[p]
+            by = by[p]
+            augment(bx, by, self.symmetries, self.rng, self.mirror)
+            n = len(bx) - len(bx) % self.batch_size
+            for i in range(0, n, self.batch_size):
+                self.batches.put((bx[i:i+self.batch_size], by[i:i+self.batch_size]))
+            rx, ry = bx[n:], by[n:]
+        self.batches.put(None)
+
+    def __iter__(self):
+        while True:
+            b = self.batches.get()
+            if b is None:
+                return
+            if isinstance(b, Exception):
+                raise IOError("ShardReader: " + str(b))
+            yield b
+
+    def steps_per_epoch(self):
+        return self.rows // self.batch_size
+
+    def close(self):
+        self.closed = True
+        while not self.batches.empty():
+            self.batches.get_nowait()
+
+def index_path(x_path):
+    """The round index beside an X file, <name>_x.<ext> has <name>.idx."""
+    d, b = os.path.split(x_path)
+    i = b.find('_x.')
+    return os.path.join(d, (b[:i] if i >= 0 else b) + '.idx')
+
+def read_index(path):
+    """The 64 byte round records of a .idx file as a NumPy record array (RIDX_DTYPE), up to the first bad record."""
+    r = np.fromfile(path, dtype=RIDX_DTYPE)
+    bad = np.flatnonzero(r['magic'] != RIDX_MAGIC)
+    return r[:bad[0]] if len(bad) > 0 else r
+
+def rays_path(x_path):
+    """The ray sidecar beside an X file, <name>_x.<ext> has <name>_r.dat."""
+    d, b = os.path.split(x_path)
+    i = b.find('_x.')
+    return os.path.join(d, (b[:i] if i >= 0 else b) + '_r.dat')
+
+def load_rays(path):
+    """(rays, meta) of a ray sidecar; rays is a read-only [rows, k] float32 memmap in the order of the X rows, each ray
+    the free distance along it over the range (1 for nothing within range), meta the k, fan (radians) and range."""
+    h = np.fromfile(path, dtype='<u4,<u2,<u2,<f4,<f4,<f4', count=1)
+    if len(h) < 1 or h[0][0] != RAYS_MAGIC:
+        raise ValueError(path + ": not a ray sidecar")
+    magic, version, k, fan, rng, half = h[0]
+    if version != 1 or k < 1:
+        raise ValueError(path + ": unsupported ray sidecar version " + str(version))
+    meta = {'k': int(k), 'fan': float(fan), 'range': float(rng), 'half': float(half)}
+    if os.stat(path).st_size <= RAYS_HEADER_SIZE:
+        return np.empty([0, k], np.float32), meta
+    return np.memmap(path, dtype='<f4', mode='r', offset=RAYS_HEADER_SIZE).reshape(-1, k), meta
+
+def rays_mirror(meta):
+    """The ray each ray of a sidecar's fan becomes in a reflection about the heading, for augment(); ray i of a fan all
+    around is at angle 2pi*i/k and turns into ray k-i, that of a narrower fan into ray k-1-i."""
+    k = meta['k']
+    i = np.arange(k)
+    return (k - i) % k if np.float32(meta['fan']) >= np.float32(2*np.pi) else k - 1 - i
+
+class Windows:
+    """[T, 6] windows of consecutive rows for recurrent models that never cross a round.
+
+    The rounds are the records of the .idx index beside the X file, which
+    porydrivecli writes and dsmerge carries through a merge; rows of a file
+    that no record covers are not used. The X and Y files are memory mapped
+    and windows[i] is a strided view into X, nothing is stored T times; the
+    only array built is one int64 start row per window. A round of n rows
+    gives windows starting `offset` rows in and every `stride` rows after.
+
+    batches() yields (x, y) minibatches in a shuffled order; x is
+    [batch, T, 6] and y the targets of the last row of every window, or of
+    every row, [batch, T, 2], with sequence_targets. Quantized files are
+    decoded a batch at a time. Rows are consecutive ticks when the round was
+    captured without --stride, --min-change or --keep. With symmetries
+    every window of a batch is augmented as a whole, see augment(). With
+    rays (True for the sidecar beside the X file, or its path) windows are
+    [T, 6+k], the rays after the inputs; `rays` is then their meta.
+    """
+    def __init__(self, x_path, y_path, T, stride=1, offset=0, index=None, sequence_targets=False, inputsize=6, outputsize=2, symmetries=1, rays=None):
+        if T < 1 or stride < 1 or offset < 0:
+            raise ValueError("T and stride must be at least 1, offset at least 0")
+        self.T = T
+        self.sequence_targets = sequence_targets
+        self.symmetries = symmetries
+        self.x, self.sx, hs = mmap(x_path, inputsize)
+        self.y, self.sy, _ = mmap(y_path, outputsize)
+        if len(self.x) != len(self.y):
+            raise ValueError(x_path + " and " + y_path + " are not row aligned")
+        self.rays = None
+        self.mirror = None
+        if rays is not None and rays is not False:
+            rp = rays_path(x_path) if rays is True else rays
+            self.r, self.rays = load_rays(rp)
+            self.mirror = rays_mirror(self.rays)
+            if len(self.r) < len(self.x):
+                raise ValueError(rp + " holds fewer rows than " + x_path)
+        rec = read_index(index if index is not None else index_path(x_path))
+        encoding = 0 if hs == 0 else (QENC_F16 if self.x.dtype == np.dtype('<f2') else QENC_I16)
+        rx = inputsize * self.x.dtype.itemsize
+        off = rec['x_off'].astype(np.int64) - hs
+        first = off // rx
+        n = rec['rows'].astype(np.int64)
+        ok = (rec['format'] == encoding) & (off >= 0) & (off % rx == 0) & (first + n <= len(self.x))
+        first, n = first[ok], n[ok]
+        self.rounds = len(first)
+
+        # every start row of every round in one pass, without a Python loop over the rounds
+        count = np.maximum(0, (n - offset - T) // stride + 1)
+        within = np.arange(int(count.sum()), dtype=np.int64) - np.repeat(np.cumsum(count) - count, count)
+        self.starts = np.repeat(first + offset, count) + within * stride
+        if len(self.x) >= T:
+            swv = np.lib.stride_tricks.sliding_window_view
+            self.xw = swv(self.x, T, axis=0).transpose(0, 2, 1) # [rows-T+1, T, 6] over the same memory
+            self.yw = swv(self.y, T, axis=0).transpose(0, 2, 1)
+            if self.rays is not None:
+                self.rw = swv(self.r, T, axis=0).transpose(0, 2, 1)
+
+    def __len__(self):
+        return len(self.starts)
+
+    def _decode(self, q, scales):
+        if scales is None:
+            return q
+        out = np.empty(q.shape, dtype=np.float32)
+        np.multiply(q, scales, out=out, casting='unsafe')
+        return out
+
+    def _window(self, s):
+        x = self._decode(self.xw[s], self.sx)
+        if self.rays is None:
+            return x
+        return np.concatenate([x.astype(np.float32, copy=False), self.rw[s]], -1)
+
+    def __getitem__(self, i):
+        """Window i, a [T, 6] view into the X file for float32 files without rays."""
+        return self._window(self.starts[i])
+
+    def steps_per_epoch(self, batch_size):
+        return (len(self.starts) + batch_size - 1) // batch_size
+
+    def batches(self, batch_size, epochs=1, shuffle=True, seed=None):
+        rng = np.random.default_rng(seed)
+        for e in range(epochs):
+            order = rng.permutation(len(self.starts)) if shuffle else np.arange(len(self.starts))
+            for i in range(0, len(order), batch_size):
+                s = np.sort(self.starts[order[i:i+batch_size]]) # in file order, the pages are touched once
+                x = self._window(s)
+                if self.sequence_targets:
+                    y = self._decode(self.yw[s], self.sy)
+                else:
+                    y = self._decode(self.y[s + self.T - 1], self.sy)
+                yield augment(x, y, self.symmetries, rng, self.mirror)
+
+def load_stats(path='dataset.stats'):
+    """The per-column statistics of a dsscan sidecar, as a dict of NumPy arrays over the 8 columns (6 inputs, 2 targets)."""
+    cols = {}
+    hist = {}
+    buckets = {}
+    totals = {}
+    with open(path) as f:
+        for line in f:
+            p = line.rstrip('\n').split('\t')
+            if p[0] == 'column':
+                cols[int(p[1])] = p[2:]
+            elif p[0] == 'hist':
+                hist[int(p[1])] = (float(p[2]), float(p[3]), np.array(p[4:], dtype=np.uint64))
+            elif p[0] == 'bucket':
+                buckets[p[1]] = int(p[2])
+            elif len(p) == 2 and p[0][:1] != '#':
+                totals[p[0]] = int(p[1])
+    n = len(cols)
+    col = lambda i, t: np.array([t(cols[c][i]) for c in range(n)])
+    return {'rows': totals.get('rows', 0), 'names': [cols[c][0] for c in range(n)],
+            'count': col(1, int), 'min': col(2, float), 'max': col(3, float),
+            'mean': col(4, float).astype(np.float32), 'var': col(5, float).astype(np.float32),
+            'nan': col(6, int), 'inf': col(7, int), 'denormal': col(8, int), 'zero': col(9, int),
+            'hist': [hist.get(c) for c in range(n)], 'buckets': buckets}
@@ -0,0 +1 @@
+gcc main.c -I ../inc -Ofast -march=native -lm -o dsconv
@@ -0,0 +1,219 @@
+/*
+    Info:
+
+        Dataset converter.
+
+        Concatenates dataset files like cat does, converting between float32
+        and the quantized fp16 / scaled int16 encodings of inc/qenc.h on the
+        way; quantized files have a header so they can not simply be cat'ed.
+        The inputs may be any mix of encodings, headerless inputs are float32.
+
+        When quantizing, the bound of every column is the largest magnitude
+        found in the inputs (an extra read pass) unless --bounds gives them,
+        so no value saturates.
+
+    Usage:
+
+        ./dsconv <f32|f16|i16> <columns> <out> <in>... [--bounds b0,b1,...]
+        ./dsconv i16 6 dataset_x.i16 d1/dataset_x.dat d2/dataset_x.dat
+        ./dsconv f32 2 dataset_y.dat 0.8_y.i16 0.9_y.i16
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../inc/qenc.h"
+
+#define CHUNK_ROWS 65536
+
+typedef struct
+{
+    FILE* f;
+    qheader h;
+    uint16_t enc;
+} input;
+
+float* fbuf;
+uint16_t* qbuf;
+
+// opens an input and reads its header if it has one
+int openInput(input* in, const char* path, const uint32_t columns)
+{
+    in->f = fopen(path, "rb");
+    if(in->f == NULL)
+    {
+        printf("Failed to open %s\n", path);
+        return -1;
+    }
+    in->enc = QENC_F32;
+    if(fread(&in->h, 1, sizeof(qheader), in->f) == sizeof(qheader) && in->h.magic == QENC_MAGIC)
+    {
+        if(qencCheck(&in->h) < 0 || in->h.columns != columns)
+        {
+            printf("%s has an unsupported header or not %u columns.\n", path, columns);
+            fclose(in->f);
+            return -1;
+        }
+        in->enc = in->h.encoding;
+    }
+    else
+        rewind(in->f);
+    return 0;
+}
+
+// next chunk of rows as float32, 0 at the end
+size_t readRows(input* in, const uint32_t columns)
+{
+    if(in->enc == QENC_F32)
+        return fread(fbuf, columns*sizeof(float), CHUNK_ROWS, in->f);
+    const size_t r = fread(qbuf, columns*sizeof(uint16_t), CHUNK_ROWS, in->f);
+    qencDecode(&in->h, qbuf, fbuf, r);
+    return r;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 5)
+    {
+        printf("Usage: ./dsconv <f32|f16|i16> <columns> <out> <in>... [--bounds b0,b1,...]\n");
+        return 0;
+    }
+
+    uint16_t enc;
+    if(strcmp(argv[1], "f32") == 0){enc = QENC_F32;}
+    else if(strcmp(argv[1], "f16") == 0){enc = QENC_F16;}
+    else if(strcmp(argv[1], "i16") == 0){enc = QENC_I16;}
+    else
+    {
+        printf("Unknown encoding: %s, use f32, f16 or i16.\n", argv[1]);
+        return 1;
+    }
+    const uint32_t columns = atoi(argv[2]);
+    if(columns == 0 || columns > QENC_MAX_COLUMNS)
+    {
+        printf("Columns must be 1 to %u.\n", QENC_MAX_COLUMNS);
+        return 1;
+    }
+    const char* out = argv[3];
+
+    char* ins[argc];
+    int nin = 0;
+    float bounds[QENC_MAX_COLUMNS] = {0};
+    uint32_t have_bounds = 0;
+    for(int i = 4; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--bounds") == 0 && i+1 < argc)
+        {
+            char* p = argv[++i];
+            for(uint32_t j = 0; j < columns && p != NULL; j++)
+            {
+                bounds[j] = atof(p);
+                p = strchr(p, ',');
+                if(p != NULL){p++;}
+            }
+            have_bounds = 1;
+        }
+        else
+            ins[nin++] = argv[i];
+    }
+    if(nin == 0)
+    {
+        printf("No inputs.\n");
+        return 1;
+    }
+
+    fbuf = malloc(CHUNK_ROWS * columns * sizeof(float));
+    qbuf = malloc(CHUNK_ROWS * columns * sizeof(uint16_t));
+    if(fbuf == NULL || qbuf == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+
+    const clock_t st = clock();
+
+    // bounds pass
+    if(enc != QENC_F32 && have_bounds == 0)
+    {
+        for(int i = 0; i < nin; i++)
+        {
+            input in;
+            if(openInput(&in, ins[i], columns) < 0)
+                return 1;
+            size_t r;
+            while((r = readRows(&in, columns)) > 0)
+            {
+                for(size_t j = 0; j < r*columns; j++)
+                {
+                    const float a = fabsf(fbuf[j]);
+                    if(a > bounds[j % columns] && isfinite(a))
+                        bounds[j % columns] = a;
+                }
+            }
+            fclose(in.f);
+        }
+    }
+    for(uint32_t j = 0; j < columns; j++)
+        if(!(bounds[j] > 0.f))
+            bounds[j] = 1.f;
+
+    FILE* fo = fopen(out, "wb");
+    if(fo == NULL)
+    {
+        printf("Failed to open %s\n", out);
+        return 1;
+    }
+    qheader oh;
+    qencInit(&oh, enc, columns, bounds);
+    if(enc != QENC_F32 && fwrite(&oh, 1, sizeof(qheader), fo) != sizeof(qheader))
+    {
+        printf("Failed to write %s\n", out);
+        return 1;
+    }
+
+    uint64_t rows = 0;
+    for(int i = 0; i < nin; i++)
+    {
+        input in;
+        if(openInput(&in, ins[i], columns) < 0)
+            return 1;
+        size_t r;
+        while((r = readRows(&in, columns)) > 0)
+        {
+            size_t wb;
+            if(enc == QENC_F32)
+                wb = fwrite(fbuf, columns*sizeof(float), r, fo);
+            else
+            {
+                qencEncode(&oh, fbuf, qbuf, r);
+                wb = fwrite(qbuf, columns*sizeof(uint16_t), r, fo);
+            }
+            if(wb != r)
+            {
+                printf("Failed to write %s\n", out);
+                return 1;
+            }
+            rows += r;
+        }
+        fclose(in.f);
+    }
+    if(fclose(fo) != 0)
+    {
+        printf("Failed to write %s\n", out);
+        return 1;
+    }
+
+    printf("%llu rows of %u columns to %s as %s in %.2f seconds.\n", (unsigned long long)rows, columns, out, argv[1], (double)(clock()-st) / CLOCKS_PER_SEC);
+    if(enc != QENC_F32)
+    {
+        printf("bounds:");
+        for(uint32_t j = 0; j < columns; j++)
+            printf(" %g", bounds[j]);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,572 @@
+/*
+    Info:
+
+        Dataset merge tool.
+
+        Joins X and Y dataset files into one training set like the old cat
+        scripts did, but the bytes are moved by the kernel with
+        copy_file_range() and the first input is reflinked with FICLONE where
+        the filesystem can share extents (inc/fcopy.h), so on Btrfs, XFS or
+        bcachefs a merge of any size takes next to no CPU or I/O.
+
+        An input is an X file (its Y file is the same name with _x. turned
+        into _y.) or a directory, which stands for its <score>_x.<ext> bucket
+        files and dataset_x.<ext> in name order. --min-score / --max-score
+        select buckets by the score in their name, files without one are
+        only taken when no range is given. --format picks the bucket files of
+        a directory by extension, dat by default.
+
+        Every X and Y pair must hold the same number of whole rows or nothing
+        is written. Quantized inputs (inc/qenc.h) must share one header, mixed
+        encodings or scales go through dsconv instead. Bucket files are read
+        under a shared lock so rounds still being appended are not split.
+
+        The outputs are written beside themselves and renamed into place at
+        the end, so an output may also be an input. A text manifest of the
+        merge (every input with its score, row count and first row in the
+        output) goes to <out_x>.manifest unless --manifest names another.
+
+        The round index of every input (<score>.idx beside <score>_x.<ext>,
+        <name>.idx beside any other <name>_x.<ext>, see inc/rindex.h) is
+        carried over with its offsets moved to where the rounds land, so the
+        output keeps its round boundaries in <name>.idx beside <out_x>.
+        Rows of inputs without an index are in no round.
+
+        The ray sidecars of porydrivecli --rays (<name>_r.dat beside
+        <name>_x.<ext>, see inc/psimrays.h) go along row for row into
+        <name>_r.dat beside <out_x> when every input has one of the same
+        rays, a merge that can't carry them says so and leaves none behind.
+
+        --shards <file> merges nothing and writes a shard manifest of the
+        inputs instead, for dataset.ShardReader to train from them in place:
+        the row count, encoding, score and a CRC-32 of every X and Y file up
+        to that many rows, tab separated, and the CRC-32 and path of its ray
+        sidecar after them when it has one. Relative paths are as given and
+        resolve against the manifest's directory, so write it from there.
+        Bucket files may keep growing, a shard is the rows it was listed with.
+
+    Usage:
+
+        ./dsmerge <out_x> <out_y> <in>... [--min-score x] [--max-score x] [--format dat|f16|i16] [--manifest file]
+        ./dsmerge --shards <manifest> <in>... [--min-score x] [--max-score x] [--format dat|f16|i16]
+        ./dsmerge dataset_x.dat dataset_y.dat . --min-score 0.8
+        ./dsmerge ../dataset_x.dat ../dataset_y.dat ../dataset_x.dat d1 d2 d3
+        ./dsmerge --shards dataset.manifest . d1 d2 d3 --min-score 0.8
+
+*/
+
+#include "../inc/fcopy.h" // first, it needs _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "../inc/vec.h"
+#include "../inc/porysim.h"
+#include "../inc/psimrays.h"
+#include "../inc/qenc.h"
+#include "../inc/rindex.h"
+
+#define XCOLS 6
+#define YCOLS 2
+
+typedef struct
+{
+    char x[4096];
+    char y[4096];
+    char r[4096];
+    float score;     // -1 when the name has none
+    int fx, fy, fr;  // fr is -1 without a ray sidecar that covers the rows
+    uint64_t rows;
+    uint16_t enc;
+    qheader hx, hy;
+    psimraysheader hr;
+} input;
+
+input* inputs = NULL;
+uint32_t ninputs = 0, cinputs = 0;
+float min_score = -1.f, max_score = -1.f;
+const char* ext = "dat";
+
+uint32_t crc_table[256];
+
+void crcInit()
+{
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+// CRC-32 (zlib.crc32) of the first len bytes, 0 on success
+int crcFile(const int fd, uint64_t len, uint32_t* crc)
+{
+    static uint8_t buf[1 << 20];
+    uint32_t c = 0xFFFFFFFF;
+    off_t o = 0;
+    posix_fadvise(fd, 0, len, POSIX_FADV_SEQUENTIAL);
+    while(len > 0)
+    {
+        const ssize_t rb = pread(fd, buf, len < sizeof(buf) ? len : sizeof(buf), o);
+        if(rb <= 0)
+            return -1;
+        for(ssize_t i = 0; i < rb; i++)
+            c = crc_table[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+        o += rb;
+        len -= rb;
+    }
+    *crc = c ^ 0xFFFFFFFF;
+    return 0;
+}
+
+double wallTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((double)tv.tv_sec) + (((double)tv.tv_usec)/1000000.0);
+}
+
+// the score of a <score>_x.<ext> name, -1 if it is not one
+float nameScore(const char* path)
+{
+    const char* n = strrchr(path, '/');
+    n = n == NULL ? path : n+1;
+    char* e;
+    const float s = strtof(n, &e);
+    if(e == n || strncmp(e, "_x.", 3) != 0)
+        return -1.f;
+    return s;
+}
+
+int ranged()
+{
+    return min_score >= 0.f || max_score >= 0.f;
+}
+
+void addInput(const char* x)
+{
+    const char* n = strrchr(x, '/');
+    n = n == NULL ? x : n+1;
+    const char* u = strstr(n, "_x.");
+    if(u == NULL)
+    {
+        printf("%s is not an X file, its name needs an _x. to find the Y file.\n", x);
+        exit(1);
+    }
+    const float s = nameScore(x);
+    if(s < 0.f && ranged())
+        return;
+    if(s >= 0.f && ((min_score >= 0.f && s < min_score) || (max_score >= 0.f && s > max_score)))
+        return;
+    if(ninputs == cinputs)
+    {
+        cinputs = cinputs ? cinputs*2 : 64;
+        inputs = realloc(inputs, cinputs * sizeof(input));
+    }
+    input* in = &inputs[ninputs++];
+    memset(in, 0, sizeof(input));
+    snprintf(in->x, sizeof(in->x), "%s", x);
+    snprintf(in->y, sizeof(in->y), "%s", x);
+    in->y[(u - x) + 1] = 'y';
+    psimRaysPath(x, in->r, sizeof(in->r));
+    in->score = s;
+    in->fx = in->fy = in->fr = -1;
+}
+
+int isBucket(const struct dirent* e)
+{
+    const char* u = strstr(e->d_name, "_x.");
+    if(u == NULL || strcmp(u+3, ext) != 0)
+        return 0;
+    return strncmp(e->d_name, "dataset_x.", 10) == 0 || nameScore(e->d_name) >= 0.f;
+}
+
+int addDir(const char* dir)
+{
+    struct dirent** list;
+    const int n = scandir(dir, &list, isBucket, alphasort);
+    if(n < 0)
+        return -1;
+    for(int i = 0; i < n; i++)
+    {
+        char p[4096];
+        snprintf(p, sizeof(p), "%s/%s", dir, list[i]->d_name);
+        addInput(p);
+        free(list[i]);
+    }
+    free(list);
+    return 0;
+}
+
+// opens, locks and sizes a pair, 0 if the rows line up
+// <dir>/<name>_x.<ext> has <dir>/<name>.idx, a name without _x. gets .idx appended
+void indexPath(const char* x, char* out, const size_t len)
+{
+    snprintf(out, len, "%s", x);
+    const char* base = strrchr(out, '/');
+    char* p = strstr(base != NULL ? base : out, "_x.");
+    if(p != NULL)
+        strcpy(p, ".idx");
+    else if(strlen(out) + 5 <= len)
+        strcat(out, ".idx");
+}
+
+// appends the index records of an input's rows to the output index, rebased to the input's first output row
+uint64_t mergeIndex(const input* in, FILE* fo, const uint64_t first, const uint64_t hs, const uint64_t rx, const uint64_t ry)
+{
+    char path[4096];
+    indexPath(in->x, path, sizeof(path));
+    FILE* f = fopen(path, "rb");
+    if(f == NULL)
+        return 0;
+    uint64_t n = 0;
+    ridx r;
+    while(fread(&r, 1, sizeof(r), f) == sizeof(r))
+    {
+        if(r.magic != RIDX_MAGIC)
+        {
+            printf("%s: bad record, the rest of the index is skipped.\n", path);
+            break;
+        }
+        // rounds of this file's encoding that lie within the rows merged
+        if(r.format != in->enc || r.x_off < hs || r.y_off < hs || (r.x_off - hs) % rx != 0 || (r.y_off - hs) % ry != 0)
+            continue;
+        const uint64_t row = (r.x_off - hs) / rx;
+        if(row != (r.y_off - hs) / ry || row + r.rows > in->rows)
+            continue;
+        r.x_off = hs + (first + row) * rx;
+        r.y_off = hs + (first + row) * ry;
+        if(fwrite(&r, 1, sizeof(r), fo) != sizeof(r))
+            break;
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+int openInput(input* in)
+{
+    in->fx = open(in->x, O_RDONLY | O_CLOEXEC);
+    in->fy = open(in->y, O_RDONLY | O_CLOEXEC);
+    if(in->fx == -1 || in->fy == -1)
+    {
+        printf("Failed to open %s or %s\n", in->x, in->y);
+        return -1;
+    }
+    flock(in->fx, LOCK_SH); // porydrivecli holds the X lock while it appends to either file
+
+    struct stat sx, sy;
+    if(fstat(in->fx, &sx) == -1 || fstat(in->fy, &sy) == -1)
+        return -1;
+
+    // a header means a quantized file, an X file without one is float32
+    in->enc = QENC_F32;
+    uint64_t bx = sx.st_size, by = sy.st_size;
+    if(pread(in->fx, &in->hx, sizeof(qheader), 0) == sizeof(qheader) && in->hx.magic == QENC_MAGIC)
+    {
+        if(qencCheck(&in->hx) < 0 || pread(in->fy, &in->hy, sizeof(qheader), 0) != sizeof(qheader) || qencCheck(&in->hy) < 0 ||
+           in->hx.encoding != in->hy.encoding || in->hx.columns != XCOLS || in->hy.columns != YCOLS)
+        {
+            printf("%s and %s do not have matching %d and %d column headers.\n", in->x, in->y, XCOLS, YCOLS);
+            return -1;
+        }
+        in->enc = in->hx.encoding;
+        bx -= sizeof(qheader);
+        by -= sizeof(qheader);
+    }
+    const uint64_t rx = XCOLS * qencBytes(in->enc), ry = YCOLS * qencBytes(in->enc);
+    if(bx % rx != 0 || by % ry != 0 || bx / rx != by / ry)
+    {
+        printf("%s and %s are not row aligned: %.2f and %.2f rows.\n", in->x, in->y, (double)bx / rx, (double)by / ry);
+        return -1;
+    }
+    in->rows = bx / rx;
+
+    // porydrivecli appends the rays under the same lock, row for row
+    const int64_t rr = psimRaysOpen(in->r, &in->hr, &in->fr);
+    if(rr >= 0 && (uint64_t)rr < in->rows)
+    {
+        printf("%s holds %lld rows of rays for %llu rows, its rays are left out.\n", in->r, (long long)rr, (unsigned long long)in->rows);
+        close(in->fr);
+        in->fr = -1;
+    }
+    return 0;
+}
+
+void closeInput(input* in)
+{
+    flock(in->fx, LOCK_UN);
+    close(in->fx);
+    close(in->fy);
+    if(in->fr > -1)
+        close(in->fr);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 4)
+    {
+        printf("Usage: ./dsmerge <out_x> <out_y> <in>... [--min-score x] [--max-score x] [--format dat|f16|i16] [--manifest file]\n");
+        printf("       ./dsmerge --shards <manifest> <in>... [--min-score x] [--max-score x] [--format dat|f16|i16]\n");
+        return 0;
+    }
+
+    const char* manifest = NULL;
+    const char* shards = NULL;
+    char* pos[argc];
+    int npos = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--min-score") == 0 && i+1 < argc){min_score = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--max-score") == 0 && i+1 < argc){max_score = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--format") == 0 && i+1 < argc){ext = argv[++i];}
+        else if(strcmp(argv[i], "--manifest") == 0 && i+1 < argc){manifest = argv[++i];}
+        else if(strcmp(argv[i], "--shards") == 0 && i+1 < argc){shards = argv[++i];}
+        else{pos[npos++] = argv[i];}
+    }
+    const int first_in = shards != NULL ? 0 : 2;
+    if(npos < first_in + 1)
+    {
+        printf("Need <out_x> <out_y> and at least one input.\n");
+        return 1;
+    }
+    const char* out_x = first_in ? pos[0] : NULL;
+    const char* out_y = first_in ? pos[1] : NULL;
+
+    for(int i = first_in; i < npos; i++)
+    {
+        struct stat s;
+        if(stat(pos[i], &s) == -1)
+        {
+            printf("Failed to open %s\n", pos[i]);
+            return 1;
+        }
+        if(S_ISDIR(s.st_mode))
+            addDir(pos[i]);
+        else if(strstr(pos[i], ".pdb") != NULL)
+        {
+            printf("%s: block files join with cat or decode with pdbdec.\n", pos[i]);
+            return 1;
+        }
+        else
+            addInput(pos[i]);
+    }
+    if(ninputs == 0)
+    {
+        printf("No inputs selected.\n");
+        return 1;
+    }
+
+    // check everything before writing anything
+    uint64_t rows = 0;
+    for(uint32_t i = 0; i < ninputs; i++)
+    {
+        input* in = &inputs[i];
+        if(openInput(in) < 0)
+            return 1;
+        rows += in->rows;
+        if(shards != NULL) // shards are decoded one by one, they need not agree
+            continue;
+        if(in->enc != inputs[0].enc ||
+           (in->enc != QENC_F32 && (memcmp(&in->hx, &inputs[0].hx, sizeof(qheader)) != 0 || memcmp(&in->hy, &inputs[0].hy, sizeof(qheader)) != 0)))
+        {
+            printf("%s has a different encoding or scales than %s, merge with dsconv instead.\n", in->x, inputs[0].x);
+            return 1;
+        }
+    }
+    const char* enc_names[3] = {"f32", "f16", "i16"};
+
+    // shard manifest
+    if(shards != NULL)
+    {
+        const double st = wallTime();
+        FILE* m = fopen(shards, "w");
+        if(m == NULL)
+        {
+            printf("Failed to write %s\n", shards);
+            return 1;
+        }
+        crcInit();
+        fprintf(m, "# dsmerge shards\n");
+        fprintf(m, "columns\t%d\t%d\n", XCOLS, YCOLS);
+        fprintf(m, "rows\t%llu\n", (unsigned long long)rows);
+        fprintf(m, "# rows\tencoding\tscore\tcrc_x\tcrc_y\tx\ty[\tcrc_r\tr]\n");
+        uint64_t bytes = 0;
+        for(uint32_t i = 0; i < ninputs; i++)
+        {
+            input* in = &inputs[i];
+            const uint64_t hs = in->enc == QENC_F32 ? 0 : sizeof(qheader);
+            const uint64_t bx = hs + in->rows * XCOLS * qencBytes(in->enc), by = hs + in->rows * YCOLS * qencBytes(in->enc);
+            const uint64_t br = in->fr > -1 ? sizeof(psimraysheader) + in->rows * in->hr.k * sizeof(float) : 0;
+            uint32_t cx, cy, cr = 0;
+            if(crcFile(in->fx, bx, &cx) < 0 || crcFile(in->fy, by, &cy) < 0 || (br > 0 && crcFile(in->fr, br, &cr) < 0))
+            {
+                printf("Failed to read %s\n", in->x);
+                return 1;
+            }
+            closeInput(in);
+            char sc[16] = "-";
+            if(in->score >= 0.f)
+                sprintf(sc, "%.1f", in->score);
+            fprintf(m, "%llu\t%s\t%s\t%08x\t%08x\t%s\t%s", (unsigned long long)in->rows, enc_names[in->enc], sc, cx, cy, in->x, in->y);
+            if(br > 0)
+                fprintf(m, "\t%08x\t%s", cr, in->r);
+            fprintf(m, "\n");
+            bytes += bx + by + br;
+        }
+        if(fclose(m) != 0)
+        {
+            printf("Failed to write %s\n", shards);
+            return 1;
+        }
+        printf("Listed %u shards, %llu rows (%.1f MB) in %.2f seconds.\n", ninputs, (unsigned long long)rows, bytes / 1048576.0, wallTime() - st);
+        return 0;
+    }
+
+    // merge
+    const double st = wallTime();
+    char tx[4096], ty[4096];
+    snprintf(tx, sizeof(tx), "%s.part", out_x);
+    snprintf(ty, sizeof(ty), "%s.part", out_y);
+    const int fox = open(tx, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    const int foy = open(ty, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fox == -1 || foy == -1)
+    {
+        printf("Failed to open %s or %s\n", tx, ty);
+        return 1;
+    }
+    const uint64_t hs = inputs[0].enc == QENC_F32 ? 0 : sizeof(qheader);
+    const uint64_t rx = XCOLS * qencBytes(inputs[0].enc), ry = YCOLS * qencBytes(inputs[0].enc);
+    char oi[4096], ti[4096+8];
+    indexPath(out_x, oi, sizeof(oi));
+    snprintf(ti, sizeof(ti), "%s.part", oi);
+    FILE* foi = fopen(ti, "wb");
+    if(foi == NULL)
+    {
+        printf("Failed to open %s\n", ti);
+        return 1;
+    }
+    // the rays go along when every input has the same ones
+    char orr[4096], tr[4096+8];
+    psimRaysPath(out_x, orr, sizeof(orr));
+    snprintf(tr, sizeof(tr), "%s.part", orr);
+    uint32_t nrays = 0, same = 0;
+    for(uint32_t i = 0; i < ninputs; i++)
+    {
+        nrays += inputs[i].fr > -1;
+        same += inputs[i].fr > -1 && memcmp(&inputs[i].hr, &inputs[0].hr, sizeof(psimraysheader)) == 0;
+    }
+    int fro = -1;
+    if(same == ninputs && (fro = open(tr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+        printf("Failed to open %s\n", tr);
+        return 1;
+    }
+    const uint64_t rr = fro > -1 ? inputs[0].hr.k * sizeof(float) : 0;
+    uint32_t cloned = 0, indexed = 0;
+    uint64_t first = 0, nidx = 0;
+    for(uint32_t i = 0; i < ninputs; i++)
+    {
+        input* in = &inputs[i];
+        int r = 0;
+        const uint64_t n = mergeIndex(in, foi, first, hs, rx, ry); // under the same lock as the rows
+        nidx += n;
+        indexed += n > 0;
+        first += in->rows;
+        if(i == 0 && fcopyClone(in->fx, fox) == 0 && fcopyClone(in->fy, foy) == 0)
+        {
+            // the clone is the whole file as it is now, the lock keeps it at the size checked
+            cloned = 1;
+            lseek(fox, 0, SEEK_END);
+            lseek(foy, 0, SEEK_END);
+        }
+        else
+        {
+            if(i == 0)
+            {
+                ftruncate(fox, 0);
+                ftruncate(foy, 0);
+                lseek(fox, 0, SEEK_SET);
+                lseek(foy, 0, SEEK_SET);
+            }
+            const uint64_t skip = i == 0 ? 0 : hs; // the first input brings the header
+            r |= fcopyRange(in->fx, skip, fox, hs - skip + in->rows * rx);
+            r |= fcopyRange(in->fy, skip, foy, hs - skip + in->rows * ry);
+        }
+        if(fro > -1)
+        {
+            const uint64_t skip = i == 0 ? 0 : sizeof(psimraysheader);
+            r |= fcopyRange(in->fr, skip, fro, sizeof(psimraysheader) - skip + in->rows * rr);
+        }
+        closeInput(in);
+        if(r != 0)
+        {
+            printf("Failed to copy %s\n", in->x);
+            unlink(tx);
+            unlink(ty);
+            fclose(foi);
+            unlink(ti);
+            if(fro > -1)
+                unlink(tr);
+            return 1;
+        }
+    }
+    if(fsync(fox) != 0 || fsync(foy) != 0 || close(fox) != 0 || close(foy) != 0 || fclose(foi) != 0 ||
+       (fro > -1 && (close(fro) != 0 || rename(tr, orr) != 0)) ||
+       rename(tx, out_x) != 0 || rename(ty, out_y) != 0 || rename(ti, oi) != 0)
+    {
+        printf("Failed to write %s and %s\n", out_x, out_y);
+        return 1;
+    }
+    // rays of an earlier merge would not line up with these rows
+    if(fro == -1)
+        unlink(orr);
+
+    // manifest
+    char mp[4096];
+    snprintf(mp, sizeof(mp), "%s.manifest", out_x);
+    FILE* m = fopen(manifest != NULL ? manifest : mp, "w");
+    if(m == NULL)
+    {
+        printf("Failed to write the manifest.\n");
+        return 1;
+    }
+    fprintf(m, "# dsmerge manifest\n");
+    fprintf(m, "out %s %s\n", out_x, out_y);
+    fprintf(m, "encoding %s\n", enc_names[inputs[0].enc]);
+    fprintf(m, "columns %d %d\n", XCOLS, YCOLS);
+    fprintf(m, "rows %llu\n", (unsigned long long)rows);
+    fprintf(m, "index %s %llu\n", oi, (unsigned long long)nidx);
+    if(fro > -1)
+        fprintf(m, "rays %s %u\n", orr, inputs[0].hr.k);
+    fprintf(m, "# first_row rows score x y\n");
+    first = 0;
+    for(uint32_t i = 0; i < ninputs; i++)
+    {
+        if(inputs[i].score >= 0.f)
+            fprintf(m, "%llu %llu %.1f %s %s\n", (unsigned long long)first, (unsigned long long)inputs[i].rows, inputs[i].score, inputs[i].x, inputs[i].y);
+        else
+            fprintf(m, "%llu %llu - %s %s\n", (unsigned long long)first, (unsigned long long)inputs[i].rows, inputs[i].x, inputs[i].y);
+        first += inputs[i].rows;
+    }
+    fclose(m);
+
+    printf("Merged %u inputs, %llu rows (%.1f MB) in %.2f seconds%s.\n", ninputs, (unsigned long long)rows,
+        (hs*2 + rows * (rx + ry)) / 1048576.0, wallTime() - st, cloned ? ", the first input reflinked" : "");
+    printf("%llu rounds indexed in %s from %u of %u inputs.\n", (unsigned long long)nidx, oi, indexed, ninputs);
+    if(fro > -1)
+        printf("%u rays a row carried into %s.\n", inputs[0].hr.k, orr);
+    else if(nrays > 0)
+        printf("Rays not carried, %u of %u inputs have a ray sidecar and all of them need one of the same rays.\n", nrays, ninputs);
+    return 0;
+}
@@ -0,0 +1,619 @@
+/*
+    Info:
+
+        Dataset scanner.
+
+        Streams X and Y dataset files (float32 or quantized, see inc/qenc.h)
+        on every core and reports, per column, the min/max/mean/variance of
+        the finite values, counts of NaN, Inf, denormal and zero values, and
+        a histogram; it checks that every X and Y pair holds the same number
+        of whole rows and counts the rows of each score bucket.
+
+        The statistics pass is AVX2 when the compiler targets it
+        (-march=native): a period of 4 rows is 3 vectors of X or 1 of Y, so
+        every lane always sees the same column and the lanes are folded into
+        columns once per chunk. The histogram is a second pass over the
+        [min, max] of the first, --hist 0 skips it.
+
+        An input is an X file (its Y file is the same name with _x. turned
+        into _y.), a directory of <score>_x.<ext> bucket files and
+        dataset_x.<ext> (--format picks the extension, dat by default) or a
+        dsmerge --shards manifest.
+
+        The statistics go to a tab separated sidecar, dataset.stats unless
+        --out names another; train.py and train2.py normalise their inputs
+        with it when it is present (dataset.load_stats()).
+
+    Usage:
+
+        ./dsscan <in>... [--out file] [--threads n] [--hist bins] [--format dat|f16|i16]
+        ./dsscan ../dataset_x.dat --out ../dataset.stats
+        ./dsscan ../multicapturecli/dataset.manifest
+
+*/
+
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+#include "../inc/qenc.h"
+
+#define XCOLS 6
+#define YCOLS 2
+#define COLS (XCOLS + YCOLS)
+#define CHUNK_ROWS 65536
+#define MAX_THREADS 256
+#define MAX_BINS 4096
+#define MAX_BUCKETS 64
+
+const char* col_names[COLS] = {"pbd.x", "pbd.y", "lad.x", "lad.y", "angle", "dist", "sr", "sp"};
+
+typedef struct
+{
+    char x[4096];
+    char y[4096];
+    float score;     // -1 when it has none
+    uint64_t rows;
+    uint16_t enc;
+    qheader hx, hy;
+    int fx, fy;
+} input;
+
+typedef struct
+{
+    uint64_t n, nan, inf, denormal, zero; // n is the finite values
+    double min, max, sum, sumsq;
+} colstat;
+
+typedef struct
+{
+    colstat st[COLS];
+    uint64_t hist[COLS][MAX_BINS];
+} tstate;
+
+input* inputs = NULL;
+uint32_t ninputs = 0, cinputs = 0;
+const char* ext = "dat";
+
+// chunk jobs
+uint64_t* job_first = NULL; // first job of every input
+uint64_t njobs = 0, next_job = 0;
+pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+int pass = 0; // 0 statistics, 1 histogram
+uint32_t bins = 32;
+double hmin[COLS], hscale[COLS];
+uint32_t read_errors = 0;
+
+double wallTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((double)tv.tv_sec) + (((double)tv.tv_usec)/1000000.0);
+}
+
+//*************************************
+// inputs
+//*************************************
+
+float nameScore(const char* path)
+{
+    const char* n = strrchr(path, '/');
+    n = n == NULL ? path : n+1;
+    char* e;
+    const float s = strtof(n, &e);
+    if(e == n || strncmp(e, "_x.", 3) != 0)
+        return -1.f;
+    return s;
+}
+
+input* addInput(const char* x, const char* y, const float score, const uint64_t rows)
+{
+    if(ninputs == cinputs)
+    {
+        cinputs = cinputs ? cinputs*2 : 64;
+        inputs = realloc(inputs, cinputs * sizeof(input));
+    }
+    input* in = &inputs[ninputs++];
+    memset(in, 0, sizeof(input));
+    snprintf(in->x, sizeof(in->x), "%s", x);
+    snprintf(in->y, sizeof(in->y), "%s", y);
+    in->score = score;
+    in->rows = rows;
+    in->fx = in->fy = -1;
+    return in;
+}
+
+int addFile(const char* x)
+{
+    const char* n = strrchr(x, '/');
+    n = n == NULL ? x : n+1;
+    const char* u = strstr(n, "_x.");
+    if(u == NULL)
+    {
+        printf("%s is not an X file, its name needs an _x. to find the Y file.\n", x);
+        return -1;
+    }
+    char y[4096];
+    snprintf(y, sizeof(y), "%s", x);
+    y[(u - x) + 1] = 'y';
+    addInput(x, y, nameScore(x), UINT64_MAX);
+    return 0;
+}
+
+int isBucket(const struct dirent* e)
+{
+    const char* u = strstr(e->d_name, "_x.");
+    if(u == NULL || strcmp(u+3, ext) != 0)
+        return 0;
+    return strncmp(e->d_name, "dataset_x.", 10) == 0 || nameScore(e->d_name) >= 0.f;
+}
+
+int addDir(const char* dir)
+{
+    struct dirent** list;
+    const int n = scandir(dir, &list, isBucket, alphasort);
+    if(n < 0)
+        return -1;
+    for(int i = 0; i < n; i++)
+    {
+        char p[4096];
+        snprintf(p, sizeof(p), "%s/%s", dir, list[i]->d_name);
+        addFile(p);
+        free(list[i]);
+    }
+    free(list);
+    return 0;
+}
+
+// a dsmerge --shards manifest, only the listed rows of each shard are scanned
+int addManifest(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if(f == NULL)
+        return -1;
+    char dp[4096];
+    snprintf(dp, sizeof(dp), "%s", path);
+    const char* base = dirname(dp);
+    char line[8192*2+256];
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\n")] = 0;
+        if(line[0] == '#')
+            continue;
+        char* p[7];
+        int n = 0;
+        for(char* t = strtok(line, "\t"); t != NULL && n < 7; t = strtok(NULL, "\t"))
+            p[n++] = t;
+        if(n != 7)
+            continue; // the totals
+        char x[4096], y[4096];
+        snprintf(x, sizeof(x), p[5][0] == '/' ? "%.0s%s" : "%s/%s", base, p[5]);
+        snprintf(y, sizeof(y), p[6][0] == '/' ? "%.0s%s" : "%s/%s", base, p[6]);
+        addInput(x, y, p[2][0] == '-' ? -1.f : atof(p[2]), strtoull(p[0], NULL, 10));
+    }
+    fclose(f);
+    return 0;
+}
+
+// opens and sizes a pair, 0 if the rows line up
+int openInput(input* in)
+{
+    in->fx = open(in->x, O_RDONLY | O_CLOEXEC);
+    in->fy = open(in->y, O_RDONLY | O_CLOEXEC);
+    if(in->fx == -1 || in->fy == -1)
+    {
+        printf("Failed to open %s or %s\n", in->x, in->y);
+        return -1;
+    }
+    posix_fadvise(in->fx, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(in->fy, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    struct stat sx, sy;
+    if(fstat(in->fx, &sx) == -1 || fstat(in->fy, &sy) == -1)
+        return -1;
+
+    in->enc = QENC_F32;
+    uint64_t bx = sx.st_size, by = sy.st_size;
+    if(pread(in->fx, &in->hx, sizeof(qheader), 0) == sizeof(qheader) && in->hx.magic == QENC_MAGIC)
+    {
+        if(qencCheck(&in->hx) < 0 || pread(in->fy, &in->hy, sizeof(qheader), 0) != sizeof(qheader) || qencCheck(&in->hy) < 0 ||
+           in->hx.encoding != in->hy.encoding || in->hx.columns != XCOLS || in->hy.columns != YCOLS)
+        {
+            printf("%s and %s do not have matching %d and %d column headers.\n", in->x, in->y, XCOLS, YCOLS);
+            return -1;
+        }
+        in->enc = in->hx.encoding;
+        bx -= sizeof(qheader);
+        by -= sizeof(qheader);
+    }
+    const uint64_t rx = XCOLS * qencBytes(in->enc), ry = YCOLS * qencBytes(in->enc);
+    if(in->rows != UINT64_MAX) // a shard, the files may have grown since it was listed
+    {
+        if(bx / rx < in->rows || by / ry < in->rows)
+        {
+            printf("%s and %s hold fewer than the %llu rows listed.\n", in->x, in->y, (unsigned long long)in->rows);
+            return -1;
+        }
+        return 0;
+    }
+    if(bx % rx != 0 || by % ry != 0 || bx / rx != by / ry)
+    {
+        printf("%s and %s are not row aligned: %.2f and %.2f rows.\n", in->x, in->y, (double)bx / rx, (double)by / ry);
+        return -1;
+    }
+    in->rows = bx / rx;
+    return 0;
+}
+
+//*************************************
+// kernels
+//*************************************
+
+static inline void scanScalar(const float f, colstat* s)
+{
+    switch(fpclassify(f))
+    {
+        case FP_NAN:       s->nan++;      return;
+        case FP_INFINITE:  s->inf++;      return;
+        case FP_SUBNORMAL: s->denormal++; break;
+        case FP_ZERO:      s->zero++;     break;
+    }
+    s->n++;
+    if(f < s->min){s->min = f;}
+    if(f > s->max){s->max = f;}
+    s->sum += f;
+    s->sumsq += (double)f*f;
+}
+
+// statistics of rows*cols values into st[cols]
+void scanStats(const float* v, const size_t rows, const uint32_t cols, colstat* st)
+{
+    size_t r = 0;
+#ifdef __AVX2__
+    // lane j of vector k of a period always holds column (k*8+j) % cols
+    uint32_t g = 8, c = cols;
+    while(c != 0){const uint32_t t = g % c; g = c; c = t;}
+    const uint32_t nv = cols / g, prows = nv * 8 / cols;
+    __m256  vmin[8], vmax[8];
+    __m256d slo[8], shi[8], qlo[8], qhi[8];
+    __m256i cn[8], cnan[8], cinf[8], cden[8], czero[8];
+    for(uint32_t k = 0; k < nv; k++)
+    {
+        vmin[k] = _mm256_set1_ps(INFINITY), vmax[k] = _mm256_set1_ps(-INFINITY);
+        slo[k] = shi[k] = qlo[k] = qhi[k] = _mm256_setzero_pd();
+        cn[k] = cnan[k] = cinf[k] = cden[k] = czero[k] = _mm256_setzero_si256();
+    }
+    const __m256i emask = _mm256_set1_epi32(0x7F800000), mmask = _mm256_set1_epi32(0x007FFFFF), zero = _mm256_setzero_si256();
+    for(; r + prows <= rows; r += prows)
+    {
+        const float* p = v + r*cols;
+        for(uint32_t k = 0; k < nv; k++)
+        {
+            const __m256 x = _mm256_loadu_ps(p + k*8);
+            const __m256i b = _mm256_castps_si256(x);
+            const __m256i e = _mm256_and_si256(b, emask);
+            const __m256i mz = _mm256_cmpeq_epi32(_mm256_and_si256(b, mmask), zero);
+            const __m256i emax = _mm256_cmpeq_epi32(e, emask);
+            const __m256i emin = _mm256_cmpeq_epi32(e, zero);
+            cnan[k] = _mm256_sub_epi32(cnan[k], _mm256_andnot_si256(mz, emax)); // masks are -1
+            cinf[k] = _mm256_sub_epi32(cinf[k], _mm256_and_si256(mz, emax));
+            cden[k] = _mm256_sub_epi32(cden[k], _mm256_andnot_si256(mz, emin));
+            czero[k] = _mm256_sub_epi32(czero[k], _mm256_and_si256(mz, emin));
+
+            const __m256i fin = _mm256_xor_si256(emax, _mm256_set1_epi32(-1));
+            const __m256 fm = _mm256_castsi256_ps(fin);
+            cn[k] = _mm256_sub_epi32(cn[k], fin);
+            vmin[k] = _mm256_min_ps(vmin[k], _mm256_blendv_ps(_mm256_set1_ps(INFINITY), x, fm));
+            vmax[k] = _mm256_max_ps(vmax[k], _mm256_blendv_ps(_mm256_set1_ps(-INFINITY), x, fm));
+            const __m256 xf = _mm256_and_ps(x, fm);
+            const __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(xf));
+            const __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(xf, 1));
+            slo[k] = _mm256_add_pd(slo[k], lo);
+            shi[k] = _mm256_add_pd(shi[k], hi);
+            qlo[k] = _mm256_add_pd(qlo[k], _mm256_mul_pd(lo, lo));
+            qhi[k] = _mm256_add_pd(qhi[k], _mm256_mul_pd(hi, hi));
+        }
+    }
+    for(uint32_t k = 0; k < nv; k++)
+    {
+        float mn[8], mx[8];
+        double s[8], q[8];
+        int32_t n[8], na[8], in[8], de[8], ze[8];
+        _mm256_storeu_ps(mn, vmin[k]);
+        _mm256_storeu_ps(mx, vmax[k]);
+        _mm256_storeu_pd(s, slo[k]);
+        _mm256_storeu_pd(s+4, shi[k]);
+        _mm256_storeu_pd(q, qlo[k]);
+        _mm256_storeu_pd(q+4, qhi[k]);
+        _mm256_storeu_si256((__m256i*)n, cn[k]);
+        _mm256_storeu_si256((__m256i*)na, cnan[k]);
+        _mm256_storeu_si256((__m256i*)in, cinf[k]);
+        _mm256_storeu_si256((__m256i*)de, cden[k]);
+        _mm256_storeu_si256((__m256i*)ze, czero[k]);
+        for(int j = 0; j < 8; j++)
+        {
+            colstat* o = &st[(k*8 + j) % cols];
+            o->n += n[j], o->nan += na[j], o->inf += in[j], o->denormal += de[j], o->zero += ze[j];
+            o->sum += s[j], o->sumsq += q[j];
+            if(mn[j] < o->min){o->min = mn[j];}
+            if(mx[j] > o->max){o->max = mx[j];}
+        }
+    }
+#endif
+    for(; r < rows; r++)
+        for(uint32_t c = 0; c < cols; c++)
+            scanScalar(v[r*cols + c], &st[c]);
+}
+
+void scanHist(const float* v, const size_t rows, const uint32_t cols, const uint32_t col0, uint64_t (*hist)[MAX_BINS])
+{
+    for(size_t r = 0; r < rows; r++)
+    {
+        for(uint32_t c = 0; c < cols; c++)
+        {
+            const float f = v[r*cols + c];
+            if(isfinite(f) == 0)
+                continue;
+            int64_t b = (int64_t)((f - hmin[col0+c]) * hscale[col0+c]);
+            if(b < 0){b = 0;}
+            if(b >= (int64_t)bins){b = bins-1;}
+            hist[col0+c][b]++;
+        }
+    }
+}
+
+//*************************************
+// threads
+//*************************************
+
+void* scanThread(void* arg)
+{
+    tstate* ts = arg;
+    uint8_t* raw = malloc(CHUNK_ROWS * XCOLS * sizeof(float));
+    float* dec = malloc(CHUNK_ROWS * XCOLS * sizeof(float));
+    uint32_t in_i = 0;
+    while(1)
+    {
+        pthread_mutex_lock(&next_lock);
+        const uint64_t j = next_job++;
+        pthread_mutex_unlock(&next_lock);
+        if(j >= njobs)
+            break;
+        while(j >= job_first[in_i+1]){in_i++;}
+        while(j < job_first[in_i]){in_i--;}
+        const input* in = &inputs[in_i];
+        const uint64_t r0 = (j - job_first[in_i]) * CHUNK_ROWS;
+        const uint64_t rows = in->rows - r0 < CHUNK_ROWS ? in->rows - r0 : CHUNK_ROWS;
+        const size_t vs = qencBytes(in->enc);
+        const off_t hs = in->enc == QENC_F32 ? 0 : sizeof(qheader);
+        for(int side = 0; side < 2; side++)
+        {
+            const uint32_t cols = side == 0 ? XCOLS : YCOLS;
+            const size_t len = rows * cols * vs;
+            if(pread(side == 0 ? in->fx : in->fy, raw, len, hs + r0*cols*vs) != (ssize_t)len)
+            {
+                __sync_fetch_and_add(&read_errors, 1);
+                break;
+            }
+            const float* v = (const float*)raw;
+            if(in->enc != QENC_F32)
+            {
+                qencDecode(side == 0 ? &in->hx : &in->hy, raw, dec, rows);
+                v = dec;
+            }
+            if(pass == 0)
+                scanStats(v, rows, cols, ts->st + (side == 0 ? 0 : XCOLS));
+            else
+                scanHist(v, rows, cols, side == 0 ? 0 : XCOLS, ts->hist);
+        }
+    }
+    free(raw);
+    free(dec);
+    return NULL;
+}
+
+void runPass(const int p, tstate* ts, const int nthreads)
+{
+    pthread_t th[MAX_THREADS];
+    pass = p;
+    next_job = 0;
+    for(int i = 0; i < nthreads; i++)
+        pthread_create(&th[i], NULL, scanThread, &ts[i]);
+    for(int i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: ./dsscan <in>... [--out file] [--threads n] [--hist bins] [--format dat|f16|i16]\n");
+        return 0;
+    }
+
+    const char* out = "dataset.stats";
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    char* pos[argc];
+    int npos = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--out") == 0 && i+1 < argc){out = argv[++i];}
+        else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc){nthreads = atoi(argv[++i]);}
+        else if(strcmp(argv[i], "--hist") == 0 && i+1 < argc){bins = atoi(argv[++i]);}
+        else if(strcmp(argv[i], "--format") == 0 && i+1 < argc){ext = argv[++i];}
+        else{pos[npos++] = argv[i];}
+    }
+    if(nthreads < 1){nthreads = 1;}
+    if(nthreads > MAX_THREADS){nthreads = MAX_THREADS;}
+    if(bins > MAX_BINS){bins = MAX_BINS;}
+
+    for(int i = 0; i < npos; i++)
+    {
+        struct stat s;
+        const size_t l = strlen(pos[i]);
+        int r = stat(pos[i], &s);
+        if(r == 0 && S_ISDIR(s.st_mode))
+            r = addDir(pos[i]);
+        else if(r == 0 && l > 9 && strcmp(pos[i] + l - 9, ".manifest") == 0)
+            r = addManifest(pos[i]);
+        else if(r == 0)
+            r = addFile(pos[i]);
+        if(r < 0)
+        {
+            printf("Failed to open %s\n", pos[i]);
+            return 1;
+        }
+    }
+
+    // open, check alignment and cut into jobs; misaligned pairs are reported and left out
+    uint32_t misaligned = 0;
+    job_first = malloc((ninputs + 1) * sizeof(uint64_t));
+    for(uint32_t i = 0; i < ninputs;)
+    {
+        if(openInput(&inputs[i]) < 0)
+        {
+            misaligned++;
+            if(inputs[i].fx > -1){close(inputs[i].fx);}
+            if(inputs[i].fy > -1){close(inputs[i].fy);}
+            inputs[i] = inputs[--ninputs];
+            continue;
+        }
+        job_first[i] = njobs;
+        njobs += (inputs[i].rows + CHUNK_ROWS - 1) / CHUNK_ROWS;
+        i++;
+    }
+    job_first[ninputs] = njobs;
+
+    const double st = wallTime();
+    tstate* ts = calloc(nthreads, sizeof(tstate));
+    if(ts == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    for(int t = 0; t < nthreads; t++)
+        for(int c = 0; c < COLS; c++)
+            ts[t].st[c].min = INFINITY, ts[t].st[c].max = -INFINITY;
+    runPass(0, ts, nthreads);
+
+    colstat all[COLS] = {0};
+    for(int c = 0; c < COLS; c++)
+    {
+        all[c].min = INFINITY, all[c].max = -INFINITY;
+        for(int t = 0; t < nthreads; t++)
+        {
+            const colstat* s = &ts[t].st[c];
+            all[c].n += s->n, all[c].nan += s->nan, all[c].inf += s->inf, all[c].denormal += s->denormal, all[c].zero += s->zero;
+            all[c].sum += s->sum, all[c].sumsq += s->sumsq;
+            if(s->min < all[c].min){all[c].min = s->min;}
+            if(s->max > all[c].max){all[c].max = s->max;}
+        }
+        hmin[c] = all[c].min;
+        hscale[c] = all[c].max > all[c].min ? bins / (all[c].max - all[c].min) : 0.0;
+    }
+    uint64_t hist[COLS][MAX_BINS] = {{0}};
+    if(bins > 0)
+    {
+        runPass(1, ts, nthreads);
+        for(int t = 0; t < nthreads; t++)
+            for(int c = 0; c < COLS; c++)
+                for(uint32_t b = 0; b < bins; b++)
+                    hist[c][b] += ts[t].hist[c][b];
+    }
+    const double el = wallTime() - st;
+
+    // rows per score bucket
+    float bscore[MAX_BUCKETS];
+    uint64_t brows[MAX_BUCKETS];
+    uint32_t nb = 0;
+    uint64_t rows = 0, bytes = 0;
+    for(uint32_t i = 0; i < ninputs; i++)
+    {
+        const input* in = &inputs[i];
+        rows += in->rows;
+        bytes += in->rows * COLS * qencBytes(in->enc);
+        uint32_t b = 0;
+        while(b < nb && bscore[b] != in->score){b++;}
+        if(b == nb && nb < MAX_BUCKETS){bscore[nb] = in->score, brows[nb++] = 0;}
+        if(b < nb){brows[b] += in->rows;}
+    }
+
+    // report and sidecar
+    FILE* f = fopen(out, "w");
+    if(f == NULL)
+    {
+        printf("Failed to write %s\n", out);
+        return 1;
+    }
+    fprintf(f, "# dsscan stats\n");
+    fprintf(f, "rows\t%llu\n", (unsigned long long)rows);
+    fprintf(f, "inputs\t%u\n", ninputs);
+    fprintf(f, "misaligned\t%u\n", misaligned);
+    fprintf(f, "# column\tindex\tname\tcount\tmin\tmax\tmean\tvar\tnan\tinf\tdenormal\tzero\n");
+    printf("%-6s %12s %12s %12s %12s %12s %8s %8s %8s %10s\n", "column", "count", "min", "max", "mean", "std", "nan", "inf", "denorm", "zero");
+    for(int c = 0; c < COLS; c++)
+    {
+        const colstat* s = &all[c];
+        const double mean = s->n ? s->sum / s->n : 0.0;
+        double var = s->n ? s->sumsq / s->n - mean*mean : 0.0;
+        if(var < 0.0){var = 0.0;}
+        const double mn = s->n ? s->min : 0.0, mx = s->n ? s->max : 0.0;
+        fprintf(f, "column\t%d\t%s\t%llu\t%.9g\t%.9g\t%.9g\t%.9g\t%llu\t%llu\t%llu\t%llu\n", c, col_names[c], (unsigned long long)s->n,
+            mn, mx, mean, var, (unsigned long long)s->nan, (unsigned long long)s->inf, (unsigned long long)s->denormal, (unsigned long long)s->zero);
+        printf("%-6s %12llu %12.6g %12.6g %12.6g %12.6g %8llu %8llu %8llu %10llu\n", col_names[c], (unsigned long long)s->n, mn, mx, mean, sqrt(var),
+            (unsigned long long)s->nan, (unsigned long long)s->inf, (unsigned long long)s->denormal, (unsigned long long)s->zero);
+    }
+    if(bins > 0)
+    {
+        fprintf(f, "# hist\tindex\tmin\tmax\tcounts...\n");
+        for(int c = 0; c < COLS; c++)
+        {
+            fprintf(f, "hist\t%d\t%.9g\t%.9g", c, all[c].n ? all[c].min : 0.0, all[c].n ? all[c].max : 0.0);
+            for(uint32_t b = 0; b < bins; b++)
+                fprintf(f, "\t%llu", (unsigned long long)hist[c][b]);
+            fprintf(f, "\n");
+        }
+    }
+    fprintf(f, "# bucket\tscore\trows\n");
+    printf("\n");
+    for(uint32_t b = 0; b < nb; b++)
+    {
+        if(bscore[b] < 0.f)
+        {
+            fprintf(f, "bucket\t-\t%llu\n", (unsigned long long)brows[b]);
+            printf("bucket -   %12llu rows\n", (unsigned long long)brows[b]);
+        }
+        else
+        {
+            fprintf(f, "bucket\t%.1f\t%llu\n", bscore[b], (unsigned long long)brows[b]);
+            printf("bucket %.1f %12llu rows\n", bscore[b], (unsigned long long)brows[b]);
+        }
+    }
+    if(fclose(f) != 0)
+    {
+        printf("Failed to write %s\n", out);
+        return 1;
+    }
+
+    printf("\n%llu rows in %u inputs (%.1f MB) in %.2f seconds on %d threads, %.0f MB/s. Wrote %s\n", (unsigned long long)rows, ninputs,
+        bytes / 1048576.0, el, nthreads, bytes / 1048576.0 * (bins > 0 ? 2 : 1) / el, out);
+    if(misaligned > 0)
+        printf("%u inputs were not row aligned and were left out.\n", misaligned);
+    if(read_errors > 0)
+        printf("%u chunks failed to read.\n", read_errors);
+    return misaligned > 0 || read_errors > 0;
+}
@@ -0,0 +1 @@
+gcc main.c -I ../inc -Ofast -lm -lpthread -o estrain
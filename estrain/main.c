@@ -0,0 +1,420 @@
+/*
+    Info:
+
+        Neuroevolution trainer, Evolution Strategies (ES) or the
+        Cross-Entropy Method (CEM).
+
+        The headless simulator (inc/porysim.h) is the fitness function,
+        every candidate network drives real rounds in virtual time and is
+        scored with the same 0-1 round score the capture tools use. No
+        dataset and no Tensorflow are involved.
+
+        Each generation:
+
+        > a seed suite is drawn, every candidate drives the same rounds
+          so that the comparison between them is fair (common random
+          numbers).
+
+        > candidates are the current parameters plus and minus sigma
+          times a slice of a shared, read-only table of gaussian noise
+          (antithetic pairs). A slice is identified by its offset alone
+          so nothing per candidate has to be stored or copied.
+
+        > all candidates are evaluated in parallel, one thread per core.
+
+        > es:  fitnesses are centered-rank transformed and the gradient
+               estimate is applied with Adam.
+          cem: the parameters move to the mean of the elite candidates.
+
+        Fitness of a round:
+
+        > collected:  1 + the round score (1-2)
+        > timed out:  the fraction of the start distance that was closed (0-1)
+
+        The current parameters are written every generation and the best
+        parameters, measured on a fixed validation suite, whenever they
+        improve. Both are `.fnn` files; copy one to policy.fnn next to
+        porydrive and press I to drive with it.
+
+    Usage:
+
+        ./estrain <layers 0-4> <layer units> <population> <generations> <seeds per candidate> [sigma] [learning rate] [es/cem] [init.fnn]
+        ./estrain 1 32 128 1000 4 0.05 0.01 es
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <sys/stat.h>
+
+#define f32 float
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#include "../inc/vec.h"
+#include "../inc/porysim.h"
+#include "../inc/fnn.h"
+
+#define NOISE_TABLE (1<<25)  // 128 MB of shared gaussian noise
+#define VALIDATION_SEEDS 16
+#define MAX_ROUND_TIME 30.0  // virtual seconds before a round counts as timed out
+#define DT (1.f/144.f)
+
+// hyperparameters
+uint32_t layers = 1;
+uint32_t layer_units = 32;
+uint32_t population = 128; // rounded up to a whole number of antithetic pairs
+uint32_t generations = 1000;
+uint32_t nseeds = 4;
+f32 sigma = 0.05f;
+f32 lr = 0.01f;
+uint32_t cem = 0;
+f32 elite = 0.25f;         // cem elite fraction
+f32 l2 = 0.005f;           // es weight decay
+
+// shared state
+psimcfg cfg;
+fnn shape;                 // architecture template
+size_t np = 0;             // parameter count
+f32* noise;                // [NOISE_TABLE]
+f32* theta;                // [np] current parameters
+uint32_t* offsets;         // [population/2] noise offset per antithetic pair
+f32* fitness;              // [population]
+uint32_t* seeds;           // [nseeds] this generation's suite
+uint32_t vseeds[VALIDATION_SEEDS];
+f32 vfitness = 0.f;        // current parameters on the validation suite
+volatile uint32_t next_job = 0;
+uint32_t njobs = 0;
+uint32_t nthreads = 1;
+
+double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t xrand(uint64_t* s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static inline f32 xrandf(uint64_t* s)
+{
+    return (f32)(xrand(s) >> 40) * 5.9604645e-08f; // [0, 1)
+}
+
+// one round from a fresh state, driven entirely by the network
+f32 evalRound(const fnn* net, const uint32_t seed)
+{
+    const psimprofile* p = psimProfile(&cfg);
+    psim s;
+    psimReset(&s, cfg.world, seed, 0.0);
+    p->collide(&s, &cfg); // directions for the first observation
+    while(s.t < MAX_ROUND_TIME)
+    {
+        f32 input[6], out[2];
+        psimObserve(&s, input);
+        fnnEval(net, input, out);
+        s.sr = out[0];
+        s.sp = out[1];
+        if(psimStepP(p, &s, &cfg, DT) == PSIM_COLLECTED)
+            return 1.f + psimRoundScore(&s);
+    }
+    const f32 d = vDist(s.pp, s.zp);
+    if(s.start_dist <= 0.f || d >= s.start_dist)
+        return 0.f;
+    return 1.f - d / s.start_dist;
+}
+
+f32 evalSuite(const fnn* net, const uint32_t* suite, const uint32_t n)
+{
+    f32 f = 0.f;
+    for(uint32_t i = 0; i < n; i++)
+        f += evalRound(net, suite[i]);
+    return f / (f32)n;
+}
+
+// job 0 is the current parameters on the validation suite, it is the longest so it goes first,
+// jobs 1..population are the candidates
+void* workerThread(void* arg)
+{
+    fnn* net = arg;
+    f32* p = malloc(np * sizeof(f32));
+    if(p == NULL)
+        return NULL;
+    while(1)
+    {
+        uint32_t j = __sync_fetch_and_add(&next_job, 1);
+        if(j >= njobs)
+            break;
+        if(j == 0)
+        {
+            fnnSetParams(net, theta);
+            vfitness = evalSuite(net, vseeds, VALIDATION_SEEDS);
+            continue;
+        }
+        j--;
+        const f32* e = &noise[offsets[j >> 1]];
+        const f32 sg = (j & 1) ? -sigma : sigma;
+        for(size_t k = 0; k < np; k++)
+            p[k] = theta[k] + sg * e[k];
+        fnnSetParams(net, p);
+        fitness[j] = evalSuite(net, seeds, nseeds);
+    }
+    free(p);
+    return NULL;
+}
+
+int cmpDesc(const void* a, const void* b)
+{
+    const f32 fa = fitness[*(const uint32_t*)a];
+    const f32 fb = fitness[*(const uint32_t*)b];
+    return (fa < fb) - (fa > fb);
+}
+
+int main(int argc, char** argv)
+{
+    printf("----\n");
+    printf("PoryDrive Neuroevolution Trainer\n");
+    printf("----\n");
+
+    if(argc < 6)
+    {
+        printf("Usage: ./estrain <layers 0-4> <layer units> <population> <generations> <seeds per candidate> [sigma] [learning rate] [es/cem] [init.fnn]\n");
+        return 0;
+    }
+    layers = atoi(argv[1]);
+    layer_units = atoi(argv[2]);
+    population = atoi(argv[3]);
+    generations = atoi(argv[4]);
+    nseeds = atoi(argv[5]);
+    if(argc >= 7){sigma = atof(argv[6]);}
+    if(argc >= 8){lr = atof(argv[7]);}
+    if(argc >= 9){cem = strcmp(argv[8], "cem") == 0;}
+    if(layers > 4){layers = 4;}
+    if(layer_units < 16){layer_units = 16;}
+    if(population < 2){population = 2;}
+    population = (population + 1) & ~1u;
+    if(nseeds < 1){nseeds = 1;}
+
+    // same topology as train.py; tanh hidden layers halving in width, tanh outputs
+    uint32_t units[7] = {6, layer_units};
+    uint32_t acts[6];
+    for(uint32_t i = 1; i <= layers; i++)
+        units[i+1] = layer_units >> i;
+    units[layers+2] = 2;
+    for(uint32_t i = 0; i < layers+2; i++)
+        acts[i] = FNN_ACT_TANH;
+
+    if(argc >= 10)
+    {
+        if(fnnLoad(&shape, argv[9]) < 0 || shape.l[0].n_in != 6 || shape.l[shape.layers-1].n_out != 2)
+        {
+            printf("Failed to load a 6 input, 2 output model from: %s\n", argv[9]);
+            return 1;
+        }
+        printf("Initial parameters: %s\n", argv[9]);
+    }
+    else if(fnnAlloc(&shape, layers+2, units, acts) < 0)
+    {
+        printf("Failed to allocate the network.\n");
+        return 1;
+    }
+    np = fnnParams(&shape);
+    if(np > NOISE_TABLE/2)
+    {
+        printf("Network has %zu parameters, the noise table only supports %u.\n", np, NOISE_TABLE/2);
+        return 1;
+    }
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+    printf("Method: %s | Parameters: %zu | Population: %u | Seeds: %u | Sigma: %g | LR: %g | Threads: %u\n",
+        cem ? "cem" : "es", np, population, nseeds, sigma, lr, nthreads);
+
+    noise = malloc(NOISE_TABLE * sizeof(f32));
+    theta = malloc(np * sizeof(f32));
+    f32* grad = calloc(np, sizeof(f32));
+    f32* am = calloc(np, sizeof(f32));
+    f32* av = calloc(np, sizeof(f32));
+    offsets = malloc((population/2) * sizeof(uint32_t));
+    fitness = malloc(population * sizeof(f32));
+    seeds = malloc(nseeds * sizeof(uint32_t));
+    uint32_t* order = malloc(population * sizeof(uint32_t));
+    f32* rankw = malloc(population * sizeof(f32));
+    if(noise == NULL || theta == NULL || grad == NULL || am == NULL || av == NULL ||
+        offsets == NULL || fitness == NULL || seeds == NULL || order == NULL || rankw == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+
+    // shared noise table, Box-Muller from a fixed seed so runs are reproducible
+    double st = getTime();
+    uint64_t rs = 0x2545F4914F6CDD1DULL;
+    for(uint32_t i = 0; i < NOISE_TABLE; i += 2)
+    {
+        const f32 u1 = xrandf(&rs) + 5.9604645e-08f;
+        const f32 u2 = xrandf(&rs);
+        const f32 r = sqrtf(-2.f * logf(u1));
+        noise[i]   = r * cosf(6.28318531f * u2);
+        noise[i+1] = r * sinf(6.28318531f * u2);
+    }
+    printf("Noise table: %.0f MB in %.2f seconds.\n", (double)NOISE_TABLE*sizeof(f32)/1048576.0, getTime()-st);
+
+    // initial parameters; glorot uniform like Keras unless a model was given
+    if(argc >= 10)
+        fnnGetParams(&shape, theta);
+    else
+    {
+        f32* p = theta;
+        for(uint32_t i = 0; i < shape.layers; i++)
+        {
+            const fnnlayer* l = &shape.l[i];
+            const f32 lim = sqrtf(6.f / (f32)(l->n_in + l->n_out));
+            for(uint32_t k = 0; k < l->n_in * l->n_out; k++)
+                *p++ = (xrandf(&rs) * 2.f - 1.f) * lim;
+            for(uint32_t k = 0; k < l->n_out; k++)
+                *p++ = 0.f;
+        }
+    }
+
+    for(uint32_t i = 0; i < VALIDATION_SEEDS; i++)
+        vseeds[i] = (uint32_t)xrand(&rs);
+
+    // per thread networks with the topology of the template
+    uint32_t lu[shape.layers+1], la[shape.layers];
+    for(uint32_t i = 0; i < shape.layers; i++)
+        lu[i] = shape.l[i].n_in, la[i] = shape.l[i].act;
+    lu[shape.layers] = shape.l[shape.layers-1].n_out;
+    fnn nets[nthreads];
+    pthread_t th[nthreads];
+    for(uint32_t i = 0; i < nthreads; i++)
+    {
+        if(fnnAlloc(&nets[i], shape.layers, lu, la) < 0)
+        {
+            printf("Failed to allocate the network.\n");
+            return 1;
+        }
+    }
+
+    mkdir("models", 0777);
+    char fn_last[256], fn_best[256];
+    sprintf(fn_last, "models/%s_%u_%u.fnn", cem ? "cem" : "es", layers, layer_units);
+    sprintf(fn_best, "models/%s_%u_%u_best.fnn", cem ? "cem" : "es", layers, layer_units);
+
+    psimConfigScarletFast(&cfg);
+
+    f32 best = -1.f;
+    uint64_t rounds = 0;
+    const double tst = getTime();
+    printf("----\n");
+    for(uint32_t g = 0; g < generations; g++)
+    {
+        st = getTime();
+
+        // this generation's seed suite and noise slices
+        for(uint32_t i = 0; i < nseeds; i++)
+            seeds[i] = (uint32_t)xrand(&rs);
+        for(uint32_t i = 0; i < population/2; i++)
+            offsets[i] = (uint32_t)(xrand(&rs) % (NOISE_TABLE - np));
+
+        // evaluate
+        next_job = 0;
+        njobs = population + 1;
+        for(uint32_t i = 0; i < nthreads; i++)
+            pthread_create(&th[i], NULL, workerThread, &nets[i]);
+        for(uint32_t i = 0; i < nthreads; i++)
+            pthread_join(th[i], NULL);
+        rounds += (uint64_t)population * nseeds + VALIDATION_SEEDS;
+
+        // keep the best parameters as measured before this update
+        if(vfitness > best)
+        {
+            best = vfitness;
+            fnnSetParams(&nets[0], theta);
+            if(fnnSave(&nets[0], fn_best) < 0)
+                printf("Failed to write: %s\n", fn_best);
+        }
+
+        // rank
+        f32 fmean = 0.f;
+        for(uint32_t i = 0; i < population; i++)
+            order[i] = i, fmean += fitness[i];
+        fmean /= (f32)population;
+        qsort(order, population, sizeof(uint32_t), cmpDesc);
+
+        if(cem == 1)
+        {
+            // move to the mean of the elite
+            uint32_t ne = (uint32_t)(elite * population);
+            if(ne < 1){ne = 1;}
+            memset(grad, 0, np * sizeof(f32));
+            for(uint32_t r = 0; r < ne; r++)
+            {
+                const uint32_t j = order[r];
+                const f32* e = &noise[offsets[j >> 1]];
+                const f32 sg = (j & 1) ? -sigma : sigma;
+                for(size_t k = 0; k < np; k++)
+                    grad[k] += sg * e[k];
+            }
+            for(size_t k = 0; k < np; k++)
+                theta[k] += grad[k] / (f32)ne;
+        }
+        else
+        {
+            // centered ranks in [-0.5, 0.5], best first
+            for(uint32_t r = 0; r < population; r++)
+                rankw[order[r]] = 0.5f - (f32)r / (f32)(population-1);
+
+            // antithetic gradient estimate
+            memset(grad, 0, np * sizeof(f32));
+            for(uint32_t i = 0; i < population/2; i++)
+            {
+                const f32 w = rankw[i*2] - rankw[i*2+1];
+                const f32* e = &noise[offsets[i]];
+                for(size_t k = 0; k < np; k++)
+                    grad[k] += w * e[k];
+            }
+
+            // Adam ascent with weight decay
+            const f32 b1 = 0.9f, b2 = 0.999f;
+            const f32 a = lr * sqrtf(1.f - powf(b2, g+1)) / (1.f - powf(b1, g+1));
+            const f32 gs = 1.f / ((f32)population * sigma);
+            for(size_t k = 0; k < np; k++)
+            {
+                const f32 gk = grad[k] * gs - l2 * theta[k];
+                am[k] = b1 * am[k] + (1.f - b1) * gk;
+                av[k] = b2 * av[k] + (1.f - b2) * gk * gk;
+                theta[k] += a * am[k] / (sqrtf(av[k]) + 1e-8f);
+            }
+        }
+
+        fnnSetParams(&nets[0], theta);
+        if(fnnSave(&nets[0], fn_last) < 0)
+            printf("Failed to write: %s\n", fn_last);
+
+        const double gt = getTime()-st;
+        printf("[%u] mean: %.4f | top: %.4f | validation: %.4f (best %.4f) | %.2f sec | %.0f rounds/sec\n",
+            g, fmean, fitness[order[0]], vfitness, best, gt, ((double)population * nseeds + VALIDATION_SEEDS) / gt);
+    }
+
+    printf("----\n");
+    printf("%llu rounds in %.2f seconds.\n", (unsigned long long)rounds, getTime()-tst);
+    printf("Last: %s\n", fn_last);
+    printf("Best: %s (validation fitness %.4f)\n", fn_best, best);
+    return 0;
+}
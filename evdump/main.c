@@ -0,0 +1,244 @@
+/*
+    Info:
+
+        Event log decoder.
+
+        Reads the fixed-record binary event logs that porydrivecli
+        (--events <file>) and porydrive (fourth argument) write, see
+        inc/evlog.h, and prints them as text.
+
+        --rounds folds the records into one line per round, so a log doubles
+        as a round index: round, seed, start time, start_dist, zs, zt, round
+        time, collisions, score and outcome (collected, timeout, open).
+        --min-score/--max-score and --outcome filter that list.
+
+        --csv prints comma separated values instead of aligned columns.
+
+    Usage:
+
+        ./evdump <file.pev> [--rounds] [--csv] [--min-score x] [--max-score x] [--outcome collected|timeout]
+        ./evdump events.pev --rounds --min-score 0.6
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../inc/evlog.h"
+
+typedef struct
+{
+    uint32_t round;
+    uint64_t seed;
+    double start, end;
+    float start_dist, zs, zt;
+    float rtime, score;
+    uint32_t cc;
+    int outcome; // 0 open, 1 collected, 2 timeout
+} round_t;
+
+const char* outcome_names[] = {"open", "collected", "timeout"};
+
+uint32_t csv = 0;
+float min_score = -1.f, max_score = 2.f;
+int outcome_filter = -1;
+
+const char* typeName(const uint16_t type)
+{
+    switch(type)
+    {
+        case EV_GAME_START:    return "game_start";
+        case EV_ROUND_START:   return "round_start";
+        case EV_ROUND_END:     return "round_end";
+        case EV_ROUND_TIMEOUT: return "round_timeout";
+        case EV_COLLISION:     return "collision";
+        case EV_ROUND_LOGGED:  return "round_logged";
+        case EV_CPS:           return "cps";
+        case EV_WATCHDOG:      return "watchdog";
+        case EV_GAME_END:      return "game_end";
+        case EV_CLOSE:         return "close";
+    }
+    return "unknown";
+}
+
+// number of payload values each type uses
+int typeValues(const uint16_t type)
+{
+    switch(type)
+    {
+        case EV_GAME_START:    return 6;
+        case EV_ROUND_START:   return 7;
+        case EV_ROUND_END:     return 8;
+        case EV_ROUND_TIMEOUT: return 3;
+        case EV_COLLISION:     return 3;
+        case EV_ROUND_LOGGED:  return 3;
+        case EV_CPS:
+        case EV_WATCHDOG:
+        case EV_GAME_END:
+        case EV_CLOSE:         return 1;
+    }
+    return 0;
+}
+
+void printRecord(const evrec* r)
+{
+    const int n = typeValues(r->type);
+    if(csv == 1)
+    {
+        printf("%s,%u,%llu,%.6f,%u,%u", typeName(r->type), r->round, (unsigned long long)r->seed, r->t, r->cc, r->cp);
+        for(int i = 0; i < 8; i++)
+        {
+            if(i < n)
+                printf(",%g", r->v[i]);
+            else
+                printf(",");
+        }
+        printf("\n");
+        return;
+    }
+    printf("%12.3f %-13s round %-7u seed %-10llu cc %-4u cp %-6u", r->t, typeName(r->type), r->round, (unsigned long long)r->seed, r->cc, r->cp);
+    for(int i = 0; i < n; i++)
+        printf(" %g", r->v[i]);
+    printf("\n");
+}
+
+void printRound(const round_t* r)
+{
+    if(r->outcome == 1 && (r->score < min_score || r->score > max_score))
+        return;
+    if(r->outcome != 1 && min_score > 0.f)
+        return;
+    if(outcome_filter != -1 && r->outcome != outcome_filter)
+        return;
+    if(csv == 1)
+        printf("%u,%llu,%.6f,%g,%g,%g,%g,%u,%g,%s\n", r->round, (unsigned long long)r->seed, r->start,
+            r->start_dist, r->zs, r->zt, r->rtime, r->cc, r->score, outcome_names[r->outcome]);
+    else
+        printf("%7u %10llu %12.3f %10.4f %6.3f %7.3f %8.3f %6u %7.4f %s\n", r->round, (unsigned long long)r->seed, r->start,
+            r->start_dist, r->zs, r->zt, r->rtime, r->cc, r->score, outcome_names[r->outcome]);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: ./evdump <file.pev> [--rounds] [--csv] [--min-score x] [--max-score x] [--outcome collected|timeout]\n");
+        return 0;
+    }
+
+    uint32_t rounds = 0;
+    for(int i = 2; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--rounds") == 0){rounds = 1;}
+        else if(strcmp(argv[i], "--csv") == 0){csv = 1;}
+        else if(strcmp(argv[i], "--min-score") == 0 && i+1 < argc){min_score = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--max-score") == 0 && i+1 < argc){max_score = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--outcome") == 0 && i+1 < argc)
+        {
+            i++;
+            if(strcmp(argv[i], "collected") == 0){outcome_filter = 1;}
+            else if(strcmp(argv[i], "timeout") == 0){outcome_filter = 2;}
+            else if(strcmp(argv[i], "open") == 0){outcome_filter = 0;}
+        }
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if(f == NULL)
+    {
+        printf("Failed to open %s\n", argv[1]);
+        return 1;
+    }
+
+    evheader h;
+    if(fread(&h, 1, sizeof(h), f) != sizeof(h) || h.magic != EVLOG_MAGIC)
+    {
+        printf("%s is not an event log.\n", argv[1]);
+        fclose(f);
+        return 1;
+    }
+    if(h.version != EVLOG_VERSION || h.record_size != sizeof(evrec))
+    {
+        printf("Unsupported event log version %u with %u byte records.\n", h.version, h.record_size);
+        fclose(f);
+        return 1;
+    }
+
+    if(csv == 0)
+        printf("# pid %d, seed %llu, start %.3f, %s\n", h.pid, (unsigned long long)h.seed, h.start,
+            (h.flags & EVLOG_FLAG_GUI) ? "porydrive" : (h.flags & EVLOG_FLAG_FAST) ? "porydrivecli virtual time" : "porydrivecli");
+    if(rounds == 1)
+    {
+        if(csv == 1)
+            printf("round,seed,start,start_dist,zs,zt,round_time,collisions,score,outcome\n");
+        else
+            printf("%7s %10s %12s %10s %6s %7s %8s %6s %7s %s\n", "round", "seed", "start", "start_dist", "zs", "zt", "time", "cc", "score", "outcome");
+    }
+    else if(csv == 1)
+        printf("type,round,seed,t,cc,cp,v0,v1,v2,v3,v4,v5,v6,v7\n");
+
+    round_t cur;
+    memset(&cur, 0, sizeof(cur));
+    uint32_t open = 0, closed = 0;
+    uint64_t n = 0;
+    evrec r;
+    while(fread(&r, 1, sizeof(r), f) == sizeof(r))
+    {
+        n++;
+        closed = r.type == EV_CLOSE; // a resumed run's log carries on after its earlier trailer
+        if(r.type == EV_CLOSE)
+        {
+            if(r.v[0] > 0.f)
+                fprintf(stderr, "%g records were dropped by the writer.\n", r.v[0]);
+        }
+
+        if(rounds == 0)
+        {
+            printRecord(&r);
+            continue;
+        }
+
+        if(r.type == EV_ROUND_START)
+        {
+            if(open == 1)
+                printRound(&cur);
+            memset(&cur, 0, sizeof(cur));
+            cur.round = r.round;
+            cur.seed = r.seed;
+            cur.start = r.t;
+            cur.start_dist = r.v[0];
+            cur.zs = r.v[1];
+            cur.zt = r.v[2];
+            open = 1;
+        }
+        else if(open == 1 && r.round == cur.round)
+        {
+            if(r.type == EV_COLLISION)
+                cur.cc = r.cc;
+            else if(r.type == EV_ROUND_END)
+            {
+                cur.score = r.v[5];
+                cur.rtime = r.v[6];
+                cur.cc = r.cc;
+                cur.outcome = 1;
+                printRound(&cur);
+                open = 0;
+            }
+            else if(r.type == EV_ROUND_TIMEOUT)
+            {
+                cur.rtime = r.v[0];
+                cur.outcome = 2;
+                printRound(&cur);
+                open = 0;
+            }
+        }
+    }
+    if(rounds == 1 && open == 1)
+        printRound(&cur);
+    fclose(f);
+
+    if(closed == 0)
+        fprintf(stderr, "No trailer, the writer did not exit cleanly (%llu records).\n", (unsigned long long)n);
+    return 0;
+}
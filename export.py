@@ -0,0 +1,55 @@
+# Exports a trained Keras model to the native `.fnn` format (see inc/fnn.h)
+# so that it can be evaluated without Tensorflow, by lutcompile for example.
+# https://github.com/PoryDrive/PoryDriveFNN
+import sys
+import os
+import numpy as np
+from struct import pack
+from tensorflow import keras
+
+os.environ['CUDA_VISIBLE_DEVICES'] = '-1'
+
+FNN_MAGIC = 0x314E4E46
+activations = {'linear': 0, 'tanh': 1, 'relu': 2, 'selu': 3, 'sigmoid': 4, 'softsign': 5, 'elu': 6}
+
+if len(sys.argv) < 3:
+    print("Usage: python3 export.py <model_path> <out.fnn>")
+    sys.exit(0)
+
+model = keras.models.load_model(sys.argv[1])
+model.summary()
+
+dense = []
+norm = None
+for layer in model.layers:
+    if isinstance(layer, keras.layers.Dropout):
+        continue
+    if isinstance(layer, keras.layers.Normalization) and len(dense) == 0:
+        # (x - mean) / std, folded into the first Dense layer so the .fnn takes raw inputs
+        mean = np.array(layer.mean, dtype=np.float64).reshape(-1)
+        std = np.maximum(np.sqrt(np.array(layer.variance, dtype=np.float64).reshape(-1)), keras.backend.epsilon())
+        norm = (mean, std)
+        continue
+    if not isinstance(layer, keras.layers.Dense):
+        print("Only Dense, Dropout and a leading Normalization layer can be exported, found:", layer.__class__.__name__)
+        sys.exit(1)
+    act = layer.get_config()['activation']
+    if act not in activations:
+        print("Unsupported activation:", act)
+        sys.exit(1)
+    kernel, bias = layer.get_weights()
+    if norm is not None:
+        mean, std = norm
+        bias = bias - (mean / std) @ kernel
+        kernel = kernel / std[:, None]
+        norm = None
+    dense.append((kernel.astype(np.float32), bias.astype(np.float32), activations[act]))
+
+with open(sys.argv[2], "wb") as f:
+    f.write(pack('<II', FNN_MAGIC, len(dense)))
+    for kernel, bias, act in dense:
+        f.write(pack('<III', kernel.shape[0], kernel.shape[1], act))
+        f.write(np.ascontiguousarray(kernel).tobytes()) # [in][out] row-major
+        f.write(bias.tobytes())
+
+print("Exported", len(dense), "layers to", sys.argv[2])
@@ -0,0 +1,299 @@
+/*
+    Block-compressed dataset container.
+
+    A .pdb file is a sequence of self-describing blocks, one per logged
+    round, holding its X (6 columns) and Y (2 columns) float32 rows
+    losslessly. There is no file header, so processes can append blocks
+    and files can be joined with cat.
+
+        dsbheader  header   24 bytes
+        uint8_t    payload[header.size]
+
+    The payload of a round is built as:
+
+        1. the bit pattern of every value becomes its second difference
+           from the same column of the previous rows, zigzag coded; at
+           144 Hz consecutive values share sign, exponent and most of the
+           mantissa and change almost linearly, so these are small words
+           (this beat XOR by 20% on captured rounds)
+        2. the words are split into four byte planes, so the high bytes of
+           every word sit together as long runs of zeros
+        3. a small LZ77 codec (below) compresses the planes
+
+    A block is stored uncompressed (DSB_STORED) if that would be smaller,
+    and carries an FNV-1a checksum of the raw rows.
+
+    The LZ77 format is a sequence of
+        token    uint8, literal count in the high nibble, match length-4 in the low
+        [uint8]  255 extensions of the literal count when the nibble is 15
+        literals
+        offset   uint16 little-endian, 1-65535 bytes back
+        [uint8]  255 extensions of the match length when the nibble is 15
+    and the final sequence has literals only.
+*/
+
+#ifndef DSBLOCK_H
+#define DSBLOCK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DSB_MAGIC    0x31424450 // "PDB1"
+#define DSB_XCOLS    6
+#define DSB_YCOLS    2
+#define DSB_COLS     (DSB_XCOLS + DSB_YCOLS)
+#define DSB_STORED   1          // flags, payload is the raw rows
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t rows;
+    float    score;
+    uint32_t size;     // payload bytes
+    uint32_t checksum; // FNV-1a of the raw X rows then the raw Y rows
+    uint32_t flags;    // DSB_*
+} dsbheader; // 24 bytes
+
+size_t dsbBound(const uint32_t rows); // worst case bytes of an encoded block, header included
+
+// encodes a round into out (dsbBound() bytes), returns the bytes used or 0 if out of memory
+size_t dsbEncode(const float* x, const float* y, const uint32_t rows, const float score, uint8_t* out);
+
+// decodes a payload into x[rows*6] and y[rows*2], 0 on success, -1 if corrupt
+int dsbDecode(const dsbheader* h, const uint8_t* payload, float* x, float* y);
+
+size_t dsbLzCompress(const uint8_t* in, const size_t n, uint8_t* out);    // out needs dsbLzBound(n)
+int dsbLzDecompress(const uint8_t* in, const size_t n, uint8_t* out, const size_t on); // 0 if it produced exactly on bytes
+static inline size_t dsbLzBound(const size_t n){return n + n/255 + 16;}
+
+//
+
+static inline uint32_t dsbChecksum(uint32_t h, const uint8_t* p, const size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static inline uint32_t dsbRead32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint8_t* dsbWriteLength(uint8_t* o, size_t len)
+{
+    while(len >= 255)
+    {
+        *o++ = 255;
+        len -= 255;
+    }
+    *o++ = (uint8_t)len;
+    return o;
+}
+
+size_t dsbLzCompress(const uint8_t* in, const size_t n, uint8_t* out)
+{
+    #define DSB_HASH_BITS 14
+    uint32_t* table = calloc(1 << DSB_HASH_BITS, sizeof(uint32_t)); // position+1 of the last 4 bytes with this hash
+    if(table == NULL)
+        return 0;
+    uint8_t* o = out;
+    size_t anchor = 0, i = 0;
+    while(n >= 8 && i + 8 <= n)
+    {
+        const uint32_t seq = dsbRead32(in + i);
+        const uint32_t hsh = (seq * 2654435761u) >> (32 - DSB_HASH_BITS);
+        const size_t cand = table[hsh];
+        table[hsh] = (uint32_t)i + 1;
+        if(cand == 0 || i - (cand-1) > 65535 || dsbRead32(in + cand-1) != seq)
+        {
+            i++;
+            continue;
+        }
+
+        // extend the match, keeping the last 4 bytes for literals
+        const size_t ref = cand-1;
+        size_t len = 4;
+        while(i + len < n - 4 && in[ref + len] == in[i + len])
+            len++;
+
+        const size_t lit = i - anchor;
+        uint8_t* token = o++;
+        *token = (uint8_t)(((lit >= 15 ? 15 : lit) << 4) | (len-4 >= 15 ? 15 : len-4));
+        if(lit >= 15){o = dsbWriteLength(o, lit-15);}
+        memcpy(o, in + anchor, lit);
+        o += lit;
+        const uint16_t off = (uint16_t)(i - ref);
+        *o++ = off & 0xFF;
+        *o++ = off >> 8;
+        if(len-4 >= 15){o = dsbWriteLength(o, len-4-15);}
+
+        i += len;
+        anchor = i;
+    }
+
+    // last literals
+    const size_t lit = n - anchor;
+    *o++ = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+    if(lit >= 15){o = dsbWriteLength(o, lit-15);}
+    memcpy(o, in + anchor, lit);
+    o += lit;
+    free(table);
+    return o - out;
+}
+
+int dsbLzDecompress(const uint8_t* in, const size_t n, uint8_t* out, const size_t on)
+{
+    const uint8_t* p = in;
+    const uint8_t* const pe = in + n;
+    size_t oi = 0;
+    while(p < pe)
+    {
+        const uint8_t token = *p++;
+        size_t lit = token >> 4;
+        if(lit == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if(p >= pe){return -1;}
+                b = *p++;
+                lit += b;
+            }
+            while(b == 255);
+        }
+        if(lit > (size_t)(pe - p) || lit > on - oi)
+            return -1;
+        memcpy(out + oi, p, lit);
+        p += lit;
+        oi += lit;
+        if(p == pe) // the final sequence
+            break;
+
+        if(pe - p < 2)
+            return -1;
+        const size_t off = p[0] | (p[1] << 8);
+        p += 2;
+        size_t len = (token & 15);
+        if(len == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if(p >= pe){return -1;}
+                b = *p++;
+                len += b;
+            }
+            while(b == 255);
+        }
+        len += 4;
+        if(off == 0 || off > oi || len > on - oi)
+            return -1;
+        // overlapping copies repeat the run, byte by byte
+        const uint8_t* r = out + oi - off;
+        for(size_t j = 0; j < len; j++)
+            out[oi + j] = r[j];
+        oi += len;
+    }
+    return oi == on ? 0 : -1;
+}
+
+size_t dsbBound(const uint32_t rows)
+{
+    return sizeof(dsbheader) + dsbLzBound((size_t)rows * DSB_COLS * 4);
+}
+
+size_t dsbEncode(const float* x, const float* y, const uint32_t rows, const float score, uint8_t* out)
+{
+    const size_t nw = (size_t)rows * DSB_COLS;
+    const size_t raw = nw * 4;
+    dsbheader h = {DSB_MAGIC, rows, score, 0, 0, 0};
+    h.checksum = dsbChecksum(dsbChecksum(2166136261u, (const uint8_t*)x, (size_t)rows*DSB_XCOLS*4), (const uint8_t*)y, (size_t)rows*DSB_YCOLS*4);
+
+    // second differences down each column, into byte planes
+    uint8_t* planes = malloc(raw);
+    if(planes == NULL)
+        return 0;
+    for(uint32_t c = 0; c < DSB_COLS; c++)
+    {
+        const float* src = c < DSB_XCOLS ? x + c : y + (c - DSB_XCOLS);
+        const uint32_t stride = c < DSB_XCOLS ? DSB_XCOLS : DSB_YCOLS;
+        uint32_t prev = 0, pdelta = 0;
+        for(uint32_t i = 0; i < rows; i++)
+        {
+            uint32_t w;
+            memcpy(&w, src + (size_t)i*stride, 4);
+            const uint32_t delta = w - prev;
+            const int32_t dd = (int32_t)(delta - pdelta);
+            const uint32_t d = ((uint32_t)dd << 1) ^ (uint32_t)(dd >> 31); // zigzag, small magnitudes either way
+            prev = w;
+            pdelta = delta;
+            const size_t k = (size_t)c*rows + i;
+            planes[k]        = d;
+            planes[nw + k]   = d >> 8;
+            planes[2*nw + k] = d >> 16;
+            planes[3*nw + k] = d >> 24;
+        }
+    }
+
+    uint8_t* payload = out + sizeof(dsbheader);
+    h.size = dsbLzCompress(planes, raw, payload);
+    free(planes);
+    if(h.size == 0 && raw > 0)
+        return 0;
+    if(h.size >= raw)
+    {
+        h.flags = DSB_STORED;
+        h.size = raw;
+        memcpy(payload, x, (size_t)rows*DSB_XCOLS*4);
+        memcpy(payload + (size_t)rows*DSB_XCOLS*4, y, (size_t)rows*DSB_YCOLS*4);
+    }
+    memcpy(out, &h, sizeof(dsbheader));
+    return sizeof(dsbheader) + h.size;
+}
+
+int dsbDecode(const dsbheader* h, const uint8_t* payload, float* x, float* y)
+{
+    const size_t nw = (size_t)h->rows * DSB_COLS;
+    const size_t raw = nw * 4;
+    if(h->flags & DSB_STORED)
+    {
+        if(h->size != raw)
+            return -1;
+        memcpy(x, payload, (size_t)h->rows*DSB_XCOLS*4);
+        memcpy(y, payload + (size_t)h->rows*DSB_XCOLS*4, (size_t)h->rows*DSB_YCOLS*4);
+    }
+    else
+    {
+        uint8_t* planes = malloc(raw + 1);
+        if(planes == NULL)
+            return -1;
+        if(dsbLzDecompress(payload, h->size, planes, raw) < 0)
+        {
+            free(planes);
+            return -1;
+        }
+        for(uint32_t c = 0; c < DSB_COLS; c++)
+        {
+            float* dst = c < DSB_XCOLS ? x + c : y + (c - DSB_XCOLS);
+            const uint32_t stride = c < DSB_XCOLS ? DSB_XCOLS : DSB_YCOLS;
+            uint32_t prev = 0, pdelta = 0;
+            for(uint32_t i = 0; i < h->rows; i++)
+            {
+                const size_t k = (size_t)c*h->rows + i;
+                const uint32_t d = (uint32_t)planes[k] | ((uint32_t)planes[nw + k] << 8) | ((uint32_t)planes[2*nw + k] << 16) | ((uint32_t)planes[3*nw + k] << 24);
+                pdelta += (d >> 1) ^ (0u - (d & 1));
+                prev += pdelta;
+                memcpy(dst + (size_t)i*stride, &prev, 4);
+            }
+        }
+        free(planes);
+    }
+    const uint32_t sum = dsbChecksum(dsbChecksum(2166136261u, (const uint8_t*)x, (size_t)h->rows*DSB_XCOLS*4), (const uint8_t*)y, (size_t)h->rows*DSB_YCOLS*4);
+    return sum == h->checksum ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,259 @@
+/*
+    Binary event log.
+
+    Fixed 64 byte records pushed into a per-instance ring by the
+    simulation thread and written out by a background flusher thread, so
+    the hot loop never formats text or makes a syscall for an event. The
+    ring never blocks; if the flusher falls a whole ring behind, new
+    records are dropped and counted in the trailer.
+
+    File format (little-endian):
+
+        evheader  header
+        evrec     records[]
+        evrec     trailer    type EV_CLOSE, v[0] = records dropped (absent if killed)
+
+    evlogAppend() carries on an existing log, for a resumed run; it keeps
+    the header and the first records and writes on after them, so a
+    trailer may also turn up before the end.
+
+    evdump/ decodes these, and lists the rounds in them as an index.
+
+    Usage:
+
+        evlog el;
+        if(evlogOpen(&el, "events.pev", seed, EVLOG_FLAG_FAST) == 0)
+        {
+            evlogPush(&el, &(evrec){.type = EV_ROUND_START, ...});
+            evlogClose(&el);
+        }
+*/
+
+#ifndef EVLOG_H
+#define EVLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define EVLOG_MAGIC   0x31564550 // "PEV1"
+#define EVLOG_VERSION 1
+#define EVLOG_RING    4096       // records, power of two
+#define EVLOG_FLUSH_US 20000     // flusher wake interval
+
+#define EVLOG_FLAG_FAST   1      // t advances in virtual time, otherwise it is wall clock seconds
+#define EVLOG_FLAG_GUI    2
+
+// record types and their payload
+#define EV_GAME_START    1 // v: capture stride, keep probability, min change sr, sp, angle, dist (porydrivecli)
+#define EV_ROUND_START   2 // v: start_dist, zs, zt, zp.x, zp.y, pp.x, pp.y
+#define EV_ROUND_END     3 // v: score terms[5] (startdist, poryspeed, porytwitch, timetaken, collisions), score, round time, start_dist
+#define EV_ROUND_TIMEOUT 4 // v: round time, start_dist, final distance
+#define EV_COLLISION     5 // v: pp.x, pp.y, sp
+#define EV_ROUND_LOGGED  6 // v: score, rows, ticks offered to the logger
+#define EV_CPS           7 // v: cycles per second
+#define EV_WATCHDOG      8 // v: cycles per second that tripped it
+#define EV_GAME_END      9 // v: game time
+#define EV_CLOSE        15 // v: records dropped
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    int32_t  pid;
+    uint32_t flags;   // EVLOG_FLAG_*
+    double   start;   // wall clock seconds at open
+    uint64_t seed;    // game seed at open
+    uint8_t  reserved[32];
+} evheader; // 64 bytes
+
+typedef struct
+{
+    uint16_t type;    // EV_*
+    uint16_t flags;   // reserved
+    uint32_t round;   // round index in this instance
+    uint64_t seed;    // game seed
+    double   t;       // simulation time
+    uint32_t cc;      // collisions in the round so far, the whole round for EV_ROUND_END
+    uint32_t cp;      // porygon collected in the game so far
+    float    v[8];    // payload, see EV_*
+} evrec; // 64 bytes
+
+typedef struct
+{
+    int fd;
+    evrec* ring;
+    uint64_t head;    // written by the producer
+    uint64_t tail;    // written by the flusher
+    uint64_t dropped;
+    uint64_t base;    // records already in the file when it was opened
+    volatile int run;
+    pthread_t th;
+} evlog;
+
+int  evlogOpen(evlog* l, const char* file, const uint64_t seed, const uint32_t flags); // 0 on success
+int  evlogAppend(evlog* l, const char* file, const uint64_t seed, const uint32_t flags, const uint64_t records); // keeps at most the first records, a missing or empty file is opened as new
+void evlogPush(evlog* l, const evrec* r); // never blocks
+void evlogClose(evlog* l);                // flushes everything, writes the trailer
+
+//
+
+static void evlogFlush(evlog* l)
+{
+    const uint64_t h = __atomic_load_n(&l->head, __ATOMIC_ACQUIRE);
+    uint64_t t = l->tail;
+    while(t < h)
+    {
+        // contiguous run up to the end of the ring
+        const uint64_t i = t & (EVLOG_RING-1);
+        uint64_t n = h - t;
+        if(n > EVLOG_RING - i){n = EVLOG_RING - i;}
+        const char* p = (const char*)&l->ring[i];
+        size_t len = n * sizeof(evrec);
+        while(len > 0)
+        {
+            const ssize_t wb = write(l->fd, p, len);
+            if(wb <= 0)
+                break;
+            p += wb;
+            len -= wb;
+        }
+        t += n;
+        __atomic_store_n(&l->tail, t, __ATOMIC_RELEASE);
+    }
+}
+
+static void* evlogThread(void* arg)
+{
+    evlog* l = arg;
+    while(l->run == 1)
+    {
+        evlogFlush(l);
+        usleep(EVLOG_FLUSH_US);
+    }
+    evlogFlush(l);
+    return NULL;
+}
+
+static int evlogStart(evlog* l)
+{
+    l->run = 1;
+    if(pthread_create(&l->th, NULL, evlogThread, l) != 0)
+    {
+        free(l->ring);
+        l->ring = NULL;
+        close(l->fd);
+        return -1;
+    }
+    return 0;
+}
+
+int evlogOpen(evlog* l, const char* file, const uint64_t seed, const uint32_t flags)
+{
+    memset(l, 0, sizeof(evlog));
+    l->fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(l->fd == -1)
+        return -1;
+    l->ring = malloc(EVLOG_RING * sizeof(evrec));
+    if(l->ring == NULL)
+    {
+        close(l->fd);
+        return -1;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    evheader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = EVLOG_MAGIC;
+    h.version = EVLOG_VERSION;
+    h.record_size = sizeof(evrec);
+    h.pid = getpid();
+    h.flags = flags;
+    h.start = (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+    h.seed = seed;
+    if(write(l->fd, &h, sizeof(h)) != sizeof(h))
+    {
+        free(l->ring);
+        close(l->fd);
+        return -1;
+    }
+    return evlogStart(l);
+}
+
+int evlogAppend(evlog* l, const char* file, const uint64_t seed, const uint32_t flags, const uint64_t records)
+{
+    memset(l, 0, sizeof(evlog));
+    l->fd = open(file, O_RDWR | O_CLOEXEC);
+    if(l->fd == -1)
+        return evlogOpen(l, file, seed, flags);
+    evheader h;
+    const ssize_t rb = pread(l->fd, &h, sizeof(h), 0);
+    if(rb == 0)
+    {
+        close(l->fd);
+        return evlogOpen(l, file, seed, flags);
+    }
+    if(rb != sizeof(h) || h.magic != EVLOG_MAGIC || h.version != EVLOG_VERSION || h.record_size != sizeof(evrec))
+    {
+        close(l->fd);
+        return -1;
+    }
+
+    // whatever came after the records kept goes, a torn record from a kill included
+    const off_t end = lseek(l->fd, 0, SEEK_END);
+    l->base = end > (off_t)sizeof(h) ? (end - sizeof(h)) / sizeof(evrec) : 0;
+    if(l->base > records){l->base = records;}
+    const off_t keep = sizeof(h) + l->base * sizeof(evrec);
+    if(end < 0 || ftruncate(l->fd, keep) == -1 || lseek(l->fd, keep, SEEK_SET) != keep)
+    {
+        close(l->fd);
+        return -1;
+    }
+    l->ring = malloc(EVLOG_RING * sizeof(evrec));
+    if(l->ring == NULL)
+    {
+        close(l->fd);
+        return -1;
+    }
+    return evlogStart(l);
+}
+
+void evlogPush(evlog* l, const evrec* r)
+{
+    if(l->ring == NULL)
+        return;
+    const uint64_t h = l->head;
+    if(h - __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE) >= EVLOG_RING)
+    {
+        l->dropped++;
+        return;
+    }
+    l->ring[h & (EVLOG_RING-1)] = *r;
+    __atomic_store_n(&l->head, h+1, __ATOMIC_RELEASE);
+}
+
+void evlogClose(evlog* l)
+{
+    if(l->ring == NULL)
+        return;
+    l->run = 0;
+    pthread_join(l->th, NULL);
+    evrec tr;
+    memset(&tr, 0, sizeof(tr));
+    tr.type = EV_CLOSE;
+    tr.v[0] = (float)l->dropped;
+    if(write(l->fd, &tr, sizeof(tr)) != sizeof(tr))
+        fprintf(stderr, "Event log trailer write failed.\n");
+    close(l->fd);
+    free(l->ring);
+    memset(l, 0, sizeof(evlog));
+}
+
+#endif
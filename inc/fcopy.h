@@ -0,0 +1,95 @@
+/*
+    Kernel-side file range copies.
+
+    fcopyRange() copies a byte range between files with copy_file_range(),
+    so the data never passes through userspace and filesystems that share
+    extents (Btrfs, XFS, bcachefs, NFS 4.2 server side copy) can do it
+    without any I/O. It falls back to read/write where that is unsupported
+    (older kernels, copies across filesystems).
+
+    fcopyClone() reflinks a whole file with FICLONE; it fails on filesystems
+    that can not share extents, callers then use fcopyRange().
+*/
+
+#ifndef FCOPY_H
+#define FCOPY_H
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+    #include <linux/fs.h>
+#endif
+
+int fcopyRange(const int in, off_t in_off, const int out, size_t len); // appends at the output's file position, 0 on success
+int fcopyClone(const int in, const int out); // 0 on success
+
+//
+
+static int fcopyFallback(const int in, off_t in_off, const int out, size_t len)
+{
+    char buf[1 << 16];
+    while(len > 0)
+    {
+        const ssize_t rb = pread(in, buf, len < sizeof(buf) ? len : sizeof(buf), in_off);
+        if(rb <= 0)
+            return -1;
+        const char* p = buf;
+        ssize_t left = rb;
+        while(left > 0)
+        {
+            const ssize_t wb = write(out, p, left);
+            if(wb <= 0)
+                return -1;
+            p += wb;
+            left -= wb;
+        }
+        in_off += rb;
+        len -= rb;
+    }
+    return 0;
+}
+
+int fcopyRange(const int in, off_t in_off, const int out, size_t len)
+{
+#ifdef __linux__
+    while(len > 0)
+    {
+        const ssize_t cb = copy_file_range(in, &in_off, out, NULL, len, 0);
+        if(cb > 0)
+        {
+            len -= cb;
+            continue;
+        }
+        if(cb == 0) // the input is shorter than asked for
+            return -1;
+        if(errno == EINTR)
+            continue;
+        if(errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)
+            break;
+        return -1;
+    }
+    if(len == 0)
+        return 0;
+#endif
+    return fcopyFallback(in, in_off, out, len);
+}
+
+int fcopyClone(const int in, const int out)
+{
+#if defined(__linux__) && defined(FICLONE)
+    return ioctl(out, FICLONE, in) == 0 ? 0 : -1;
+#else
+    (void)in, (void)out;
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+    Portable Feed-forward Neural Network (FNN) inference.
+
+    Loads the `.fnn` files written by export.py (or by any of the native
+    tools) and evaluates them on the CPU, no Tensorflow required.
+
+    File format (little-endian):
+
+        uint32 magic      FNN_MAGIC ("FNN1")
+        uint32 layers     number of Dense layers
+        per layer:
+            uint32 in     input units
+            uint32 out    output units
+            uint32 act    FNN_ACT_* activation
+            float  w[in*out]  kernel, row-major [in][out] (the Keras layout)
+            float  b[out]     bias
+
+    Usage:
+
+        fnn net;
+        if(fnnLoad(&net, "policy.fnn") == 0)
+        {
+            float out[2];
+            fnnEval(&net, input, out);
+            fnnFree(&net);
+        }
+*/
+
+#ifndef FNN_H
+#define FNN_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FNN_MAGIC 0x314E4E46 // "FNN1"
+
+#define FNN_ACT_LINEAR   0
+#define FNN_ACT_TANH     1
+#define FNN_ACT_RELU     2
+#define FNN_ACT_SELU     3
+#define FNN_ACT_SIGMOID  4
+#define FNN_ACT_SOFTSIGN 5
+#define FNN_ACT_ELU      6
+
+typedef struct
+{
+    uint32_t n_in, n_out, act;
+    float* w; // [n_in][n_out]
+    float* b; // [n_out]
+} fnnlayer;
+
+typedef struct
+{
+    uint32_t layers;
+    uint32_t max_units; // widest layer, sizes the evaluation scratch
+    fnnlayer* l;
+} fnn;
+
+int  fnnLoad(fnn* net, const char* file); // 0 on success
+int  fnnSave(const fnn* net, const char* file);
+int  fnnAlloc(fnn* net, const uint32_t layers, const uint32_t* units, const uint32_t* acts); // units[layers+1], acts[layers], zeroed weights
+void fnnFree(fnn* net);
+void fnnEval(const fnn* net, const float* in, float* out);
+size_t fnnParams(const fnn* net);                  // total weights + biases
+void fnnGetParams(const fnn* net, float* p);       // flatten in file order
+void fnnSetParams(fnn* net, const float* p);
+
+//
+
+static inline float fnnActivate(const uint32_t act, const float x)
+{
+    switch(act)
+    {
+        case FNN_ACT_TANH:     return tanhf(x);
+        case FNN_ACT_RELU:     return x > 0.f ? x : 0.f;
+        case FNN_ACT_SELU:     return x > 0.f ? 1.050700987f * x : 1.758099341f * (expf(x) - 1.f);
+        case FNN_ACT_SIGMOID:  return 1.f / (1.f + expf(-x));
+        case FNN_ACT_SOFTSIGN: return x / (1.f + fabsf(x));
+        case FNN_ACT_ELU:      return x > 0.f ? x : expf(x) - 1.f;
+        default:               return x;
+    }
+}
+
+void fnnFree(fnn* net)
+{
+    if(net->l != NULL)
+    {
+        for(uint32_t i = 0; i < net->layers; i++)
+        {
+            free(net->l[i].w);
+            free(net->l[i].b);
+        }
+        free(net->l);
+    }
+    memset(net, 0, sizeof(fnn));
+}
+
+int fnnAlloc(fnn* net, const uint32_t layers, const uint32_t* units, const uint32_t* acts)
+{
+    memset(net, 0, sizeof(fnn));
+    if(layers == 0)
+        return -1;
+    net->l = calloc(layers, sizeof(fnnlayer));
+    if(net->l == NULL)
+        return -1;
+    net->layers = layers;
+    for(uint32_t i = 0; i < layers; i++)
+    {
+        fnnlayer* l = &net->l[i];
+        if(units[i] == 0 || units[i+1] == 0)
+        {
+            fnnFree(net);
+            return -1;
+        }
+        l->n_in = units[i], l->n_out = units[i+1], l->act = acts[i];
+        l->w = calloc(l->n_in * l->n_out, sizeof(float));
+        l->b = calloc(l->n_out, sizeof(float));
+        if(l->w == NULL || l->b == NULL)
+        {
+            fnnFree(net);
+            return -1;
+        }
+        if(l->n_in > net->max_units){net->max_units = l->n_in;}
+        if(l->n_out > net->max_units){net->max_units = l->n_out;}
+    }
+    return 0;
+}
+
+int fnnSave(const fnn* net, const char* file)
+{
+    FILE* f = fopen(file, "wb");
+    if(f == NULL)
+        return -1;
+    const uint32_t hdr[2] = {FNN_MAGIC, net->layers};
+    int r = fwrite(hdr, sizeof(uint32_t), 2, f) == 2;
+    for(uint32_t i = 0; r && i < net->layers; i++)
+    {
+        const fnnlayer* l = &net->l[i];
+        const uint32_t ld[3] = {l->n_in, l->n_out, l->act};
+        r = fwrite(ld, sizeof(uint32_t), 3, f) == 3 &&
+            fwrite(l->w, sizeof(float), l->n_in * l->n_out, f) == l->n_in * l->n_out &&
+            fwrite(l->b, sizeof(float), l->n_out, f) == l->n_out;
+    }
+    if(fclose(f) != 0 || r == 0)
+        return -1;
+    return 0;
+}
+
+size_t fnnParams(const fnn* net)
+{
+    size_t n = 0;
+    for(uint32_t i = 0; i < net->layers; i++)
+        n += (size_t)net->l[i].n_in * net->l[i].n_out + net->l[i].n_out;
+    return n;
+}
+
+void fnnGetParams(const fnn* net, float* p)
+{
+    for(uint32_t i = 0; i < net->layers; i++)
+    {
+        const fnnlayer* l = &net->l[i];
+        memcpy(p, l->w, l->n_in * l->n_out * sizeof(float));
+        p += l->n_in * l->n_out;
+        memcpy(p, l->b, l->n_out * sizeof(float));
+        p += l->n_out;
+    }
+}
+
+void fnnSetParams(fnn* net, const float* p)
+{
+    for(uint32_t i = 0; i < net->layers; i++)
+    {
+        fnnlayer* l = &net->l[i];
+        memcpy(l->w, p, l->n_in * l->n_out * sizeof(float));
+        p += l->n_in * l->n_out;
+        memcpy(l->b, p, l->n_out * sizeof(float));
+        p += l->n_out;
+    }
+}
+
+int fnnLoad(fnn* net, const char* file)
+{
+    memset(net, 0, sizeof(fnn));
+    FILE* f = fopen(file, "rb");
+    if(f == NULL)
+        return -1;
+
+    uint32_t hdr[2];
+    if(fread(hdr, sizeof(uint32_t), 2, f) != 2 || hdr[0] != FNN_MAGIC || hdr[1] == 0 || hdr[1] > 1024)
+    {
+        fclose(f);
+        return -1;
+    }
+
+    net->l = calloc(hdr[1], sizeof(fnnlayer));
+    if(net->l == NULL)
+    {
+        fclose(f);
+        return -1;
+    }
+    net->layers = hdr[1];
+
+    for(uint32_t i = 0; i < net->layers; i++)
+    {
+        fnnlayer* l = &net->l[i];
+        uint32_t ld[3];
+        if(fread(ld, sizeof(uint32_t), 3, f) != 3 || ld[0] == 0 || ld[1] == 0 || (i > 0 && ld[0] != net->l[i-1].n_out))
+            goto fail;
+        l->n_in = ld[0], l->n_out = ld[1], l->act = ld[2];
+        l->w = malloc(l->n_in * l->n_out * sizeof(float));
+        l->b = malloc(l->n_out * sizeof(float));
+        if(l->w == NULL || l->b == NULL)
+            goto fail;
+        if(fread(l->w, sizeof(float), l->n_in * l->n_out, f) != l->n_in * l->n_out)
+            goto fail;
+        if(fread(l->b, sizeof(float), l->n_out, f) != l->n_out)
+            goto fail;
+        if(l->n_in > net->max_units){net->max_units = l->n_in;}
+        if(l->n_out > net->max_units){net->max_units = l->n_out;}
+    }
+
+    fclose(f);
+    return 0;
+
+fail:
+    fclose(f);
+    fnnFree(net);
+    return -1;
+}
+
+void fnnEval(const fnn* net, const float* in, float* out)
+{
+    // two ping-pong activation buffers on the stack, so this is thread safe
+    float buf[2][net->max_units];
+    const float* x = in;
+    for(uint32_t i = 0; i < net->layers; i++)
+    {
+        const fnnlayer* l = &net->l[i];
+        float* y = (i == net->layers-1) ? out : buf[i & 1];
+        memcpy(y, l->b, l->n_out * sizeof(float));
+        for(uint32_t j = 0; j < l->n_in; j++)
+        {
+            const float xj = x[j];
+            const float* w = &l->w[j * l->n_out];
+            for(uint32_t k = 0; k < l->n_out; k++) // row-major kernel keeps this loop contiguous and vectorisable
+                y[k] += xj * w[k];
+        }
+        if(l->act != FNN_ACT_LINEAR)
+            for(uint32_t k = 0; k < l->n_out; k++)
+                y[k] = fnnActivate(l->act, y[k]);
+        x = y;
+    }
+}
+
+#endif
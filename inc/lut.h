@@ -0,0 +1,183 @@
+/*
+    Interpolated lookup-table policy.
+
+    The six FNN inputs (pbd.x, pbd.y, lad.x, lad.y, angle, dist) only span
+    three degrees of freedom; the car heading, the bearing from the porygon
+    to the car and the distance between them. A `.lut` file holds a policy
+    sampled on a regular grid over those three parameters and lutEval()
+    answers sr/sp with trilinear interpolation, which is a handful of loads
+    and multiplies regardless of how large the network it was baked from was.
+
+    Axes:
+
+        heading  h = atan2(pbd.y, pbd.x)  nh nodes over [-PI, PI), periodic
+        bearing  b = atan2(lad.y, lad.x)  nb nodes over [-PI, PI), periodic
+        distance d = vDist(pp, zp)        nd nodes over [0, dmax], the node
+                                          spacing is square-root warped so
+                                          that short distances, where the
+                                          speed switching happens, get most
+                                          of the resolution.
+
+    File format (little-endian):
+
+        uint32 magic      LUT_MAGIC ("PLU1")
+        uint32 nh, nb, nd
+        float  dmax
+        float  data[nh][nb][nd][2]  sr, sp
+
+    lutcompile/ bakes these from a `.fnn` model.
+*/
+
+#ifndef LUT_H
+#define LUT_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LUT_MAGIC 0x31554C50 // "PLU1"
+#define LUT_PI  3.14159265f
+#define LUT_2PI 6.28318531f
+
+typedef struct
+{
+    uint32_t nh, nb, nd;
+    float dmax;
+    float* data; // [nh][nb][nd][2]
+} lut;
+
+int  lutAlloc(lut* t, const uint32_t nh, const uint32_t nb, const uint32_t nd, const float dmax);
+int  lutLoad(lut* t, const char* file);
+int  lutSave(const lut* t, const char* file);
+void lutFree(lut* t);
+void lutNode(const lut* t, const uint32_t ih, const uint32_t ib, const uint32_t id, float* input); // grid node to an FNN input vector
+void lutEval(const lut* t, const float* input, float* out); // FNN input vector to sr/sp
+
+//
+
+// minimax polynomial atan2, max error ~1e-5 radians which is well below a table cell
+static inline float lutAtan2(const float y, const float x)
+{
+    const float ax = fabsf(x), ay = fabsf(y);
+    const float mx = ax > ay ? ax : ay;
+    if(mx == 0.f)
+        return 0.f;
+    const float a = (ax < ay ? ax : ay) / mx;
+    const float s = a*a;
+    float r = ((((-0.01172120f*s + 0.05265332f)*s - 0.11643287f)*s + 0.19354346f)*s - 0.33262347f)*s*a + 0.99997726f*a;
+    if(ay > ax){r = 1.57079637f - r;}
+    if(x < 0.f){r = LUT_PI - r;}
+    if(y < 0.f){r = -r;}
+    return r;
+}
+
+int lutAlloc(lut* t, const uint32_t nh, const uint32_t nb, const uint32_t nd, const float dmax)
+{
+    memset(t, 0, sizeof(lut));
+    if(nh < 2 || nb < 2 || nd < 2 || dmax <= 0.f)
+        return -1;
+    t->data = malloc((size_t)nh * nb * nd * 2 * sizeof(float));
+    if(t->data == NULL)
+        return -1;
+    t->nh = nh, t->nb = nb, t->nd = nd, t->dmax = dmax;
+    return 0;
+}
+
+void lutFree(lut* t)
+{
+    free(t->data);
+    memset(t, 0, sizeof(lut));
+}
+
+int lutLoad(lut* t, const char* file)
+{
+    memset(t, 0, sizeof(lut));
+    FILE* f = fopen(file, "rb");
+    if(f == NULL)
+        return -1;
+    uint32_t hdr[4];
+    float dmax;
+    if(fread(hdr, sizeof(uint32_t), 4, f) != 4 || fread(&dmax, sizeof(float), 1, f) != 1 || hdr[0] != LUT_MAGIC ||
+        lutAlloc(t, hdr[1], hdr[2], hdr[3], dmax) < 0)
+    {
+        fclose(f);
+        return -1;
+    }
+    const size_t n = (size_t)t->nh * t->nb * t->nd * 2;
+    if(fread(t->data, sizeof(float), n, f) != n)
+    {
+        fclose(f);
+        lutFree(t);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int lutSave(const lut* t, const char* file)
+{
+    FILE* f = fopen(file, "wb");
+    if(f == NULL)
+        return -1;
+    const uint32_t hdr[4] = {LUT_MAGIC, t->nh, t->nb, t->nd};
+    const size_t n = (size_t)t->nh * t->nb * t->nd * 2;
+    const int r = fwrite(hdr, sizeof(uint32_t), 4, f) == 4 &&
+                  fwrite(&t->dmax, sizeof(float), 1, f) == 1 &&
+                  fwrite(t->data, sizeof(float), n, f) == n;
+    if(fclose(f) != 0 || r == 0)
+        return -1;
+    return 0;
+}
+
+void lutNode(const lut* t, const uint32_t ih, const uint32_t ib, const uint32_t id, float* input)
+{
+    const float h = -LUT_PI + LUT_2PI * (float)ih / (float)t->nh;
+    const float b = -LUT_PI + LUT_2PI * (float)ib / (float)t->nb;
+    const float u = (float)id / (float)(t->nd-1);
+    input[0] = cosf(h);
+    input[1] = sinf(h);
+    input[2] = cosf(b);
+    input[3] = sinf(b);
+    input[4] = input[0]*input[2] + input[1]*input[3];
+    input[5] = u*u*t->dmax;
+}
+
+void lutEval(const lut* t, const float* input, float* out)
+{
+    // continuous grid coordinates
+    const float fh = (lutAtan2(input[1], input[0]) + LUT_PI) * ((float)t->nh / LUT_2PI);
+    const float fb = (lutAtan2(input[3], input[2]) + LUT_PI) * ((float)t->nb / LUT_2PI);
+    float u = input[5] > 0.f ? sqrtf(input[5] / t->dmax) : 0.f;
+    if(u > 1.f){u = 1.f;}
+    const float fd = u * (float)(t->nd-1);
+
+    // cell corners, heading and bearing wrap around
+    uint32_t h0 = (uint32_t)fh, b0 = (uint32_t)fb, d0 = (uint32_t)fd;
+    if(h0 >= t->nh){h0 = t->nh-1;}
+    if(b0 >= t->nb){b0 = t->nb-1;}
+    if(d0 >= t->nd-1){d0 = t->nd-2;}
+    const uint32_t h1 = h0+1 == t->nh ? 0 : h0+1;
+    const uint32_t b1 = b0+1 == t->nb ? 0 : b0+1;
+    const float wh = fh - (float)h0, wb = fb - (float)b0, wd = fd - (float)d0;
+
+    // d is the innermost axis so each (h,b) pair is one contiguous run of 4 floats
+    const size_t sb = (size_t)t->nd * 2, sh = sb * t->nb;
+    const float* c00 = &t->data[h0*sh + b0*sb + d0*2];
+    const float* c01 = &t->data[h0*sh + b1*sb + d0*2];
+    const float* c10 = &t->data[h1*sh + b0*sb + d0*2];
+    const float* c11 = &t->data[h1*sh + b1*sb + d0*2];
+    for(int k = 0; k < 2; k++)
+    {
+        const float v00 = c00[k] + (c00[k+2] - c00[k]) * wd;
+        const float v01 = c01[k] + (c01[k+2] - c01[k]) * wd;
+        const float v10 = c10[k] + (c10[k+2] - c10[k]) * wd;
+        const float v11 = c11[k] + (c11[k+2] - c11[k]) * wd;
+        const float v0 = v00 + (v01 - v00) * wb;
+        const float v1 = v10 + (v11 - v10) * wb;
+        out[k] = v0 + (v1 - v0) * wh;
+    }
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+    Live simulator metrics in shared memory.
+
+    Every porydrivecli maps a small fixed-layout struct at
+    /dev/shm/porydrive_metrics.<pid> and bumps its counters in place, which
+    costs the simulator nothing more than a few stores. porydrive-top maps
+    all of them read-only and aggregates them while they run.
+
+    There is a single writer per segment and every counter is a naturally
+    aligned 64-bit word, so readers never see torn values; they may see a
+    round counted before its samples, which is fine for monitoring.
+
+    A segment is removed when its process exits normally, porydrive-top
+    removes the ones left behind by processes that were killed.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define METRICS_MAGIC   0x3154454D // "MET1"
+#define METRICS_DIR     "/dev/shm"
+#define METRICS_PREFIX  "porydrive_metrics."
+#define METRICS_BUCKETS 11 // score buckets 0.0 to 1.0, as the file names round them
+
+#define METRICS_FLAG_FAST   1
+#define METRICS_FLAG_STREAM 2
+#define METRICS_FLAG_DAGGER 4
+
+typedef struct
+{
+    uint32_t magic;
+    int32_t pid;
+    uint32_t flags;         // METRICS_FLAG_*
+    uint32_t cps;           // cycles in the last whole second
+    double start;           // wall clock seconds
+    double heartbeat;       // wall clock of the last per-second update
+
+    uint64_t ticks;         // simulation steps
+    uint64_t rounds;        // porygon collected
+    uint64_t timeouts;      // rounds that took too long
+    uint64_t rounds_logged[METRICS_BUCKETS];
+    uint64_t samples;       // rows written
+    uint64_t bytes;         // bytes written, files or stream
+    uint64_t lock_waits;    // bucket file locks taken
+    uint64_t lock_wait_ns;  // time spent waiting for them
+    uint64_t near_misses;   // paced seconds that came close to the CPS watchdog
+} metrics;
+
+metrics* metricsCreate(); // NULL if shared memory is unavailable, the caller carries on without
+void metricsRemove(metrics* m);
+int metricsBucket(const float score); // bucket index of a score, the nearest tenth like the bucket file names
+
+//
+
+static inline void metricsPath(char* path, const int pid)
+{
+    sprintf(path, "%s/%s%d", METRICS_DIR, METRICS_PREFIX, pid);
+}
+
+metrics* metricsCreate()
+{
+    char path[64];
+    metricsPath(path, getpid());
+    const int f = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(f == -1)
+        return NULL;
+    if(ftruncate(f, sizeof(metrics)) == -1)
+    {
+        close(f);
+        unlink(path);
+        return NULL;
+    }
+    metrics* m = mmap(NULL, sizeof(metrics), PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+    {
+        unlink(path);
+        return NULL;
+    }
+    memset(m, 0, sizeof(metrics));
+    m->pid = getpid();
+    m->magic = METRICS_MAGIC;
+    return m;
+}
+
+void metricsRemove(metrics* m)
+{
+    if(m == NULL)
+        return;
+    char path[64];
+    metricsPath(path, m->pid);
+    munmap(m, sizeof(metrics));
+    unlink(path);
+}
+
+int metricsBucket(const float score)
+{
+    int b = (int)(score * 10.f + 0.5f);
+    if(b < 0){b = 0;}
+    if(b >= METRICS_BUCKETS){b = METRICS_BUCKETS-1;}
+    return b;
+}
+
+#endif
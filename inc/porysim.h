@@ -0,0 +1,565 @@
+/*
+    Re-entrant PoryDrive simulation core.
+
+    The car, porygon and cube lattice simulation from multicapturecli with
+    all of its state in one struct, including the random number generator,
+    so that any number of independent instances can be stepped from any
+    number of threads. Every instance is fully determined by its seed.
+
+    Requires vec.h.
+
+    The arena and its cubes are the config's world (psimworld.h), NULL for
+    the game's arena. Collisions only test the cubes in the grid cells
+    around the car and the porygon, so a tick costs the same in a world of
+    any size.
+
+    One tick is split in three so that callers can log between the update
+    and the collision pass, exactly as the capture code always has:
+
+        psimAutoDrive(&s, &cfg);              // or set s.sr / s.sp yourself
+        s.t += dt;
+        const int e = psimUpdate(&s, &cfg, dt);
+        if(e == PSIM_TIMEOUT || e == PSIM_RESPAWN)
+            return;                           // new round, nothing to collide
+        if(e == PSIM_COLLECTED)
+            score = psimRoundScore(&s);
+        ...                                   // log psimObserve() etc.
+        psimCollide(&s, &cfg);
+
+    psimStep() does all of that for callers that don't need to.
+
+    The four physics presets of the game are profiles; for each one the
+    tick is generated with its car physics as compile-time constants (the
+    *T templates below are inlined with a pointer to a static const config,
+    so the loads fold and the sticky_collisions branch disappears).
+    psimProfile() picks the specialised functions for a config whose car
+    physics match a preset, or the generic ones that read the config every
+    tick, which is what a config.txt gets:
+
+        const psimprofile* p = psimProfile(&cfg);
+        p->autodrive(&s, &cfg);
+        const int e = p->update(&s, &cfg, dt);
+        p->collide(&s, &cfg);
+
+    psimStep() looks the profile up every tick, loops that step one config
+    for many ticks resolve it once and call psimStepP(p, ...) instead.
+
+    The auto drive variables are always read from the config, porydrivecli
+    randomises them per game.
+*/
+
+#ifndef PORYSIM_H
+#define PORYSIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "psimworld.h"
+
+#define PSIM_NONE      0
+#define PSIM_TIMEOUT   1 // round exceeded 60 seconds, a new porygon was spawned
+#define PSIM_COLLECTED 2 // porygon collected this tick, rtime/rcc hold the round stats
+#define PSIM_RESPAWN   3 // the collected porygon has respawned, a new round started
+
+typedef struct
+{
+    // car physics
+    float maxspeed;
+    float acceleration;
+    float inertia;
+    float drag;
+    float steeringspeed;
+    float steerinertia;
+    float minsteer;
+    float maxsteer;
+    float steering_deadzone;
+    float steeringtransfer;
+    float steeringtransferinertia;
+    unsigned int sticky_collisions;
+
+    // auto drive
+    float ad_min_dstep;
+    float ad_max_dstep;
+    float ad_min_speedswitch;
+    float ad_maxspeed_reductor;
+
+    const psimworld* world; // NULL for psimWorldClassic()
+} psimcfg;
+
+typedef struct
+{
+    // player
+    float pr; // rotation
+    float sr; // steering rotation
+    vec pp;   // position
+    vec pv;   // velocity
+    vec pd;   // wheel direction
+    vec pbd;  // body direction
+    float sp; // speed
+    unsigned int cp; // collected porygon count
+    unsigned int cc; // collision count
+
+    // porygon
+    vec zp;   // position
+    vec zd;   // direction
+    float zr; // rotation
+    float zs; // speed
+    double za;// alive state
+    float zt; // twitch radius
+
+    // round
+    double t;                // simulation time
+    double round_start_time;
+    float start_dist;
+    double rtime;            // last collected round; time taken
+    unsigned int rcc;        // last collected round; collisions
+
+    // internal
+    float ad_ld, ad_td;      // auto drive state machine
+    float colliding;         // id of the cube currently counted as a collision, 0 for none
+    uint32_t rng;            // per-instance seir random state
+} psim;
+
+#define PSIM_ORIGINAL    0
+#define PSIM_SCARLET     1
+#define PSIM_SCARLETFAST 2
+#define PSIM_HYBRID      3
+#define PSIM_PROFILES    4
+
+typedef struct
+{
+    const char* name;
+    const psimcfg* cfg; // NULL for the generic profile
+    void (*autodrive)(psim* s, const psimcfg* c);
+    int  (*update)(psim* s, const psimcfg* c, const float dt);
+    void (*collide)(psim* s, const psimcfg* c);
+} psimprofile;
+
+void  psimConfigProfile(psimcfg* c, const int profile); // PSIM_ORIGINAL etc.
+void  psimConfigScarletFast(psimcfg* c);
+const psimprofile* psimProfile(const psimcfg* c); // specialised if the car physics match a preset
+void  psimReset(psim* s, const psimworld* w, const uint32_t seed, const double t); // w NULL for the classic arena
+void  psimSpawn(psim* s, const psimworld* w);
+void  psimRebase(psim* s, const double t);      // moves the clock to t, for a restored state under a new time base
+void  psimAutoDrive(psim* s, const psimcfg* c);
+int   psimUpdate(psim* s, const psimcfg* c, const float dt);
+void  psimCollide(psim* s, const psimcfg* c);
+int   psimStep(psim* s, const psimcfg* c, const float dt);
+int   psimStepP(const psimprofile* p, psim* s, const psimcfg* c, const float dt); // psimStep() with p = psimProfile(c)
+void  psimObserve(const psim* s, float* input); // the 6 FNN inputs
+float psimRoundScore(const psim* s);            // 0-1 score of the last collected round
+float psimScore(const float start_dist, const float zs, const float zt, const double rtime, const unsigned int rcc, float* terms); // terms[5] may be NULL
+
+//
+
+// the seir generator is a bare multiply, seeds s and 2s give related streams and even states lose
+// period, so seeds are scrambled (splitmix32) and made odd before they become its state
+static inline uint32_t psimSeed(uint32_t x)
+{
+    x += 0x9E3779B9u;
+    x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+    x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+    x ^= x >> 16;
+    return x | 1u;
+}
+
+// https://www.musicdsp.org/en/latest/Other/273-fast-float-random-numbers.html
+static inline float psimRandf(psim* s)
+{
+    s->rng *= 16807;
+    return (float)(s->rng & 0x7FFFFFFF) * 4.6566129e-010f;
+}
+
+static inline float psimRandFloat(psim* s, const float min, const float max)
+{
+    return min + psimRandf(s) * (max-min);
+}
+
+// the presets of main.c, with the default auto drive
+#define PSIM_AUTODRIVE_DEFAULTS .ad_min_dstep = 0.01f, .ad_max_dstep = 0.06f, .ad_min_speedswitch = 2.f, .ad_maxspeed_reductor = 0.5f
+
+static const psimcfg psim_cfg_original = {
+    .maxspeed = 0.006f, .acceleration = 0.001f, .inertia = 0.0001f, .drag = 0.00038f,
+    .steeringspeed = 1.2f, .steerinertia = 233.f, .minsteer = 0.1f, .maxsteer = 0.7f,
+    .steering_deadzone = 0.013f, .steeringtransfer = 0.023f, .steeringtransferinertia = 280.f,
+    .sticky_collisions = 1, PSIM_AUTODRIVE_DEFAULTS};
+
+static const psimcfg psim_cfg_scarlet = {
+    .maxspeed = 0.0095f, .acceleration = 0.0025f, .inertia = 0.00015f, .drag = 0.00038f,
+    .steeringspeed = 1.2f, .steerinertia = 233.f, .minsteer = 0.32f, .maxsteer = 0.55f,
+    .steering_deadzone = 0.013f, .steeringtransfer = 0.023f, .steeringtransferinertia = 280.f,
+    .sticky_collisions = 0, PSIM_AUTODRIVE_DEFAULTS};
+
+static const psimcfg psim_cfg_scarletfast = {
+    .maxspeed = 0.0165f, .acceleration = 0.0028f, .inertia = 0.00022f, .drag = 0.00038f,
+    .steeringspeed = 1.4f, .steerinertia = 180.f, .minsteer = 0.16f, .maxsteer = 0.3f,
+    .steering_deadzone = 0.013f, .steeringtransfer = 0.023f, .steeringtransferinertia = 280.f,
+    .sticky_collisions = 0, PSIM_AUTODRIVE_DEFAULTS};
+
+static const psimcfg psim_cfg_hybrid = {
+    .maxspeed = 0.0165f, .acceleration = 0.0028f, .inertia = 0.00022f, .drag = 0.00038f,
+    .steeringspeed = 3.2f, .steerinertia = 233.f, .minsteer = 0.1f, .maxsteer = 0.2f,
+    .steering_deadzone = 0.013f, .steeringtransfer = 0.023f, .steeringtransferinertia = 280.f,
+    .sticky_collisions = 0, PSIM_AUTODRIVE_DEFAULTS};
+
+static const psimcfg* const psim_cfgs[PSIM_PROFILES] = {&psim_cfg_original, &psim_cfg_scarlet, &psim_cfg_scarletfast, &psim_cfg_hybrid};
+
+void psimConfigProfile(psimcfg* c, const int profile)
+{
+    *c = *psim_cfgs[profile >= 0 && profile < PSIM_PROFILES ? profile : PSIM_SCARLETFAST];
+}
+
+void psimConfigScarletFast(psimcfg* c)
+{
+    psimConfigProfile(c, PSIM_SCARLETFAST);
+}
+
+static inline const psimworld* psimWorld(const psimcfg* c)
+{
+    return c->world != NULL ? c->world : psimWorldClassic();
+}
+
+void psimSpawn(psim* s, const psimworld* w)
+{
+    if(w == NULL){w = psimWorldClassic();}
+    s->zp = (vec){psimRandFloat(s, -w->spawn, w->spawn), psimRandFloat(s, -w->spawn, w->spawn), 0.f};
+    s->zs = psimRandFloat(s, 0.3f, 1.f);
+    s->zt = psimRandFloat(s, 8.f, 16.f);
+    s->za = 0.0;
+
+    s->start_dist = vDist(s->pp, s->zp);
+    s->round_start_time = s->t;
+}
+
+void psimRebase(psim* s, const double t)
+{
+    const double d = t - s->t;
+    s->t = t;
+    s->round_start_time += d;
+    if(s->za != 0.0)
+        s->za += d;
+}
+
+void psimReset(psim* s, const psimworld* w, const uint32_t seed, const double t)
+{
+    memset(s, 0, sizeof(psim));
+    s->rng = psimSeed(seed);
+    s->t = t;
+    s->ad_td = 1.f;
+    psimSpawn(s, w);
+}
+
+// p is the car physics, c the auto drive variables
+static inline __attribute__((always_inline)) void psimAutoDriveT(psim* s, const psimcfg* p, const psimcfg* c)
+{
+    float tr = p->maxsteer * ((p->maxspeed-s->sp) * p->steerinertia);
+    if(tr < p->minsteer){tr = p->minsteer;}
+
+    // side winder 2, stochastic state machine "ai"
+    vec lad = s->pp;
+    vSub(&lad, lad, s->zp);
+    vNorm(&lad);
+    const float as = fabsf(vDot(s->pbd, lad)+1.f) * 0.5f;
+    const float d = vDist(s->pp, s->zp);
+    float ds = d * 0.01f;
+    if(ds < c->ad_min_dstep){ds = c->ad_min_dstep;}
+    else if(ds > c->ad_max_dstep){ds = c->ad_max_dstep;}
+    if(fabsf(s->ad_ld-d) > ds && s->ad_ld < d){s->ad_td *= -1.f;}
+    s->ad_ld = d;
+    s->sr = (tr * as) * s->ad_td;
+    if(d < c->ad_min_speedswitch)
+        s->sp = p->maxspeed * (d*c->ad_maxspeed_reductor)+0.003f;
+    else
+        s->sp = p->maxspeed;
+}
+
+// c is the car physics, w the world
+static inline __attribute__((always_inline)) int psimUpdateT(psim* s, const psimcfg* c, const psimworld* w, const float dt)
+{
+    const float b = w->size;
+
+    // simulate car
+    if(s->sp > 0.f)
+        s->sp -= c->drag * dt;
+    else
+        s->sp += c->drag * dt;
+
+    if(fabsf(s->sp) > c->maxspeed)
+    {
+        if(s->sp > 0.f)
+            s->sp = c->maxspeed;
+        else
+            s->sp = -c->maxspeed;
+    }
+
+    if(s->sp > c->inertia || s->sp < -c->inertia)
+    {
+        vAdd(&s->pp, s->pp, s->pv);
+        vMulS(&s->pv, s->pd, s->sp);
+        s->pr -= s->sr * c->steeringtransfer * (s->sp*c->steeringtransferinertia);
+    }
+
+    if(s->pp.x > b){s->pp.x = b;}
+    else if(s->pp.x < -b){s->pp.x = -b;}
+    if(s->pp.y > b){s->pp.y = b;}
+    else if(s->pp.y < -b){s->pp.y = -b;}
+
+    // new round if timelimit exceeded
+    const double roundtime = s->t - s->round_start_time;
+    if(roundtime >= 60.0)
+    {
+        psimSpawn(s, w);
+        return PSIM_TIMEOUT;
+    }
+
+    // simulate porygon
+    if(s->za == 0.0)
+    {
+        vec inc;
+        vMulS(&inc, s->zd, s->zs * dt);
+        vAdd(&s->zp, s->zp, inc);
+        s->zr += psimRandFloat(s, -s->zt, s->zt) * dt;
+
+        if(s->zp.x > b){s->zp.x = b; s->zr = psimRandFloat(s, -PI, PI);}
+        else if(s->zp.x < -b){s->zp.x = -b; s->zr = psimRandFloat(s, -PI, PI);}
+        if(s->zp.y > b){s->zp.y = b; s->zr = psimRandFloat(s, -PI, PI);}
+        else if(s->zp.y < -b){s->zp.y = -b; s->zr = psimRandFloat(s, -PI, PI);}
+
+        // front collision cube point
+        vec cp1 = s->pp;
+        vec cd1 = s->pbd;
+        vMulS(&cd1, cd1, 0.0525f);
+        vAdd(&cp1, cp1, cd1);
+
+        // back collision cube point
+        vec cp2 = s->pp;
+        vec cd2 = s->pbd;
+        vMulS(&cd2, cd2, -0.0525f);
+        vAdd(&cp2, cp2, cd2);
+
+        // do Axis-Aligned Cube collisions for both points against porygon
+        const float dla1 = vDistLa(cp1, s->zp); // front car
+        const float dla2 = vDistLa(cp2, s->zp); // back car
+        if(dla1 < 0.04f || dla2 < 0.04f)
+        {
+            s->cp++;
+            s->za = s->t+6.0;
+            s->rtime = roundtime;
+            s->rcc = s->cc;
+            s->cc = 0;
+            return PSIM_COLLECTED;
+        }
+    }
+    else if(s->t > s->za)
+    {
+        psimSpawn(s, w);
+        return PSIM_RESPAWN;
+    }
+    return PSIM_NONE;
+}
+
+// the direction a cube at (x, y) pushes p away in; the arena clamp can put the car or the porygon
+// exactly on an edge cube, then it is pushed towards the middle rather than normalising a zero vector
+static inline __attribute__((always_inline)) vec psimPushDir(const vec p, const float x, const float y)
+{
+    vec nf = (vec){p.x - x, p.y - y, 0.f};
+    if(nf.x*nf.x + nf.y*nf.y < 1e-12f)
+        return (vec){x > 0.f ? -1.f : 1.f, 0.f, 0.f};
+    vNorm(&nf);
+    return nf;
+}
+
+// a cube pushes the porygon out of its reach
+static inline __attribute__((always_inline)) void psimCubePorygon(psim* s, const float x, const float y)
+{
+    const float dlap = vDistLa(s->zp, (vec){x, y, 0.f});
+    if(dlap < 0.15f)
+    {
+        vec nf = psimPushDir(s->zp, x, y);
+        vMulS(&nf, nf, 0.15f-dlap);
+        vAdd(&s->zp, s->zp, nf);
+    }
+}
+
+// cp1 / cp2 are the front and back collision points of the car, which no cube moves (only pv);
+// returns 1 if this is the cube counted in colliding and the car is still on it
+static inline __attribute__((always_inline)) int psimCubeCar(psim* s, const psimcfg* c, const float x, const float y, const float id, const vec cp1, const vec cp2)
+{
+    // if car is moving compute collisions
+    if(s->sp > c->inertia || s->sp < -c->inertia)
+    {
+        // do Axis-Aligned Cube collisions for points against the cube
+        const float dla1 = vDistLa(cp1, (vec){x, y, 0.f}); // front car
+        const float dla0 = vDistLa(s->pp, (vec){x, y, 0.f}); // center car
+        const float dla2 = vDistLa(cp2, (vec){x, y, 0.f}); // back car
+        float dla = -1.f;
+        if(dla1 <= 0.097f){dla = dla1;}
+        else if(dla0 <= 0.097f){dla = dla0;}
+        else if(dla2 <= 0.097f){dla = dla2;}
+        if(dla >= 0.f)
+        {
+            vec nf = psimPushDir(s->pp, x, y);
+            vMulS(&nf, nf, 0.097f-dla);
+            vAdd(&s->pv, s->pv, nf);
+            if(c->sticky_collisions){s->sp *= 0.5f;}
+        }
+    }
+
+    // official colliding count
+    const float dla = vDist(s->pp, (vec){x, y, 0.f});
+    if(dla <= 0.13f)
+    {
+        if(s->colliding == 0.f)
+        {
+            s->colliding = id;
+            s->cc++;
+        }
+        return s->colliding == id;
+    }
+    else if(id == s->colliding)
+    {
+        s->colliding = 0.f;
+    }
+    return 0;
+}
+
+static inline __attribute__((always_inline)) void psimCollideT(psim* s, const psimcfg* c, const psimworld* w)
+{
+    // front collision cube point
+    vec cp1 = s->pp;
+    vec cd1 = s->pbd;
+    vMulS(&cd1, cd1, 0.0525f);
+    vAdd(&cp1, cp1, cd1);
+
+    // back collision cube point
+    vec cp2 = s->pp;
+    vec cd2 = s->pbd;
+    vMulS(&cd2, cd2, -0.0525f);
+    vAdd(&cp2, cp2, cd2);
+
+    // the cubes within reach of the porygon, then of the car, nothing
+    // reaches further than 0.15; at the game's spacing only one cube can
+    // act on either of them at a time so the two passes change nothing
+    uint32_t cx0, cx1, cy0, cy1;
+    psimWorldBox(w, s->zp.x, s->zp.y, 0.15f, &cx0, &cx1, &cy0, &cy1);
+    for(uint32_t cx = cx0; cx <= cx1; cx++)
+        for(uint32_t k = w->start[cx*w->gw+cy0], e = w->start[cx*w->gw+cy1+1]; k < e; k++)
+            psimCubePorygon(s, w->x[k], w->y[k]);
+
+    // a colliding cube the car has left the cells of is let go of too
+    int on = 0;
+    psimWorldBox(w, s->pp.x, s->pp.y, 0.15f, &cx0, &cx1, &cy0, &cy1);
+    for(uint32_t cx = cx0; cx <= cx1; cx++)
+        for(uint32_t k = w->start[cx*w->gw+cy0], e = w->start[cx*w->gw+cy1+1]; k < e; k++)
+            on |= psimCubeCar(s, c, w->x[k], w->y[k], (float)(k+1), cp1, cp2);
+    if(!on){s->colliding = 0.f;}
+
+    // heading vectors, the Y row of the render matrices worked out in 2D;
+    // the translations never reach that row and RotZ(-pr) RotZ(sr) is a
+    // rotation by sr-pr
+    float zs, zc, ps, pc, ss, sc;
+    fsincos(s->zr, &zs, &zc);
+    fsincos(s->pr, &ps, &pc);
+    fsincos(s->sr, &ss, &sc);
+
+    // porygon direction
+    s->zd.x = -zs;
+    s->zd.y = -zc;
+    s->zd.z = 0.f;
+
+    // wheel; front left direction
+    s->pd.x = ps*sc - pc*ss;
+    s->pd.y = -(pc*sc + ps*ss);
+    s->pd.z = 0.f;
+
+    // body direction
+    s->pbd.x = ps;
+    s->pbd.y = -pc;
+    s->pbd.z = 0.f;
+}
+
+// the generic tick, every variable read from the config
+void psimAutoDrive(psim* s, const psimcfg* c){psimAutoDriveT(s, c, c);}
+int  psimUpdate(psim* s, const psimcfg* c, const float dt){return psimUpdateT(s, c, psimWorld(c), dt);}
+void psimCollide(psim* s, const psimcfg* c){psimCollideT(s, c, psimWorld(c));}
+
+// and one per preset with its car physics folded in
+#define PSIM_SPECIALISE(n) \
+    static void psimAutoDrive_##n(psim* s, const psimcfg* c){psimAutoDriveT(s, &psim_cfg_##n, c);} \
+    static int  psimUpdate_##n(psim* s, const psimcfg* c, const float dt){return psimUpdateT(s, &psim_cfg_##n, psimWorld(c), dt);} \
+    static void psimCollide_##n(psim* s, const psimcfg* c){psimCollideT(s, &psim_cfg_##n, psimWorld(c));}
+PSIM_SPECIALISE(original)
+PSIM_SPECIALISE(scarlet)
+PSIM_SPECIALISE(scarletfast)
+PSIM_SPECIALISE(hybrid)
+
+static const psimprofile psim_profiles[PSIM_PROFILES+1] = {
+    {"Original",    &psim_cfg_original,    psimAutoDrive_original,    psimUpdate_original,    psimCollide_original},
+    {"Scarlet",     &psim_cfg_scarlet,     psimAutoDrive_scarlet,     psimUpdate_scarlet,     psimCollide_scarlet},
+    {"ScarletFast", &psim_cfg_scarletfast, psimAutoDrive_scarletfast, psimUpdate_scarletfast, psimCollide_scarletfast},
+    {"Hybrid",      &psim_cfg_hybrid,      psimAutoDrive_hybrid,      psimUpdate_hybrid,      psimCollide_hybrid},
+    {"config",      NULL,                  psimAutoDrive,             psimUpdate,             psimCollide}};
+
+const psimprofile* psimProfile(const psimcfg* c)
+{
+    // the car physics are everything before the auto drive variables
+    for(int i = 0; i < PSIM_PROFILES; i++)
+        if(memcmp(c, psim_profiles[i].cfg, offsetof(psimcfg, ad_min_dstep)) == 0)
+            return &psim_profiles[i];
+    return &psim_profiles[PSIM_PROFILES];
+}
+
+int psimStep(psim* s, const psimcfg* c, const float dt)
+{
+    return psimStepP(psimProfile(c), s, c, dt);
+}
+
+int psimStepP(const psimprofile* p, psim* s, const psimcfg* c, const float dt)
+{
+    s->t += dt;
+    const int e = p->update(s, c, dt);
+    if(e != PSIM_TIMEOUT && e != PSIM_RESPAWN)
+        p->collide(s, c);
+    return e;
+}
+
+void psimObserve(const psim* s, float* input)
+{
+    vec lad = s->pp;
+    vSub(&lad, lad, s->zp);
+    vNorm(&lad);
+    input[0] = s->pbd.x;
+    input[1] = s->pbd.y;
+    input[2] = lad.x;
+    input[3] = lad.y;
+    input[4] = vDot(s->pbd, lad);
+    input[5] = vDist(s->pp, s->zp);
+}
+
+float psimScore(const float start_dist, const float zs, const float zt, const double rtime, const unsigned int rcc, float* terms)
+{
+    const float score_startdist = start_dist*0.027777778f;
+    const float score_poryspeed = zs;
+    const float score_porytwitch= (zt-8.f) * 0.125f;
+    const float score_timetaken = 1.f-(float)(rtime * 0.003003003);
+    const float score_collisions= 1.f-(((float)rcc)*0.003003003f);
+    if(terms != NULL)
+    {
+        terms[0] = score_startdist;
+        terms[1] = score_poryspeed;
+        terms[2] = score_porytwitch;
+        terms[3] = score_timetaken;
+        terms[4] = score_collisions;
+    }
+    if(rcc > 333 || rtime > 60.0)
+        return 0.f;
+    return (score_startdist + score_poryspeed + score_porytwitch + score_timetaken + score_collisions) / 5.f;
+}
+
+float psimRoundScore(const psim* s)
+{
+    return psimScore(s->start_dist, s->zs, s->zt, s->rtime, s->rcc, NULL);
+}
+
+#endif
@@ -0,0 +1,279 @@
+/*
+    Ray-cast proximity sensors for porysim.h.
+
+    K rays from the car's centre fanned around its heading (pbd), each the
+    distance the car could travel along it before it touched a cube, over
+    the range and normalised to 0-1, 1 where nothing is within range:
+
+        psimrays r;
+        psimRaysInit(&r, 16, x2PI, 2.f);    // 16 rays all around, 2 units
+        float rays[16];
+        psimRaysCast(&r, psimWorld(&cfg), &s, rays);
+
+    Ray 0 is straight ahead. A fan of the full circle spaces the rays 2π/K
+    apart going anticlockwise, a narrower fan spreads them evenly from
+    -fan/2 to +fan/2. psimRaysParse() takes a spec like the worlds do,
+    "k=16,fan=360,range=2" with the fan in degrees, or just the ray count.
+
+    The rays walk the world's ray grid (psimWorldRay() in psimworld.h),
+    four at a time in SSE lanes, each lane stepping its own cells and
+    dropping out at its first hit; no branch depends on a lane, so the
+    mispredicts that dominate one ray at a time are gone. The lanes test
+    the same cubes with the same operations as psimWorldRay() and return
+    the same bits, or agree to rounding where -Ofast reassociates one of
+    them. 16 rays over 2 units are about 0.55 µs a tick against 0.65 one
+    ray at a time, 8 rays over 4 units about 0.33.
+
+    Logged rays go to a sidecar beside the bucket's X file, <score>_r.dat,
+    a psimraysheader and then [rows][k] float32 in the order of the X rows.
+    The header records the version and the rays, a file is only appended
+    to with the same ones. psimRaysPath() names the sidecar of any X file,
+    dsmerge and rquery carry it through with the rows it belongs to.
+*/
+
+#ifndef PSIMRAYS_H
+#define PSIMRAYS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define PSIM_RAYS_MAX 64
+#define PSIM_RAYS_MAGIC 0x31595250 // PRY1
+#define PSIM_RAYS_VERSION 1
+
+typedef struct
+{
+    uint32_t k;
+    float fan;                  // radians, x2PI for all around
+    float range;
+    float c[PSIM_RAYS_MAX];     // ray directions as a rotation of the heading
+    float s[PSIM_RAYS_MAX];
+} psimrays;
+
+typedef struct // 32 bytes
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t k;
+    float fan, range;
+    float half;                 // PSIM_RAY_HALF, the cube box the rays were cast against
+    uint32_t reserved[3];
+} psimraysheader;
+
+int  psimRaysInit(psimrays* r, const uint32_t k, const float fan, const float range); // 0 on success
+int  psimRaysParse(psimrays* r, const char* spec);                                    // 0 on success, 16 rays all around over 2 units for keys not given
+void psimRaysCast(const psimrays* r, const psimworld* w, const psim* s, float* out);  // out[k]
+void psimRaysCastAt(const psimrays* r, const psimworld* w, const float px, const float py, const float hx, const float hy, float* out); // from (px, py) heading (hx, hy)
+void psimRaysHeader(const psimrays* r, psimraysheader* h);
+int  psimRaysCheck(const psimrays* r, const psimraysheader* h); // 0 when a sidecar holds these rays
+void psimRaysPath(const char* x, char* out, const size_t len);  // <dir>/<name>_x.<ext> has <dir>/<name>_r.dat, other names get _r.dat appended
+int64_t psimRaysOpen(const char* path, psimraysheader* h, int* fd); // the rows of a sidecar, -1 when there is none or it is not one
+
+//
+
+int psimRaysInit(psimrays* r, const uint32_t k, const float fan, const float range)
+{
+    memset(r, 0, sizeof(psimrays));
+    if(k < 1 || k > PSIM_RAYS_MAX || !(fan > 0.f && fan <= x2PI) || !(range > 0.f))
+        return -1;
+    r->k = k;
+    r->fan = fan;
+    r->range = range;
+    for(uint32_t i = 0; i < k; i++)
+    {
+        float a;
+        if(fan >= x2PI)
+            a = x2PI * (float)i / (float)k;
+        else
+            a = k == 1 ? 0.f : -0.5f*fan + fan * (float)i / (float)(k-1);
+        fsincos(a, &r->s[i], &r->c[i]);
+    }
+    return 0;
+}
+
+int psimRaysParse(psimrays* r, const char* spec)
+{
+    uint32_t k = 16;
+    float fan = 360.f, range = 2.f;
+    char buf[256];
+    if(strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+    char* save = NULL;
+    for(char* kv = strtok_r(buf, ",", &save); kv != NULL; kv = strtok_r(NULL, ",", &save))
+    {
+        char* v = strchr(kv, '=');
+        if(v == NULL)
+        {
+            k = strtoul(kv, NULL, 10);
+            continue;
+        }
+        *v++ = 0;
+        if(strcmp(kv, "k") == 0){k = strtoul(v, NULL, 10);}
+        else if(strcmp(kv, "fan") == 0){fan = atof(v);}
+        else if(strcmp(kv, "range") == 0){range = atof(v);}
+        else
+            return -1;
+    }
+    return psimRaysInit(r, k, fan >= 360.f ? x2PI : fan * DEG2RAD, range);
+}
+
+#ifndef NOSSE
+// four rays from one origin, the distances to their first cubes or range
+static inline __m128 psimRays4(const psimworld* w, const float ox, const float oy, __m128 dx, __m128 dy, const float range)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 tiny = _mm_set1_ps(1e-9f);
+    dx = _mm_or_ps(_mm_max_ps(_mm_andnot_ps(sign, dx), tiny), _mm_and_ps(sign, dx));
+    dy = _mm_or_ps(_mm_max_ps(_mm_andnot_ps(sign, dy), tiny), _mm_and_ps(sign, dy));
+    const __m128 ix = _mm_div_ps(_mm_set1_ps(1.f), dx);
+    const __m128 iy = _mm_div_ps(_mm_set1_ps(1.f), dy);
+
+    // every lane starts in the origin's cell
+    const float gx = (ox - w->org) * w->inv_cell;
+    const float gy = (oy - w->org) * w->inv_cell;
+    const uint32_t cx = psimWorldCellOf(w, ox), cy = psimWorldCellOf(w, oy);
+    const int32_t gw = (int32_t)w->gw;
+    const __m128 px = _mm_cmpgt_ps(dx, zero), py = _mm_cmpgt_ps(dy, zero);
+    const __m128 tdx = _mm_mul_ps(_mm_set1_ps(PSIM_WORLD_CELL), _mm_andnot_ps(sign, ix));
+    const __m128 tdy = _mm_mul_ps(_mm_set1_ps(PSIM_WORLD_CELL), _mm_andnot_ps(sign, iy));
+    const __m128 fx = _mm_set1_ps((float)(cx+1) - gx), bx = _mm_set1_ps(gx - (float)cx);
+    const __m128 fy = _mm_set1_ps((float)(cy+1) - gy), by = _mm_set1_ps(gy - (float)cy);
+    __m128 tmx = _mm_mul_ps(_mm_or_ps(_mm_and_ps(px, fx), _mm_andnot_ps(px, bx)), tdx);
+    __m128 tmy = _mm_mul_ps(_mm_or_ps(_mm_and_ps(py, fy), _mm_andnot_ps(py, by)), tdy);
+
+    // a lane is done once its next cell is past the range or off the grid
+    const __m128 ex = _mm_or_ps(_mm_and_ps(px, _mm_set1_ps((float)gw - gx)), _mm_andnot_ps(px, _mm_set1_ps(gx)));
+    const __m128 ey = _mm_or_ps(_mm_and_ps(py, _mm_set1_ps((float)gw - gy)), _mm_andnot_ps(py, _mm_set1_ps(gy)));
+    const __m128 lim = _mm_min_ps(_mm_set1_ps(range), _mm_min_ps(_mm_mul_ps(ex, tdx), _mm_mul_ps(ey, tdy)));
+    const __m128i stepx = _mm_or_si128(_mm_and_si128(_mm_castps_si128(px), _mm_set1_epi32(gw)), _mm_andnot_si128(_mm_castps_si128(px), _mm_set1_epi32(-gw)));
+    const __m128i stepy = _mm_or_si128(_mm_and_si128(_mm_castps_si128(py), _mm_set1_epi32(1)), _mm_andnot_si128(_mm_castps_si128(py), _mm_set1_epi32(-1)));
+    __m128i cell = _mm_set1_epi32((int32_t)(cx*w->gw + cy));
+
+    // a lane with no cube left in its cell tests one behind its origin, which never hits
+    const __m128 vox = _mm_set1_ps(ox), voy = _mm_set1_ps(oy);
+    float nx[4], ny[4];
+    _mm_storeu_ps(nx, _mm_sub_ps(vox, dx));
+    _mm_storeu_ps(ny, _mm_sub_ps(voy, dy));
+    const __m128 half = _mm_set1_ps(PSIM_RAY_HALF);
+    const uint32_t last = w->gw*w->gw - 1;
+    __m128 best = _mm_set1_ps(range);
+    __m128 active = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    while(1)
+    {
+        uint32_t c[4], b[4], m[4], mm = 0;
+        _mm_storeu_si128((__m128i*)c, cell);
+        const int am = _mm_movemask_ps(active);
+        for(int l = 0; l < 4; l++)
+        {
+            const uint32_t cl = c[l] > last ? last : c[l]; // rounding at the edge of the grid
+            b[l] = w->rstart[cl];
+            m[l] = (am >> l & 1) ? w->rstart[cl+1] - b[l] : 0;
+            mm = m[l] > mm ? m[l] : mm;
+        }
+        for(uint32_t j = 0; j < mm; j++)
+        {
+            #define PSIM_RAYS_LANE(l, v, n) (j < m[l] ? w->v[b[l]+j] : n[l])
+            const __m128 vx = _mm_setr_ps(PSIM_RAYS_LANE(0, rx, nx), PSIM_RAYS_LANE(1, rx, nx), PSIM_RAYS_LANE(2, rx, nx), PSIM_RAYS_LANE(3, rx, nx));
+            const __m128 vy = _mm_setr_ps(PSIM_RAYS_LANE(0, ry, ny), PSIM_RAYS_LANE(1, ry, ny), PSIM_RAYS_LANE(2, ry, ny), PSIM_RAYS_LANE(3, ry, ny));
+            #undef PSIM_RAYS_LANE
+            const __m128 ax = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(vx, half), vox), ix), bx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(vx, half), vox), ix);
+            const __m128 ay = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(vy, half), voy), iy), by = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(vy, half), voy), iy);
+            const __m128 tn = _mm_max_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by));
+            const __m128 tf = _mm_min_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by));
+            const __m128 hit = _mm_and_ps(_mm_cmple_ps(tn, tf), _mm_cmpge_ps(tf, zero));
+            best = _mm_or_ps(_mm_and_ps(hit, _mm_min_ps(best, _mm_max_ps(tn, zero))), _mm_andnot_ps(hit, best));
+        }
+
+        // a hit before the next cell cannot be beaten by anything in it
+        const __m128 tnext = _mm_min_ps(tmx, tmy);
+        active = _mm_and_ps(active, _mm_and_ps(_mm_cmpgt_ps(best, tnext), _mm_cmplt_ps(tnext, lim)));
+        if(_mm_movemask_ps(active) == 0)
+            return best;
+        const __m128 mx = _mm_cmplt_ps(tmx, tmy);
+        const __m128i mxi = _mm_castps_si128(mx);
+        cell = _mm_add_epi32(cell, _mm_or_si128(_mm_and_si128(mxi, stepx), _mm_andnot_si128(mxi, stepy)));
+        tmx = _mm_add_ps(tmx, _mm_and_ps(mx, tdx));
+        tmy = _mm_add_ps(tmy, _mm_andnot_ps(mx, tdy));
+    }
+}
+#endif
+
+void psimRaysCastAt(const psimrays* r, const psimworld* w, const float px, const float py, const float hx, const float hy, float* out)
+{
+    const float inv = 1.f / r->range;
+#ifndef NOSSE
+    const __m128 vhx = _mm_set1_ps(hx), vhy = _mm_set1_ps(hy), vinv = _mm_set1_ps(inv);
+    for(uint32_t i = 0; i < r->k; i += 4)
+    {
+        const __m128 c = _mm_loadu_ps(&r->c[i]), s = _mm_loadu_ps(&r->s[i]);
+        const __m128 dx = _mm_sub_ps(_mm_mul_ps(vhx, c), _mm_mul_ps(vhy, s));
+        const __m128 dy = _mm_add_ps(_mm_mul_ps(vhx, s), _mm_mul_ps(vhy, c));
+        float d[4];
+        _mm_storeu_ps(d, _mm_mul_ps(psimRays4(w, px, py, dx, dy, r->range), vinv));
+        for(uint32_t l = 0; l < 4 && i+l < r->k; l++)
+            out[i+l] = d[l];
+    }
+#else
+    for(uint32_t i = 0; i < r->k; i++)
+        out[i] = psimWorldRay(w, px, py, hx*r->c[i] - hy*r->s[i], hx*r->s[i] + hy*r->c[i], r->range) * inv;
+#endif
+}
+
+void psimRaysCast(const psimrays* r, const psimworld* w, const psim* s, float* out)
+{
+    psimRaysCastAt(r, w, s->pp.x, s->pp.y, s->pbd.x, s->pbd.y, out);
+}
+
+void psimRaysHeader(const psimrays* r, psimraysheader* h)
+{
+    memset(h, 0, sizeof(psimraysheader));
+    h->magic = PSIM_RAYS_MAGIC;
+    h->version = PSIM_RAYS_VERSION;
+    h->k = r->k;
+    h->fan = r->fan;
+    h->range = r->range;
+    h->half = PSIM_RAY_HALF;
+}
+
+int psimRaysCheck(const psimrays* r, const psimraysheader* h)
+{
+    psimraysheader e;
+    psimRaysHeader(r, &e);
+    return memcmp(&e, h, sizeof(psimraysheader)) == 0 ? 0 : -1;
+}
+
+void psimRaysPath(const char* x, char* out, const size_t len)
+{
+    snprintf(out, len, "%s", x);
+    const char* base = strrchr(out, '/');
+    char* p = strstr(base != NULL ? base : out, "_x.");
+    if(p != NULL)
+        *p = 0;
+    if(strlen(out) + 7 <= len)
+        strcat(out, "_r.dat");
+}
+
+int64_t psimRaysOpen(const char* path, psimraysheader* h, int* fd)
+{
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(*fd == -1)
+        return -1;
+    struct stat st;
+    if(fstat(*fd, &st) == -1 || pread(*fd, h, sizeof(psimraysheader), 0) != sizeof(psimraysheader) ||
+       h->magic != PSIM_RAYS_MAGIC || h->version != PSIM_RAYS_VERSION || h->k < 1 || h->k > PSIM_RAYS_MAX)
+    {
+        close(*fd);
+        *fd = -1;
+        return -1;
+    }
+    return (st.st_size - (off_t)sizeof(psimraysheader)) / (off_t)(h->k*sizeof(float));
+}
+
+#endif
@@ -0,0 +1,474 @@
+/*
+    Deterministic replays of porysim.h games.
+
+    A psim is fully determined by its state, its config and, each tick,
+    the clock and the [sr, sp] it is driven with; the auto drive and the
+    policies only ever choose sr and sp, and every random number comes from
+    the state's own generator. So a recording is the state before the
+    first tick followed by one 16 byte psimtick per tick, and playing it
+    back steps the same physics through the same states bit for bit. With
+    PSIM_REPLAY_AUTODRIVE the auto drive is stepped too, so its state
+    machine follows as well and a state taken from a replay carries on
+    exactly as the recorded one did:
+
+        psimreplayheader  header   the config, world spec, dt, seed, start state
+        psimtick          ticks[]  t, sr, sp; until the end of the file
+
+    Before every PSIM_REPLAY_EVERY-th tick the recorder writes a key
+    record, a 16 byte marker (an all ones t, a NaN no clock can be, and
+    sizeof(psim)) and then the whole state as the tick is about to be
+    stepped, padded to 16 bytes.
+
+    The clock is recorded, not dt, so a run paced by the wall clock plays
+    back as exactly as a --fast one. The header is the raw structs, like a
+    checkpoint, so a recording only loads in a build with the same psim
+    layout. Playing back the same states also needs the same floating
+    point; porysim.h under another compiler or other flags (-O2 against
+    -Ofast, say) rounds differently, and one different bit grows into a
+    different game. So playback takes the recorded state at every key
+    record, a build that rounds differently drifts for less than one
+    interval and is back on the recorded game at the next key. The first
+    key that did not match is kept in `diverged` and the number of them
+    in `resyncs`. A partial record at the end of a file that was killed
+    is ignored.
+
+    psimRecordResume() carries a recording on from a checkpoint of the
+    game taken after its first `ticks` ticks; what was recorded after
+    them goes, so the file steps from its start state straight on into
+    the resumed run.
+
+    Recording, around each tick of the caller's loop:
+
+        psimrecorder rec;
+        psimRecordOpen(&rec, "game.prp", &cfg, world_spec, seed, round, dt, PSIM_REPLAY_AUTODRIVE, &s);
+        p->autodrive(&s, &cfg);              // and / or a policy sets s.sr, s.sp
+        psimRecordTick(&rec, t, &s);
+        s.t = t;
+        e = p->update(&s, &cfg, dt); ...
+        psimRecordClose(&rec);
+
+    Playing back:
+
+        psimreplay r;
+        psimReplayLoad(&r, "game.prp", 0);   // a snapshot every 1440 ticks
+        if(r.diverged < r.n) ...             // this build drifts between the keys
+        while(psimReplayStep(&r) >= 0)
+            ... r.s is the state after r.at ticks
+        psimReplaySeek(&r, tick);
+
+    Loading steps the whole recording once to take a snapshot of the state
+    every `every` ticks and to index the rounds, so a seek to any tick
+    restores the snapshot at or before it and steps at most every-1 ticks,
+    a fraction of a millisecond. Seeks resync at the keys like playback,
+    so they land on the same states as playing through.
+*/
+
+#ifndef PSIMREPLAY_H
+#define PSIMREPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PSIM_REPLAY_MAGIC 0x33505250 // PRP3
+#define PSIM_REPLAY_EVERY 1440       // ticks between key records, and by default between snapshots; 10 seconds
+#define PSIM_RECORD_BUF   4096       // ticks buffered per write
+#define PSIM_REPLAY_KEY   (1 + (sizeof(psim)+15)/16) // 16 byte records a key takes
+
+#define PSIM_REPLAY_AUTODRIVE 1      // the auto drive stepped every tick before sr, sp were chosen
+
+typedef struct
+{
+    double t;           // the clock the tick was stepped at
+    float sr, sp;       // what the car was driven with
+} psimtick; // 16 bytes
+
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sizes;         // sizeof(psim) << 16 | sizeof(psimcfg), another build's layout will not load
+    uint64_t seed;          // the game seed, informational
+    float dt;
+    uint32_t round;         // the caller's index of the round in play at the start
+    uint32_t world_cubes;   // checks the world rebuilt from the spec
+    uint32_t flags;         // PSIM_REPLAY_*
+    psimcfg cfg;            // the world pointer is meaningless
+    char world[256];        // the psimworld.h spec, empty for the classic arena
+    psim start;             // the state before the first tick
+} psimreplayheader;
+
+typedef struct
+{
+    int fd;
+    uint32_t n;
+    uint64_t ticks;
+    psimtick buf[PSIM_RECORD_BUF+PSIM_REPLAY_KEY];
+} psimrecorder;
+
+typedef struct
+{
+    uint32_t start;     // the round's first tick
+    uint32_t end;       // the tick it was collected or timed out on, the tick count if neither
+    int e;              // PSIM_COLLECTED, PSIM_TIMEOUT or PSIM_NONE
+    float score;        // psimRoundScore() when collected
+} psimround;
+
+typedef struct
+{
+    psimreplayheader h;
+    psimworld world;        // built from h.world
+    psimcfg cfg;
+    const psimprofile* prof;
+    psimtick* ticks;        // [n]
+    uint32_t n;
+    psim* keys;             // [nk], the recorded state before tick i*PSIM_REPLAY_EVERY is stepped
+    uint32_t nk;
+    uint32_t diverged;      // the tick of the first key this build did not arrive at, n when it arrived at them all
+    uint32_t resyncs;       // keys it did not arrive at
+    uint32_t loading;
+    uint32_t every;
+    psim* snaps;            // [n/every+1], the state after i*every ticks
+    psimround* rounds;      // [nr]
+    uint32_t nr;
+    psim s;                 // the state after `at` ticks
+    uint32_t at;
+} psimreplay;
+
+int  psimRecordOpen(psimrecorder* r, const char* file, const psimcfg* c, const char* world, const uint64_t seed, const uint32_t round, const float dt, const uint32_t flags, const psim* start); // 0 on success, world NULL for the classic arena
+static inline int psimRecordTick(psimrecorder* r, const double t, const psim* s); // s about to be stepped at t, -1 once a write has failed
+int  psimRecordResume(psimrecorder* r, const char* file, const uint64_t seed, const uint64_t ticks); // 0 on success, -1 for another game or one short of ticks
+int  psimRecordFlush(psimrecorder* r);
+void psimRecordClose(psimrecorder* r);
+
+int  psimReplayLoad(psimreplay* r, const char* file, const uint32_t every); // 0 on success, every 0 for PSIM_REPLAY_EVERY
+void psimReplayFree(psimreplay* r);
+int  psimReplayStep(psimreplay* r);                          // the psim event of the next tick, -1 at the end
+void psimReplaySeek(psimreplay* r, uint32_t tick);           // to the state after `tick` ticks
+uint32_t psimReplayFind(const psimreplay* r, const double t); // the first tick stepped at or after t
+uint32_t psimReplayRound(const psimreplay* r, const uint32_t tick); // index into rounds[] of the round in play after `tick` ticks
+static inline uint64_t psimReplayHash(const psim* s);
+
+//
+
+#define PSIM_REPLAY_KEYMARK 0xFFFFFFFFFFFFFFFFull
+
+// FNV-1a over the car, porygon and round state, the collision id and the random state; the auto drive's
+// state machine is left out, it is only stepped with PSIM_REPLAY_AUTODRIVE. Compares a state with its key.
+static inline uint64_t psimReplayHash(const psim* s)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    const uint8_t* p = (const uint8_t*)s;
+    for(size_t i = 0; i < offsetof(psim, ad_ld); i++)
+        h = (h ^ p[i]) * 0x100000001B3ull;
+    uint32_t tail[2];
+    memcpy(&tail[0], &s->colliding, sizeof(float));
+    tail[1] = s->rng;
+    p = (const uint8_t*)tail;
+    for(size_t i = 0; i < sizeof(tail); i++)
+        h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+int psimRecordFlush(psimrecorder* r)
+{
+    if(r->fd < 0)
+        return -1;
+    const char* p = (const char*)r->buf;
+    size_t len = r->n * sizeof(psimtick);
+    while(len > 0)
+    {
+        const ssize_t w = write(r->fd, p, len);
+        if(w <= 0)
+        {
+            close(r->fd);
+            r->fd = -1;
+            return -1;
+        }
+        p += w, len -= w;
+    }
+    r->n = 0;
+    return 0;
+}
+
+static inline int psimRecordTick(psimrecorder* r, const double t, const psim* s)
+{
+    if(r->fd < 0)
+        return -1;
+    if(r->ticks++ % PSIM_REPLAY_EVERY == 0)
+    {
+        const uint64_t c[2] = {PSIM_REPLAY_KEYMARK, sizeof(psim)};
+        memcpy(&r->buf[r->n], c, sizeof(psimtick));
+        memset(&r->buf[r->n+1], 0, (PSIM_REPLAY_KEY-1) * sizeof(psimtick));
+        memcpy(&r->buf[r->n+1], s, sizeof(psim));
+        r->n += PSIM_REPLAY_KEY;
+    }
+    r->buf[r->n++] = (psimtick){t, s->sr, s->sp};
+    if(r->n >= PSIM_RECORD_BUF)
+        return psimRecordFlush(r);
+    return 0;
+}
+
+int psimRecordOpen(psimrecorder* r, const char* file, const psimcfg* c, const char* world, const uint64_t seed, const uint32_t round, const float dt, const uint32_t flags, const psim* start)
+{
+    r->n = 0;
+    r->ticks = 0;
+    r->fd = -1;
+    psimreplayheader h;
+    memset(&h, 0, sizeof(h));
+    if(world != NULL && strlen(world) >= sizeof(h.world))
+        return -1;
+    h.magic = PSIM_REPLAY_MAGIC;
+    h.sizes = (uint32_t)(sizeof(psim) << 16 | sizeof(psimcfg));
+    h.seed = seed;
+    h.dt = dt;
+    h.round = round;
+    h.world_cubes = psimWorld(c)->n;
+    h.flags = flags;
+    h.cfg = *c;
+    h.cfg.world = NULL;
+    if(world != NULL)
+        strcpy(h.world, world);
+    h.start = *start;
+
+    r->fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(r->fd < 0)
+        return -1;
+    if(write(r->fd, &h, sizeof(h)) != sizeof(h))
+    {
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int psimRecordResume(psimrecorder* r, const char* file, const uint64_t seed, const uint64_t ticks)
+{
+    r->n = 0;
+    r->ticks = ticks;
+    r->fd = open(file, O_RDWR);
+    if(r->fd < 0)
+        return -1;
+    psimreplayheader h;
+    const off_t keep = sizeof(h) + (ticks + (ticks + PSIM_REPLAY_EVERY-1) / PSIM_REPLAY_EVERY * PSIM_REPLAY_KEY) * sizeof(psimtick);
+    if(pread(r->fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != PSIM_REPLAY_MAGIC || h.sizes != (uint32_t)(sizeof(psim) << 16 | sizeof(psimcfg)) || h.seed != seed ||
+       lseek(r->fd, 0, SEEK_END) < keep || ftruncate(r->fd, keep) == -1 || lseek(r->fd, keep, SEEK_SET) != keep)
+    {
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void psimRecordClose(psimrecorder* r)
+{
+    if(r->fd < 0)
+        return;
+    psimRecordFlush(r);
+    if(r->fd > -1)
+        close(r->fd);
+    r->fd = -1;
+}
+
+int psimReplayStep(psimreplay* r)
+{
+    if(r->at >= r->n)
+        return -1;
+    const psimtick* k = &r->ticks[r->at++];
+    psim* s = &r->s;
+    if(r->h.flags & PSIM_REPLAY_AUTODRIVE) // only for its state machine, it has no say
+        r->prof->autodrive(s, &r->cfg);
+    s->sr = k->sr, s->sp = k->sp;
+    const uint32_t tick = r->at-1;
+    if(tick % PSIM_REPLAY_EVERY == 0 && tick / PSIM_REPLAY_EVERY < r->nk)
+    {
+        // back onto the recorded game, whatever this build's rounding made of the interval before
+        const psim* key = &r->keys[tick / PSIM_REPLAY_EVERY];
+        if(r->loading == 1 && psimReplayHash(s) != psimReplayHash(key))
+        {
+            if(r->diverged == r->n)
+                r->diverged = tick;
+            r->resyncs++;
+        }
+        *s = *key;
+    }
+    s->t = k->t;
+    const int e = r->prof->update(s, &r->cfg, r->h.dt);
+    if(e != PSIM_TIMEOUT && e != PSIM_RESPAWN)
+        r->prof->collide(s, &r->cfg);
+    return e;
+}
+
+void psimReplaySeek(psimreplay* r, uint32_t tick)
+{
+    if(tick > r->n){tick = r->n;}
+    if(tick < r->at || tick - r->at >= r->every) // otherwise stepping on from here is no further
+    {
+        r->at = tick - tick % r->every;
+        r->s = r->snaps[r->at / r->every];
+    }
+    while(r->at < tick)
+        psimReplayStep(r);
+}
+
+uint32_t psimReplayFind(const psimreplay* r, const double t)
+{
+    uint32_t lo = 0, hi = r->n;
+    while(lo < hi)
+    {
+        const uint32_t mid = lo + (hi-lo)/2;
+        if(r->ticks[mid].t < t)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+uint32_t psimReplayRound(const psimreplay* r, const uint32_t tick)
+{
+    uint32_t lo = 0, hi = r->nr;
+    while(hi - lo > 1)
+    {
+        const uint32_t mid = lo + (hi-lo)/2;
+        if(r->rounds[mid].start <= tick)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void psimReplayFree(psimreplay* r)
+{
+    free(r->ticks);
+    free(r->keys);
+    free(r->snaps);
+    free(r->rounds);
+    psimWorldFree(&r->world);
+    memset(r, 0, sizeof(psimreplay));
+}
+
+int psimReplayLoad(psimreplay* r, const char* file, const uint32_t every)
+{
+    memset(r, 0, sizeof(psimreplay));
+    r->every = every ? every : PSIM_REPLAY_EVERY;
+
+    const int fd = open(file, O_RDONLY);
+    if(fd < 0)
+        return -1;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(psimreplayheader))
+    {
+        close(fd);
+        return -1;
+    }
+    const size_t map_size = st.st_size;
+    const uint8_t* map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return -1;
+    memcpy(&r->h, map, sizeof(psimreplayheader));
+    const size_t nrec = (map_size - sizeof(psimreplayheader)) / sizeof(psimtick);
+    if(r->h.magic != PSIM_REPLAY_MAGIC || r->h.sizes != (uint32_t)(sizeof(psim) << 16 | sizeof(psimcfg)) || r->h.world[sizeof(r->h.world)-1] != 0 || nrec > 0xFFFFFFFF)
+    {
+        munmap((void*)map, map_size);
+        return -1;
+    }
+
+    // the ticks and the key records apart
+    r->ticks = malloc((nrec ? nrec : 1) * sizeof(psimtick));
+    r->keys = malloc((nrec / PSIM_REPLAY_EVERY + 2) * sizeof(psim));
+    if(r->ticks == NULL || r->keys == NULL)
+    {
+        munmap((void*)map, map_size);
+        goto fail;
+    }
+    const uint8_t* rec = map + sizeof(psimreplayheader);
+    for(size_t i = 0; i < nrec; i++, rec += sizeof(psimtick))
+    {
+        uint64_t c[2];
+        memcpy(c, rec, sizeof(c));
+        if(c[0] == PSIM_REPLAY_KEYMARK)
+        {
+            // a key always comes before the tick it is of, and only at every PSIM_REPLAY_EVERY-th one
+            if(c[1] != sizeof(psim) || i + PSIM_REPLAY_KEY > nrec || r->n != r->nk * PSIM_REPLAY_EVERY)
+                break;
+            memcpy(&r->keys[r->nk++], rec + sizeof(psimtick), sizeof(psim));
+            i += PSIM_REPLAY_KEY-1;
+            rec += (PSIM_REPLAY_KEY-1) * sizeof(psimtick);
+        }
+        else
+            memcpy(&r->ticks[r->n++], rec, sizeof(psimtick));
+    }
+    munmap((void*)map, map_size);
+    r->diverged = r->n;
+
+    r->cfg = r->h.cfg;
+    r->cfg.world = NULL;
+    if(r->h.world[0] != 0)
+    {
+        psimworldcfg wc;
+        if(psimWorldParse(&wc, r->h.world) < 0 || psimWorldCreate(&r->world, &wc) < 0)
+            goto fail;
+        r->cfg.world = &r->world;
+    }
+    if(psimWorld(&r->cfg)->n != r->h.world_cubes)
+        goto fail;
+    r->prof = psimProfile(&r->cfg);
+
+    // one pass over the whole recording for the snapshots and the rounds
+    uint32_t cap = 64;
+    r->snaps = malloc((r->n / r->every + 1) * sizeof(psim));
+    r->rounds = malloc(cap * sizeof(psimround));
+    if(r->snaps == NULL || r->rounds == NULL)
+        goto fail;
+    r->s = r->h.start;
+    r->rounds[0] = (psimround){0, r->n, PSIM_NONE, 0.f};
+    r->nr = 1;
+    r->loading = 1;
+    for(r->at = 0; r->at < r->n;)
+    {
+        if(r->at % r->every == 0)
+            r->snaps[r->at / r->every] = r->s;
+        const int e = psimReplayStep(r);
+        psimround* rd = &r->rounds[r->nr-1];
+        if(e == PSIM_COLLECTED || (e == PSIM_TIMEOUT && rd->e == PSIM_NONE))
+        {
+            rd->end = r->at-1;
+            rd->e = e;
+            rd->score = e == PSIM_COLLECTED ? psimRoundScore(&r->s) : 0.f;
+        }
+        if(e == PSIM_TIMEOUT || e == PSIM_RESPAWN)
+        {
+            if(r->nr == cap)
+            {
+                cap *= 2;
+                psimround* nr = realloc(r->rounds, cap * sizeof(psimround));
+                if(nr == NULL)
+                    goto fail;
+                r->rounds = nr;
+            }
+            r->rounds[r->nr++] = (psimround){r->at, r->n, PSIM_NONE, 0.f};
+        }
+    }
+    if(r->n % r->every == 0)
+        r->snaps[r->n / r->every] = r->s;
+    r->loading = 0; // compared once, seeks only resync
+    r->at = 0;
+    r->s = r->h.start;
+    return 0;
+
+fail:
+    psimReplayFree(r);
+    return -1;
+}
+
+#endif
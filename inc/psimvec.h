@@ -0,0 +1,228 @@
+/*
+    Batched PoryDrive environments.
+
+    N independent porysim.h instances behind one create/reset/step API over
+    contiguous arrays, so a caller steps thousands of environments per call
+    with no per-environment overhead; porysim/ builds it into
+    libporysim.so and porysim.py wraps the arrays as NumPy views.
+
+    Requires vec.h and porysim.h.
+
+    An episode is a round. A step applies one [sr, sp] action per
+    environment (NULL lets the auto drive drive), holds it for `ticks`
+    ticks of 1/144 s and writes:
+
+        out_obs     [n][6]  psimObserve(), the 6 FNN inputs
+        out_reward  [n]     the round score (0-1) if a porygon was collected
+        out_done    [n]     PSIM_COLLECTED or PSIM_TIMEOUT when the round
+                            ended, PSIM_NONE otherwise
+
+    A finished round is followed straight away by the next one in the same
+    environment (no 6 second respawn wait), so out_obs is always of a live
+    round. An environment whose state has gone non-finite (an action of
+    NaN, say) is reset and reported as a timeout. Any of the outputs may be NULL. A config whose car physics match
+    a preset steps with that preset's specialised tick (psimProfile()).
+
+    Environments are split over `threads` threads per step, each stepping
+    a contiguous slice, so the results do not depend on the thread count.
+*/
+
+#ifndef PSIMVEC_H
+#define PSIMVEC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define PSIMVEC_MAX_THREADS 256
+
+typedef struct
+{
+    uint32_t n;
+    uint32_t threads;
+    float dt;
+    psimcfg cfg;
+    psim* envs;
+
+    // the current step
+    const float* actions;
+    float* out_obs;
+    float* out_reward;
+    uint8_t* out_done;
+    uint32_t ticks;
+} psimvec;
+
+psimvec* psimvecCreate(const uint32_t n_envs, const psimcfg* config, const uint32_t threads); // config may be NULL for ScarletFast, threads 0 for one per core
+void     psimvecFree(psimvec* v);
+void     psimvecReset(psimvec* v, const uint32_t* seeds, float* out_obs); // seeds[n], NULL seeds environments 1 to n
+void     psimvecStep(psimvec* v, const float* actions, const uint32_t ticks, float* out_obs, float* out_reward, uint8_t* out_done);
+psimcfg* psimvecConfig(psimvec* v);  // may be changed between steps
+psim*    psimvecStates(psimvec* v);  // the n environments, read only between steps
+
+//
+
+psimvec* psimvecCreate(const uint32_t n_envs, const psimcfg* config, const uint32_t threads)
+{
+    psimvec* v = calloc(1, sizeof(psimvec));
+    if(v == NULL)
+        return NULL;
+    v->envs = calloc(n_envs ? n_envs : 1, sizeof(psim));
+    if(v->envs == NULL)
+    {
+        free(v);
+        return NULL;
+    }
+    v->n = n_envs;
+    v->dt = 1.f / 144.f;
+    v->threads = threads ? threads : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if(v->threads < 1){v->threads = 1;}
+    if(v->threads > PSIMVEC_MAX_THREADS){v->threads = PSIMVEC_MAX_THREADS;}
+    if(config != NULL)
+        v->cfg = *config;
+    else
+        psimConfigScarletFast(&v->cfg);
+    psimvecReset(v, NULL, NULL);
+    return v;
+}
+
+void psimvecFree(psimvec* v)
+{
+    if(v == NULL)
+        return;
+    free(v->envs);
+    free(v);
+}
+
+psimcfg* psimvecConfig(psimvec* v)
+{
+    return &v->cfg;
+}
+
+psim* psimvecStates(psimvec* v)
+{
+    return v->envs;
+}
+
+void psimvecReset(psimvec* v, const uint32_t* seeds, float* out_obs)
+{
+    for(uint32_t i = 0; i < v->n; i++)
+    {
+        psim* s = &v->envs[i];
+        psimReset(s, v->cfg.world, seeds != NULL ? seeds[i] : i+1, 0.0);
+        psimCollide(s, &v->cfg); // directions for the first observation
+        if(out_obs != NULL)
+            psimObserve(s, out_obs + i*6);
+    }
+}
+
+// by the bits, -Ofast may assume there are no NaNs and drop an isfinite()
+static inline int psimvecFinite(const psim* s)
+{
+    const float f[7] = {s->pp.x, s->pp.y, s->zp.x, s->zp.y, s->sr, s->sp, s->pr};
+    for(int i = 0; i < 7; i++)
+    {
+        uint32_t u;
+        memcpy(&u, &f[i], sizeof(u));
+        if((u & 0x7F800000) == 0x7F800000)
+            return 0;
+    }
+    return 1;
+}
+
+static void psimvecSlice(psimvec* v, const uint32_t i0, const uint32_t i1)
+{
+    const psimcfg* c = &v->cfg;
+    const psimprofile* p = psimProfile(c);
+    for(uint32_t i = i0; i < i1; i++)
+    {
+        psim* s = &v->envs[i];
+        float reward = 0.f;
+        uint8_t done = PSIM_NONE;
+        for(uint32_t k = 0; k < v->ticks && done == PSIM_NONE; k++)
+        {
+            if(v->actions != NULL)
+                s->sr = v->actions[i*2], s->sp = v->actions[i*2+1];
+            else
+                p->autodrive(s, c);
+            s->t += v->dt;
+            const int e = p->update(s, c, v->dt);
+            if(e == PSIM_COLLECTED)
+            {
+                reward = psimRoundScore(s);
+                done = PSIM_COLLECTED;
+                psimSpawn(s, c->world);
+            }
+            else if(e == PSIM_TIMEOUT)
+                done = PSIM_TIMEOUT;
+            p->collide(s, c);
+        }
+
+        // a non-finite state never recovers, it ends the episode as a new game rather than poisoning the batch
+        if(psimvecFinite(s) == 0)
+        {
+            psimReset(s, c->world, s->rng, 0.0);
+            psimCollide(s, c);
+            reward = 0.f;
+            done = PSIM_TIMEOUT;
+        }
+        if(v->out_obs != NULL){psimObserve(s, v->out_obs + i*6);}
+        if(v->out_reward != NULL){v->out_reward[i] = reward;}
+        if(v->out_done != NULL){v->out_done[i] = done;}
+    }
+}
+
+typedef struct
+{
+    psimvec* v;
+    uint32_t i0, i1;
+} psimvecjob;
+
+static void* psimvecThread(void* arg)
+{
+    const psimvecjob* j = arg;
+    psimvecSlice(j->v, j->i0, j->i1);
+    return NULL;
+}
+
+void psimvecStep(psimvec* v, const float* actions, const uint32_t ticks, float* out_obs, float* out_reward, uint8_t* out_done)
+{
+    v->actions = actions;
+    v->ticks = ticks ? ticks : 1;
+    v->out_obs = out_obs;
+    v->out_reward = out_reward;
+    v->out_done = out_done;
+
+    // a thread only pays off with a few hundred ticks of work
+    uint32_t nt = v->threads;
+    const uint32_t min_slice = 64;
+    if(nt > 1 && v->n / nt < min_slice){nt = v->n / min_slice;}
+    if(nt <= 1)
+    {
+        psimvecSlice(v, 0, v->n);
+        return;
+    }
+
+    pthread_t th[PSIMVEC_MAX_THREADS];
+    psimvecjob jobs[PSIMVEC_MAX_THREADS];
+    const uint32_t per = (v->n + nt - 1) / nt;
+    uint32_t started = 0;
+    for(uint32_t t = 1; t < nt; t++) // the caller takes the first slice
+    {
+        jobs[t] = (psimvecjob){v, t*per, (t+1)*per < v->n ? (t+1)*per : v->n};
+        if(jobs[t].i0 >= jobs[t].i1)
+            break;
+        if(pthread_create(&th[t], NULL, psimvecThread, &jobs[t]) != 0)
+        {
+            psimvecSlice(v, jobs[t].i0, jobs[t].i1);
+            jobs[t].i1 = 0;
+        }
+        started = t;
+    }
+    psimvecSlice(v, 0, per < v->n ? per : v->n);
+    for(uint32_t t = 1; t <= started; t++)
+        if(jobs[t].i1 != 0)
+            pthread_join(th[t], NULL);
+}
+
+#endif
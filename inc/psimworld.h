@@ -0,0 +1,427 @@
+/*
+    PoryDrive worlds; the arena size and the cubes in it.
+
+    A world is built from a psimworldcfg, usually parsed from a spec of
+    comma separated key=value pairs (all optional):
+
+        layout=lattice  lattice, jitter, random or file
+        size=17.5       half extent, the car and porygon stay within ±size
+                        and porygons spawn within ±(size+0.5)
+        spacing=0.53    lattice spacing
+        jitter=0.13     jitter: the most a lattice cube is moved per axis,
+                        a quarter of the spacing by default
+        count=0         random: cubes, 0 for the density of the lattice
+        hole=0.1        no cube within ±hole of the origin, where the car
+                        starts; at least PSIM_WORLD_CLEAR for jitter and
+                        random, whose cubes can land anywhere near it
+        seed=1          jitter / random: layout seed
+        file=path       file: a cube per line as "x y", # comments
+
+    e.g. "layout=jitter,size=70" is 16× the area of the game's arena. The
+    defaults are that arena exactly, the lattice generated the same way.
+
+    The cubes are bucketed into a uniform grid of PSIM_WORLD_CELL cells,
+    stored in cell order with a first-cube offset per cell, so everything
+    within a radius of a point is a handful of contiguous ranges however
+    large the world is:
+
+        uint32_t cx0, cx1, cy0, cy1;
+        psimWorldBox(w, x, y, r, &cx0, &cx1, &cy0, &cy1);
+        for(uint32_t cx = cx0; cx <= cx1; cx++)
+            for(uint32_t k = w->start[cx*w->gw+cy0], e = w->start[cx*w->gw+cy1+1]; k < e; k++)
+                ... w->x[k], w->y[k], the cube's id is k+1
+
+    Cubes more than PSIM_WORLD_MARGIN outside ±size can never be reached
+    or seen and are dropped. psimWorldClassic() is the game's arena, built
+    at load time.
+
+    A second grid of the same cells lists a cube in every cell its
+    ±PSIM_RAY_HALF collision box overlaps (rx, ry, rstart), so a ray only
+    has to test the cubes of the cells it passes through and can stop in
+    the cell of its first hit. psimWorldRay() walks it cell by cell
+    (Amanatides & Woo) and returns how far the car's centre can travel
+    along the ray before it would touch a cube.
+*/
+
+#ifndef PSIMWORLD_H
+#define PSIMWORLD_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PSIM_LAYOUT_LATTICE 0
+#define PSIM_LAYOUT_JITTER  1
+#define PSIM_LAYOUT_RANDOM  2
+#define PSIM_LAYOUT_FILE    3
+
+#define PSIM_WORLD_CELL 0.32f // at least twice the 0.15 reach of a collision, a query touches 2x2 cells
+#define PSIM_WORLD_MARGIN 1.f
+#define PSIM_WORLD_MAX_CUBES 16777216 // ids are exact in a float
+#define PSIM_RAY_HALF 0.097f // the longest axis distance of a push
+#define PSIM_WORLD_CLEAR 0.275f // the 0.15 reach of a collision and a cube's half width, the least hole of a jitter or random world
+
+typedef struct
+{
+    uint32_t layout;
+    float size;
+    float spacing;
+    float jitter;  // < 0 for a quarter of the spacing
+    uint32_t count;
+    float hole;
+    uint32_t seed;
+    char file[256];
+} psimworldcfg;
+
+typedef struct
+{
+    float size;      // the car and porygon stay within ±size
+    float spawn;     // porygons spawn within ±spawn
+    uint32_t n;      // cubes
+    float* x;        // [n] in cell order
+    float* y;
+    float org;       // grid corner, -(size + PSIM_WORLD_MARGIN)
+    float inv_cell;
+    uint32_t gw;     // cells per side
+    uint32_t* start; // [gw*gw+1] first cube of each cell
+    uint32_t rn;     // ray grid entries, a cube is in 1 to 4 cells
+    float* rx;       // [rn] in cell order
+    float* ry;
+    uint32_t* rstart; // [gw*gw+1]
+} psimworld;
+
+void psimWorldDefaults(psimworldcfg* c);
+int  psimWorldParse(psimworldcfg* c, const char* spec);  // 0 on success, the defaults for keys not given
+int  psimWorldCreate(psimworld* w, const psimworldcfg* c); // 0 on success
+void psimWorldFree(psimworld* w);
+static inline const psimworld* psimWorldClassic(void);
+static inline void psimWorldBox(const psimworld* w, const float x, const float y, const float r, uint32_t* cx0, uint32_t* cx1, uint32_t* cy0, uint32_t* cy1);
+static inline float psimWorldRay(const psimworld* w, const float ox, const float oy, const float dx, const float dy, const float range); // (dx, dy) normalised, range if no cube is hit within it
+
+//
+
+static inline uint32_t psimWorldCellOf(const psimworld* w, const float v)
+{
+    const float c = (v - w->org) * w->inv_cell;
+    if(c <= 0.f){return 0;}
+    if(c >= (float)(w->gw-1)){return w->gw-1;}
+    return (uint32_t)c;
+}
+
+static inline void psimWorldBox(const psimworld* w, const float x, const float y, const float r, uint32_t* cx0, uint32_t* cx1, uint32_t* cy0, uint32_t* cy1)
+{
+    *cx0 = psimWorldCellOf(w, x-r);
+    *cx1 = psimWorldCellOf(w, x+r);
+    *cy0 = psimWorldCellOf(w, y-r);
+    *cy1 = psimWorldCellOf(w, y+r);
+}
+
+static inline float psimWorldRay(const psimworld* w, const float ox, const float oy, float dx, float dy, const float range)
+{
+    // an axis the ray does not move along never gets to its next cell
+    if(fabsf(dx) < 1e-9f){dx = dx < 0.f ? -1e-9f : 1e-9f;}
+    if(fabsf(dy) < 1e-9f){dy = dy < 0.f ? -1e-9f : 1e-9f;}
+    const float ix = 1.f / dx, iy = 1.f / dy;
+    const float gx = (ox - w->org) * w->inv_cell;
+    const float gy = (oy - w->org) * w->inv_cell;
+    const uint32_t cx = psimWorldCellOf(w, ox), cy = psimWorldCellOf(w, oy);
+    const float tdx = PSIM_WORLD_CELL * fabsf(ix), tdy = PSIM_WORLD_CELL * fabsf(iy);
+    float tmx = (dx > 0.f ? (float)(cx+1) - gx : gx - (float)cx) * tdx;
+    float tmy = (dy > 0.f ? (float)(cy+1) - gy : gy - (float)cy) * tdy;
+
+    // stepping is branch free, the ray ends at the range or the edge of the grid
+    const int32_t sx = dx > 0.f ? (int32_t)w->gw : -(int32_t)w->gw, sy = dy > 0.f ? 1 : -1;
+    const float ex = (dx > 0.f ? (float)w->gw - gx : gx) * tdx;
+    const float ey = (dy > 0.f ? (float)w->gw - gy : gy) * tdy;
+    const float lim = fminf(range, fminf(ex, ey));
+    const uint32_t last = w->gw*w->gw - 1;
+    uint32_t c = cx*w->gw + cy;
+    float best = range;
+    while(1)
+    {
+        const uint32_t cl = c > last ? last : c; // rounding at the edge of the grid
+        for(uint32_t k = w->rstart[cl], e = w->rstart[cl+1]; k < e; k++)
+        {
+            // slab test against the cube's collision box
+            const float ax = (w->rx[k] - PSIM_RAY_HALF - ox) * ix, bx = (w->rx[k] + PSIM_RAY_HALF - ox) * ix;
+            const float ay = (w->ry[k] - PSIM_RAY_HALF - oy) * iy, by = (w->ry[k] + PSIM_RAY_HALF - oy) * iy;
+            const float tn = fmaxf(fminf(ax, bx), fminf(ay, by));
+            const float tf = fminf(fmaxf(ax, bx), fmaxf(ay, by));
+            const float t = fmaxf(tn, 0.f);
+            best = (tn <= tf && tf >= 0.f && t < best) ? t : best;
+        }
+        // a hit before the next cell cannot be beaten by anything in it
+        const float tnext = fminf(tmx, tmy);
+        if(best <= tnext || tnext >= lim)
+            return best;
+        const int mx = tmx < tmy;
+        c += mx ? sx : sy;
+        tmx += mx ? tdx : 0.f;
+        tmy += mx ? 0.f : tdy;
+    }
+}
+
+void psimWorldDefaults(psimworldcfg* c)
+{
+    memset(c, 0, sizeof(psimworldcfg));
+    c->layout = PSIM_LAYOUT_LATTICE;
+    c->size = 17.5f;
+    c->spacing = 0.53f;
+    c->jitter = -1.f;
+    c->hole = 0.1f;
+    c->seed = 1;
+}
+
+int psimWorldParse(psimworldcfg* c, const char* spec)
+{
+    psimWorldDefaults(c);
+    char buf[1024];
+    if(strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+    char* save = NULL;
+    for(char* kv = strtok_r(buf, ",", &save); kv != NULL; kv = strtok_r(NULL, ",", &save))
+    {
+        char* v = strchr(kv, '=');
+        if(v == NULL)
+            return -1;
+        *v++ = 0;
+        if(strcmp(kv, "layout") == 0)
+        {
+            if(strcmp(v, "lattice") == 0){c->layout = PSIM_LAYOUT_LATTICE;}
+            else if(strcmp(v, "jitter") == 0){c->layout = PSIM_LAYOUT_JITTER;}
+            else if(strcmp(v, "random") == 0){c->layout = PSIM_LAYOUT_RANDOM;}
+            else if(strcmp(v, "file") == 0){c->layout = PSIM_LAYOUT_FILE;}
+            else{return -1;}
+        }
+        else if(strcmp(kv, "size") == 0){c->size = atof(v);}
+        else if(strcmp(kv, "spacing") == 0){c->spacing = atof(v);}
+        else if(strcmp(kv, "jitter") == 0){c->jitter = atof(v);}
+        else if(strcmp(kv, "count") == 0){c->count = strtoul(v, NULL, 10);}
+        else if(strcmp(kv, "hole") == 0){c->hole = atof(v);}
+        else if(strcmp(kv, "seed") == 0){c->seed = strtoul(v, NULL, 10);}
+        else if(strcmp(kv, "file") == 0)
+        {
+            if(strlen(v) >= sizeof(c->file))
+                return -1;
+            strcpy(c->file, v);
+            c->layout = PSIM_LAYOUT_FILE;
+        }
+        else
+            return -1;
+    }
+    if(!(c->size > 0.f && c->size <= 100000.f) || !(c->spacing > 0.01f) || c->hole < 0.f)
+        return -1;
+    if(c->layout == PSIM_LAYOUT_FILE && c->file[0] == 0)
+        return -1;
+    return 0;
+}
+
+void psimWorldFree(psimworld* w)
+{
+    free(w->x);
+    free(w->y);
+    free(w->start);
+    free(w->rx);
+    free(w->ry);
+    free(w->rstart);
+    memset(w, 0, sizeof(psimworld));
+}
+
+// the cube list, before the grid; 0 on success
+static int psimWorldAdd(float** x, float** y, uint32_t* n, uint32_t* cap, const psimworldcfg* c, const float hole, const float px, const float py)
+{
+    if((px >= -hole && px <= hole) && (py >= -hole && py <= hole))
+        return 0;
+    const float reach = c->size + PSIM_WORLD_MARGIN;
+    if(px < -reach || px > reach || py < -reach || py > reach)
+        return 0;
+    if(*n == PSIM_WORLD_MAX_CUBES)
+        return -1;
+    if(*n == *cap)
+    {
+        *cap = *cap ? *cap*2 : 4096;
+        float* nx = realloc(*x, *cap * sizeof(float));
+        if(nx == NULL){return -1;}
+        *x = nx;
+        float* ny = realloc(*y, *cap * sizeof(float));
+        if(ny == NULL){return -1;}
+        *y = ny;
+    }
+    (*x)[*n] = px;
+    (*y)[*n] = py;
+    (*n)++;
+    return 0;
+}
+
+static inline float psimWorldRandf(uint32_t* rng)
+{
+    *rng *= 16807;
+    return (float)(*rng & 0x7FFFFFFF) * 4.6566129e-010f;
+}
+
+int psimWorldCreate(psimworld* w, const psimworldcfg* c)
+{
+    memset(w, 0, sizeof(psimworld));
+    float *x = NULL, *y = NULL;
+    uint32_t n = 0, cap = 0;
+    uint32_t rng = c->seed == 0 ? 1 : c->seed;
+    int r = 0;
+    // the lattice keeps the game's arena exact, a placed cube must not start the car in a collision
+    const float hole = (c->layout == PSIM_LAYOUT_JITTER || c->layout == PSIM_LAYOUT_RANDOM) && c->hole < PSIM_WORLD_CLEAR ? PSIM_WORLD_CLEAR : c->hole;
+    if(c->layout == PSIM_LAYOUT_LATTICE || c->layout == PSIM_LAYOUT_JITTER)
+    {
+        // accumulated in float exactly like the game's loop, which is what places the original cubes
+        const float j = c->layout == PSIM_LAYOUT_JITTER ? (c->jitter < 0.f ? c->spacing*0.25f : c->jitter) : 0.f;
+        const float end = c->size + 0.5f;
+        for(float i = -c->size; i <= end && r == 0; i += c->spacing)
+            for(float k = -c->size; k <= end && r == 0; k += c->spacing)
+            {
+                float px = i, py = k;
+                if(j > 0.f)
+                {
+                    px += (psimWorldRandf(&rng)*2.f-1.f) * j;
+                    py += (psimWorldRandf(&rng)*2.f-1.f) * j;
+                }
+                r = psimWorldAdd(&x, &y, &n, &cap, c, hole, px, py);
+            }
+    }
+    else if(c->layout == PSIM_LAYOUT_RANDOM)
+    {
+        uint32_t count = c->count;
+        if(count == 0)
+        {
+            const float side = (2.f*c->size + 0.5f) / c->spacing + 1.f;
+            count = side*side > (float)PSIM_WORLD_MAX_CUBES ? PSIM_WORLD_MAX_CUBES : (uint32_t)(side*side);
+        }
+        for(uint32_t i = 0; i < count && r == 0; i++)
+        {
+            const float px = (psimWorldRandf(&rng)*2.f-1.f) * c->size;
+            const float py = (psimWorldRandf(&rng)*2.f-1.f) * c->size;
+            r = psimWorldAdd(&x, &y, &n, &cap, c, hole, px, py);
+        }
+    }
+    else if(c->layout == PSIM_LAYOUT_FILE)
+    {
+        FILE* f = fopen(c->file, "r");
+        if(f == NULL)
+            return -1;
+        char line[256];
+        while(r == 0 && fgets(line, sizeof(line), f) != NULL)
+        {
+            float px, py;
+            if(line[0] == '#' || sscanf(line, "%f %f", &px, &py) != 2)
+                continue;
+            r = psimWorldAdd(&x, &y, &n, &cap, c, hole, px, py);
+        }
+        fclose(f);
+    }
+    else
+        r = -1;
+
+    // bucket into the grid, a counting sort that keeps the generated order within a cell
+    w->size = c->size;
+    w->spawn = c->size + 0.5f;
+    w->org = -(c->size + PSIM_WORLD_MARGIN);
+    w->inv_cell = 1.f / PSIM_WORLD_CELL;
+    w->gw = (uint32_t)ceilf((-2.f*w->org) * w->inv_cell) + 1;
+    if(r == 0 && (uint64_t)w->gw*w->gw >= UINT32_MAX)
+        r = -1;
+    if(r == 0)
+    {
+        const uint32_t cells = w->gw*w->gw;
+        w->start = calloc((size_t)cells+1, sizeof(uint32_t));
+        w->x = malloc((n ? n : 1) * sizeof(float));
+        w->y = malloc((n ? n : 1) * sizeof(float));
+        if(w->start == NULL || w->x == NULL || w->y == NULL)
+            r = -1;
+        else
+        {
+            for(uint32_t i = 0; i < n; i++)
+                w->start[psimWorldCellOf(w, x[i])*w->gw + psimWorldCellOf(w, y[i]) + 1]++;
+            for(uint32_t i = 0; i < cells; i++)
+                w->start[i+1] += w->start[i];
+            for(uint32_t i = 0; i < n; i++)
+            {
+                const uint32_t k = w->start[psimWorldCellOf(w, x[i])*w->gw + psimWorldCellOf(w, y[i])]++;
+                w->x[k] = x[i];
+                w->y[k] = y[i];
+            }
+            // the fill moved every start to the next cell's
+            memmove(w->start+1, w->start, cells * sizeof(uint32_t));
+            w->start[0] = 0;
+            w->n = n;
+        }
+    }
+
+    // the ray grid, every cell a cube's collision box overlaps
+    if(r == 0)
+    {
+        const uint32_t cells = w->gw*w->gw;
+        w->rstart = calloc((size_t)cells+1, sizeof(uint32_t));
+        if(w->rstart == NULL)
+            r = -1;
+        for(int pass = 0; pass < 2 && r == 0; pass++)
+        {
+            for(uint32_t i = 0; i < n; i++)
+            {
+                const uint32_t x0 = psimWorldCellOf(w, x[i]-PSIM_RAY_HALF), x1 = psimWorldCellOf(w, x[i]+PSIM_RAY_HALF);
+                const uint32_t y0 = psimWorldCellOf(w, y[i]-PSIM_RAY_HALF), y1 = psimWorldCellOf(w, y[i]+PSIM_RAY_HALF);
+                for(uint32_t cx = x0; cx <= x1; cx++)
+                    for(uint32_t cy = y0; cy <= y1; cy++)
+                    {
+                        if(pass == 0)
+                        {
+                            w->rstart[cx*w->gw + cy + 1]++;
+                            continue;
+                        }
+                        const uint32_t k = w->rstart[cx*w->gw + cy]++;
+                        w->rx[k] = x[i];
+                        w->ry[k] = y[i];
+                    }
+            }
+            if(pass == 0)
+            {
+                for(uint32_t i = 0; i < cells; i++)
+                    w->rstart[i+1] += w->rstart[i];
+                w->rn = w->rstart[cells];
+                w->rx = malloc((w->rn ? w->rn : 1) * sizeof(float));
+                w->ry = malloc((w->rn ? w->rn : 1) * sizeof(float));
+                if(w->rx == NULL || w->ry == NULL)
+                    r = -1;
+            }
+            else
+            {
+                memmove(w->rstart+1, w->rstart, cells * sizeof(uint32_t));
+                w->rstart[0] = 0;
+            }
+        }
+    }
+    free(x);
+    free(y);
+    if(r != 0)
+        psimWorldFree(w);
+    return r;
+}
+
+static psimworld psim_world_classic;
+
+__attribute__((constructor)) static void psimWorldClassicInit(void)
+{
+    psimworldcfg c;
+    psimWorldDefaults(&c);
+    if(psimWorldCreate(&psim_world_classic, &c) != 0)
+    {
+        fprintf(stderr, "psimworld: out of memory for the classic arena\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline const psimworld* psimWorldClassic(void)
+{
+    return &psim_world_classic;
+}
+
+#endif
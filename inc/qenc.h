@@ -0,0 +1,261 @@
+/*
+    Quantized dataset encoding.
+
+    Dataset files are normally headerless float32 rows, 6 columns for X
+    and 2 for Y. Every column is bounded, so they can be stored as fp16 or
+    scaled int16 instead, a half of the disk and page cache. Such a file
+    starts with a qheader that declares the encoding and a scale per
+    column; a stored value q decodes to q * scale.
+
+        int16  scale = bound / 32767, values beyond the bound saturate
+        fp16   scale = bound, the stored values are normalised to +-1
+
+    File format (little-endian):
+
+        qheader  header     48 bytes
+        int16/fp16 rows[][columns]
+
+    Encode and decode are SSE2 for int16 and F16C for fp16 when the
+    compiler targets it (-march=native), scalar otherwise. dataset.py
+    decodes the same files in NumPy.
+*/
+
+#ifndef QENC_H
+#define QENC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+    #include <immintrin.h>
+#endif
+
+#define QENC_MAGIC   0x31535150 // "PQS1"
+#define QENC_VERSION 1
+#define QENC_MAX_COLUMNS 8
+
+#define QENC_F32 0 // headerless float32, the original format
+#define QENC_F16 1
+#define QENC_I16 2
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t encoding;  // QENC_F16 or QENC_I16
+    uint32_t columns;
+    uint32_t reserved;
+    float scale[QENC_MAX_COLUMNS];
+} qheader; // 48 bytes
+
+// bounds of the 6 inputs, pbd.x pbd.y lad.x lad.y angle dist, and the 2 targets, sr sp
+void qencInit(qheader* h, const uint16_t encoding, const uint32_t columns, const float* bounds);
+int  qencCheck(const qheader* h); // 0 if the header is valid
+
+static inline size_t qencBytes(const uint16_t encoding){return encoding == QENC_F32 ? 4 : 2;} // per value
+
+void qencEncode(const qheader* h, const float* in, void* out, const size_t rows);
+void qencDecode(const qheader* h, const void* in, float* out, const size_t rows);
+
+// scalar IEEE 754 half conversions, round to nearest even
+static inline uint16_t qencToHalf(const float f);
+static inline float qencFromHalf(const uint16_t h);
+
+//
+
+static inline uint16_t qencToHalf(const float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7FFFFFFF;
+    if(x >= 0x7F800000) // inf or nan
+        return sign | 0x7C00 | (x > 0x7F800000 ? 0x200 : 0);
+    if(x >= 0x477FF000) // rounds beyond the largest half
+        return sign | 0x7C00;
+    if(x < 0x38800000) // subnormal half or zero
+    {
+        if(x < 0x33000000)
+            return sign;
+        const uint32_t e = x >> 23;
+        const uint32_t m = (x & 0x7FFFFF) | 0x800000;
+        const uint32_t shift = 126 - e;
+        uint32_t r = m >> shift;
+        const uint32_t rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+        if(rem > half || (rem == half && (r & 1)))
+            r++;
+        return sign | r;
+    }
+    x -= 0x38000000; // rebias 127 to 15
+    uint32_t r = x >> 13;
+    const uint32_t rem = x & 0x1FFF;
+    if(rem > 0x1000 || (rem == 0x1000 && (r & 1)))
+        r++;
+    return sign | r;
+}
+
+static inline float qencFromHalf(const uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t e = (h >> 10) & 0x1F, m = h & 0x3FF;
+    uint32_t x;
+    if(e == 0)
+    {
+        if(m == 0)
+            x = sign;
+        else
+        {
+            const float f = (float)m * 5.9604645e-8f; // 2^-24
+            memcpy(&x, &f, 4);
+            x |= sign;
+        }
+    }
+    else if(e == 31)
+        x = sign | 0x7F800000 | (m << 13);
+    else
+        x = sign | ((e + 112) << 23) | (m << 13);
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+void qencInit(qheader* h, const uint16_t encoding, const uint32_t columns, const float* bounds)
+{
+    memset(h, 0, sizeof(qheader));
+    h->magic = QENC_MAGIC;
+    h->version = QENC_VERSION;
+    h->encoding = encoding;
+    h->columns = columns;
+    for(uint32_t i = 0; i < columns && i < QENC_MAX_COLUMNS; i++)
+        h->scale[i] = encoding == QENC_I16 ? bounds[i] / 32767.f : bounds[i];
+}
+
+int qencCheck(const qheader* h)
+{
+    if(h->magic != QENC_MAGIC || h->version != QENC_VERSION)
+        return -1;
+    if(h->encoding != QENC_F16 && h->encoding != QENC_I16)
+        return -1;
+    if(h->columns == 0 || h->columns > QENC_MAX_COLUMNS)
+        return -1;
+    for(uint32_t i = 0; i < h->columns; i++)
+        if(!(h->scale[i] > 0.f))
+            return -1;
+    return 0;
+}
+
+void qencEncode(const qheader* h, const float* in, void* out, const size_t rows)
+{
+    const uint32_t c = h->columns;
+    const size_t n = rows * c;
+    float inv[12];
+    for(uint32_t j = 0; j < 12; j++)
+        inv[j] = 1.f / h->scale[j % c];
+
+    // 6 inputs per row do not divide 4 lanes, so 12 values (two rows) are
+    // done per step with three rotated scale vectors; 2 and 4 column files
+    // repeat the same vector
+#if defined(__SSE2__)
+    const __m128 s0 = _mm_loadu_ps(inv), s1 = _mm_loadu_ps(inv + 4), s2 = _mm_loadu_ps(inv + 8);
+    const uint32_t simd = (12 % c) == 0;
+#endif
+    size_t i = 0;
+    if(h->encoding == QENC_I16)
+    {
+        int16_t* o = out;
+#if defined(__SSE2__)
+        if(simd)
+        {
+            for(; i + 12 <= n; i += 12)
+            {
+                const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), s0));
+                const __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), s1));
+                const __m128i d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 8), s2));
+                _mm_storeu_si128((__m128i*)(o + i), _mm_packs_epi32(a, b)); // saturates
+                _mm_storel_epi64((__m128i*)(o + i + 8), _mm_packs_epi32(d, d));
+            }
+        }
+#endif
+        for(; i < n; i++)
+        {
+            float q = in[i] * inv[i % c];
+            q = q > 32767.f ? 32767.f : q < -32768.f ? -32768.f : q;
+            o[i] = (int16_t)lrintf(q);
+        }
+    }
+    else
+    {
+        uint16_t* o = out;
+#if defined(__F16C__)
+        if(simd)
+        {
+            for(; i + 12 <= n; i += 12)
+            {
+                _mm_storel_epi64((__m128i*)(o + i),     _mm_cvtps_ph(_mm_mul_ps(_mm_loadu_ps(in + i), s0), _MM_FROUND_TO_NEAREST_INT));
+                _mm_storel_epi64((__m128i*)(o + i + 4), _mm_cvtps_ph(_mm_mul_ps(_mm_loadu_ps(in + i + 4), s1), _MM_FROUND_TO_NEAREST_INT));
+                _mm_storel_epi64((__m128i*)(o + i + 8), _mm_cvtps_ph(_mm_mul_ps(_mm_loadu_ps(in + i + 8), s2), _MM_FROUND_TO_NEAREST_INT));
+            }
+        }
+#endif
+        for(; i < n; i++)
+            o[i] = qencToHalf(in[i] * inv[i % c]);
+    }
+}
+
+void qencDecode(const qheader* h, const void* in, float* out, const size_t rows)
+{
+    const uint32_t c = h->columns;
+    const size_t n = rows * c;
+
+    // same layout as qencEncode()
+#if defined(__SSE2__)
+    const float* sc = h->scale;
+    const __m128 s0 = _mm_setr_ps(sc[0],     sc[1 % c], sc[2 % c],  sc[3 % c]);
+    const __m128 s1 = _mm_setr_ps(sc[4 % c], sc[5 % c], sc[6 % c],  sc[7 % c]);
+    const __m128 s2 = _mm_setr_ps(sc[8 % c], sc[9 % c], sc[10 % c], sc[11 % c]);
+    const uint32_t simd = (12 % c) == 0;
+#endif
+    size_t i = 0;
+    if(h->encoding == QENC_I16)
+    {
+        const int16_t* p = in;
+#if defined(__SSE2__)
+        if(simd)
+        {
+            for(; i + 12 <= n; i += 12)
+            {
+                const __m128i a = _mm_loadu_si128((const __m128i*)(p + i));      // values 0-7
+                const __m128i b = _mm_loadl_epi64((const __m128i*)(p + i + 8));  // values 8-11
+                const __m128i a0 = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16); // sign extend
+                const __m128i a1 = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+                const __m128i b0 = _mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16);
+                _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(a0), s0));
+                _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(a1), s1));
+                _mm_storeu_ps(out + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(b0), s2));
+            }
+        }
+#endif
+        for(; i < n; i++)
+            out[i] = (float)p[i] * h->scale[i % c];
+    }
+    else
+    {
+        const uint16_t* p = in;
+#if defined(__F16C__)
+        if(simd)
+        {
+            for(; i + 12 <= n; i += 12)
+            {
+                _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(p + i))), s0));
+                _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(p + i + 4))), s1));
+                _mm_storeu_ps(out + i + 8, _mm_mul_ps(_mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(p + i + 8))), s2));
+            }
+        }
+#endif
+        for(; i < n; i++)
+            out[i] = qencFromHalf(p[i]) * h->scale[i % c];
+    }
+}
+
+#endif
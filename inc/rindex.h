@@ -0,0 +1,54 @@
+/*
+    Per-round dataset index.
+
+    porydrivecli appends one fixed 64 byte record to <score>.idx for every
+    round it logs to the <score> bucket, next to the bucket files and under
+    the same lock. A record keeps the raw factors the round score is made
+    of and where the round's rows are, so any subset of rounds can be
+    selected or re-scored later without capturing again (see rquery/).
+
+    Offsets are into <score>_x.<ext> and <score>_y.<ext> for the float32 and
+    quantized formats; for RIDX_PDB both are the offset of the block in
+    <score>.pdb, whose header gives its size.
+
+    Records carry a magic so files can be joined and resynchronised, the
+    file has no header.
+*/
+
+#ifndef RINDEX_H
+#define RINDEX_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define RIDX_MAGIC 0x31584952 // "RIX1"
+
+// formats, the first three match QENC_*
+#define RIDX_F32 0
+#define RIDX_F16 1
+#define RIDX_I16 2
+#define RIDX_PDB 3
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t format;     // RIDX_*
+    uint32_t rows;
+    uint32_t cc;         // collisions in the round
+    uint64_t x_off;      // byte offsets of the round's rows
+    uint64_t y_off;
+    uint64_t seed;       // game seed
+    float    score;      // the score it was bucketed by
+    float    start_dist;
+    float    zs;
+    float    zt;
+    float    rtime;      // round time, seconds
+    uint32_t round;      // round index in the game
+} ridx; // 64 bytes
+
+static inline const char* ridxExt(const uint32_t format)
+{
+    return format == RIDX_F16 ? "f16" : format == RIDX_I16 ? "i16" : format == RIDX_PDB ? "pdb" : "dat";
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+    Info:
+
+        Lookup-table policy compiler.
+
+        Samples an exported `.fnn` model (see export.py) on a grid of
+        car heading, porygon bearing and distance and writes the result as a
+        `.lut` table (see inc/lut.h) which answers sr/sp with trilinear
+        interpolation in a few nanoseconds.
+
+        After baking, the table is checked against the network on random
+        states and the error and per-evaluation timings are reported.
+
+    Usage:
+
+        ./lutcompile <model.fnn> <out.lut> [heading nodes] [bearing nodes] [distance nodes] [max distance] [error samples]
+        ./lutcompile policy.fnn policy.lut 64 64 64 51 1000000
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../inc/fnn.h"
+#include "../inc/lut.h"
+
+fnn net;
+lut tab;
+uint32_t nthreads = 1;
+
+double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// each thread bakes an interleaved set of heading slices
+void* bakeThread(void* arg)
+{
+    const uint32_t id = (uint32_t)(uintptr_t)arg;
+    for(uint32_t ih = id; ih < tab.nh; ih += nthreads)
+    {
+        for(uint32_t ib = 0; ib < tab.nb; ib++)
+        {
+            for(uint32_t k = 0; k < tab.nd; k++)
+            {
+                float input[6];
+                lutNode(&tab, ih, ib, k, input);
+                float* o = &tab.data[(((size_t)ih * tab.nb + ib) * tab.nd + k) * 2];
+                fnnEval(&net, input, o);
+            }
+        }
+    }
+    return NULL;
+}
+
+static inline float xrandf(uint64_t* s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return (float)(*s >> 40) * 5.9604645e-08f; // [0, 1)
+}
+
+int main(int argc, char** argv)
+{
+    printf("----\n");
+    printf("PoryDrive LUT Compiler\n");
+    printf("----\n");
+
+    if(argc < 3)
+    {
+        printf("Usage: ./lutcompile <model.fnn> <out.lut> [heading nodes] [bearing nodes] [distance nodes] [max distance] [error samples]\n");
+        return 0;
+    }
+
+    uint32_t nh = 64, nb = 64, nd = 64;
+    float dmax = 51.f;
+    uint32_t samples = 1000000;
+    if(argc >= 4){nh = atoi(argv[3]);}
+    if(argc >= 5){nb = atoi(argv[4]);}
+    if(argc >= 6){nd = atoi(argv[5]);}
+    if(argc >= 7){dmax = atof(argv[6]);}
+    if(argc >= 8){samples = atoi(argv[7]);}
+
+    if(fnnLoad(&net, argv[1]) < 0)
+    {
+        printf("Failed to load model: %s\n", argv[1]);
+        return 1;
+    }
+    if(net.l[0].n_in != 6 || net.l[net.layers-1].n_out != 2)
+    {
+        printf("Model must take 6 inputs and produce 2 outputs, this one is %u:%u.\n", net.l[0].n_in, net.l[net.layers-1].n_out);
+        return 1;
+    }
+    printf("Model: %s (%u layers)\n", argv[1], net.layers);
+
+    if(lutAlloc(&tab, nh, nb, nd, dmax) < 0)
+    {
+        printf("Invalid table dimensions %ux%ux%u with max distance %g.\n", nh, nb, nd, dmax);
+        return 1;
+    }
+    printf("Table: %ux%ux%u nodes, max distance %g, %.2f MB\n", nh, nb, nd, dmax, (double)nh*nb*nd*2*sizeof(float)/1048576.0);
+
+    // bake
+    long np = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = np > 0 ? (uint32_t)np : 1;
+    if(nthreads > nh){nthreads = nh;}
+    double st = getTime();
+    pthread_t th[nthreads];
+    for(uint32_t i = 0; i < nthreads; i++)
+        pthread_create(&th[i], NULL, bakeThread, (void*)(uintptr_t)i);
+    for(uint32_t i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+    printf("Baked in %.2f seconds on %u threads.\n", getTime()-st, nthreads);
+
+    if(lutSave(&tab, argv[2]) < 0)
+    {
+        printf("Failed to write table: %s\n", argv[2]);
+        return 1;
+    }
+    printf("Wrote: %s\n", argv[2]);
+
+    // error report against the network on random states
+    float* in = samples > 0 ? malloc((size_t)samples * 8 * sizeof(float)) : NULL;
+    if(in != NULL)
+    {
+        float* of = in + (size_t)samples * 6;
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        for(uint32_t i = 0; i < samples; i++)
+        {
+            const float h = -LUT_PI + LUT_2PI * xrandf(&seed);
+            const float b = -LUT_PI + LUT_2PI * xrandf(&seed);
+            const float d = dmax * xrandf(&seed);
+            float* x = &in[i*6];
+            x[0] = cosf(h), x[1] = sinf(h), x[2] = cosf(b), x[3] = sinf(b), x[4] = cosf(h-b), x[5] = d;
+        }
+
+        st = getTime();
+        for(uint32_t i = 0; i < samples; i++)
+            fnnEval(&net, &in[i*6], &of[i*2]);
+        const double tfnn = getTime()-st;
+
+        double sum[2] = {0}, sumsq[2] = {0}, mx[2] = {0};
+        st = getTime();
+        for(uint32_t i = 0; i < samples; i++)
+        {
+            float ol[2];
+            lutEval(&tab, &in[i*6], ol);
+            for(int k = 0; k < 2; k++)
+            {
+                const double e = fabs((double)of[i*2+k] - (double)ol[k]);
+                sum[k] += e;
+                sumsq[k] += e*e;
+                if(e > mx[k]){mx[k] = e;}
+            }
+        }
+        const double tlut = getTime()-st;
+
+        printf("----\n");
+        printf("Error report over %u random states:\n", samples);
+        printf("sr: mean abs %g, rms %g, max %g\n", sum[0]/samples, sqrt(sumsq[0]/samples), mx[0]);
+        printf("sp: mean abs %g, rms %g, max %g\n", sum[1]/samples, sqrt(sumsq[1]/samples), mx[1]);
+        printf("FNN: %.1f ns/eval, LUT: %.1f ns/eval (incl. error accounting)\n", tfnn/samples*1e9, tlut/samples*1e9);
+        free(in);
+    }
+
+    lutFree(&tab);
+    fnnFree(&net);
+    return 0;
+}
@@ -26,6 +26,17 @@
         1-5 = Car Physics config selection (5 loads from file)
 
 
+    Replay (--replay <file>, a porydrivecli --record recording):
+
+        Space = Pause/Play
+        UP/DOWN = Double/Halve playback speed
+        LEFT/RIGHT = Seek back/forward 10 seconds, 1 with Shift
+        COMMA/PERIOD = Step back/forward one tick
+        PAGE UP/PAGE DOWN = Previous/Next round
+        E = 5 seconds before the end of the round in play
+        HOME/END = Start/End of the recording
+
+
     Mouse:
 
         RIGHT CLICK/MOUSE4 = Zoom Snap Close/Ariel
@@ -88,6 +99,12 @@
 #include "inc/esAux2.h"
 
 #include "inc/res.h"
+#include "inc/lut.h"
+#include "inc/fnn.h"
+#include "inc/porysim.h"
+#include "inc/psimrays.h"
+#include "inc/psimreplay.h"
+#include "inc/evlog.h"
 #include "assets/purplecube.h"
 #include "assets/porygon.h"
 #include "assets/dna.h"
@@ -176,7 +193,14 @@ uint auto_drive=0;
     f32 ad_min_speedswitch = 2.f;
     f32 ad_maxspeed_reductor = 0.5f;
 uint neural_drive=0;
+lut neural_lut = {0}; // policy.lut, when loaded it replaces the pred.py bridge
+fnn neural_fnn = {0}; // policy.fnn, used natively when there is no policy.lut
 uint dataset_logger=0;
+evlog events = {0}; // binary event log, fourth command line argument
+uint round_index = 0;
+uint game_seed = 0;
+double round_start_time = 0.0;
+f32 start_dist = 0.f;
 
 // porygon vars
 vec zp; // position
@@ -203,6 +227,16 @@ f32 suspension_pitch_limit = 0.03f;
 f32 suspension_roll = 30.f;
 f32 suspension_roll_limit = 9.f;
 uint sticky_collisions = 0;
+psimworld world = {0};  // a "world <spec>" line in config.txt (see inc/psimworld.h)
+const psimworld* wp;    // the world, or the classic arena
+psimrays rays = {0};    // a "rays <spec>" line in config.txt, for a policy.fnn that takes 6+k inputs (see inc/psimrays.h)
+
+// replay, --replay <file>; the game is a porydrivecli --record recording stepped through porysim.h in virtual time
+psimreplay replay = {0};
+f32 replay_speed = 1.f;  // recorded ticks per tick of the loop
+uint replay_pause = 0;
+f32 replay_acc = 0.f;    // fractional ticks owed at speeds under 1
+uint replay_round = 0;   // the round last printed to the console
 
 char cname[256] = {0};
 
@@ -215,6 +249,36 @@ void timestamp(char* ts)
     strftime(ts, 16, "%H:%M:%S", localtime(&tt));
 }
 
+void logEvent(const uint16_t type, const f32* v, const uint n)
+{
+    if(events.ring == NULL)
+        return;
+    evrec r;
+    memset(&r, 0, sizeof(r));
+    r.type = type;
+    r.round = round_index;
+    r.seed = game_seed;
+    r.t = t;
+    r.cc = cc;
+    r.cp = cp;
+    if(n > 0)
+        memcpy(r.v, v, n*sizeof(f32));
+    evlogPush(&events, &r);
+}
+
+void logRoundStart()
+{
+    round_index++;
+    round_start_time = t;
+    start_dist = vDist(pp, zp);
+    logEvent(EV_ROUND_START, (f32[]){start_dist, zs, zt, zp.x, zp.y, pp.x, pp.y}, 7);
+}
+
+void closeEvents()
+{
+    evlogClose(&events);
+}
+
 void loadConfig(uint type)
 {
     FILE* f = fopen("config.txt", "r");
@@ -231,14 +295,36 @@ void loadConfig(uint type)
         else
             printf("\nDetected config.txt loading settings...\n");
 
-        char line[256];
-        while(fgets(line, 256, f) != NULL)
+        char line[1024];
+        while(fgets(line, 1024, f) != NULL)
         {
             char set[64];
             memset(set, 0, 64);
             float val;
-            
-            if(sscanf(line, "%63s %f", set, &val) == 2)
+            char spec[1024];
+
+            if(sscanf(line, "world %1023s", spec) == 1)
+            {
+                psimworldcfg wc;
+                psimworld nw;
+                if(psimWorldParse(&wc, spec) == 0 && psimWorldCreate(&nw, &wc) == 0)
+                {
+                    if(wp == &world){psimWorldFree(&world);}
+                    world = nw;
+                    wp = &world;
+                    printf("World Loaded: %u cubes within ±%g\n", world.n, world.size);
+                }
+                else
+                    printf("Invalid world: %s\n", spec);
+            }
+            else if(sscanf(line, "rays %1023s", spec) == 1)
+            {
+                if(psimRaysParse(&rays, spec) == 0)
+                    printf("Rays Loaded: %u over %g units in a fan of %g degrees\n", rays.k, rays.range, rays.fan * RAD2DEG);
+                else
+                    printf("Invalid rays: %s\n", spec);
+            }
+            else if(sscanf(line, "%63s %f", set, &val) == 2)
             {
                 if(type == 0)
                     printf("Setting Loaded: %s %g\n", set, val);
@@ -455,11 +541,15 @@ uint64_t microtime()
     return 1000000 * tv.tv_sec + tv.tv_usec;
 }
 
-#define isnorm isnormal
-// static inline uint isnorm(const f32 f)
-// {
-//     return isnormal(f);
-// }
+// finite and not denormal; zero is a legitimate value, sr == 0 is driving straight.
+// Tested on the bits, -Ofast lets the compiler assume there are no NaNs.
+static inline uint isnorm(const f32 f)
+{
+    uint32_t b;
+    memcpy(&b, &f, 4);
+    const uint32_t e = b & 0x7F800000;
+    return (e != 0 && e != 0x7F800000) || (b & 0x7FFFFFFF) == 0;
+}
 
 int forceTrim(const char* file, const size_t trim)
 {
@@ -547,7 +637,7 @@ void iterDNA()
     iterBody();
 }
 
-void rCube(f32 x, f32 y)
+void rCube(f32 x, f32 y, f32 id)
 {
     if(RENDER_PASS == 1)
     {
@@ -576,16 +666,8 @@ void rCube(f32 x, f32 y)
         }
     }
 
-    // cube collisions
-    const f32 dlap = vDistLa(zp, (vec){x, y, 0.f}); // porygon
-    if(dlap < 0.15f)
-    {
-        vec nf;
-        vSub(&nf, zp, (vec){x, y, 0.f});
-        vNorm(&nf);
-        vMulS(&nf, nf, 0.15f-dlap);
-        vAdd(&zp, zp, nf);
-    }
+    // the porygon was pushed out of the cubes by cubePorygon()
+    const f32 dlap = vDistLa(zp, (vec){x, y, 0.f});
 
     //printf("pp: %f %f - %f\n", pp.x, pp.y, t);
     //printf("pv: %f %f - %f\n", pv.x, pv.y, t);
@@ -611,27 +693,21 @@ void rCube(f32 x, f32 y)
         const f32 dla2 = vDistLa(cp2, (vec){x, y, 0.f}); // back car
         if(dla1 <= 0.097f)
         {
-            vec nf;
-            vSub(&nf, pp, (vec){x, y, 0.f});
-            vNorm(&nf);
+            vec nf = psimPushDir(pp, x, y);
             vMulS(&nf, nf, 0.097f-dla1);
             vAdd(&pv, pv, nf);
             if(sticky_collisions){sp *= 0.5f;}
         }
         else if(dla0 <= 0.097f)
         {
-            vec nf;
-            vSub(&nf, pp, (vec){x, y, 0.f});
-            vNorm(&nf);
+            vec nf = psimPushDir(pp, x, y);
             vMulS(&nf, nf, 0.097f-dla0);
             vAdd(&pv, pv, nf);
             if(sticky_collisions){sp *= 0.5f;}
         }
         else if(dla2 <= 0.097f)
         {
-            vec nf;
-            vSub(&nf, pp, (vec){x, y, 0.f});
-            vNorm(&nf);
+            vec nf = psimPushDir(pp, x, y);
             vMulS(&nf, nf, 0.097f-dla2);
             vAdd(&pv, pv, nf);
             if(sticky_collisions){sp *= 0.5f;}
@@ -647,15 +723,16 @@ void rCube(f32 x, f32 y)
     {
         if(colliding == 0.f)
         {
-            colliding = x*y+x;
+            colliding = id;
             cc++;
+            logEvent(EV_COLLISION, (f32[]){pp.x, pp.y, sp}, 3);
 
             // char strts[16];
             // timestamp(&strts[0]);
             // printf("[%s] Collisions: %u\n", strts, cc);
         }
     }
-    else if(x*y+x == colliding)
+    else if(id == colliding)
     {
         colliding = 0.f;
     }
@@ -667,15 +744,16 @@ void rCube(f32 x, f32 y)
         {
             if(pc == 0.f)
             {
-                pc = x*y+x;
+                pc = id;
                 cc++;
+                logEvent(EV_COLLISION, (f32[]){pp.x, pp.y, sp}, 3);
 
                 // char strts[16];
                 // timestamp(&strts[0]);
                 // printf("[%s] Collisions: %u\n", strts, cc);
             }
         }
-        else if(x*y+x == pc)
+        else if(id == pc)
         {
             pc = 0.f;
         }
@@ -700,6 +778,27 @@ void rCube(f32 x, f32 y)
     }
 }
 
+// cube collisions for the porygon, which may be out of sight of the car in a large world
+void cubePorygon()
+{
+    uint32_t cx0, cx1, cy0, cy1;
+    psimWorldBox(wp, zp.x, zp.y, 0.15f, &cx0, &cx1, &cy0, &cy1);
+    for(uint32_t cx = cx0; cx <= cx1; cx++)
+    {
+        for(uint32_t k = wp->start[cx*wp->gw+cy0], e = wp->start[cx*wp->gw+cy1+1]; k < e; k++)
+        {
+            const vec c = (vec){wp->x[k], wp->y[k], 0.f};
+            const f32 dlap = vDistLa(zp, c);
+            if(dlap < 0.15f)
+            {
+                vec nf = psimPushDir(zp, c.x, c.y);
+                vMulS(&nf, nf, 0.15f-dlap);
+                vAdd(&zp, zp, nf);
+            }
+        }
+    }
+}
+
 void rPorygon(f32 x, f32 y, f32 r)
 {
     if(RENDER_PASS == 1)
@@ -949,7 +1048,8 @@ void rCar(f32 x, f32 y, f32 z, f32 rx)
 // game functions
 //*************************************
 
-void newGame(unsigned int seed)
+// everything of a new game but the start records, those go after randGame() has set its porygon
+void resetGame(unsigned int seed)
 {
     srand(seed);
     srandf(seed);
@@ -972,11 +1072,20 @@ void newGame(unsigned int seed)
     sr = 0.f;
     sp = 0.f;
 
-    zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
+    zp = (vec){uRandFloat(-wp->spawn, wp->spawn), uRandFloat(-wp->spawn, wp->spawn), 0.f};
     //zp = (vec){0.f, 0.3f, 0.f};
     zs = 0.3f;
     za = 0.0;
     zt = 8.f;
+
+    game_seed = seed;
+}
+
+void newGame(unsigned int seed)
+{
+    resetGame(seed);
+    logEvent(EV_GAME_START, NULL, 0);
+    logRoundStart();
 }
 
 void randAutoDrive()
@@ -990,12 +1099,14 @@ void randAutoDrive()
 void randGame()
 {
     const int seed = urand();
-    newGame(seed);
+    resetGame(seed);
 
-    zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
+    zp = (vec){uRandFloat(-wp->spawn, wp->spawn), uRandFloat(-wp->spawn, wp->spawn), 0.f};
     zs = uRandFloat(0.3f, 1.f);
     zt = uRandFloat(8.f, 16.f);
     za = 0.0;
+    logEvent(EV_GAME_START, NULL, 0);
+    logRoundStart();
 
     // randAutoDrive();
     configScarletFast();
@@ -1009,10 +1120,162 @@ void randGame()
     printf("\n[%s] Rand Game Start [%u], DATASET LOGGER & AUTO DRIVE ON.\n", strts, seed);
 }
 
+//*************************************
+// replay
+//*************************************
+
+// the clock of the state after `tick` ticks
+double replayClock(const uint32_t tick)
+{
+    return tick == 0 ? replay.h.start.t : replay.ticks[tick-1].t;
+}
+
+void replayPrintRound(const uint32_t i)
+{
+    const psimround* rd = &replay.rounds[i];
+    const double rst = rd->start == 0 ? replay.h.start.round_start_time : replayClock(rd->start);
+    const double at = replayClock(rd->start) - replayClock(0);
+    char strts[16];
+    timestamp(&strts[0]);
+    if(rd->e == PSIM_COLLECTED)
+        printf("[%s] Replay round %u of %u at %.1f s (t %.3f): collected in %.1f s, score %.3f.\n", strts, replay.h.round+i, replay.h.round+replay.nr-1, at, replayClock(rd->start), replayClock(rd->end+1)-rst, rd->score);
+    else if(rd->e == PSIM_TIMEOUT)
+        printf("[%s] Replay round %u of %u at %.1f s (t %.3f): timed out.\n", strts, replay.h.round+i, replay.h.round+replay.nr-1, at, replayClock(rd->start));
+    else
+        printf("[%s] Replay round %u of %u at %.1f s (t %.3f): still in play at the end.\n", strts, replay.h.round+i, replay.h.round+replay.nr-1, at, replayClock(rd->start));
+}
+
+void replaySeek(const int64_t tick)
+{
+    psimReplaySeek(&replay, tick < 0 ? 0 : tick > replay.n ? replay.n : (uint32_t)tick);
+    replay_acc = 0.f;
+}
+
+// advances the recording in virtual time and shows its state; the game's own physics sit out
+void replayUpdate()
+{
+    if(replay_pause == 0)
+    {
+        replay_acc += replay_speed;
+        for(; replay_acc >= 1.f; replay_acc -= 1.f)
+            if(psimReplayStep(&replay) < 0)
+                break;
+        if(replay.at == replay.n)
+            replay_acc = 0.f;
+    }
+
+    const uint32_t rd = psimReplayRound(&replay, replay.at);
+    if(rd != replay_round)
+    {
+        replay_round = rd;
+        replayPrintRound(rd);
+    }
+
+    // the recorded clocks are moved onto the game's for the porygon fade
+    psim s = replay.s;
+    psimRebase(&s, t);
+    pr = s.pr, sr = s.sr, pp = s.pp, pv = s.pv, pd = s.pd, pbd = s.pbd, sp = s.sp;
+    cp = s.cp, cc = s.cc;
+    zp = s.zp, zd = s.zd, zr = s.zr, zs = s.zs, za = s.za, zt = s.zt;
+
+    static double ltut = 0.0;
+    if(t > ltut)
+    {
+        char title[512];
+        const double rt = replayClock(replay.at) - replayClock(0);
+        const double rl = replayClock(replay.n) - replayClock(0);
+        const f32 dsp = fabsf(sp*(1.f/maxspeed)*130.f);
+        sprintf(title, "| Replay %02u:%02u:%02u / %02u:%02u:%02u | %s%s%gx | Round %u | Speed %.f MPH | Porygon %u | %s", (uint)(rt/3600), (uint)(rt/60)%60, (uint)rt%60, (uint)(rl/3600), (uint)(rl/60)%60, (uint)rl%60, replay.resyncs > 0 ? "Resynced " : "", replay_pause ? "Paused " : "", replay_speed, replay.h.round+rd, dsp, cp, cname);
+        glfwSetWindowTitle(window, title);
+        ltut = t + 0.25;
+    }
+}
+
+// 1 when the key was for the replay
+uint replayKey(const int key, const int action, const int mods)
+{
+    // only seeking repeats while a key is held
+    if(action == GLFW_REPEAT && key != GLFW_KEY_LEFT && key != GLFW_KEY_RIGHT && key != GLFW_KEY_COMMA && key != GLFW_KEY_PERIOD)
+        return 1;
+    const int64_t at = replay.at;
+    const int64_t sec = mods & GLFW_MOD_SHIFT ? 144 : 1440;
+    if(key == GLFW_KEY_SPACE)
+        replay_pause = 1 - replay_pause;
+    else if(key == GLFW_KEY_UP)
+        replay_speed = replay_speed < 1024.f ? replay_speed * 2.f : 1024.f;
+    else if(key == GLFW_KEY_DOWN)
+        replay_speed = replay_speed > 0.125f ? replay_speed * 0.5f : 0.125f;
+    else if(key == GLFW_KEY_LEFT)
+        replaySeek(at - sec);
+    else if(key == GLFW_KEY_RIGHT)
+        replaySeek(at + sec);
+    else if(key == GLFW_KEY_COMMA)
+        replay_pause = 1, replaySeek(at - 1);
+    else if(key == GLFW_KEY_PERIOD)
+        replay_pause = 1, replaySeek(at + 1);
+    else if(key == GLFW_KEY_PAGE_UP)
+    {
+        // to the start of the round in play, or of the one before when just there
+        const uint32_t rd = psimReplayRound(&replay, replay.at);
+        const uint32_t st = replay.rounds[rd].start;
+        replaySeek(at - st > 144 || rd == 0 ? st : replay.rounds[rd-1].start);
+    }
+    else if(key == GLFW_KEY_PAGE_DOWN)
+    {
+        const uint32_t rd = psimReplayRound(&replay, replay.at);
+        replaySeek(rd+1 < replay.nr ? replay.rounds[rd+1].start : replay.n);
+    }
+    else if(key == GLFW_KEY_E)
+    {
+        const psimround* rd = &replay.rounds[psimReplayRound(&replay, replay.at)];
+        replaySeek(rd->end > rd->start + 720 ? rd->end - 720 : rd->start);
+    }
+    else if(key == GLFW_KEY_HOME)
+        replaySeek(0);
+    else if(key == GLFW_KEY_END)
+        replaySeek(replay.n);
+    else
+        return key != GLFW_KEY_ESCAPE && key != GLFW_KEY_F && key != GLFW_KEY_P; // the game's keys have nothing to drive
+    return 1;
+}
+
+int replayLoad(const char* file)
+{
+    if(psimReplayLoad(&replay, file, 0) < 0)
+        return -1;
+
+    // the recording's world and car physics
+    const psimcfg* c = &replay.cfg;
+    wp = psimWorld(c);
+    maxspeed = c->maxspeed;
+    acceleration = c->acceleration;
+    inertia = c->inertia;
+    drag = c->drag;
+    steeringspeed = c->steeringspeed;
+    steerinertia = c->steerinertia;
+    minsteer = c->minsteer;
+    maxsteer = c->maxsteer;
+    steering_deadzone = c->steering_deadzone;
+    steeringtransfer = c->steeringtransfer;
+    steeringtransferinertia = c->steeringtransferinertia;
+    sticky_collisions = c->sticky_collisions;
+    sprintf(cname, "%s", replay.prof->name);
+
+    const double len = replayClock(replay.n) - replayClock(0);
+    char strts[16];
+    timestamp(&strts[0]);
+    printf("[%s] Replay [%u]: %u ticks, %.1f minutes, %u rounds, %s physics in %u cubes within ±%g.\n", strts, (uint)replay.h.seed, replay.n, len/60.0, replay.nr, cname, wp->n, wp->size);
+    if(replay.diverged < replay.n)
+        printf("[%s] Replay: this build steps the recording differently, first before %.1f s (tick %u); it takes the recorded state again every 10 seconds, %u times, and may differ from the recorded game in between. Build porydrive with the compiler and flags porydrivecli was built with to replay it exactly.\n", strts, replayClock(replay.diverged) - replayClock(0), replay.diverged, replay.resyncs);
+    replay_round = 0;
+    replayPrintRound(0);
+    return 0;
+}
+
 //*************************************
 // update & render
 //*************************************
-void main_loop()
+void gameUpdate()
 {
 //*************************************
 // keystates
@@ -1124,42 +1387,62 @@ void main_loop()
         const f32 angle = vDot(pbd, lad);
         const f32 dist = vDist(pp, zp);
 
-        const float input[6] = {pbd.x, pbd.y, lad.x, lad.y, angle, dist};
+        float input[6+PSIM_RAYS_MAX] = {pbd.x, pbd.y, lad.x, lad.y, angle, dist};
+        if(neural_fnn.l != NULL && neural_fnn.l[0].n_in == 6+rays.k && rays.k > 0)
+            psimRaysCastAt(&rays, wp, pp.x, pp.y, pbd.x, pbd.y, input+6);
 
-        // write input to file
-        FILE *f = fopen("/dev/shm/porydrive_input.dat", "wb");
-        if(f != NULL)
+        // baked lookup-table policy, no bridge required
+        if(neural_lut.data != NULL)
         {
-            const size_t wbs = 6 * sizeof(float);
-            if(fwrite(input, 1, wbs, f) != wbs)
-                printf("ERROR: neural write failed.\n");
-            fclose(f);
+            float ret[2];
+            lutEval(&neural_lut, input, ret);
+            sr = ret[0];
+            sp = ret[1];
         }
-
-        // load last result
-        float ret[2];
-        f = fopen("/dev/shm/porydrive_r.dat", "rb");
-        if(f != NULL)
+        else if(neural_fnn.l != NULL) // exported or neuroevolved network evaluated in-process
         {
-            if(fread(&ret, sizeof(float), 2, f) == 2)
+            float ret[2];
+            fnnEval(&neural_fnn, input, ret);
+            sr = ret[0];
+            sp = ret[1];
+        }
+        else
+        {
+            // write input to file
+            FILE *f = fopen("/dev/shm/porydrive_input.dat", "wb");
+            if(f != NULL)
             {
-                // lock range
-                // if(ret[0] < -1.f){ret[0] = -1.f;}
-                // if(ret[0] > 1.f){ret[0] = 1.f;}
-                // if(ret[1] < -1.f){ret[1] = -1.f;}
-                // if(ret[1] > 1.f){ret[1] = 1.f;}
-                // printf("%f %f %u %u\n", ret[0], ret[1], isnorm(ret[0]), isnorm(ret[1]));
-
-                if(isnorm(ret[0]) == 1 && isnorm(ret[1]) == 1)
+                const size_t wbs = 6 * sizeof(float);
+                if(fwrite(input, 1, wbs, f) != wbs)
+                    printf("ERROR: neural write failed.\n");
+                fclose(f);
+            }
+
+            // load last result
+            float ret[2];
+            f = fopen("/dev/shm/porydrive_r.dat", "rb");
+            if(f != NULL)
+            {
+                if(fread(&ret, sizeof(float), 2, f) == 2)
                 {
-                    // set new vars
-                    sr = ret[0];
-                    sp = ret[1];
-                }
+                    // lock range
+                    // if(ret[0] < -1.f){ret[0] = -1.f;}
+                    // if(ret[0] > 1.f){ret[0] = 1.f;}
+                    // if(ret[1] < -1.f){ret[1] = -1.f;}
+                    // if(ret[1] > 1.f){ret[1] = 1.f;}
+                    // printf("%f %f %u %u\n", ret[0], ret[1], isnorm(ret[0]), isnorm(ret[1]));
+
+                    if(isnorm(ret[0]) == 1 && isnorm(ret[1]) == 1)
+                    {
+                        // set new vars
+                        sr = ret[0];
+                        sp = ret[1];
+                    }
 
-                // printf("%f %f\n", sp, sr);
+                    // printf("%f %f\n", sp, sr);
+                }
+                fclose(f);
             }
-            fclose(f);
         }
     }
     
@@ -1302,10 +1585,11 @@ void main_loop()
         pr -= sr * steeringtransfer * (sp*steeringtransferinertia);
     }
 
-    if(pp.x > 17.5f){pp.x = 17.5f;}
-    else if(pp.x < -17.5f){pp.x = -17.5f;}
-    if(pp.y > 17.5f){pp.y = 17.5f;}
-    else if(pp.y < -17.5f){pp.y = -17.5f;}
+    const f32 b = wp->size;
+    if(pp.x > b){pp.x = b;}
+    else if(pp.x < -b){pp.x = -b;}
+    if(pp.y > b){pp.y = b;}
+    else if(pp.y < -b){pp.y = -b;}
 
 //*************************************
 // simulate porygon
@@ -1318,10 +1602,10 @@ void main_loop()
         vAdd(&zp, zp, inc);
         zr += fRandFloat(-zt, zt) * dt;
 
-        if(zp.x > 17.5f){zp.x = 17.5f; zr = fRandFloat(-PI, PI);}
-        else if(zp.x < -17.5f){zp.x = -17.5f; zr = fRandFloat(-PI, PI);}
-        if(zp.y > 17.5f){zp.y = 17.5f; zr = fRandFloat(-PI, PI);}
-        else if(zp.y < -17.5f){zp.y = -17.5f; zr = fRandFloat(-PI, PI);}
+        if(zp.x > b){zp.x = b; zr = fRandFloat(-PI, PI);}
+        else if(zp.x < -b){zp.x = -b; zr = fRandFloat(-PI, PI);}
+        if(zp.y > b){zp.y = b; zr = fRandFloat(-PI, PI);}
+        else if(zp.y < -b){zp.y = -b; zr = fRandFloat(-PI, PI);}
 
         // front collision cube point
         vec cp1 = pp;
@@ -1344,6 +1628,11 @@ void main_loop()
             za = t+6.0;
             iterDNA();
 
+            f32 terms[5];
+            const double rtime = t-round_start_time;
+            const f32 score = psimScore(start_dist, zs, zt, rtime, cc, terms);
+            logEvent(EV_ROUND_END, (f32[]){terms[0], terms[1], terms[2], terms[3], terms[4], score, (f32)rtime, start_dist}, 8);
+
             char strts[16];
             timestamp(&strts[0]);
             printf("[%s] Porygon collected: %u, collisions: %u\n", strts, cp, cc);
@@ -1352,14 +1641,18 @@ void main_loop()
     }
     else if(t > za)
     {
-        zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
+        zp = (vec){uRandFloat(-wp->spawn, wp->spawn), uRandFloat(-wp->spawn, wp->spawn), 0.f};
         zs = uRandFloat(0.3f, 1.f);
         zt = uRandFloat(8.f, 16.f);
         za = 0.0;
+        logRoundStart();
 
         // randAutoDrive();
     }
+}
 
+void renderScene()
+{
 //*************************************
 // camera
 //*************************************
@@ -1398,11 +1691,14 @@ void main_loop()
 // main render
 //*************************************
 
-    // render scene
-    for(f32 i = -17.5f; i <= 18.f; i += 0.53f)
-        for(f32 j = -17.5f; j <= 18.f; j += 0.53f)
-            if((i < -0.1f || i > 0.1f) || (j < -0.1f || j > 0.1f)) // lol a branch for so little tut tut
-                rCube(i, j);
+    // render scene, the cubes within the far plane of the car; the
+    // car's collisions are done as they are drawn
+    cubePorygon();
+    uint32_t cx0, cx1, cy0, cy1;
+    psimWorldBox(wp, pp.x, pp.y, FAR_DISTANCE, &cx0, &cx1, &cy0, &cy1);
+    for(uint32_t cx = cx0; cx <= cx1; cx++)
+        for(uint32_t k = wp->start[cx*wp->gw+cy0], e = wp->start[cx*wp->gw+cy1+1]; k < e; k++)
+            rCube(wp->x[k], wp->y[k], (f32)(k+1));
 
     // render porygon
     rPorygon(zp.x, zp.y, zr);
@@ -1421,11 +1717,22 @@ void main_loop()
         glfwSwapBuffers(window);
 }
 
+void main_loop()
+{
+    if(replay.n != 0)
+        replayUpdate();
+    else
+        gameUpdate();
+    renderScene();
+}
+
 //*************************************
 // Input Handelling
 //*************************************
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    if(replay.n != 0 && action != GLFW_RELEASE && replayKey(key, action, mods) == 1)
+        return;
     // control
     if(action == GLFW_PRESS)
     {
@@ -1445,6 +1752,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
             printf("[%s] Game End.\n", strts);
             printf("[%s] Porygon Collected: %u\n", strts, cp);
             printf("[%s] Time-Taken: %s or %g Seconds\n\n", strts, tts, t-st);
+            logEvent(EV_GAME_END, (f32[]){(f32)(t-st)}, 1);
             
             // new
             newGame(urand());
@@ -1543,6 +1851,15 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
                 configScarletFast();
                 char strts[16];
                 timestamp(&strts[0]);
+                if(neural_lut.data == NULL && lutLoad(&neural_lut, "policy.lut") == 0)
+                    printf("[%s] Loaded policy.lut (%ux%ux%u).\n", strts, neural_lut.nh, neural_lut.nb, neural_lut.nd);
+                else if(neural_lut.data == NULL && neural_fnn.l == NULL && fnnLoad(&neural_fnn, "policy.fnn") == 0)
+                {
+                    printf("[%s] Loaded policy.fnn (%u layers).\n", strts, neural_fnn.layers);
+                    const uint32_t k = neural_fnn.l[0].n_in - 6;
+                    if(k != rays.k && psimRaysInit(&rays, k, x2PI, 2.f) == 0)
+                        printf("[%s] policy.fnn takes %u rays, cast all around over 2 units without a rays line in config.txt.\n", strts, k);
+                }
                 printf("[%s] Neural Drive: ON\n", strts);
             }
         }
@@ -1630,7 +1947,7 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 
     mIdent(&projection);
     mPerspective(&projection, 60.0f, aspect, 0.01f, FAR_DISTANCE);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (f32*)&projection.m[0][0])
+    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (f32*)&projection.m[0][0]);
 }
 
 //*************************************
@@ -1638,6 +1955,21 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 //*************************************
 int main(int argc, char** argv)
 {
+    // replay flags come before the positional arguments
+    char* replay_file = NULL;
+    double replay_at = -1.0;
+    while(argc >= 3 && strncmp(argv[1], "--", 2) == 0)
+    {
+        if(strcmp(argv[1], "--replay") == 0)
+            replay_file = argv[2];
+        else if(strcmp(argv[1], "--at") == 0)
+            replay_at = atof(argv[2]);
+        else
+            break;
+        argv += 2;
+        argc -= 2;
+    }
+
     // allow custom msaa level
     int msaa = 16;
     if(argc >= 2){msaa = atoi(argv[1]);}
@@ -1647,7 +1979,7 @@ int main(int argc, char** argv)
     if(argc >= 3){maxfps = atof(argv[2]);}
 
     // trigger special mode
-    if(argc == 4)
+    if(argc >= 4)
         winw = 420, winh = 240, msaa = 0, maxfps = 10.0, RENDER_PASS = 0;
 
     // help
@@ -1658,6 +1990,8 @@ int main(int argc, char** argv)
     printf("----\n");
     printf("Three command line arguments, msaa 0-16, maxfps, data logging mode 0-1.\n");
     printf("e.g; ./porydrive 16 144 0\n");
+    printf("A fourth writes a binary event log, e.g; ./porydrive 16 144 0 events.pev\n");
+    printf("--replay <file> first plays back a porydrivecli --record recording, --at <t> from its clock t, e.g; ./porydrive --replay game.prp --at 812.5\n");
     printf("----\n");
     printf("~ Keyboard Input:\n");
     printf("ESCAPE = Focus/Unfocus Mouse Look\n");
@@ -1673,6 +2007,14 @@ int main(int argc, char** argv)
     printf("Space = Brake\n");
     printf("1-5 = Car Physics config selection (5 loads from file)\n");
     printf("L = Toggle dataset logging\n");
+    printf("~ Replay Input:\n");
+    printf("Space = Pause/Play\n");
+    printf("UP/DOWN = Double/Halve playback speed\n");
+    printf("LEFT/RIGHT = Seek back/forward 10 seconds, 1 with Shift\n");
+    printf("COMMA/PERIOD = Step back/forward one tick\n");
+    printf("PAGE UP/PAGE DOWN = Previous/Next round\n");
+    printf("E = 5 seconds before the end of the round in play\n");
+    printf("HOME/END = Start/End of the recording\n");
     printf("----\n");
     printf("~ Mouse Input:\n");
     printf("RIGHT/MOUSE4 = Zoom Snap Close/Ariel\n");
@@ -1813,9 +2155,27 @@ int main(int argc, char** argv)
 //*************************************
 
     // init
+    wp = psimWorldClassic();
     configScarlet();
     loadConfig(0);
-    if(argc == 4)
+    if(argc >= 5)
+    {
+        if(evlogOpen(&events, argv[4], 0, EVLOG_FLAG_GUI) == 0)
+            atexit(closeEvents);
+        else
+            printf("Failed to open event log: %s\n", argv[4]);
+    }
+    if(replay_file != NULL)
+    {
+        if(replayLoad(replay_file) < 0)
+        {
+            printf("Failed to load replay: %s\n", replay_file);
+            exit(EXIT_FAILURE);
+        }
+        if(replay_at >= 0.0)
+            replaySeek(psimReplayFind(&replay, replay_at));
+    }
+    else if(argc >= 4)
         randGame();
     else
         newGame(NEWGAME_SEED);
@@ -1920,6 +2280,7 @@ int main(int argc, char** argv)
     printf("[%s] Game End.\n", strts);
     printf("[%s] Porygon Collected: %u\n", strts, cp);
     printf("[%s] Time-Taken: %s or %g Seconds\n\n", strts, tts, t-st);
+    logEvent(EV_GAME_END, (f32[]){(f32)(t-st)}, 1);
 
     // done
     glfwDestroyWindow(window);
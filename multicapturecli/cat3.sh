@@ -1,2 +1 @@
-cat 0.8_x.dat 0.9_x.dat 1.0_x.dat > dataset_x.dat
-cat 0.8_y.dat 0.9_y.dat 1.0_y.dat > dataset_y.dat
\ No newline at end of file
+../dsmerge/dsmerge dataset_x.dat dataset_y.dat . --min-score 0.8
\ No newline at end of file
@@ -1,2 +1,5 @@
-gcc main.c -I ../inc -Ofast -lm -o porydrivecli
-./porydrivecli
\ No newline at end of file
+gcc main.c -I ../inc -Ofast -lm -lpthread -o porydrivecli
+gcc farm.c -O2 -o porydrivefarm
+gcc top.c -I ../inc -O2 -o porydrive-top
+gcc coord.c -I ../inc -O2 -o porydrive-coord
+./porydrivecli
@@ -0,0 +1,1019 @@
+/*
+    Info:
+
+        Distributed capture for porydrivecli over TCP.
+
+        A coordinator hands out game seeds to workers on any number of
+        hosts, tracks the rounds that come back against per-bucket
+        quotas and appends them to its own bucket files. A worker runs
+        one `porydrivecli --stream --fast --seed <seed>` per core and sends
+        every round its processes stream back down the connection.
+
+        > one lease is one seed of <rounds> rounds. A seed is leased to
+          one process at a time and never handed out again once it has
+          run, so no two hosts ever simulate the same game.
+
+        > a seeded --fast run is reproducible, so when a worker drops
+          out mid-seed the seed goes back in the queue with the count of
+          rounds already received, and whoever gets it next skips those.
+
+        > quotas are rounds per score bucket; a full bucket is closed
+          and the workers told, they stop sending its rounds. With any
+          --quota only the buckets given one are collected and the run
+          ends when they are all full, otherwise it ends when the seed
+          range is used up.
+
+        > local runs a coordinator and N workers on 127.0.0.1 of one
+          machine, to test a setup before it goes out to the hosts.
+
+        > every round kept goes in <score>.idx beside its bucket files
+          too, as porydrivecli's do (see inc/rindex.h); the index record
+          comes down the stream with the round.
+
+        Messages are an 8 byte header [uint32 type][uint32 payload
+        length] and a fixed payload, a round is followed by its rows as
+        in --stream. Little-endian hosts only.
+
+    Usage:
+
+        ./porydrive-coord serve [--listen <host:port>] [options]
+        ./porydrive-coord work <host:port> [-j <procs>] [--cli <path>] [-- <porydrivecli flags>]
+        ./porydrive-coord local <workers> [-j <procs>] [--cli <path>] [options] [-- <porydrivecli flags>]
+
+        --listen <host:port>   default 0.0.0.0:7474
+        --seeds <first:count>  the seed range handed out (default 1:1000000)
+        --rounds <n>           rounds per seed (default 64)
+        --min-score <x>        lowest score streamed back (default 0.01)
+        --quota <bucket:n>     rounds wanted in a bucket, e.g. --quota 0.8:5000, repeatable
+        --out <dir>            where the bucket files go (default .)
+        -j <procs>             porydrivecli processes per worker (default: cores)
+
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../inc/metrics.h"
+#include "../inc/rindex.h"
+
+#define COORD_VERSION 2
+#define COORD_PORT    "7474"
+#define MAX_CONNS     1024
+#define MAX_PROCS     1024
+#define ROUND_MAX     (57024/6) // rows, the porydrivecli log buffer
+
+#define PC_HELLO 1 // w>c pchello
+#define PC_WANT  2 // w>c uint32 n, n more leases
+#define PC_LEASE 3 // c>w pclease
+#define PC_ROUND 4 // w>c pcround, f32 x[rows*6], f32 y[rows*2]
+#define PC_DONE  5 // w>c uint64 seed, all of its rounds were run
+#define PC_FAIL  6 // w>c uint64 seed, the process died; back in the queue
+#define PC_QUOTA 7 // c>w uint32 closed, bit per bucket that takes no more rounds
+#define PC_STOP  8 // c>w nothing left, the worker ends
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t len;
+} pchdr;
+
+typedef struct
+{
+    uint32_t version;
+    uint32_t procs;
+    char name[64];
+} pchello;
+
+typedef struct
+{
+    uint64_t seed;
+    uint32_t rounds;
+    uint32_t skip;      // rounds of this seed the coordinator already has
+    float minscore;
+    uint32_t closed;
+} pclease;
+
+typedef struct
+{
+    uint64_t seed;      // the lease
+    uint32_t ordinal;   // nth round this seed streamed
+    uint32_t pad;
+    ridx r;             // as streamed, without offsets
+} pcround;
+
+volatile sig_atomic_t quit = 0;
+
+void sigQuit(int s)
+{
+    (void)s;
+    quit = 1;
+}
+
+double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void timestamp(char* ts)
+{
+    const time_t tt = time(0);
+    strftime(ts, 16, "%H:%M:%S", localtime(&tt));
+}
+
+int writeAll(const int f, const void* buf, size_t len)
+{
+    const char* p = buf;
+    while(len > 0)
+    {
+        const ssize_t wb = write(f, p, len);
+        if(wb < 0 && errno == EINTR)
+            continue;
+        if(wb <= 0)
+            return -1;
+        p += wb;
+        len -= wb;
+    }
+    return 0;
+}
+
+int sendMsg(const int fd, const uint32_t type, const void* p, const uint32_t len)
+{
+    const pchdr h = {type, len};
+    if(writeAll(fd, &h, sizeof(h)) < 0)
+        return -1;
+    return len > 0 ? writeAll(fd, p, len) : 0;
+}
+
+// "host:port", either may be left out
+void splitAddr(const char* s, char* host, char* port)
+{
+    strcpy(host, "0.0.0.0");
+    strcpy(port, COORD_PORT);
+    const char* c = strrchr(s, ':');
+    if(c == NULL)
+    {
+        snprintf(host, 256, "%s", s);
+        return;
+    }
+    if(c > s)
+        snprintf(host, 256, "%.*s", (int)(c-s), s);
+    if(c[1] != 0)
+        snprintf(port, 16, "%s", c+1);
+}
+
+int listenOn(const char* addr)
+{
+    char host[256], port[16];
+    splitAddr(addr, host, port);
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if(getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+    int fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(fd == -1 || bind(fd, res->ai_addr, res->ai_addrlen) == -1 || listen(fd, 128) == -1)
+    {
+        if(fd > -1){close(fd);}
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int connectTo(const char* addr)
+{
+    char host[256], port[16];
+    splitAddr(addr, host, port);
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+    int fd = -1;
+    for(struct addrinfo* a = res; a != NULL && fd == -1; a = a->ai_next)
+    {
+        fd = socket(a->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd > -1 && connect(fd, a->ai_addr, a->ai_addrlen) == -1)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if(fd > -1)
+    {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// a growing receive buffer, messages are taken off the front as they complete
+typedef struct
+{
+    uint8_t* p;
+    size_t n, cap;
+} rbuf;
+
+// -1 on EOF or error
+int rbufFill(rbuf* b, const int fd)
+{
+    if(b->cap - b->n < 65536)
+    {
+        const size_t nc = b->cap < 65536 ? 262144 : b->cap * 2;
+        uint8_t* np = realloc(b->p, nc);
+        if(np == NULL)
+            return -1;
+        b->p = np, b->cap = nc;
+    }
+    const ssize_t r = read(fd, b->p + b->n, b->cap - b->n);
+    if(r < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if(r <= 0)
+        return -1;
+    b->n += r;
+    return 0;
+}
+
+void rbufTake(rbuf* b, const size_t len)
+{
+    memmove(b->p, b->p + len, b->n - len);
+    b->n -= len;
+}
+
+//*************************************
+// coordinator
+//*************************************
+
+typedef struct
+{
+    int fd;
+    rbuf in;
+    uint32_t want;      // leases asked for and not yet given
+    uint32_t procs;
+    uint64_t rounds;
+    char name[64];
+} conn;
+
+typedef struct
+{
+    uint64_t seed;
+    uint32_t got;       // rounds received, the skip when it is leased again
+    int c;              // the connection holding it, -1 when queued
+} lease;
+
+typedef struct
+{
+    const char* listen;
+    uint64_t seed_first, seed_count;
+    uint32_t rounds;
+    float minscore;
+    uint64_t quota[METRICS_BUCKETS];
+    uint32_t has_quota;
+    const char* out;
+} coordopts;
+
+conn conns[MAX_CONNS];
+uint32_t nconns = 0;
+lease* leases = NULL; // in flight and requeued
+uint32_t nleases = 0, cap_leases = 0;
+uint64_t seed_next = 0, seeds_done = 0;
+uint64_t got_rounds[METRICS_BUCKETS] = {0}, got_rows[METRICS_BUCKETS] = {0}, dropped = 0;
+uint32_t closed = 0;
+uint64_t last_total = 0; // kept rounds at the last progress line
+
+uint32_t closedMask(const coordopts* o)
+{
+    uint32_t m = 0;
+    for(int b = 0; b < METRICS_BUCKETS; b++)
+        if(o->has_quota == 1 && got_rounds[b] >= o->quota[b])
+            m |= 1u << b;
+    return m;
+}
+
+int allFull(const coordopts* o)
+{
+    return o->has_quota == 1 && closed == (1u << METRICS_BUCKETS) - 1;
+}
+
+// the round's rows and its index record, at the offsets the rows went to
+int appendRound(const coordopts* o, const ridx* ri, const float* x, const float* y)
+{
+    char fnx[512], fny[512], fni[512];
+    snprintf(fnx, sizeof(fnx), "%s/%.1f_x.dat", o->out, ri->score);
+    snprintf(fny, sizeof(fny), "%s/%.1f_y.dat", o->out, ri->score);
+    snprintf(fni, sizeof(fni), "%s/%.1f.idx", o->out, ri->score);
+    const int fx = open(fnx, O_APPEND | O_CREAT | O_WRONLY | O_CLOEXEC, S_IRWXU);
+    if(fx == -1)
+        return -1;
+    const int fy = open(fny, O_APPEND | O_CREAT | O_WRONLY | O_CLOEXEC, S_IRWXU);
+    if(fy == -1)
+    {
+        close(fx);
+        return -1;
+    }
+    const int fi = open(fni, O_APPEND | O_CREAT | O_WRONLY | O_CLOEXEC, S_IRWXU);
+    if(fi == -1)
+    {
+        close(fy);
+        close(fx);
+        return -1;
+    }
+    // local porydrivecli processes may share the bucket files
+    flock(fx, LOCK_EX);
+    ridx r = *ri;
+    r.x_off = lseek(fx, 0, SEEK_END);
+    r.y_off = lseek(fy, 0, SEEK_END);
+    const int e = writeAll(fx, x, r.rows*6*sizeof(float)) < 0 || writeAll(fy, y, r.rows*2*sizeof(float)) < 0 ||
+                  writeAll(fi, &r, sizeof(r)) < 0 ? -1 : 0;
+    flock(fx, LOCK_UN);
+    close(fi);
+    close(fy);
+    close(fx);
+    return e;
+}
+
+void giveLeases(const coordopts* o, conn* c, const int ci)
+{
+    while(c->want > 0)
+    {
+        // requeued seeds first
+        int li = -1;
+        for(uint32_t i = 0; i < nleases; i++)
+            if(leases[i].c == -1){li = i; break;}
+        if(li == -1)
+        {
+            if(seed_next >= o->seed_first + o->seed_count)
+                return;
+            if(nleases == cap_leases)
+            {
+                cap_leases = cap_leases ? cap_leases*2 : 256;
+                leases = realloc(leases, cap_leases * sizeof(lease));
+                if(leases == NULL)
+                {
+                    printf("Out of memory.\n");
+                    exit(1);
+                }
+            }
+            li = nleases++;
+            leases[li] = (lease){seed_next++, 0, -1};
+        }
+        leases[li].c = ci;
+        const pclease l = {leases[li].seed, o->rounds, leases[li].got, o->minscore, closed};
+        sendMsg(c->fd, PC_LEASE, &l, sizeof(l));
+        c->want--;
+    }
+}
+
+lease* findLease(const int ci, const uint64_t seed)
+{
+    for(uint32_t i = 0; i < nleases; i++)
+        if(leases[i].c == ci && leases[i].seed == seed)
+            return &leases[i];
+    return NULL;
+}
+
+void dropLease(lease* l)
+{
+    *l = leases[--nleases];
+}
+
+void dropConn(const int ci)
+{
+    char strts[16];
+    timestamp(&strts[0]);
+    printf("[%s] Worker %s left after %llu rounds.\n", strts, conns[ci].name, (unsigned long long)conns[ci].rounds);
+    for(uint32_t i = 0; i < nleases; i++)
+        if(leases[i].c == ci)
+            leases[i].c = -1; // back in the queue
+    close(conns[ci].fd);
+    free(conns[ci].in.p);
+    // the last connection takes its index, and its leases with it
+    const int last = --nconns;
+    if(ci != last)
+    {
+        conns[ci] = conns[last];
+        for(uint32_t i = 0; i < nleases; i++)
+            if(leases[i].c == last)
+                leases[i].c = ci;
+    }
+}
+
+// -1 drops the connection
+int handleMsg(const coordopts* o, const int ci, const pchdr* h, const uint8_t* p)
+{
+    conn* c = &conns[ci];
+    if(h->type == PC_HELLO && h->len == sizeof(pchello))
+    {
+        const pchello* m = (const pchello*)p;
+        if(m->version != COORD_VERSION)
+            return -1;
+        memcpy(c->name, m->name, 63);
+        c->procs = m->procs;
+        char strts[16];
+        timestamp(&strts[0]);
+        printf("[%s] Worker %s joined with %u processes.\n", strts, c->name, c->procs);
+        if(closed != 0)
+            sendMsg(c->fd, PC_QUOTA, &closed, sizeof(closed));
+    }
+    else if(h->type == PC_WANT && h->len == sizeof(uint32_t))
+    {
+        c->want += *(const uint32_t*)p;
+        giveLeases(o, c, ci);
+    }
+    else if(h->type == PC_ROUND && h->len >= sizeof(pcround))
+    {
+        const pcround* m = (const pcround*)p;
+        if(m->r.magic != RIDX_MAGIC || m->r.format != RIDX_F32 || m->r.rows == 0 || m->r.rows > ROUND_MAX || h->len != sizeof(pcround) + m->r.rows*8*sizeof(float))
+            return -1;
+        lease* l = findLease(ci, m->seed);
+        if(l == NULL || m->ordinal < l->got)
+            return 0; // not its lease, or a round we already have
+        l->got = m->ordinal + 1;
+        c->rounds++;
+        const int b = metricsBucket(m->r.score);
+        if(m->r.score < o->minscore || (closed & (1u << b)) != 0)
+        {
+            dropped++;
+            return 0;
+        }
+        const float* x = (const float*)(p + sizeof(pcround));
+        if(appendRound(o, &m->r, x, x + m->r.rows*6) < 0)
+        {
+            printf("Failed to write the %.1f bucket files, exiting.\n", m->r.score);
+            exit(1);
+        }
+        got_rounds[b]++;
+        got_rows[b] += m->r.rows;
+        const uint32_t nc = closedMask(o);
+        if(nc != closed)
+        {
+            closed = nc;
+            for(uint32_t i = 0; i < nconns; i++)
+                sendMsg(conns[i].fd, PC_QUOTA, &closed, sizeof(closed));
+        }
+    }
+    else if((h->type == PC_DONE || h->type == PC_FAIL) && h->len == sizeof(uint64_t))
+    {
+        lease* l = findLease(ci, *(const uint64_t*)p);
+        if(l == NULL)
+            return 0;
+        if(h->type == PC_DONE)
+        {
+            seeds_done++;
+            dropLease(l);
+        }
+        else
+            l->c = -1;
+        // a requeued seed may be waiting on another worker
+        for(uint32_t i = 0; i < nconns; i++)
+            giveLeases(o, &conns[i], i);
+    }
+    else
+        return -1;
+    return 0;
+}
+
+void printProgress(const coordopts* o, const double elapsed)
+{
+    uint64_t total = 0;
+    for(int b = 0; b < METRICS_BUCKETS; b++)
+        total += got_rounds[b];
+    uint32_t procs = 0;
+    for(uint32_t i = 0; i < nconns; i++)
+        procs += conns[i].procs;
+    char strts[16];
+    timestamp(&strts[0]);
+    printf("[%s] workers %u (%u processes) | seeds %llu done, %u leased | rounds %llu kept, %llu dropped | %.1f rounds/min | %.0f sec\n",
+        strts, nconns, procs, (unsigned long long)seeds_done, nleases, (unsigned long long)total, (unsigned long long)dropped,
+        (double)(total - last_total) * 6.0, elapsed);
+    last_total = total;
+    char line[512];
+    int n = 0;
+    for(int b = 0; b < METRICS_BUCKETS && n < 400; b++)
+    {
+        if(o->has_quota == 1 && o->quota[b] > 0)
+            n += sprintf(line+n, " %.1f:%llu/%llu", b*0.1f, (unsigned long long)got_rounds[b], (unsigned long long)o->quota[b]);
+        else if(got_rounds[b] > 0)
+            n += sprintf(line+n, " %.1f:%llu", b*0.1f, (unsigned long long)got_rounds[b]);
+    }
+    if(n > 0)
+        printf("[%s] buckets%s\n", strts, line);
+}
+
+int serve(const coordopts* o, const int lfd)
+{
+    seed_next = o->seed_first;
+    closed = closedMask(o);
+    char strts[16];
+    timestamp(&strts[0]);
+    printf("[%s] Coordinating seeds %llu to %llu, %u rounds each, min score %g, bucket files in %s\n", strts, (unsigned long long)o->seed_first,
+        (unsigned long long)(o->seed_first + o->seed_count - 1), o->rounds, o->minscore, o->out);
+
+    struct pollfd pfd[MAX_CONNS+1];
+    const double st = getTime();
+    double next_report = st + 10.0;
+    while(quit == 0)
+    {
+        if(allFull(o) || (seed_next >= o->seed_first + o->seed_count && nleases == 0))
+            break;
+
+        pfd[0] = (struct pollfd){lfd, POLLIN, 0};
+        for(uint32_t i = 0; i < nconns; i++)
+            pfd[i+1] = (struct pollfd){conns[i].fd, POLLIN, 0};
+        poll(pfd, nconns+1, 500);
+
+        // serviced from the back so that dropping one does not move any still to do
+        for(int i = (int)nconns-1; i >= 0; i--)
+        {
+            if(pfd[i+1].revents == 0)
+                continue;
+            conn* c = &conns[i];
+            int r = rbufFill(&c->in, c->fd);
+            while(r == 0 && c->in.n >= sizeof(pchdr))
+            {
+                pchdr h;
+                memcpy(&h, c->in.p, sizeof(h));
+                if(h.len > sizeof(pcround) + ROUND_MAX*8*sizeof(float))
+                {
+                    r = -1;
+                    break;
+                }
+                if(c->in.n < sizeof(pchdr) + h.len)
+                    break;
+                r = handleMsg(o, i, &h, c->in.p + sizeof(pchdr));
+                rbufTake(&c->in, sizeof(pchdr) + h.len);
+            }
+            if(r < 0)
+                dropConn(i);
+        }
+
+        if(pfd[0].revents & POLLIN)
+        {
+            const int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+            if(fd > -1 && nconns < MAX_CONNS)
+            {
+                const int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                memset(&conns[nconns], 0, sizeof(conn));
+                conns[nconns].fd = fd;
+                strcpy(conns[nconns].name, "?");
+                nconns++;
+            }
+            else if(fd > -1)
+                close(fd);
+        }
+
+        if(getTime() >= next_report)
+        {
+            printProgress(o, getTime() - st);
+            next_report = getTime() + 10.0;
+        }
+    }
+
+    for(uint32_t i = 0; i < nconns; i++)
+    {
+        sendMsg(conns[i].fd, PC_STOP, NULL, 0);
+        close(conns[i].fd);
+    }
+    printProgress(o, getTime() - st);
+    timestamp(&strts[0]);
+    if(quit == 1)
+        printf("[%s] Stopped.\n", strts);
+    else if(allFull(o))
+        printf("[%s] All quotas are full.\n", strts);
+    else
+        printf("[%s] The seed range is used up.\n", strts);
+    return 0;
+}
+
+//*************************************
+// worker
+//*************************************
+
+typedef struct
+{
+    pid_t pid;          // 0 when free
+    int fd;             // its --stream stdout
+    uint64_t seed;
+    uint32_t skip, ordinal;
+    rbuf in;
+} proc;
+
+proc procs[MAX_PROCS];
+uint32_t wclosed = 0;
+
+// the game seed of a leased seed; neighbouring lease numbers are spread over the whole 32 bits (splitmix64)
+// rather than handed to the game's multiplicative generator as small correlated seeds
+uint32_t gameSeed(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    const uint32_t s = (uint32_t)(x >> 32);
+    return s != 0 ? s : 1;
+}
+
+int spawn(proc* p, const pclease* l, const char* cli, char** extra, const int nextra)
+{
+    int pp[2];
+    if(pipe2(pp, O_CLOEXEC) == -1)
+        return -1;
+    const pid_t pid = fork();
+    if(pid == -1)
+    {
+        close(pp[0]);
+        close(pp[1]);
+        return -1;
+    }
+    if(pid == 0)
+    {
+        signal(SIGINT, SIG_IGN); // stopped by the worker
+        signal(SIGPIPE, SIG_DFL);
+        char seed[32], rounds[16], minscore[32];
+        sprintf(seed, "%u", gameSeed(l->seed));
+        sprintf(rounds, "%u", l->rounds);
+        sprintf(minscore, "%g", l->minscore);
+        char* argv[nextra + 10];
+        int n = 0;
+        argv[n++] = (char*)cli;
+        argv[n++] = "--stream";
+        argv[n++] = "--fast"; // a requeued seed skips the rounds already received, that needs a reproducible run
+        argv[n++] = "--quiet";
+        argv[n++] = "--seed";
+        argv[n++] = seed;
+        for(int i = 0; i < nextra; i++)
+            argv[n++] = extra[i];
+        argv[n++] = rounds;
+        argv[n++] = "0";
+        argv[n++] = minscore;
+        argv[n] = NULL;
+        const int dn = open("/dev/null", O_WRONLY);
+        dup2(pp[1], 1);
+        if(dn > -1){dup2(dn, 2);}
+        execv(cli, argv);
+        _exit(127);
+    }
+    close(pp[1]);
+    p->pid = pid;
+    p->fd = pp[0];
+    p->seed = l->seed;
+    p->skip = l->skip;
+    p->ordinal = 0;
+    p->in.n = 0;
+    return 0;
+}
+
+// forwards the whole rounds in a process' stream, [ridx][f32 x[rows*6]][f32 y[rows*2]]
+int forwardRounds(proc* p, const int sfd)
+{
+    while(p->in.n >= sizeof(ridx))
+    {
+        ridx ri;
+        memcpy(&ri, p->in.p, sizeof(ri));
+        if(ri.magic != RIDX_MAGIC || ri.rows > ROUND_MAX)
+            return -1;
+        const size_t len = sizeof(ri) + ri.rows*8*sizeof(float);
+        if(p->in.n < len)
+            break;
+        const uint32_t ordinal = p->ordinal++;
+        if(ordinal >= p->skip && (wclosed & (1u << metricsBucket(ri.score))) == 0)
+        {
+            const pcround r = {p->seed, ordinal, 0, ri};
+            const pchdr h = {PC_ROUND, sizeof(r) + ri.rows*8*sizeof(float)};
+            if(writeAll(sfd, &h, sizeof(h)) < 0 || writeAll(sfd, &r, sizeof(r)) < 0 || writeAll(sfd, p->in.p + sizeof(ri), len - sizeof(ri)) < 0)
+                return -2;
+        }
+        rbufTake(&p->in, len);
+    }
+    return 0;
+}
+
+// waits up to `grace` seconds for a child to exit, then kills it
+int reap(const pid_t pid, const double grace)
+{
+    int status = 0;
+    const double end = getTime() + grace;
+    while(waitpid(pid, &status, WNOHANG) == 0)
+    {
+        if(getTime() > end)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            break;
+        }
+        usleep(10000);
+    }
+    return status;
+}
+
+// the pipes are closed first, a process blocked writing a round gets EPIPE instead of waiting on a reader that is gone
+void stopProcs(const uint32_t np)
+{
+    for(uint32_t i = 0; i < np; i++)
+    {
+        if(procs[i].pid == 0)
+            continue;
+        close(procs[i].fd);
+        kill(procs[i].pid, SIGTERM);
+    }
+    for(uint32_t i = 0; i < np; i++)
+    {
+        if(procs[i].pid == 0)
+            continue;
+        reap(procs[i].pid, 5.0);
+        procs[i].pid = 0;
+    }
+}
+
+int work(const char* addr, uint32_t np, const char* cli, char** extra, const int nextra)
+{
+    if(np == 0){np = sysconf(_SC_NPROCESSORS_ONLN);}
+    if(np > MAX_PROCS){np = MAX_PROCS;}
+    if(access(cli, X_OK) == -1)
+    {
+        printf("Cannot run %s, use --cli.\n", cli);
+        return 1;
+    }
+    int sfd = -1;
+    for(int tries = 0; sfd == -1 && tries < 50 && quit == 0; tries++) // the coordinator may still be starting
+    {
+        sfd = connectTo(addr);
+        if(sfd == -1){usleep(100000);}
+    }
+    if(sfd == -1)
+    {
+        printf("Cannot reach the coordinator at %s.\n", addr);
+        return 1;
+    }
+
+    pchello hello = {COORD_VERSION, np, {0}};
+    gethostname(hello.name, 48);
+    sprintf(hello.name + strlen(hello.name), ":%d", getpid());
+    sendMsg(sfd, PC_HELLO, &hello, sizeof(hello));
+    sendMsg(sfd, PC_WANT, &np, sizeof(np));
+    printf("Connected to %s as %s, %u processes.\n", addr, hello.name, np);
+
+    rbuf in = {0};
+    struct pollfd pfd[MAX_PROCS+1];
+    uint32_t pidx[MAX_PROCS];
+    uint64_t seeds = 0, failed = 0;
+    int ret = 0;
+    while(quit == 0)
+    {
+        pfd[0] = (struct pollfd){sfd, POLLIN, 0};
+        uint32_t n = 1;
+        for(uint32_t i = 0; i < np; i++)
+        {
+            if(procs[i].pid == 0)
+                continue;
+            pfd[n] = (struct pollfd){procs[i].fd, POLLIN, 0};
+            pidx[n++] = i;
+        }
+        poll(pfd, n, 500);
+
+        // rounds from the processes
+        for(uint32_t k = 1; k < n; k++)
+        {
+            if(pfd[k].revents == 0)
+                continue;
+            proc* p = &procs[pidx[k]];
+            int r = rbufFill(&p->in, p->fd);
+            const int f = forwardRounds(p, sfd);
+            if(f == -2)
+            {
+                printf("Lost the coordinator.\n");
+                stopProcs(np);
+                return 1;
+            }
+            if(r < 0 || f < 0)
+            {
+                close(p->fd);
+                if(f < 0){kill(p->pid, SIGTERM);}
+                const int status = reap(p->pid, 5.0);
+                p->pid = 0;
+                const uint32_t ok = f == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                sendMsg(sfd, ok ? PC_DONE : PC_FAIL, &p->seed, sizeof(uint64_t));
+                const uint32_t one = 1;
+                sendMsg(sfd, PC_WANT, &one, sizeof(one));
+                seeds++;
+                if(ok == 0){failed++;}
+            }
+        }
+
+        // leases and quota changes
+        if(pfd[0].revents == 0)
+            continue;
+        if(rbufFill(&in, sfd) < 0)
+        {
+            printf("The coordinator has gone, %llu seeds run.\n", (unsigned long long)seeds);
+            ret = 1;
+            break;
+        }
+        uint32_t stop = 0;
+        while(in.n >= sizeof(pchdr))
+        {
+            pchdr h;
+            memcpy(&h, in.p, sizeof(h));
+            if(in.n < sizeof(pchdr) + h.len)
+                break;
+            const uint8_t* m = in.p + sizeof(pchdr);
+            if(h.type == PC_LEASE && h.len == sizeof(pclease))
+            {
+                pclease l;
+                memcpy(&l, m, sizeof(l));
+                wclosed = l.closed;
+                uint32_t i = 0;
+                while(i < np && procs[i].pid != 0){i++;}
+                if(i == np || spawn(&procs[i], &l, cli, extra, nextra) < 0)
+                {
+                    sendMsg(sfd, PC_FAIL, &l.seed, sizeof(uint64_t));
+                    failed++;
+                }
+            }
+            else if(h.type == PC_QUOTA && h.len == sizeof(uint32_t))
+                memcpy(&wclosed, m, sizeof(uint32_t));
+            else if(h.type == PC_STOP)
+                stop = 1;
+            rbufTake(&in, sizeof(pchdr) + h.len);
+        }
+        if(stop == 1)
+        {
+            printf("Coordinator says stop, %llu seeds run (%llu failed).\n", (unsigned long long)seeds, (unsigned long long)failed);
+            break;
+        }
+    }
+    stopProcs(np);
+    close(sfd);
+    return ret;
+}
+
+//*************************************
+// entry
+//*************************************
+
+void usage()
+{
+    printf("Usage:\n");
+    printf("  ./porydrive-coord serve [--listen <host:port>] [--seeds <first:count>] [--rounds <n>] [--min-score <x>] [--quota <bucket:n>]... [--out <dir>]\n");
+    printf("  ./porydrive-coord work <host:port> [-j <procs>] [--cli <path>] [-- <porydrivecli flags>]\n");
+    printf("  ./porydrive-coord local <workers> [-j <procs>] [--cli <path>] [serve options] [-- <porydrivecli flags>]\n");
+}
+
+int main(int argc, char** argv)
+{
+    printf("----\n");
+    printf("PoryDrive Coordinator\n");
+    printf("----\n");
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if(argc < 2)
+    {
+        usage();
+        return 0;
+    }
+    const char* mode = argv[1];
+    int first = 2;
+    const char* target = NULL;
+    if(strcmp(mode, "work") == 0 || strcmp(mode, "local") == 0)
+    {
+        if(argc < 3)
+        {
+            usage();
+            return 1;
+        }
+        target = argv[2];
+        first = 3;
+    }
+    else if(strcmp(mode, "serve") != 0)
+    {
+        usage();
+        return 1;
+    }
+
+    coordopts o = {"0.0.0.0:" COORD_PORT, 1, 1000000, 64, 0.01f, {0}, 0, "."};
+    uint32_t np = 0;
+    const char* cli = "./porydrivecli";
+    char** extra = NULL;
+    int nextra = 0;
+    for(int i = first; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--") == 0)
+        {
+            extra = &argv[i+1];
+            nextra = argc - i - 1;
+            break;
+        }
+        else if(strcmp(argv[i], "--listen") == 0 && i+1 < argc){o.listen = argv[++i];}
+        else if(strcmp(argv[i], "--seeds") == 0 && i+1 < argc)
+        {
+            unsigned long long a = 0, b = 0;
+            if(sscanf(argv[++i], "%llu:%llu", &a, &b) != 2 || b == 0)
+            {
+                printf("--seeds is <first:count>.\n");
+                return 1;
+            }
+            o.seed_first = a, o.seed_count = b;
+        }
+        else if(strcmp(argv[i], "--rounds") == 0 && i+1 < argc){o.rounds = atoi(argv[++i]);}
+        else if(strcmp(argv[i], "--min-score") == 0 && i+1 < argc){o.minscore = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--quota") == 0 && i+1 < argc)
+        {
+            float b = 0.f;
+            unsigned long long q = 0;
+            if(sscanf(argv[++i], "%f:%llu", &b, &q) != 2 || b < 0.f || b > 1.f)
+            {
+                printf("--quota is <bucket:rounds>, e.g. 0.8:5000.\n");
+                return 1;
+            }
+            o.quota[metricsBucket(b)] = q;
+            o.has_quota = 1;
+        }
+        else if(strcmp(argv[i], "--out") == 0 && i+1 < argc){o.out = argv[++i];}
+        else if(strcmp(argv[i], "-j") == 0 && i+1 < argc){np = atoi(argv[++i]);}
+        else if(strcmp(argv[i], "--cli") == 0 && i+1 < argc){cli = argv[++i];}
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(o.rounds < 2){o.rounds = 2;} // porydrivecli exits on its last round before logging it
+    if(o.minscore <= 0.f){o.minscore = 0.01f;}
+    if(o.seed_first + o.seed_count > 0x100000000ULL)
+    {
+        printf("Seeds are 32 bit in porydrivecli, the range must end by 4294967295.\n");
+        return 1;
+    }
+
+    signal(SIGINT, sigQuit);
+    signal(SIGTERM, sigQuit);
+    signal(SIGPIPE, SIG_IGN);
+
+    if(strcmp(mode, "work") == 0)
+        return work(target, np, cli, extra, nextra);
+
+    if(strcmp(mode, "serve") == 0)
+    {
+        const int lfd = listenOn(o.listen);
+        if(lfd == -1)
+        {
+            printf("Cannot listen on %s.\n", o.listen);
+            return 1;
+        }
+        return serve(&o, lfd);
+    }
+
+    // local; the coordinator on an ephemeral loopback port, the workers as child processes
+    const uint32_t workers = atoi(target);
+    const int lfd = listenOn("127.0.0.1:0");
+    struct sockaddr_in sa;
+    socklen_t sl = sizeof(sa);
+    if(lfd == -1 || getsockname(lfd, (struct sockaddr*)&sa, &sl) == -1)
+    {
+        printf("Cannot listen on the loopback.\n");
+        return 1;
+    }
+    char addr[32];
+    sprintf(addr, "127.0.0.1:%u", ntohs(sa.sin_port));
+    printf("Local run on %s with %u workers.\n", addr, workers);
+    if(np == 0){np = 1;}
+    pid_t wp[workers ? workers : 1];
+    for(uint32_t i = 0; i < workers; i++)
+    {
+        wp[i] = fork();
+        if(wp[i] == 0)
+        {
+            close(lfd);
+            signal(SIGINT, SIG_IGN); // the coordinator stops them
+            _exit(work(addr, np, cli, extra, nextra));
+        }
+    }
+    const int r = serve(&o, lfd);
+    close(lfd);
+    for(uint32_t i = 0; i < workers; i++)
+        if(wp[i] > 0)
+            reap(wp[i], 15.0);
+    return r;
+}
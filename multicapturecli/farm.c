@@ -0,0 +1,509 @@
+/*
+    Info:
+
+        Process-farm supervisor for porydrivecli, a replacement for go.sh.
+
+        > keeps a target number of workers running, any worker that exits,
+          because it completed its rounds, timed out or tripped the CPS
+          watchdog, is started again.
+
+        > ramps up gradually; at most <ramp> launches per second. When a
+          worker trips the CPS watchdog the box is overcommitted, so
+          launches pause for a cool-down and the ramp rate halves, down to
+          no less than one per second.
+
+        > pins every worker; to one core when there are no more workers
+          than cores, otherwise to one NUMA node so the scheduler can
+          balance within it. Consecutive workers alternate between nodes.
+
+        > reads the log of every worker and aggregates it into one
+          progress line every 10 seconds.
+
+        > every worker gets its slot number in PORYDRIVE_SLOT, so
+          `--resume ckpt/{slot}.ckpt` restarts a worker from its own
+          checkpoint.
+
+        Ctrl+C stops the workers, kills any still running 15 seconds
+        later, and prints a summary.
+
+    Usage:
+
+        ./porydrivefarm <workers> [options] -- <porydrivecli args>
+        ./porydrivefarm 512 --ramp 16 -- 32400 1200 0
+
+        --ramp <n>       launches per second (default: cores)
+        --pin <mode>     core, node or none (default: core, node when oversubscribed)
+        --cli <path>     worker executable (default: ./porydrivecli)
+        --once           do not restart workers that exit
+
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define LINE_MAX_LEN 512
+#define COOLDOWN 10.0 // seconds without launches after a CPS watchdog exit
+
+typedef struct
+{
+    pid_t pid;      // 0 when the slot is empty
+    int fd;         // read end of its stdout/stderr
+    int cpu;        // index into the placement list
+    char line[LINE_MAX_LEN];
+    uint32_t ll;
+} worker;
+
+// placement
+typedef struct
+{
+    int node;
+    int cpu;
+} place;
+place* places;
+uint32_t nplaces = 0;
+cpu_set_t* node_sets;
+int nnodes = 0;
+uint32_t pin_mode = 0; // 0 none, 1 core, 2 node
+
+// aggregate progress
+uint64_t collected = 0, qualified = 0, unqualified = 0, timeouts = 0;
+uint64_t launches = 0, restarts = 0, cps_exits = 0, completed_exits = 0, other_exits = 0;
+uint32_t cps_min = 0xFFFFFFFF, cps_last_sum = 0, cps_last_n = 0;
+
+volatile sig_atomic_t quit = 0;
+
+void sigQuit(int s)
+{
+    (void)s;
+    quit = 1;
+}
+
+double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void timestamp(char* ts)
+{
+    const time_t tt = time(0);
+    strftime(ts, 16, "%H:%M:%S", localtime(&tt));
+}
+
+// "0-3,8,10-11"
+void parseCpuList(const char* s, cpu_set_t* set)
+{
+    CPU_ZERO(set);
+    while(*s != 0 && *s != '\n')
+    {
+        char* e;
+        const long a = strtol(s, &e, 10);
+        long b = a;
+        if(e == s)
+            break;
+        if(*e == '-')
+        {
+            s = e+1;
+            b = strtol(s, &e, 10);
+        }
+        for(long i = a; i <= b && i < CPU_SETSIZE; i++)
+            CPU_SET(i, set);
+        s = *e == ',' ? e+1 : e;
+    }
+}
+
+// cpus we are allowed on, grouped by NUMA node and interleaved so that consecutive workers alternate nodes
+void buildPlacement()
+{
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    node_sets = calloc(CPU_SETSIZE, sizeof(cpu_set_t));
+    DIR* d = opendir("/sys/devices/system/node");
+    if(d != NULL)
+    {
+        struct dirent* de;
+        while((de = readdir(d)) != NULL)
+        {
+            int n;
+            if(sscanf(de->d_name, "node%d", &n) != 1 || n < 0 || n >= CPU_SETSIZE)
+                continue;
+            char path[300], buf[4096];
+            sprintf(path, "/sys/devices/system/node/%s/cpulist", de->d_name);
+            FILE* f = fopen(path, "r");
+            if(f == NULL)
+                continue;
+            if(fgets(buf, sizeof(buf), f) != NULL)
+            {
+                parseCpuList(buf, &node_sets[n]);
+                CPU_AND(&node_sets[n], &node_sets[n], &allowed);
+                if(n+1 > nnodes){nnodes = n+1;}
+            }
+            fclose(f);
+        }
+        closedir(d);
+    }
+    if(nnodes == 0) // no NUMA information, one node with everything
+    {
+        node_sets[0] = allowed;
+        nnodes = 1;
+    }
+
+    places = malloc(CPU_SETSIZE * sizeof(place));
+    int cursor[nnodes];
+    memset(cursor, 0, sizeof(cursor));
+    uint32_t added = 1;
+    while(added > 0)
+    {
+        added = 0;
+        for(int n = 0; n < nnodes; n++)
+        {
+            while(cursor[n] < CPU_SETSIZE && !CPU_ISSET(cursor[n], &node_sets[n]))
+                cursor[n]++;
+            if(cursor[n] < CPU_SETSIZE)
+            {
+                places[nplaces++] = (place){n, cursor[n]};
+                cursor[n]++;
+                added++;
+            }
+        }
+    }
+    if(nplaces == 0)
+        places[nplaces++] = (place){0, 0};
+}
+
+int launch(worker* w, const uint32_t slot, char** wargv)
+{
+    int p[2];
+    if(pipe2(p, O_CLOEXEC) == -1)
+        return -1;
+    w->cpu = slot % nplaces;
+    const pid_t pid = fork();
+    if(pid == -1)
+    {
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+    if(pid == 0)
+    {
+        signal(SIGINT, SIG_IGN); // the supervisor decides when workers stop
+        if(pin_mode == 1)
+        {
+            cpu_set_t s;
+            CPU_ZERO(&s);
+            CPU_SET(places[w->cpu].cpu, &s);
+            sched_setaffinity(0, sizeof(s), &s);
+        }
+        else if(pin_mode == 2)
+            sched_setaffinity(0, sizeof(cpu_set_t), &node_sets[places[w->cpu].node]);
+        char sv[16];
+        sprintf(sv, "%u", slot);
+        setenv("PORYDRIVE_SLOT", sv, 1);
+        dup2(p[1], 1);
+        dup2(p[1], 2);
+        execv(wargv[0], wargv);
+        _exit(127);
+    }
+    close(p[1]);
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    w->pid = pid;
+    w->fd = p[0];
+    w->ll = 0;
+    launches++;
+    return 0;
+}
+
+// one log line of a worker, returns 1 when it reported a CPS watchdog exit
+int parseLine(const char* l)
+{
+    uint32_t v;
+    const char* m;
+    if(strstr(l, "Porygon collected:") != NULL)
+        collected++;
+    else if(strstr(l, "did not qualify") != NULL)
+        unqualified++;
+    else if(strstr(l, "Round took too long") != NULL)
+        timeouts++;
+    else if((m = strstr(l, "CPS dropped to unacceptable level:")) != NULL)
+        return 1;
+    else if((m = strstr(l, "CPS: ")) != NULL && sscanf(m+5, "%u", &v) == 1)
+    {
+        if(v < cps_min){cps_min = v;}
+        cps_last_sum += v;
+        cps_last_n++;
+    }
+    else if(strstr(l, " : ") != NULL) // score line
+        qualified++;
+    return 0;
+}
+
+// drains a worker pipe, returns -1 on EOF
+int drain(worker* w, uint32_t* cps_exit)
+{
+    char buf[4096];
+    while(1)
+    {
+        const ssize_t r = read(w->fd, buf, sizeof(buf));
+        if(r == 0)
+            return -1;
+        if(r < 0)
+            return 0;
+        for(ssize_t i = 0; i < r; i++)
+        {
+            if(buf[i] == '\n' || w->ll == LINE_MAX_LEN-1)
+            {
+                w->line[w->ll] = 0;
+                if(parseLine(w->line) == 1)
+                    *cps_exit = 1;
+                w->ll = 0;
+            }
+            else
+                w->line[w->ll++] = buf[i];
+        }
+    }
+}
+
+// waits up to `grace` seconds for a worker to exit, then kills it
+int reap(const pid_t pid, const double grace)
+{
+    int status = 0;
+    const double end = getTime() + grace;
+    while(waitpid(pid, &status, WNOHANG) == 0)
+    {
+        if(getTime() > end)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            break;
+        }
+        usleep(10000);
+    }
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    printf("----\n");
+    printf("PoryDrive Farm\n");
+    printf("----\n");
+
+    int dd = -1;
+    for(int i = 1; i < argc; i++)
+        if(strcmp(argv[i], "--") == 0){dd = i; break;}
+    if(argc < 2 || dd == -1)
+    {
+        printf("Usage: ./porydrivefarm <workers> [--ramp <n>] [--pin core|node|none] [--cli <path>] [--once] -- <porydrivecli args>\n");
+        return 0;
+    }
+
+    const uint32_t target = atoi(argv[1]);
+    double ramp = 0.0;
+    const char* cli = "./porydrivecli";
+    uint32_t once = 0;
+    int pin = -1;
+    for(int i = 2; i < dd; i++)
+    {
+        if(strcmp(argv[i], "--ramp") == 0 && i+1 < dd){ramp = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--cli") == 0 && i+1 < dd){cli = argv[++i];}
+        else if(strcmp(argv[i], "--once") == 0){once = 1;}
+        else if(strcmp(argv[i], "--pin") == 0 && i+1 < dd)
+        {
+            i++;
+            pin = strcmp(argv[i], "core") == 0 ? 1 : strcmp(argv[i], "node") == 0 ? 2 : 0;
+        }
+    }
+    for(int i = dd+1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--stream") == 0)
+        {
+            printf("--stream workers belong to a consumer (online.py), not the farm.\n");
+            return 1;
+        }
+        if(strcmp(argv[i], "--quiet") == 0)
+        {
+            printf("--quiet hides the round and CPS lines the farm counts from, leave it off.\n");
+            return 1;
+        }
+    }
+    if(target == 0)
+        return 0;
+
+    // worker argv
+    char* wargv[argc - dd + 1];
+    wargv[0] = (char*)cli;
+    for(int i = dd+1; i < argc; i++)
+        wargv[i-dd] = argv[i];
+    wargv[argc-dd] = NULL;
+
+    buildPlacement();
+    if(ramp <= 0.0){ramp = nplaces;}
+    pin_mode = pin >= 0 ? (uint32_t)pin : (target <= nplaces ? 1 : 2);
+    printf("Workers: %u | CPUs: %u on %d node(s) | Pinning: %s | Ramp: %g/sec | Restart: %s\n", target, nplaces, nnodes,
+        pin_mode == 1 ? "core" : pin_mode == 2 ? "node" : "none", ramp, once ? "no" : "yes");
+    printf("----\n");
+
+    signal(SIGINT, sigQuit);
+    signal(SIGTERM, sigQuit);
+    signal(SIGPIPE, SIG_IGN);
+
+    worker* w = calloc(target, sizeof(worker));
+    struct pollfd* pfd = malloc(target * sizeof(struct pollfd));
+    uint32_t* pidx = malloc(target * sizeof(uint32_t));
+    uint32_t* started = calloc(target, sizeof(uint32_t)); // launches per slot, anything after the first is a restart
+    if(w == NULL || pfd == NULL || pidx == NULL || started == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+
+    const double st = getTime();
+    double last = st, next_report = st + 10.0, hold_until = 0.0;
+    double tokens = 1.0;
+    uint64_t last_collected = 0;
+    uint32_t running = 0;
+    while(quit == 0)
+    {
+        const double now = getTime();
+
+        // ramp; a token bucket refilled at the ramp rate, paused during a cool-down
+        tokens += (now - last) * ramp;
+        const double cap = ramp > 1.0 ? ramp : 1.0; // a launch takes a whole token, even below 1/sec
+        if(tokens > cap){tokens = cap;}
+        last = now;
+        if(now >= hold_until)
+        {
+            for(uint32_t i = 0; i < target && tokens >= 1.0; i++)
+            {
+                if(w[i].pid != 0 || (once == 1 && started[i] > 0))
+                    continue;
+                if(launch(&w[i], i, wargv) == 0)
+                {
+                    if(started[i]++ > 0){restarts++;}
+                    running++;
+                    tokens -= 1.0;
+                }
+            }
+        }
+
+        // logs
+        uint32_t np = 0;
+        for(uint32_t i = 0; i < target; i++)
+        {
+            if(w[i].pid == 0)
+                continue;
+            pfd[np] = (struct pollfd){w[i].fd, POLLIN, 0};
+            pidx[np++] = i;
+        }
+        if(np == 0 && once == 1 && running == 0 && launches >= target)
+            break;
+        poll(pfd, np, 200);
+        for(uint32_t k = 0; k < np; k++)
+        {
+            if(pfd[k].revents == 0)
+                continue;
+            worker* wk = &w[pidx[k]];
+            uint32_t cps_exit = 0;
+            const int r = drain(wk, &cps_exit);
+            if(cps_exit == 1)
+            {
+                cps_exits++;
+                hold_until = getTime() + COOLDOWN;
+                if(ramp > 1.0){ramp = ramp > 2.0 ? ramp * 0.5 : 1.0;}
+                char strts[16];
+                timestamp(&strts[0]);
+                printf("[%s] Worker %d tripped the CPS watchdog, holding launches for %g seconds, ramp now %g/sec.\n", strts, wk->pid, COOLDOWN, ramp);
+            }
+            if(r < 0)
+            {
+                // exited, or about to; reap it
+                int status;
+                waitpid(wk->pid, &status, 0);
+                close(wk->fd);
+                if(cps_exit == 0)
+                {
+                    if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                        completed_exits++;
+                    else
+                        other_exits++;
+                }
+                wk->pid = 0;
+                running--;
+            }
+        }
+
+        // aggregate progress
+        if(getTime() >= next_report)
+        {
+            char strts[16];
+            timestamp(&strts[0]);
+            printf("[%s] workers %u/%u | rounds %llu (%llu qualified, %llu not) | timeouts %llu | %.1f rounds/min | CPS avg %u min %u | restarts %llu | watchdog exits %llu\n",
+                strts, running, target, (unsigned long long)collected, (unsigned long long)qualified, (unsigned long long)unqualified,
+                (unsigned long long)timeouts, (double)(collected - last_collected) * 6.0, cps_last_n > 0 ? cps_last_sum / cps_last_n : 0,
+                cps_min == 0xFFFFFFFF ? 0 : cps_min, (unsigned long long)restarts, (unsigned long long)cps_exits);
+            last_collected = collected;
+            cps_last_sum = 0, cps_last_n = 0;
+            next_report = getTime() + 10.0;
+        }
+    }
+
+    // stop; the pipes are read while the workers checkpoint and exit, so none blocks on a full pipe
+    // writing its last lines, and any still running after the grace period is killed
+    for(uint32_t i = 0; i < target; i++)
+        if(w[i].pid != 0)
+            kill(w[i].pid, SIGTERM);
+    const double grace = getTime() + 15.0;
+    while(getTime() < grace)
+    {
+        uint32_t np = 0;
+        for(uint32_t i = 0; i < target; i++)
+        {
+            if(w[i].pid == 0 || w[i].fd == -1)
+                continue;
+            pfd[np] = (struct pollfd){w[i].fd, POLLIN, 0};
+            pidx[np++] = i;
+        }
+        if(np == 0)
+            break;
+        poll(pfd, np, 200);
+        for(uint32_t k = 0; k < np; k++)
+        {
+            worker* wk = &w[pidx[k]];
+            uint32_t cps_exit = 0;
+            if(pfd[k].revents != 0 && drain(wk, &cps_exit) < 0)
+            {
+                close(wk->fd);
+                wk->fd = -1;
+            }
+        }
+    }
+    for(uint32_t i = 0; i < target; i++)
+    {
+        if(w[i].pid == 0)
+            continue;
+        if(w[i].fd != -1)
+            close(w[i].fd);
+        reap(w[i].pid, grace - getTime());
+    }
+
+    const double el = getTime() - st;
+    printf("\n----\n");
+    printf("Ran for %.2f minutes.\n", el / 60.0);
+    printf("Rounds: %llu (%llu qualified, %llu not), timeouts: %llu, %.1f rounds/min\n", (unsigned long long)collected,
+        (unsigned long long)qualified, (unsigned long long)unqualified, (unsigned long long)timeouts, (double)collected / (el / 60.0));
+    printf("Launches: %llu (%llu restarts) | Exits: %llu completed, %llu CPS watchdog, %llu other\n", (unsigned long long)launches,
+        (unsigned long long)restarts, (unsigned long long)completed_exits, (unsigned long long)cps_exits, (unsigned long long)other_exits);
+    return 0;
+}
@@ -34,6 +34,7 @@
 
 */
 
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,6 +47,7 @@
 
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <signal.h>
 
 //#define uint GLushort
 #define sint short
@@ -59,7 +61,16 @@
 #define SEIR_RAND
 
 #include "../inc/vec.h"
-#include "../inc/mat.h"
+#include "../inc/porysim.h"
+#include "../inc/psimrays.h"
+#include "../inc/psimreplay.h"
+#include "../inc/fnn.h"
+#include "../inc/lut.h"
+#include "../inc/metrics.h"
+#include "../inc/evlog.h"
+#include "../inc/qenc.h"
+#include "../inc/dsblock.h"
+#include "../inc/rindex.h"
 
 //*************************************
 // globals
@@ -70,33 +81,27 @@ double t = 0; // time
 f32 dt = 0;   // delta time
 double timeout = 0; // timeout after
 
-// render state matrices
-mat model;
-
 // game vars
 #define NEWGAME_SEED 1337
 double st=0; // start time
 char tts[32];// time taken string
 
-// player vars
-f32 pr; // rotation
-f32 sr; // steering rotation
-vec pp; // position
-vec pv; // velocity
-vec pd; // wheel direction
-vec pbd;// body direction
-f32 sp; // speed
+// simulation, the car, porygon and round state live in here (see inc/porysim.h)
+psimcfg cfg;
+const psimprofile* prof; // the ScarletFast specialised tick
+psim sim;
+psimworld world;         // --world, the classic arena when not given
+uint have_world = 0;
+char* world_spec = NULL;
 uint mcp;// max collected porygon count
-uint cp;// collected porygon count
-uint cc;// collision count
 
 // ai/ml
 uint auto_drive=0;
-    f32 ad_min_dstep = 0.01f;
-    f32 ad_max_dstep = 0.06f;
-    f32 ad_min_speedswitch = 2.f;
-    f32 ad_maxspeed_reductor = 0.5f;
-uint neural_drive=0;
+uint neural_drive=0;  // --policy, DAgger; the model drives and the expert labels
+    fnn policy_fnn = {0};
+    lut policy_lut = {0};
+    f32 beta = 0.f;   // --beta, chance per tick that the expert drives instead
+    f32 label[2];     // the expert's sr, sp for the current state
 uint dataset_logger=0;
 
 // logging score
@@ -106,57 +111,206 @@ uint dxi = 0;
 #define YMAX 19008
 float dataset_y[YMAX];
 uint dyi = 0;
-f32 start_dist = 0.f;
-double round_start_time = 0;
 f32 round_score = 0.f;
+
+// --rays, proximity sensors logged to <score>_r.dat beside the X file, row for row, and
+// fed to a policy that takes 6+k inputs (see inc/psimrays.h)
+psimrays rays = {0};
+uint have_rays = 0;
+float dataset_r[XMAX/6*PSIM_RAYS_MAX]; // the rays of row i at i*k
 f32 minscore = 0.f;
 
-// porygon vars
-vec zp; // position
-vec zd; // direction
-f32 zr; // rotation
-f32 zs; // speed
-double za;// alive state
-f32 zt; // twitch radius
-
-// configurable vars
-f32 maxspeed = 0.0165f;
-f32 acceleration = 0.0028f;
-f32 inertia = 0.00022f;
-f32 drag = 0.00038f;
-f32 steeringspeed = 1.4f;
-f32 steerinertia = 180.f;
-f32 minsteer = 0.16f;
-f32 maxsteer = 0.3f;
-f32 steeringtransfer = 0.023f;
-f32 steeringtransferinertia = 280.f;
+// --encode, bucket files as fp16 or scaled int16 (see inc/qenc.h)
+uint16_t encoding = QENC_F32;
+qheader qhx, qhy; // scales for new bucket files, existing files keep their own
+uint16_t qdataset_x[XMAX];
+uint16_t qdataset_y[YMAX];
+
+// raw factors of the round being written, for the <score>.idx round index (see inc/rindex.h)
+ridx round_rec;
+
+// capture policy, which ticks of a round are logged
+uint stride = 1;          // --stride, every nth tick
+f32 min_change[4] = {0};  // --min-change, sr, sp, angle, dist; a row is kept if any moved this far from the last kept row (0 = ignored)
+f32 keep = 1.f;           // --keep, chance a row that got this far is kept
+uint round_ticks = 0;     // ticks offered to the logger this round
+f32 last_kept[4];
+uint have_kept = 0;
+uint keep_rng = 1;
+
+// --compress, one lossless compressed block per round in %.1f.pdb (see inc/dsblock.h)
+uint compress = 0;
+uint8_t* block = NULL;
+
+// live metrics for porydrive-top, a private copy when shared memory is unavailable so updates never need a check
+metrics met_private;
+metrics* met = &met_private;
+#define CPS_NEAR_MISS 136 // a paced second under this is counted as a watchdog near-miss
+
+// binary event log
+evlog events = {0};
+char events_file[512] = {0}; // --events
+uint quiet = 0;           // --quiet, no per-round text output
+uint round_index = 0;
+uint64_t game_seed = 0;
+double game_start = 0.0;
+volatile sig_atomic_t quit_requested = 0;
+
+// run modes
+uint fast = 0;     // --fast, virtual time; step as fast as the CPU allows
+int stream_fd = -1;// --stream, qualifying rounds go down stdout instead of into bucket files
+uint have_seed = 0;// --seed, the game seed instead of /dev/urandom; with --fast the clock starts at 0 and the run is reproducible
+uint seed_arg = 0;
+char record_file[512] = {0}; // --record, every tick's controls for porydrive to play back (see inc/psimreplay.h)
+psimrecorder rec = {.fd = -1};
+
+// --resume, the whole run state is checkpointed at a tick boundary after every written round and
+// every ckpt_every seconds, a restarted process carries on from the last checkpoint (see saveCheckpoint)
+#define CKPT_MAGIC 0x334B4350 // PCK3
+char ckpt_file[512] = {0};
+double ckpt_every = 60.0;   // --checkpoint-every
+double ckpt_next = 0.0;
+uint ckpt_due = 0;          // a round was written this tick
+uint in_tick = 0;           // exits from inside main_loop() leave the last checkpoint alone
+uint64_t ckpt_ev_records = 0, ckpt_rec_ticks = 0; // how far the restored run had got in its --events log and --record recording
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sizes;         // sizeof(psim) << 16 | sizeof(psimcfg), another build's layout will not load
+    uint64_t game_seed;
+    double t, game_start;
+    psimcfg cfg;
+    psim sim;
+    int64_t rand_state;     // vec.h randf(), the --beta coin
+    uint32_t round_index, round_ticks, have_kept, keep_rng;
+    uint32_t world_cubes;   // the --world a run was started with must be given again
+    f32 world_size;
+    uint32_t rays_k;        // and the same --rays
+    f32 rays_fan, rays_range;
+    f32 last_kept[4];
+    f32 label[2];
+    uint32_t auto_drive, dataset_logger;
+    uint64_t ev_records;    // in the --events log, and ticks in the --record recording; a resume cuts them back to here
+    uint64_t rec_ticks;
+    uint32_t dxi, dyi;      // followed by dataset_x[dxi], dataset_y[dyi] and dataset_r[dxi/6*rays_k], the round in flight
+} ckpt;
 
 //*************************************
 // utility functions
 //*************************************
+double wallNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+void removeMetrics()
+{
+    if(met != &met_private)
+        metricsRemove(met);
+    met = &met_private;
+}
+
+// the event loop exits normally at the next tick so that the atexit() handlers flush and clean up
+void sigExit(int s)
+{
+    (void)s;
+    quit_requested = 1;
+}
+
 void setConfig()
 {
-    maxspeed = 0.0165f;
-    acceleration = 0.0028f;
-    inertia = 0.00022f;
-    drag = 0.00038f;
-    steeringspeed = 1.4f;
-    steerinertia = 180.f;
-    minsteer = 0.16f;
-    maxsteer = 0.3f;
-    steeringtransfer = 0.023f;
-    steeringtransferinertia = 280.f;
+    psimConfigScarletFast(&cfg);
+    prof = psimProfile(&cfg);
+}
+
+// the car physics stay locked to ScarletFast, only the auto drive variables are taken (see adsearch)
+void loadConfig()
+{
+    FILE* f = fopen("config.txt", "r");
+    if(f)
+    {
+        char line[256];
+        while(fgets(line, 256, f) != NULL)
+        {
+            char set[64];
+            memset(set, 0, 64);
+            float val;
+            if(sscanf(line, "%63s %f", set, &val) == 2)
+            {
+                if(strcmp(set, "ad_min_dstep") == 0){cfg.ad_min_dstep = val;}
+                if(strcmp(set, "ad_max_dstep") == 0){cfg.ad_max_dstep = val;}
+                if(strcmp(set, "ad_min_speedswitch") == 0){cfg.ad_min_speedswitch = val;}
+                if(strcmp(set, "ad_maxspeed_reductor") == 0){cfg.ad_maxspeed_reductor = val;}
+            }
+        }
+        fclose(f);
+        printf("config.txt: ad_min_dstep %g, ad_max_dstep %g, ad_min_speedswitch %g, ad_maxspeed_reductor %g\n",
+            cfg.ad_min_dstep, cfg.ad_max_dstep, cfg.ad_min_speedswitch, cfg.ad_maxspeed_reductor);
+    }
 }
 
 void timestamp(char* ts)
 {
+    // formatted at most once per second
+    static time_t lt = 0;
+    static char lts[16];
     const time_t tt = time(0);
-    strftime(ts, 16, "%H:%M:%S", localtime(&tt));
+    if(tt != lt)
+    {
+        strftime(lts, 16, "%H:%M:%S", localtime(&tt));
+        lt = tt;
+    }
+    memcpy(ts, lts, 16);
 }
 
-static inline f32 fRandFloat(const float min, const float max)
+void logEvent(const uint16_t type, const f32* v, const uint n)
 {
-    return min + randf() * (max-min); 
+    if(events.ring == NULL)
+        return;
+    evrec r;
+    memset(&r, 0, sizeof(r));
+    r.type = type;
+    r.round = round_index;
+    r.seed = game_seed;
+    r.t = t;
+    r.cc = type == EV_ROUND_END ? sim.rcc : sim.cc; // psimUpdate has already reset cc for the next round
+    r.cp = sim.cp;
+    if(n > 0)
+        memcpy(r.v, v, n*sizeof(f32));
+    evlogPush(&events, &r);
+}
+
+// a new round; counts it for the event log and resets the capture policy
+void roundStart()
+{
+    round_index++;
+    round_ticks = 0;
+    have_kept = 0;
+    logEvent(EV_ROUND_START, (f32[]){sim.start_dist, sim.zs, sim.zt, sim.zp.x, sim.zp.y, sim.pp.x, sim.pp.y}, 7);
+}
+
+void closeEvents()
+{
+    logEvent(EV_GAME_END, (f32[]){(f32)(t-game_start)}, 1);
+    evlogClose(&events);
+}
+
+void closeRecord()
+{
+    psimRecordClose(&rec);
+}
+
+// {slot} becomes the porydrivefarm worker slot so that every worker keeps its own file
+void slotPath(char* dst, const size_t size, const char* arg)
+{
+    const char* slot = getenv("PORYDRIVE_SLOT");
+    const char* sp = strstr(arg, "{slot}");
+    if(sp != NULL)
+        snprintf(dst, size, "%.*s%s%s", (int)(sp-arg), arg, slot != NULL ? slot : "0", sp+6);
+    else
+        snprintf(dst, size, "%s", arg);
 }
 
 void timeTaken(uint ss)
@@ -235,6 +389,41 @@ int trimFile(const int f, const off_t trim)
     return 0;
 }
 
+// a new quantized bucket file gets the header, an existing one must match the encoding and its scales are used
+int bucketHeader(const int f, qheader* h)
+{
+    struct stat st;
+    if(fstat(f, &st) == -1)
+        return -1;
+    if(st.st_size == 0)
+        return write(f, h, sizeof(qheader)) == sizeof(qheader) ? 0 : -1;
+    qheader eh;
+    if(pread(f, &eh, sizeof(qheader), 0) != sizeof(qheader) || qencCheck(&eh) < 0 ||
+       eh.encoding != h->encoding || eh.columns != h->columns)
+        return -1;
+    *h = eh;
+    return 0;
+}
+
+int writeAll(const int f, const void* buf, size_t len)
+{
+    const char* p = buf;
+    while(len > 0)
+    {
+        const ssize_t wb = write(f, p, len);
+        if(wb < 0 && errno == EINTR && quit_requested == 0)
+            continue;
+        if(wb <= 0)
+            return -1;
+        p += wb;
+        len -= wb;
+        // a SIGTERM cuts a write blocked on a full pipe short (or to EINTR), that is a quit
+        if(len > 0 && quit_requested == 1)
+            return -1;
+    }
+    return 0;
+}
+
 void writeWarning(const char* s)
 {
     FILE* f = fopen("WARNING_FLAGGED_ERROR.TXT", "a"); // just make it long so that it is noticable
@@ -248,178 +437,163 @@ void writeWarning(const char* s)
     }
 }
 
-//*************************************
-// render functions
-//*************************************
-
-void rCube(f32 x, f32 y)
+// written to <file>.tmp and renamed over the last checkpoint, a kill at any point leaves a whole one
+void saveCheckpoint()
 {
-    // cube collisions
-    const f32 dlap = vDistLa(zp, (vec){x, y, 0.f}); // porygon
-    if(dlap < 0.15f)
-    {
-        vec nf;
-        vSub(&nf, zp, (vec){x, y, 0.f});
-        vNorm(&nf);
-        vMulS(&nf, nf, 0.15f-dlap);
-        vAdd(&zp, zp, nf);
-    }
-
-    // if car is moving compute collisions
-    if(sp > inertia || sp < -inertia)
-    {
-        // front collision cube point
-        vec cp1 = pp;
-        vec cd1 = pbd;
-        vMulS(&cd1, cd1, 0.0525f);
-        vAdd(&cp1, cp1, cd1);
-
-        // back collision cube point
-        vec cp2 = pp;
-        vec cd2 = pbd;
-        vMulS(&cd2, cd2, -0.0525f);
-        vAdd(&cp2, cp2, cd2);
-
-        // do Axis-Aligned Cube collisions for points against rCube() being rendered
-        const f32 dla1 = vDistLa(cp1, (vec){x, y, 0.f}); // front car
-        const f32 dla0 = vDistLa(pp, (vec){x, y, 0.f}); // center car
-        const f32 dla2 = vDistLa(cp2, (vec){x, y, 0.f}); // back car
-        if(dla1 <= 0.097f)
-        {
-            vec nf;
-            vSub(&nf, pp, (vec){x, y, 0.f});
-            vNorm(&nf);
-            vMulS(&nf, nf, 0.097f-dla1);
-            vAdd(&pv, pv, nf);
-        }
-        else if(dla0 <= 0.097f)
-        {
-            vec nf;
-            vSub(&nf, pp, (vec){x, y, 0.f});
-            vNorm(&nf);
-            vMulS(&nf, nf, 0.097f-dla0);
-            vAdd(&pv, pv, nf);
-        }
-        else if(dla2 <= 0.097f)
-        {
-            vec nf;
-            vSub(&nf, pp, (vec){x, y, 0.f});
-            vNorm(&nf);
-            vMulS(&nf, nf, 0.097f-dla2);
-            vAdd(&pv, pv, nf);
-        }
-    }
-
-    // official colliding count
-    const f32 dla = vDist(pp, (vec){x, y, 0.f});
-    static f32 colliding = 0.f;
-    if(dla <= 0.13f)
+    ckpt c;
+    memset(&c, 0, sizeof(c));
+    c.magic = CKPT_MAGIC;
+    c.sizes = sizeof(psim) << 16 | sizeof(psimcfg);
+    c.game_seed = game_seed;
+    c.t = t;
+    c.game_start = game_start;
+    c.cfg = cfg;
+    c.sim = sim;
+    c.rand_state = srandfq;
+    c.round_index = round_index;
+    c.round_ticks = round_ticks;
+    c.have_kept = have_kept;
+    c.keep_rng = keep_rng;
+    c.world_cubes = psimWorld(&cfg)->n;
+    c.world_size = psimWorld(&cfg)->size;
+    c.rays_k = rays.k;
+    c.rays_fan = rays.fan;
+    c.rays_range = rays.range;
+    memcpy(c.last_kept, last_kept, sizeof(last_kept));
+    memcpy(c.label, label, sizeof(label));
+    c.auto_drive = auto_drive;
+    c.dataset_logger = dataset_logger;
+    c.ev_records = events.ring != NULL ? events.base + events.head : 0;
+    if(rec.fd > -1) // on disk up to here, whatever becomes of the process
+        psimRecordFlush(&rec);
+    c.rec_ticks = rec.ticks;
+    c.dxi = dxi;
+    c.dyi = dyi;
+
+    char tmp[sizeof(ckpt_file)+4];
+    sprintf(tmp, "%s.tmp", ckpt_file);
+    const int f = open(tmp, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if(f == -1)
     {
-        if(colliding == 0.f)
-        {
-            colliding = x*y+x;
-            cc++;
-
-            // char strts[16];
-            // timestamp(&strts[0]);
-            // printf("[%s] Collisions: %u\n", strts, cc);
-        }
+        writeWarning("Failed to open the checkpoint.");
+        return;
     }
-    else if(x*y+x == colliding)
+    if(writeAll(f, &c, sizeof(c)) < 0 ||
+       writeAll(f, &dataset_x[0], dxi*sizeof(f32)) < 0 ||
+       writeAll(f, &dataset_y[0], dyi*sizeof(f32)) < 0 ||
+       writeAll(f, &dataset_r[0], dxi/6*rays.k*sizeof(f32)) < 0 ||
+       fdatasync(f) == -1)
     {
-        colliding = 0.f;
+        close(f);
+        unlink(tmp);
+        writeWarning("Failed to write the checkpoint.");
+        return;
     }
+    close(f);
+    if(rename(tmp, ckpt_file) == -1)
+        writeWarning("Failed to replace the checkpoint.");
 }
 
-void rPorygon(f32 x, f32 y, f32 r)
+// 1 when the run state was restored, 0 when there is no checkpoint yet, -1 when it is unusable
+int loadCheckpoint()
 {
-    mIdent(&model);
-    mTranslate(&model, x, y, 0.f);
-    mRotZ(&model, r);
-
-    // returns direction
-    mGetDirY(&zd, model);
-    vInv(&zd);
+    const int f = open(ckpt_file, O_RDONLY | O_CLOEXEC);
+    if(f == -1)
+        return 0;
+    ckpt c;
+    int r = -1;
+    if(read(f, &c, sizeof(c)) == sizeof(c) && c.magic == CKPT_MAGIC && c.sizes == (sizeof(psim) << 16 | sizeof(psimcfg)) &&
+       c.world_cubes == psimWorld(&cfg)->n && c.world_size == psimWorld(&cfg)->size &&
+       c.rays_k == rays.k && c.rays_fan == rays.fan && c.rays_range == rays.range &&
+       c.dxi <= XMAX && c.dyi <= YMAX && c.dxi/6 == c.dyi/2 &&
+       read(f, &dataset_x[0], c.dxi*sizeof(f32)) == (ssize_t)(c.dxi*sizeof(f32)) &&
+       read(f, &dataset_y[0], c.dyi*sizeof(f32)) == (ssize_t)(c.dyi*sizeof(f32)) &&
+       read(f, &dataset_r[0], c.dxi/6*rays.k*sizeof(f32)) == (ssize_t)(c.dxi/6*rays.k*sizeof(f32)))
+        r = 1;
+    close(f);
+    if(r < 0)
+        return r;
+
+    game_seed = c.game_seed;
+    t = c.t;
+    game_start = c.game_start;
+    cfg = c.cfg;
+    cfg.world = have_world ? &world : NULL;
+    prof = psimProfile(&cfg);
+    sim = c.sim;
+    srandfq = c.rand_state;
+    round_index = c.round_index;
+    round_ticks = c.round_ticks;
+    have_kept = c.have_kept;
+    keep_rng = c.keep_rng;
+    memcpy(last_kept, c.last_kept, sizeof(last_kept));
+    memcpy(label, c.label, sizeof(label));
+    auto_drive = c.auto_drive;
+    dataset_logger = c.dataset_logger;
+    ckpt_ev_records = c.ev_records;
+    ckpt_rec_ticks = c.rec_ticks;
+    dxi = c.dxi;
+    dyi = c.dyi;
+    return 1;
 }
 
-void rCar(f32 x, f32 y, f32 z, f32 rx)
+void exitCheckpoint()
 {
-    // wheel spin speed
-    static f32 wr = 0.f;
-    const f32 speed = sp * 33.f;
-    if(sp > inertia || sp < -inertia)
-        wr += speed;
-
-    // wheel; front left
-    mIdent(&model);
-    mTranslate(&model, x, y, z);
-    mRotZ(&model, -rx);
-    mTranslate(&model, 0.026343f, -0.054417f, 0.012185f);
-    mRotZ(&model, sr);
-
-    // returns direction
-    mGetDirY(&pd, model);
-    vInv(&pd);
-
-    // body & window matrix
-
-    mIdent(&model);
-    mTranslate(&model, x, y, z);
-    mRotZ(&model, -rx);
+    if(in_tick == 0)
+        saveCheckpoint();
+}
 
-    // returns direction
-    mGetDirY(&pbd, model);
-    vInv(&pbd);
+// after every tick; checkpoints once a round has been written, or when the interval is up
+void checkpointTick(const double wt)
+{
+    if(ckpt_file[0] == 0)
+        return;
+    if(ckpt_due == 1 || wt >= ckpt_next)
+    {
+        saveCheckpoint();
+        ckpt_due = 0;
+        ckpt_next = wt + ckpt_every;
+    }
 }
 
 //*************************************
 // game functions
 //*************************************
 
-void newGame(unsigned int seed)
+void randAutoDrive()
 {
-    srand(seed);
-    srandf(seed);
-    
-    pp = (vec){0.f, 0.f, 0.f};
-    pv = (vec){0.f, 0.f, 0.f};
-    pd = (vec){0.f, 0.f, 0.f};
-    pbd = (vec){0.f, 0.f, 0.f};
-
-    st = 0;
-
-    cp = 0;
-    cc = 0;
-    pr = 0.f;
-    sr = 0.f;
-    sp = 0.f;
-
-    zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
-    zs = 0.3f;
-    za = 0.0;
-    zt = 8.f;
+    cfg.ad_min_dstep = uRandFloat(0.01f, 0.03f);
+    cfg.ad_max_dstep = uRandFloat(0.03f, 0.09f);
+    cfg.ad_min_speedswitch = uRandFloat(2.f, 4.f);
+    cfg.ad_maxspeed_reductor = uRandFloat(0.1f, 0.5f);
 }
 
-void randAutoDrive()
+// a resumed run carries on the log from its checkpoint
+void openEvents(const uint resume)
 {
-    ad_min_dstep = uRandFloat(0.01f, 0.03f);
-    ad_max_dstep = uRandFloat(0.03f, 0.09f);
-    ad_min_speedswitch = uRandFloat(2.f, 4.f);
-    ad_maxspeed_reductor = uRandFloat(0.1f, 0.5f);
+    if(events_file[0] != 0 && events.ring == NULL)
+    {
+        const uint32_t flags = fast ? EVLOG_FLAG_FAST : 0;
+        if((resume == 1 ? evlogAppend(&events, events_file, game_seed, flags, ckpt_ev_records) : evlogOpen(&events, events_file, game_seed, flags)) == 0)
+            atexit(closeEvents);
+        else
+            printf("Failed to open event log: %s\n", events_file);
+    }
+    logEvent(EV_GAME_START, (f32[]){(f32)stride, keep, min_change[0], min_change[1], min_change[2], min_change[3]}, 6);
 }
 
 void randGame()
 {
-    const int seed = urand();
-    newGame(seed);
-
-    zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
-    zs = uRandFloat(0.3f, 1.f);
-    zt = uRandFloat(8.f, 16.f);
-    za = 0.0;
+    const uint seed = have_seed == 1 ? seed_arg : urand();
+    st = 0;
+    psimReset(&sim, cfg.world, seed, t);
+    srandf(seed);
+    game_seed = seed;
+    game_start = t;
 
-    round_start_time = t;
-    start_dist = vDist(pp, zp);
+    keep_rng = seed | 1;
+    openEvents(0);
+    roundStart();
 
     // randAutoDrive();
 
@@ -431,17 +605,350 @@ void randGame()
     printf("\n[%s] Rand Game Start [%u], DATASET LOGGER & AUTO DRIVE ON.\n", strts, seed);
 }
 
-#define isnorm isnormal
-// static inline uint isnorm(const f32 f)
-// {
-//     return isnormal(f);
-// }
+// the --rays sidecar of a bucket, under the X file's lock; a new one gets the header, an existing one must
+// hold the same rays and as many rows as the X file has before this round, -1 when the round can't go in
+int openRays(const char* fn, const int fx, const off_t x_data, const size_t x_row)
+{
+    const int f = open(fn, O_APPEND | O_CREAT | O_RDWR, S_IRWXU);
+    if(f == -1)
+        return -1;
+    psimraysheader h, eh;
+    psimRaysHeader(&rays, &h);
+    struct stat st, sx;
+    if(fstat(f, &st) == -1 || fstat(fx, &sx) == -1 ||
+       (st.st_size == 0 && write(f, &h, sizeof(h)) != sizeof(h)) ||
+       (st.st_size != 0 && (pread(f, &eh, sizeof(eh), 0) != sizeof(eh) || psimRaysCheck(&rays, &eh) < 0)))
+    {
+        close(f);
+        return -1;
+    }
+    const off_t r_rows = st.st_size == 0 ? 0 : (st.st_size - (off_t)sizeof(h)) / (off_t)(rays.k*sizeof(f32));
+    if(r_rows != (sx.st_size - x_data) / (off_t)x_row)
+    {
+        close(f);
+        return -1;
+    }
+    return f;
+}
+
+// the index record of the logged round
+ridx roundIndex(const uint32_t format, const off_t x_off, const off_t y_off)
+{
+    ridx r = round_rec;
+    r.magic = RIDX_MAGIC;
+    r.format = format;
+    r.rows = dxi/6;
+    r.x_off = x_off;
+    r.y_off = y_off;
+    r.seed = game_seed;
+    r.score = round_score;
+    r.round = round_index;
+    return r;
+}
+
+// appends the round to the index of its bucket, the caller holds the bucket lock
+void writeIndex(const uint32_t format, const off_t x_off, const off_t y_off)
+{
+    char fn[32];
+    sprintf(fn, "%.1f.idx", round_score);
+    const int f = open(fn, O_APPEND | O_CREAT | O_WRONLY, S_IRWXU);
+    if(f == -1)
+    {
+        writeWarning("Failed to open the round index.");
+        return;
+    }
+    const ridx r = roundIndex(format, x_off, y_off);
+    if(write(f, &r, sizeof(r)) != sizeof(r))
+        writeWarning("Failed to append to the round index.");
+    close(f);
+}
+
+// writes the logged round to its score bucket, or down the stream, and clears the log buffers
+void writeRound()
+{
+    ckpt_due = 1;
+
+    // stream the round to the consumer on stdout, [ridx][f32 x[rows*6]][f32 y[rows*2]]; its index record without offsets
+    if(stream_fd > -1)
+    {
+        const ridx hdr = roundIndex(RIDX_F32, 0, 0);
+        met->rounds_logged[metricsBucket(round_score)]++;
+        met->samples += dxi/6;
+        met->bytes += sizeof(hdr) + (dxi+dyi)*sizeof(f32);
+        logEvent(EV_ROUND_LOGGED, (f32[]){round_score, (f32)(dxi/6), (f32)round_ticks}, 3);
+        if(writeAll(stream_fd, &hdr, sizeof(hdr)) < 0 ||
+           writeAll(stream_fd, &dataset_x[0], dxi*sizeof(f32)) < 0 ||
+           writeAll(stream_fd, &dataset_y[0], dyi*sizeof(f32)) < 0)
+        {
+            printf(quit_requested ? "Stopped while streaming a round, exiting.\n" : "Stream consumer has gone away, exiting.\n");
+            exit(0);
+        }
+        dxi = 0, dyi = 0;
+        round_score = 0.f;
+    }
+    else if(compress == 1) // compress outside of the lock, append the block in one write
+    {
+        const size_t bs = dsbEncode(&dataset_x[0], &dataset_y[0], dxi/6, round_score, block);
+        char fnb[32];
+        sprintf(fnb, "%.1f.pdb", round_score);
+        int fb = open(fnb, O_APPEND | O_CREAT | O_WRONLY, S_IRWXU);
+        if(bs > 0 && fb > -1)
+        {
+            const double lst = wallNs();
+            int lr;
+            while((lr = flock(fb, LOCK_EX)) == -1 && errno == EINTR){} // a signal must not get us writing unlocked
+            if(lr == -1)
+                usleep(1000);
+            met->lock_wait_ns += (uint64_t)(wallNs() - lst);
+            met->lock_waits++;
+            met->rounds_logged[metricsBucket(round_score)]++;
+            met->samples += dxi/6;
+            met->bytes += bs;
+            logEvent(EV_ROUND_LOGGED, (f32[]){round_score, (f32)(dxi/6), (f32)round_ticks}, 3);
+
+            const off_t bo = lseek(fb, 0, SEEK_END);
+            const ssize_t wb = write(fb, block, bs);
+            if(wb == bs)
+                writeIndex(RIDX_PDB, bo, bo);
+            else
+            {
+                char emsg[256];
+                sprintf(emsg, "Just wrote corrupted bytes to %s! (last %zu bytes).", fnb, wb);
+                writeWarning(emsg);
+                if(wb > 0 && trimFile(fb, wb) < 0)
+                {
+                    writeWarning("Failed to revert block file write error. Exiting.");
+                    exit(0);
+                }
+                writeWarning("Repaired.");
+            }
+
+            if(flock(fb, LOCK_UN) == -1)
+                usleep(1000);
+        }
+        if(fb > -1)
+            close(fb);
+
+        dxi = 0, dyi = 0;
+        round_score = 0.f;
+    }
+    else // write log buffer to file
+    {
+        const char* ext = encoding == QENC_F16 ? "f16" : encoding == QENC_I16 ? "i16" : "dat";
+        char fnbx[32];
+        sprintf(fnbx, "%.1f_x.%s", round_score, ext);
+        char fnby[32];
+        sprintf(fnby, "%.1f_y.%s", round_score, ext);
+
+        // open and lock the X file and don't unlock until Y is also written to
+        int fx = open(fnbx, O_APPEND | O_CREAT | (encoding != QENC_F32 ? O_RDWR : O_WRONLY), S_IRWXU);
+        if(fx > -1)
+        {
+            // lock X
+            const double lst = wallNs();
+            int lr;
+            while((lr = flock(fx, LOCK_EX)) == -1 && errno == EINTR){} // a signal must not get us writing unlocked
+            if(lr == -1) // very rare that these would hang forever unless there is some serious hard drive failure.
+                usleep(1000);
+            met->lock_wait_ns += (uint64_t)(wallNs() - lst);
+            met->lock_waits++;
+
+            // quantize with the scales of the files
+            const void* bx = &dataset_x[0];
+            const void* by = &dataset_y[0];
+            qheader hx = qhx, hy = qhy;
+            if(encoding != QENC_F32)
+            {
+                if(bucketHeader(fx, &hx) < 0)
+                {
+                    char emsg[256];
+                    sprintf(emsg, "%s is not a matching quantized dataset, round dropped.", fnbx);
+                    writeWarning(emsg);
+                    flock(fx, LOCK_UN);
+                    close(fx);
+                    dxi = 0, dyi = 0;
+                    round_score = 0.f;
+                    return;
+                }
+                qencEncode(&hx, &dataset_x[0], &qdataset_x[0], dxi/6);
+                bx = &qdataset_x[0];
+                by = &qdataset_y[0];
+            }
+            const size_t vs = qencBytes(encoding);
+
+            // the rays go in row for row with X, a bucket written without them or with other ones can't take them
+            int fr = -1;
+            char fnbr[32];
+            sprintf(fnbr, "%.1f_r.dat", round_score);
+            if(have_rays == 1 && (fr = openRays(fnbr, fx, encoding != QENC_F32 ? sizeof(qheader) : 0, 6*vs)) < 0)
+            {
+                char emsg[256];
+                sprintf(emsg, "%s does not line up with %s or holds other rays, round dropped.", fnbr, fnbx);
+                writeWarning(emsg);
+                flock(fx, LOCK_UN);
+                close(fx);
+                dxi = 0, dyi = 0;
+                round_score = 0.f;
+                return;
+            }
+
+            met->rounds_logged[metricsBucket(round_score)]++;
+            met->samples += dxi/6;
+            met->bytes += (dxi+dyi)*vs;
+            logEvent(EV_ROUND_LOGGED, (f32[]){round_score, (f32)(dxi/6), (f32)round_ticks}, 3);
+
+            // append to X file
+            uint ok = 1;
+            const off_t xo = lseek(fx, 0, SEEK_END);
+            const size_t dxis = dxi*vs;
+            const ssize_t wb = write(fx, bx, dxis);
+            if(wb != dxis) // this is very rare but if it fails... well.. we have a log
+            {
+                ok = 0;
+                char emsg[256];
+                sprintf(emsg, "Just wrote corrupted bytes to %s! (last %zu bytes).", fnbx, wb);
+                writeWarning(emsg);
+                if(trimFile(fx, wb) < 0) // revert append to X dataset
+                {
+                    writeWarning("Failed to revert X file write error. Exiting.");
+                    exit(0); // locks, file handles, all cleaned automatically
+                }
+                writeWarning("Repaired.");
+            }
+
+            // open Y file but we don't need to lock it as the X file lock is governing both
+            int fy = open(fnby, O_APPEND | O_CREAT | (encoding != QENC_F32 ? O_RDWR : O_WRONLY), S_IRWXU);
+            if(fy > -1 && encoding != QENC_F32 && bucketHeader(fy, &hy) < 0)
+            {
+                close(fy);
+                fy = -1;
+            }
+            if(fy > -1)
+            {
+                // append to Y file
+                if(encoding != QENC_F32)
+                    qencEncode(&hy, &dataset_y[0], &qdataset_y[0], dyi/2);
+                const off_t yo = lseek(fy, 0, SEEK_END);
+                const size_t dyis = dyi*vs;
+                const ssize_t wb = write(fy, by, dyis);
+                if(wb == dyis && ok == 1 && fr > -1)
+                {
+                    // without its rays the round comes back out of X and Y
+                    const size_t dris = dxi/6*rays.k*sizeof(f32);
+                    const ssize_t wr = write(fr, &dataset_r[0], dris);
+                    if(wr != dris)
+                    {
+                        ok = 0;
+                        char emsg[256];
+                        sprintf(emsg, "Just wrote corrupted bytes to %s! (last %zu bytes).", fnbr, wr);
+                        writeWarning(emsg);
+                        if((wr > 0 && trimFile(fr, wr) < 0) || trimFile(fx, dxis) < 0 || trimFile(fy, dyis) < 0)
+                        {
+                            writeWarning("Failed to revert ray file write error. Exiting.");
+                            exit(0);
+                        }
+                        writeWarning("Repaired.");
+                    }
+                }
+                if(wb == dyis && ok == 1)
+                    writeIndex(encoding, xo, yo);
+                if(wb != dyis) // this is very rare but if it fails... well.. we have a log
+                {
+                    char emsg[256];
+                    sprintf(emsg, "Just wrote corrupted bytes to %s! (last %zu bytes).", fnby, wb);
+                    writeWarning(emsg);
+                    if(trimFile(fx, dxis) < 0) // revert append to X dataset
+                    {
+                        writeWarning("Failed to revert X file write error. Exiting.");
+                        exit(0); // locks, file handles, all cleaned automatically
+                    }
+                    if(trimFile(fy, wb) < 0) // clear corrupted write to Y dataset
+                    {
+                        writeWarning("Failed to revert Y file write error. Exiting.");
+                        exit(0); // locks, file handles, all cleaned automatically
+                    }
+                    writeWarning("Repaired.");
+                }
+
+                // close Y
+                close(fy);
+            }
+            else
+            {
+                // failed to open Y dataset for append so lets revert the last append to X dataset
+                writeWarning("Failed to open Y file.");
+                if(trimFile(fx, dxis) < 0)
+                {
+                    writeWarning("Failed to revert X file after Y file open failed. Exiting.");
+                    exit(0);
+                }
+            }
+
+            if(fr > -1)
+                close(fr);
+
+            // unlock X
+            if(flock(fx, LOCK_UN) == -1)
+                usleep(1000);
+
+            // close X
+            close(fx);
+        }
+
+        dxi = 0, dyi = 0;
+        round_score = 0.f;
+    }
+}
+
+// finite and not denormal; zero is a legitimate value, sr == 0 is driving straight.
+// Tested on the bits, -Ofast lets the compiler assume there are no NaNs.
+static inline uint isnorm(const f32 f)
+{
+    uint32_t b;
+    memcpy(&b, &f, 4);
+    const uint32_t e = b & 0x7F800000;
+    return (e != 0 && e != 0x7F800000) || (b & 0x7FFFFFFF) == 0;
+}
+
+// the capture policy; stride, then minimum change, then random thinning. The first row of a round is always kept.
+uint captureRow(const f32* input, const f32 ysr, const f32 ysp)
+{
+    const uint tick = round_ticks++;
+    if(tick % stride != 0)
+        return 0;
+    const f32 v[4] = {ysr, ysp, input[4], input[5]};
+    if(have_kept == 1)
+    {
+        uint any = 0, moved = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            if(min_change[i] > 0.f)
+            {
+                any = 1;
+                if(fabsf(v[i] - last_kept[i]) >= min_change[i]){moved = 1;}
+            }
+        }
+        if(any == 1 && moved == 0)
+            return 0;
+        if(keep < 1.f)
+        {
+            keep_rng *= 16807;
+            if((f32)(keep_rng & 0x7FFFFFFF) * 4.6566129e-010f >= keep)
+                return 0;
+        }
+    }
+    memcpy(last_kept, v, sizeof(v));
+    have_kept = 1;
+    return 1;
+}
 
 //*************************************
 // update & render
 //*************************************
 void main_loop()
 {
+    met->ticks++;
+
 //*************************************
 // update stats
 //*************************************
@@ -458,215 +965,102 @@ void main_loop()
 //*************************************
 // auto drive
 //*************************************
-    f32 tr = maxsteer * ((maxspeed-sp) * steerinertia);
-    if(tr < minsteer){tr = minsteer;}
-    
-    // side winder 1
-    /*
-        vec lad = pp;
-        vSub(&lad, lad, zp);
-        vNorm(&lad);
-        const f32 as = fabsf(vDot(pbd, lad)+1.f) * 0.5f;
-        sr = tr * as;
-        const f32 d = vDist(pp, zp);
-        if(d < 2.f)
-            sp = maxspeed * (d*0.5f)+0.003f;
-        else
-            sp = maxspeed;
-    */
-
-    // side winder 2
-    if(auto_drive == 1) // stochastic state machine "ai"
-    {
-        vec lad = pp;
-        vSub(&lad, lad, zp);
-        vNorm(&lad);
-        const f32 as = fabsf(vDot(pbd, lad)+1.f) * 0.5f;
-        static f32 ld = 0.f, td = 1.f;
-        const f32 d = vDist(pp, zp);
-        f32 ds = d * 0.01f;
-        if(ds < ad_min_dstep){ds = ad_min_dstep;}
-        else if(ds > ad_max_dstep){ds = ad_max_dstep;}
-        if(fabsf(ld-d) > ds && ld < d){td *= -1.f;}
-        ld = d;
-        sr = (tr * as) * td;
-        if(d < ad_min_speedswitch)
-            sp = maxspeed * (d*ad_maxspeed_reductor)+0.003f;
-        else
-            sp = maxspeed;
-    }
-
-    // neural net
-    // if(neural_drive == 1) // Feed-Forward Neural Network (FNN)
-    // {
-    //     vec lad = pp;
-    //     vSub(&lad, lad, zp);
-    //     vNorm(&lad);
-    //     const f32 angle = vDot(pbd, lad);
-    //     const f32 dist = vDist(pp, zp);
-
-    //     const float input[6] = {pbd.x, pbd.y, lad.x, lad.y, angle, dist};
-
-    //     // write input to file
-    //     FILE *f = fopen("/dev/shm/porydrive_input.dat", "wb");
-    //     if(f != NULL)
-    //     {
-    //         const size_t wbs = 6 * sizeof(float);
-    //         if(fwrite(input, 1, wbs, f) != wbs)
-    //             printf("ERROR: neural write failed.\n");
-    //         fclose(f);
-    //     }
-
-    //     // load last result
-    //     float ret[2];
-    //     f = fopen("/dev/shm/porydrive_r.dat", "rb");
-    //     if(f != NULL)
-    //     {
-    //         if(fread(&ret, 2, sizeof(float), f) == sizeof(float))
-    //         {
-    //             if(isnorm(ret[0]) == 1 && isnorm(ret[1]) == 1)
-    //             {
-    //                 // set new vars
-    //                 sr = ret[0];
-    //                 sp = ret[1];
-    //             }
-    //         }
-    //         fclose(f);
-    //     }
-    // }
-
-
-//*************************************
-// simulate car
-//*************************************
-
-    if(sp > 0.f)
-        sp -= drag * dt;
-    else
-        sp += drag * dt;
-
-    if(fabsf(sp) > maxspeed)
-    {
-        if(sp > 0.f)
-            sp = maxspeed;
-        else
-            sp = -maxspeed;
-    }
+    if(auto_drive == 1) // side winder 2, stochastic state machine "ai"
+        prof->autodrive(&sim, &cfg);
 
-    if(sp > inertia || sp < -inertia)
+    // DAgger; the expert still steps so its state machine follows the visited states but it only
+    // provides the labels, the model drives unless the beta coin hands this tick to the expert
+    if(neural_drive == 1)
     {
-        vAdd(&pp, pp, pv);
-        vMulS(&pv, pd, sp);
-        pr -= sr * steeringtransfer * (sp*steeringtransferinertia);
+        label[0] = sim.sr, label[1] = sim.sp;
+        if(beta == 0.f || randf() >= beta)
+        {
+            f32 input[6+PSIM_RAYS_MAX], ret[2];
+            psimObserve(&sim, input);
+            if(have_rays == 1)
+                psimRaysCast(&rays, psimWorld(&cfg), &sim, input+6);
+            if(policy_lut.data != NULL)
+                lutEval(&policy_lut, input, ret);
+            else
+                fnnEval(&policy_fnn, input, ret);
+            if(isnorm(ret[0]) && isnorm(ret[1]))
+                sim.sr = ret[0], sim.sp = ret[1];
+        }
     }
 
-    if(pp.x > 17.5f){pp.x = 17.5f;}
-    else if(pp.x < -17.5f){pp.x = -17.5f;}
-    if(pp.y > 17.5f){pp.y = 17.5f;}
-    else if(pp.y < -17.5f){pp.y = -17.5f;}
-
 //*************************************
-// simulate porygon
+// simulate car & porygon
 //*************************************
-
-    // new round if timelimit exceeded
-    const double roundtime = t-round_start_time;
-    if(roundtime >= 60.0)
+    if(rec.fd > -1 && psimRecordTick(&rec, t, &sim) < 0)
+        writeWarning("The recording could not be written, it stops here.");
+    sim.t = t;
+    const double prev_round_start = sim.round_start_time;
+    const f32 prev_start_dist = sim.start_dist;
+    const vec prev_zp = sim.zp;
+    const f32 prev_zs = sim.zs, prev_zt = sim.zt;
+    const uint prev_cc = sim.cc;
+    const int e = prof->update(&sim, &cfg, dt);
+    if(e == PSIM_TIMEOUT)
     {
-        zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
-        zs = uRandFloat(0.3f, 1.f);
-        zt = uRandFloat(8.f, 16.f);
-        za = 0.0;
+        // the states a failing model visits are what DAgger is after, they go to the 0.0 bucket
+        round_score = 0.f;
+        round_rec = (ridx){.start_dist = prev_start_dist, .zs = prev_zs, .zt = prev_zt, .rtime = (f32)(t-prev_round_start), .cc = prev_cc};
+        if(neural_drive == 1 && dxi > 0 && dyi > 0)
+            writeRound();
+        dxi = 0, dyi = 0;
 
-        start_dist = vDist(pp, zp);
-        round_start_time = t;
+        met->timeouts++;
+        logEvent(EV_ROUND_TIMEOUT, (f32[]){(f32)(t-prev_round_start), prev_start_dist, vDist(sim.pp, prev_zp)}, 3);
+        roundStart();
+        if(quiet == 0)
+        {
+            char strts[16];
+            timestamp(&strts[0]);
+            printf("[%s] Round took too long, starting new round.\n", strts);
+        }
+        return;
+    }
+    else if(e == PSIM_RESPAWN)
+    {
+        // randAutoDrive();
 
         dxi = 0, dyi = 0;
         round_score = 0.f;
-
-        char strts[16];
-        timestamp(&strts[0]);
-        printf("[%s] Round took too long, starting new round.\n", strts);
+        roundStart();
         return;
     }
-
-    if(za == 0.0)
+    else if(e == PSIM_COLLECTED)
     {
-        vec inc;
-        vMulS(&inc, zd, zs * dt);
-        vAdd(&zp, zp, inc);
-        zr += fRandFloat(-zt, zt) * dt;
-
-        if(zp.x > 17.5f){zp.x = 17.5f; zr = fRandFloat(-PI, PI);}
-        else if(zp.x < -17.5f){zp.x = -17.5f; zr = fRandFloat(-PI, PI);}
-        if(zp.y > 17.5f){zp.y = 17.5f; zr = fRandFloat(-PI, PI);}
-        else if(zp.y < -17.5f){zp.y = -17.5f; zr = fRandFloat(-PI, PI);}
-
-        // front collision cube point
-        vec cp1 = pp;
-        vec cd1 = pbd;
-        vMulS(&cd1, cd1, 0.0525f);
-        vAdd(&cp1, cp1, cd1);
-
-        // back collision cube point
-        vec cp2 = pp;
-        vec cd2 = pbd;
-        vMulS(&cd2, cd2, -0.0525f);
-        vAdd(&cp2, cp2, cd2);
-
-        // do Axis-Aligned Cube collisions for both points against porygon
-        const f32 dla1 = vDistLa(cp1, zp); // front car
-        const f32 dla2 = vDistLa(cp2, zp); // back car
-        if(dla1 < 0.04f || dla2 < 0.04f)
+        met->rounds++;
+        if(sim.cp >= mcp)
         {
-            cp++;
-            if(cp >= mcp)
+            // the finished run is checkpointed too, resuming it again exits straight away
+            if(ckpt_file[0] != 0)
             {
-                char strts[16];
-                timestamp(&strts[0]);
-                printf("[%s] %u rounds completed, exiting...", strts, mcp);
-                exit(0);
+                dxi = 0, dyi = 0;
+                saveCheckpoint();
             }
+            char strts[16];
+            timestamp(&strts[0]);
+            printf("[%s] %u rounds completed, exiting...", strts, mcp);
+            exit(0);
+        }
 
-            za = t+6.0;
-
+        f32 terms[5];
+        round_score = psimScore(sim.start_dist, sim.zs, sim.zt, sim.rtime, sim.rcc, terms);
+        round_rec = (ridx){.start_dist = sim.start_dist, .zs = sim.zs, .zt = sim.zt, .rtime = (f32)sim.rtime, .cc = sim.rcc};
+        logEvent(EV_ROUND_END, (f32[]){terms[0], terms[1], terms[2], terms[3], terms[4], round_score, (f32)sim.rtime, sim.start_dist}, 8);
+        if(quiet == 0)
+        {
             char strts[16];
             timestamp(&strts[0]);
-            printf("[%s] Porygon collected: %u, collisions: %u\n", strts, cp, cc);
-            if(cc <= 333 && roundtime <= 60.0)
-            {
-                const f32 score_startdist = start_dist*0.027777778f;
-                const f32 score_poryspeed = zs;
-                const f32 score_porytwitch= (zt-8.f) * 0.125f;
-                const f32 score_timetaken = 1.f-(f32)(roundtime * 0.003003003);
-                const f32 score_collisions= 1.f-(((f32)cc)*0.003003003f);
-                round_score = (score_startdist + score_poryspeed + score_porytwitch + score_timetaken + score_collisions) / 5.f;
-                printf("[%s] %g %g %g %g %g : %g\n", strts, score_startdist, score_poryspeed, score_porytwitch, score_timetaken, score_collisions, round_score);
-            }
+            printf("[%s] Porygon collected: %u, collisions: %u\n", strts, sim.cp, sim.rcc);
+            if(round_score > 0.f)
+                printf("[%s] %g %g %g %g %g : %g\n", strts, terms[0], terms[1], terms[2], terms[3], terms[4], round_score);
             else
-            {
-                round_score = 0.f;
-                printf("[%s] This round did not qualify for logging. %g Round Time.\n", strts, roundtime);
-            }
-            cc = 0;
+                printf("[%s] This round did not qualify for logging. %g Round Time.\n", strts, sim.rtime);
         }
     }
-    else if(t > za)
-    {
-        zp = (vec){uRandFloat(-18.f, 18.f), uRandFloat(-18.f, 18.f), 0.f};
-        zs = uRandFloat(0.3f, 1.f);
-        zt = uRandFloat(8.f, 16.f);
-        za = 0.0;
-
-        start_dist = vDist(pp, zp);
-        round_start_time = t;
-
-        // randAutoDrive();
-
-        dxi = 0, dyi = 0;
-        round_score = 0.f;
-        return;
-    }
 
 //*************************************
 // dataset logging
@@ -675,21 +1069,18 @@ void main_loop()
     // neural net dataset
     if(dataset_logger == 1)
     {
-        vec lad = pp;
-        vSub(&lad, lad, zp);
-        vNorm(&lad);
-        const f32 angle = vDot(pbd, lad);
-        const f32 dist = vDist(pp, zp);
+        f32 input[6+PSIM_RAYS_MAX]; // pbd.x, pbd.y, lad.x, lad.y, angle, dist, then the rays
+        psimObserve(&sim, input);
+        if(have_rays == 1)
+            psimRaysCast(&rays, psimWorld(&cfg), &sim, input+6);
 
         uint fail = 0;
-        if(isnorm(pbd.x) == 0){fail++;}
-        if(isnorm(pbd.y) == 0){fail++;}
-        if(isnorm(lad.x) == 0){fail++;}
-        if(isnorm(lad.y) == 0){fail++;}
-        if(isnorm(angle) == 0){fail++;}
-        if(isnorm(dist) == 0){fail++;}
-        if(isnorm(sr) == 0){fail++;}
-        if(isnorm(sp) == 0){fail++;}
+        for(uint k = 0; k < 6+rays.k; k++)
+            if(isnorm(input[k]) == 0){fail++;}
+        const f32 ysr = neural_drive == 1 ? label[0] : sim.sr;
+        const f32 ysp = neural_drive == 1 ? label[1] : sim.sp;
+        if(isnorm(ysr) == 0){fail++;}
+        if(isnorm(ysp) == 0){fail++;}
 
         if(dxi >= XMAX-1 || dyi >= YMAX-1)
         {
@@ -697,103 +1088,20 @@ void main_loop()
             printf("Dataset log buffers are full, this should never happen.\n");
         }
 
-        if(fail == 0)
+        if(fail == 0 && captureRow(input, ysr, ysp) == 1)
         {
             // log x
-            dataset_x[dxi++] = pbd.x;
-            dataset_x[dxi++] = pbd.y;
-            dataset_x[dxi++] = lad.x;
-            dataset_x[dxi++] = lad.y;
-            dataset_x[dxi++] = angle;
-            dataset_x[dxi++] = dist;
+            memcpy(&dataset_r[dxi/6*rays.k], input+6, rays.k*sizeof(f32));
+            memcpy(&dataset_x[dxi], input, 6*sizeof(f32));
+            dxi += 6;
 
             // log y
-            dataset_y[dyi++] = sr;
-            dataset_y[dyi++] = sp;
+            dataset_y[dyi++] = ysr;
+            dataset_y[dyi++] = ysp;
         }
 
-        // write log buffer to file
-        if(round_score >= minscore && dxi > 0 && dyi > 0)
-        {
-            char fnbx[32];
-            sprintf(fnbx, "%.1f_x.dat", round_score);
-            char fnby[32];
-            sprintf(fnby, "%.1f_y.dat", round_score);
-
-            // open and lock the X file and don't unlock until Y is also written to
-            int fx = open(fnbx, O_APPEND | O_CREAT | O_WRONLY, S_IRWXU);
-            if(fx > -1)
-            {
-                // lock X
-                if(flock(fx, LOCK_EX) == -1) // very rare that these would hang forever unless there is some serious hard drive failure.
-                    usleep(1000);
-
-                // append to X file
-                const size_t dxis = dxi*sizeof(f32);
-                const ssize_t wb = write(fx, &dataset_x[0], dxis);
-                if(wb != dxis) // this is very rare but if it fails... well.. we have a log
-                {
-                    char emsg[256];
-                    sprintf(emsg, "Just wrote corrupted bytes to %s! (last %zu bytes).", fnbx, wb);
-                    writeWarning(emsg);
-                    if(trimFile(fx, wb) < 0) // revert append to X dataset
-                    {
-                        writeWarning("Failed to revert X file write error. Exiting.");
-                        exit(0); // locks, file handles, all cleaned automatically
-                    }
-                    writeWarning("Repaired.");
-                }
-
-                // open Y file but we don't need to lock it as the X file lock is governing both
-                int fy = open(fnby, O_APPEND | O_CREAT | O_WRONLY, S_IRWXU);
-                if(fy > -1)
-                {
-                    // append to Y file
-                    const size_t dyis = dyi*sizeof(f32);
-                    const ssize_t wb = write(fy, &dataset_y[0], dyis);
-                    if(wb != dyis) // this is very rare but if it fails... well.. we have a log
-                    {
-                        char emsg[256];
-                        sprintf(emsg, "Just wrote corrupted bytes to %s! (last %zu bytes).", fnby, wb);
-                        writeWarning(emsg);
-                        if(trimFile(fx, 24) < 0) // revert append to X dataset
-                        {
-                            writeWarning("Failed to revert X file write error. Exiting.");
-                            exit(0); // locks, file handles, all cleaned automatically
-                        }
-                        if(trimFile(fy, wb) < 0) // clear corrupted write to Y dataset
-                        {
-                            writeWarning("Failed to revert Y file write error. Exiting.");
-                            exit(0); // locks, file handles, all cleaned automatically
-                        }
-                        writeWarning("Repaired.");
-                    }
-
-                    // close Y
-                    close(fy);
-                }
-                else
-                {
-                    // failed to open Y dataset for append so lets revert the last append to X dataset
-                    writeWarning("Failed to open Y file.");
-                    if(trimFile(fx, 24) < 0)
-                    {
-                        writeWarning("Failed to revert X file after Y file open failed. Exiting.");
-                        exit(0);
-                    }
-                }
-
-                // unlock X
-                if(flock(fx, LOCK_UN) == -1)
-                    usleep(1000);
-
-                // close X
-                close(fx);
-            }
-
-            dxi = 0, dyi = 0;
-            round_score = 0.f;
-        }
+        if(e == PSIM_COLLECTED && (round_score >= minscore || neural_drive == 1) && dxi > 0 && dyi > 0)
+            writeRound();
     }
 
     // writing the targets to a seperate file makes file io errors more annoying to catch, but it does streamline
@@ -803,17 +1111,11 @@ void main_loop()
 // main render (this is just for simulation now)
 //*************************************
 
-    // render scene
-    for(f32 i = -17.5f; i <= 18.f; i += 0.53f)
-        for(f32 j = -17.5f; j <= 18.f; j += 0.53f)
-            if((i < -0.1f || i > 0.1f) || (j < -0.1f || j > 0.1f)) // lol a branch for so little tut tut
-                rCube(i, j);
-
-    // render porygon
-    rPorygon(zp.x, zp.y, zr);
-
-    // render player
-    rCar(pp.x, pp.y, pp.z, pr);
+    // cube lattice collisions, porygon & car directions
+    const uint pcc = sim.cc;
+    prof->collide(&sim, &cfg);
+    if(sim.cc != pcc)
+        logEvent(EV_COLLISION, (f32[]){sim.pp.x, sim.pp.y, sim.sp}, 3);
 }
 
 //*************************************
@@ -832,15 +1134,150 @@ int main(int argc, char** argv)
 // execute update / render loop
 //*************************************
 
+    // flags can go anywhere, the rest are positional
+    char* pos[3] = {0};
+    uint npos = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--fast") == 0)
+            fast = 1;
+        else if(strcmp(argv[i], "--stream") == 0)
+            fast = 1, stream_fd = 1;
+        else if(strcmp(argv[i], "--policy") == 0 && i+1 < argc)
+        {
+            // either format, the magic tells them apart
+            i++;
+            if(lutLoad(&policy_lut, argv[i]) < 0 && fnnLoad(&policy_fnn, argv[i]) < 0)
+            {
+                printf("Failed to load policy: %s\n", argv[i]);
+                return 1;
+            }
+            if(policy_fnn.l != NULL && (policy_fnn.l[0].n_in < 6 || policy_fnn.l[policy_fnn.layers-1].n_out != 2))
+            {
+                printf("Policy must take 6 inputs, and any rays, and produce 2 outputs: %s\n", argv[i]);
+                return 1;
+            }
+            fast = 1, neural_drive = 1;
+        }
+        else if(strcmp(argv[i], "--beta") == 0 && i+1 < argc)
+            beta = atof(argv[++i]);
+        else if(strcmp(argv[i], "--events") == 0 && i+1 < argc)
+            slotPath(events_file, sizeof(events_file), argv[++i]);
+        else if(strcmp(argv[i], "--quiet") == 0)
+            quiet = 1;
+        else if(strcmp(argv[i], "--compress") == 0)
+            compress = 1;
+        else if(strcmp(argv[i], "--stride") == 0 && i+1 < argc)
+            stride = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--keep") == 0 && i+1 < argc)
+            keep = atof(argv[++i]);
+        else if(strcmp(argv[i], "--min-change") == 0 && i+1 < argc)
+        {
+            // sr,sp,angle,dist
+            char* p = argv[++i];
+            for(int j = 0; j < 4 && p != NULL; j++)
+            {
+                min_change[j] = atof(p);
+                p = strchr(p, ',');
+                if(p != NULL){p++;}
+            }
+        }
+        else if(strcmp(argv[i], "--resume") == 0 && i+1 < argc)
+            slotPath(ckpt_file, sizeof(ckpt_file), argv[++i]);
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc)
+            slotPath(record_file, sizeof(record_file), argv[++i]);
+        else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+            have_seed = 1, seed_arg = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "--world") == 0 && i+1 < argc)
+        {
+            i++;
+            psimworldcfg wc;
+            if(psimWorldParse(&wc, argv[i]) < 0 || psimWorldCreate(&world, &wc) < 0)
+            {
+                printf("Failed to create world: %s\n", argv[i]);
+                return 1;
+            }
+            have_world = 1;
+            world_spec = argv[i];
+        }
+        else if(strcmp(argv[i], "--rays") == 0 && i+1 < argc)
+        {
+            i++;
+            if(psimRaysParse(&rays, argv[i]) < 0)
+            {
+                printf("Bad rays: %s, e.g. k=16,fan=360,range=2.\n", argv[i]);
+                return 1;
+            }
+            have_rays = 1;
+        }
+        else if(strcmp(argv[i], "--checkpoint-every") == 0 && i+1 < argc)
+            ckpt_every = atof(argv[++i]);
+        else if(strcmp(argv[i], "--encode") == 0 && i+1 < argc)
+        {
+            i++;
+            if(strcmp(argv[i], "f16") == 0){encoding = QENC_F16;}
+            else if(strcmp(argv[i], "i16") == 0){encoding = QENC_I16;}
+            else if(strcmp(argv[i], "f32") == 0){encoding = QENC_F32;}
+            else
+            {
+                printf("Unknown encoding: %s, use f32, f16 or i16.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(npos < 3)
+            pos[npos++] = argv[i];
+    }
+
+    if(have_rays == 1 && (stream_fd > -1 || compress == 1))
+    {
+        printf("--rays are logged beside bucket files, not with --stream or --compress.\n");
+        return 1;
+    }
+    if(policy_fnn.l != NULL && policy_fnn.l[0].n_in != 6+rays.k)
+    {
+        printf("The policy takes %u inputs, 6 and --rays %u would be %u.\n", policy_fnn.l[0].n_in, rays.k, 6+rays.k);
+        return 1;
+    }
+
+    // stdout now belongs to the consumer, keep the log on stderr
+    if(stream_fd > -1)
+    {
+        stream_fd = dup(1);
+        dup2(2, 1);
+    }
+
+    // whole lines as they happen, porydrivefarm and online.py read this log through a pipe
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
     // how many rounds to run for
     mcp = 512;
-    if(argc >= 2){mcp = atoi(argv[1]);}
+    if(npos >= 1){mcp = atoi(pos[0]);}
     timeout = 0;
-    if(argc >= 3){timeout = atof(argv[2]);}
+    if(npos >= 2){timeout = atof(pos[1]);}
     minscore = 0.01f;
-    if(argc >= 4){minscore = atof(argv[3]);}
+    if(npos >= 3){minscore = atof(pos[2]);}
     if(minscore == 0.f){minscore = 0.01f;}
-    printf("Running for %u rounds with a timeout of %g seconds.\n----\n", mcp, timeout);
+    printf("Running for %u rounds with a timeout of %g seconds.\n", mcp, timeout);
+    if(fast == 1)
+        printf("Virtual time, unpaced.%s\n", stream_fd > -1 ? " Streaming rounds to stdout." : "");
+    if(neural_drive == 1)
+        printf("DAgger: the policy drives %.0f%% of ticks, the auto drive labels every state.\n", (1.f-beta)*100.f);
+    if(stride < 1){stride = 1;}
+    if(keep <= 0.f || keep > 1.f){keep = 1.f;}
+    if(stride > 1 || keep < 1.f || min_change[0] > 0.f || min_change[1] > 0.f || min_change[2] > 0.f || min_change[3] > 0.f)
+        printf("Capture: every %u ticks, min change sr %g sp %g angle %g dist %g, keep %g.\n", stride, min_change[0], min_change[1], min_change[2], min_change[3], keep);
+    if(compress == 1)
+    {
+        block = malloc(dsbBound(XMAX/6));
+        if(block == NULL)
+        {
+            printf("Out of memory.\n");
+            return 1;
+        }
+        if(encoding != QENC_F32)
+            printf("--compress is lossless float32, --encode is ignored.\n");
+    }
+    printf("----\n");
 
     // i did consider threading this, and having a log buffer
     // per thread that got aggregated by a logging thread
@@ -854,27 +1291,154 @@ int main(int argc, char** argv)
     useconds_t wait = wait_interval;
 
     // init
-    t = glfwGetTime();
+    t = have_seed == 1 && fast == 1 ? 0.0 : glfwGetTime();
     setConfig();
-    randGame();
+    loadConfig();
+    if(have_world == 1)
+    {
+        cfg.world = &world;
+        printf("World: %u cubes within ±%g.\n", world.n, world.size);
+    }
+    if(have_rays == 1)
+        printf("Rays: %u over %g units in a fan of %g degrees, logged to <score>_r.dat.\n", rays.k, rays.range, rays.fan * RAD2DEG);
+    uint resumed = 0;
+    if(ckpt_file[0] != 0)
+    {
+        const int r = loadCheckpoint();
+        if(r == 1)
+        {
+            if(sim.cp >= mcp)
+            {
+                printf("%s: all %u rounds are already complete.\n", ckpt_file, mcp);
+                return 0;
+            }
+            resumed = 1;
+            openEvents(1);
+            char strts[16];
+            timestamp(&strts[0]);
+            printf("\n[%s] Resumed Game [%u] from %s at round %u, porygon %u of %u, %u rows in flight.\n", strts, (uint)game_seed, ckpt_file, round_index, sim.cp, mcp, dxi/6);
+        }
+        else if(r < 0)
+        {
+            // moved aside rather than overwritten, it may be from another build
+            char bad[sizeof(ckpt_file)+4];
+            sprintf(bad, "%s.bad", ckpt_file);
+            rename(ckpt_file, bad);
+            printf("%s is not a usable checkpoint, moved to %s.\n", ckpt_file, bad);
+        }
+    }
+    if(resumed == 0)
+        randGame();
+
+    // bounds for quantized bucket files; unit vectors, the angle and the arena
+    // diagonal, sr is within the steering limit at zero speed (with headroom
+    // for reversing), sp within the top speed. vNorm()'s rsqrt leaves a unit
+    // vector up to 1.0004 long and their dot up to 1.0008, so those get 1.001
+    // rather than saturating
+    const f32 spawn = psimWorld(&cfg)->spawn;
+    qencInit(&qhx, encoding, 6, (f32[]){1.001f, 1.001f, 1.001f, 1.001f, 1.001f, spawn > 18.f ? spawn*2.9f : 52.f});
+    qencInit(&qhy, encoding, 2, (f32[]){fmaxf(cfg.maxsteer * 2.f*cfg.maxspeed * cfg.steerinertia, cfg.minsteer), cfg.maxspeed});
+
+    // publish live metrics, removed again on exit
+    metrics* m = metricsCreate();
+    if(m != NULL)
+    {
+        met = m;
+        atexit(removeMetrics);
+    }
+    // without SA_RESTART, so that a --stream write blocked on a consumer that stopped reading returns
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigExit;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    met->pid = getpid();
+    met->flags = (fast ? METRICS_FLAG_FAST : 0) | (stream_fd > -1 ? METRICS_FLAG_STREAM : 0) | (neural_drive ? METRICS_FLAG_DAGGER : 0);
+    met->start = glfwGetTime();
 
     // reset
     const double st = glfwGetTime();
-    t = glfwGetTime();
+    if(resumed == 0)
+        t = have_seed == 1 && fast == 1 ? 0.0 : st;
+    else if(fast == 0) // the restored wall clocks carry on from now, virtual time carries on as it was
+    {
+        game_start += st - t;
+        psimRebase(&sim, st);
+        t = st;
+    }
+    if(ckpt_file[0] != 0)
+    {
+        ckpt_next = st + ckpt_every;
+        atexit(exitCheckpoint);
+        printf("Checkpointing to %s every %g seconds and after every written round.\n", ckpt_file, ckpt_every);
+    }
     dt = 1.0 / 144.0; // fixed timestep delta-time
+    if(record_file[0] != 0)
+    {
+        // a resumed run carries on its recording, or starts one from the restored state when it had none
+        if(resumed == 1 && ckpt_rec_ticks > 0 ? psimRecordResume(&rec, record_file, game_seed, ckpt_rec_ticks) < 0 :
+           psimRecordOpen(&rec, record_file, &cfg, world_spec, game_seed, round_index, dt, auto_drive ? PSIM_REPLAY_AUTODRIVE : 0, &sim) < 0)
+        {
+            printf("Failed to open recording: %s\n", record_file);
+            return 1;
+        }
+        atexit(closeRecord);
+        printf("Recording every tick to %s.\n", record_file);
+    }
 
     // "framerate" or Cycles Per Second (CPS) monitoring
-    double ltt = t+32.0;
+    double ltt = st+32.0;
     uint fc = 0;
-    double ltt2 = t+1.0;
+    double ltt2 = st+1.0;
     uint fc2 = 0;
     
     // event loop
     while(1)
     {
+        // in virtual time the simulation no longer depends on keeping up with the wall clock
+        if(fast == 1)
+        {
+            if(quit_requested == 1)
+                exit(0);
+            t += dt;
+            in_tick = 1;
+            main_loop();
+            in_tick = 0;
+            fc++;
+            fc2++;
+            const double wt = glfwGetTime();
+            checkpointTick(wt);
+            if(wt > ltt2)
+            {
+                met->cps = fc2;
+                met->heartbeat = wt;
+                fc2 = 0;
+                ltt2 = wt+1.0;
+            }
+            if(wt > ltt)
+            {
+                logEvent(EV_CPS, (f32[]){(f32)(fc/32)}, 1);
+                char strts[16];
+                timestamp(&strts[0]);
+                if(quiet == 0)
+                    printf("[%s] CPS: %u\n", strts, fc/32);
+                fc = 0;
+                ltt = wt+32.0;
+            }
+            if(timeout != 0 && wt-st >= timeout)
+                return 0;
+            continue;
+        }
+
         usleep(wait);
+        if(quit_requested == 1)
+            exit(0);
         t = glfwGetTime();
+        in_tick = 1;
         main_loop();
+        in_tick = 0;
+        checkpointTick(t);
 
         // if CPS drops below 120, quit! bad data!!
         fc2++;
@@ -885,8 +1449,13 @@ int main(int argc, char** argv)
                 char strts[16];
                 timestamp(&strts[0]);
                 printf("[%s] CPS dropped to unacceptable level: %u\n", strts, fc2);
+                logEvent(EV_WATCHDOG, (f32[]){(f32)fc2}, 1);
                 exit(0);
             }
+            if(fc2 < CPS_NEAR_MISS)
+                met->near_misses++;
+            met->cps = fc2;
+            met->heartbeat = t;
             fc2 = 0;
             ltt2 = t+1.0;
         }
@@ -895,9 +1464,11 @@ int main(int argc, char** argv)
         fc++;
         if(t > ltt)
         {
+            logEvent(EV_CPS, (f32[]){(f32)(fc/32)}, 1);
             char strts[16];
             timestamp(&strts[0]);
-            printf("[%s] CPS: %u\n", strts, fc/32);
+            if(quiet == 0)
+                printf("[%s] CPS: %u\n", strts, fc/32);
             fc = 0;
             ltt = t+32.0;
         }
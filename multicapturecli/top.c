@@ -0,0 +1,269 @@
+/*
+    Info:
+
+        porydrive-top, a live view of every running porydrivecli.
+
+        Maps the shared-memory metrics each simulator publishes (see
+        inc/metrics.h) and shows aggregate throughput, rounds logged per
+        score bucket so that starving buckets stand out, bytes written,
+        bucket file lock waits and CPS watchdog near-misses, followed by
+        the slowest processes.
+
+        Segments left behind by killed processes are removed.
+
+        --prom writes the same counters in the Prometheus text exposition
+        format on every refresh (atomically, for a textfile collector).
+
+    Usage:
+
+        ./porydrive-top [interval seconds] [--prom <file>] [--once]
+        ./porydrive-top 2 --prom /var/lib/node_exporter/porydrive.prom
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/time.h>
+
+#include "../inc/metrics.h"
+
+#define MAX_ROWS 20
+
+typedef struct
+{
+    metrics* m;     // read-only mapping
+    metrics prev;   // copy at the last refresh
+    uint32_t seen;  // 1 once prev is valid
+    uint32_t mark;
+    double rate;    // ticks/sec over the last refresh
+} proc;
+
+proc* procs = NULL;
+uint32_t nprocs = 0, cprocs = 0;
+
+double wallTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((double)tv.tv_sec) + (((double)tv.tv_usec)/1000000.0);
+}
+
+int alive(const int pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+metrics* mapMetrics(const char* path)
+{
+    const int f = open(path, O_RDONLY | O_CLOEXEC);
+    if(f == -1)
+        return NULL;
+    metrics* m = mmap(NULL, sizeof(metrics), PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return NULL;
+    if(m->magic != METRICS_MAGIC)
+    {
+        munmap(m, sizeof(metrics));
+        return NULL;
+    }
+    return m;
+}
+
+// picks up new segments and drops the ones whose process has gone
+void scan()
+{
+    for(uint32_t i = 0; i < nprocs; i++)
+        procs[i].mark = 0;
+
+    DIR* d = opendir(METRICS_DIR);
+    if(d != NULL)
+    {
+        const size_t pl = strlen(METRICS_PREFIX);
+        struct dirent* de;
+        while((de = readdir(d)) != NULL)
+        {
+            if(strncmp(de->d_name, METRICS_PREFIX, pl) != 0)
+                continue;
+            const int pid = atoi(de->d_name + pl);
+            char path[300];
+            sprintf(path, "%s/%s", METRICS_DIR, de->d_name);
+            if(pid <= 0 || alive(pid) == 0)
+            {
+                unlink(path);
+                continue;
+            }
+            uint32_t i = 0;
+            while(i < nprocs && procs[i].m->pid != pid)
+                i++;
+            if(i == nprocs)
+            {
+                metrics* m = mapMetrics(path);
+                if(m == NULL)
+                    continue;
+                if(nprocs == cprocs)
+                {
+                    cprocs = cprocs ? cprocs*2 : 256;
+                    procs = realloc(procs, cprocs * sizeof(proc));
+                }
+                memset(&procs[nprocs], 0, sizeof(proc));
+                procs[nprocs].m = m;
+                nprocs++;
+            }
+            procs[i].mark = 1;
+        }
+        closedir(d);
+    }
+
+    for(uint32_t i = 0; i < nprocs;)
+    {
+        if(procs[i].mark == 0)
+        {
+            munmap(procs[i].m, sizeof(metrics));
+            procs[i] = procs[--nprocs];
+        }
+        else
+            i++;
+    }
+}
+
+int cmpRate(const void* a, const void* b)
+{
+    const double ra = ((const proc*)a)->rate, rb = ((const proc*)b)->rate;
+    return (ra > rb) - (ra < rb);
+}
+
+void writeProm(const char* file, const metrics* tot)
+{
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE* f = fopen(tmp, "w");
+    if(f == NULL)
+        return;
+    fprintf(f, "# HELP porydrive_processes Running simulator processes.\n# TYPE porydrive_processes gauge\nporydrive_processes %u\n", nprocs);
+    #define PROM_COUNTER(name, help, field) \
+        fprintf(f, "# HELP porydrive_" name " " help "\n# TYPE porydrive_" name " counter\n"); \
+        fprintf(f, "porydrive_" name " %llu\n", (unsigned long long)tot->field); \
+        for(uint32_t i = 0; i < nprocs; i++) \
+            fprintf(f, "porydrive_" name "{pid=\"%d\"} %llu\n", procs[i].prev.pid, (unsigned long long)procs[i].prev.field);
+    PROM_COUNTER("ticks_total", "Simulation steps.", ticks)
+    PROM_COUNTER("rounds_total", "Porygon collected.", rounds)
+    PROM_COUNTER("timeouts_total", "Rounds that took too long.", timeouts)
+    PROM_COUNTER("samples_total", "Rows written.", samples)
+    PROM_COUNTER("bytes_total", "Bytes written.", bytes)
+    PROM_COUNTER("lock_waits_total", "Bucket file locks taken.", lock_waits)
+    PROM_COUNTER("watchdog_near_misses_total", "Paced seconds close to the CPS watchdog.", near_misses)
+    #undef PROM_COUNTER
+    fprintf(f, "# HELP porydrive_lock_wait_seconds_total Time spent waiting for bucket file locks.\n# TYPE porydrive_lock_wait_seconds_total counter\n");
+    fprintf(f, "porydrive_lock_wait_seconds_total %.9f\n", tot->lock_wait_ns * 1e-9);
+    fprintf(f, "# HELP porydrive_rounds_logged_total Rounds logged per score bucket.\n# TYPE porydrive_rounds_logged_total counter\n");
+    for(int b = 0; b < METRICS_BUCKETS; b++)
+        fprintf(f, "porydrive_rounds_logged_total{bucket=\"%.1f\"} %llu\n", b * 0.1f, (unsigned long long)tot->rounds_logged[b]);
+    fprintf(f, "# HELP porydrive_cps Cycles in the last whole second.\n# TYPE porydrive_cps gauge\n");
+    for(uint32_t i = 0; i < nprocs; i++)
+        fprintf(f, "porydrive_cps{pid=\"%d\"} %u\n", procs[i].prev.pid, procs[i].prev.cps);
+    if(fclose(f) == 0)
+        rename(tmp, file);
+    else
+        unlink(tmp);
+}
+
+int main(int argc, char** argv)
+{
+    double interval = 2.0;
+    const char* prom = NULL;
+    uint32_t once = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--prom") == 0 && i+1 < argc){prom = argv[++i];}
+        else if(strcmp(argv[i], "--once") == 0){once = 1;}
+        else if(strcmp(argv[i], "--help") == 0)
+        {
+            printf("Usage: ./porydrive-top [interval seconds] [--prom <file>] [--once]\n");
+            return 0;
+        }
+        else{interval = atof(argv[i]);}
+    }
+    if(interval < 0.1){interval = 0.1;}
+
+    double last = wallTime();
+    uint32_t first = 1;
+    while(1)
+    {
+        scan();
+        const double now = wallTime();
+        const double el = now - last;
+        last = now;
+
+        // totals, and rates over processes that were also there last time
+        metrics tot, dlt;
+        memset(&tot, 0, sizeof(tot));
+        memset(&dlt, 0, sizeof(dlt));
+        uint32_t stalled = 0;
+        for(uint32_t i = 0; i < nprocs; i++)
+        {
+            proc* p = &procs[i];
+            metrics c;
+            memcpy(&c, p->m, sizeof(metrics));
+            #define ACC(field) tot.field += c.field; if(p->seen) dlt.field += c.field - p->prev.field;
+            ACC(ticks) ACC(rounds) ACC(timeouts) ACC(samples) ACC(bytes) ACC(lock_waits) ACC(lock_wait_ns) ACC(near_misses)
+            for(int b = 0; b < METRICS_BUCKETS; b++){ACC(rounds_logged[b])}
+            #undef ACC
+            p->rate = p->seen ? (double)(c.ticks - p->prev.ticks) / el : 0.0;
+            if(c.heartbeat > 0.0 && now - c.heartbeat > 5.0)
+                stalled++;
+            p->prev = c;
+            p->seen = 1;
+        }
+
+        if(prom != NULL)
+            writeProm(prom, &tot);
+
+        if(first == 0)
+        {
+            if(once == 0)
+                printf("\033[H\033[2J");
+            char ts[16];
+            const time_t tt = time(0);
+            strftime(ts, 16, "%H:%M:%S", localtime(&tt));
+            printf("porydrive-top %s | %u processes (%u stalled) | every %gs\n\n", ts, nprocs, stalled, interval);
+            printf("ticks/s %.0f | rounds/min %.1f | timeouts/min %.1f | samples/s %.0f | MB/s %.3f\n",
+                dlt.ticks / el, dlt.rounds * 60.0 / el, dlt.timeouts * 60.0 / el, dlt.samples / el, dlt.bytes / el / 1048576.0);
+            printf("lock waits %llu, avg %.3f ms | watchdog near-misses %llu (+%llu)\n",
+                (unsigned long long)tot.lock_waits, dlt.lock_waits ? dlt.lock_wait_ns / 1e6 / dlt.lock_waits : 0.0,
+                (unsigned long long)tot.near_misses, (unsigned long long)dlt.near_misses);
+            printf("totals: %llu ticks, %llu rounds, %llu timeouts, %llu samples, %.2f MB\n\n",
+                (unsigned long long)tot.ticks, (unsigned long long)tot.rounds, (unsigned long long)tot.timeouts,
+                (unsigned long long)tot.samples, tot.bytes / 1048576.0);
+
+            printf("bucket      logged   per min\n");
+            for(int b = 0; b < METRICS_BUCKETS; b++)
+                printf("   %.1f %11llu %9.1f\n", b * 0.1f, (unsigned long long)tot.rounds_logged[b], dlt.rounds_logged[b] * 60.0 / el);
+
+            // slowest first
+            qsort(procs, nprocs, sizeof(proc), cmpRate);
+            printf("\n%8s %10s %6s %8s %8s %10s %7s\n", "pid", "ticks/s", "cps", "rounds", "timeout", "samples", "misses");
+            for(uint32_t i = 0; i < nprocs && i < MAX_ROWS; i++)
+            {
+                const metrics* c = &procs[i].prev;
+                printf("%8d %10.0f %6u %8llu %8llu %10llu %7llu%s\n", c->pid, procs[i].rate, c->cps, (unsigned long long)c->rounds,
+                    (unsigned long long)c->timeouts, (unsigned long long)c->samples, (unsigned long long)c->near_misses,
+                    (c->flags & METRICS_FLAG_DAGGER) ? " dagger" : (c->flags & METRICS_FLAG_STREAM) ? " stream" : (c->flags & METRICS_FLAG_FAST) ? " fast" : "");
+            }
+            if(nprocs > MAX_ROWS)
+                printf("... %u more\n", nprocs - MAX_ROWS);
+            fflush(stdout);
+            if(once == 1)
+                break;
+        }
+        first = 0;
+        usleep((useconds_t)(interval * 1000000.0));
+    }
+    return 0;
+}
@@ -1,2 +1 @@
-cat d1/dataset_x.dat d2/dataset_x.dat d3/dataset_x.dat d4/dataset_x.dat d5/dataset_x.dat d6/dataset_x.dat d7/dataset_x.dat d8/dataset_x.dat d9/dataset_x.dat d10/dataset_x.dat > dataset_x.dat
-cat d1/dataset_y.dat d2/dataset_y.dat d3/dataset_y.dat d4/dataset_y.dat d5/dataset_y.dat d6/dataset_y.dat d7/dataset_y.dat d8/dataset_y.dat d9/dataset_y.dat d10/dataset_y.dat > dataset_y.dat
\ No newline at end of file
+../dsmerge/dsmerge dataset_x.dat dataset_y.dat d1 d2 d3 d4 d5 d6 d7 d8 d9 d10
\ No newline at end of file
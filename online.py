@@ -0,0 +1,263 @@
+# Online training, simulator workers stream rounds straight into the trainer.
+# https://github.com/PoryDrive/PoryDriveFNN
+#
+# Launches <workers> `porydrivecli --stream` processes, a reader thread per
+# worker pushes every qualifying round into a bounded in-memory shuffle
+# reservoir and the trainer draws random minibatches from it concurrently.
+# When the reservoir is full the readers block, the pipes fill and the
+# workers block on write; that is the backpressure. Nothing touches disk
+# apart from the periodic model checkpoints.
+#
+# python3 online.py <layers 0-4> <layer units> <batches> <optimiser> <cpu only 1/0> <workers> <min score> <reservoir rows> <samples to train>
+# python3 online.py 4 384 32 nesterov 1 8 0.5 1000000 100000000
+import sys
+import os
+import threading
+import subprocess
+import numpy as np
+from struct import unpack_from
+from time import time_ns, time
+from os import mkdir
+from os.path import isdir
+
+# hyperparameters
+optimiser = 'adam'
+inputsize = 6
+outputsize = 2
+activator = 'tanh'
+layers = 4
+layer_units = 384
+batches = 32
+workers = os.cpu_count()
+minscore = 0.01
+reservoir_rows = 1000000
+train_samples = 100000000
+checkpoint_seconds = 600
+cli = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'multicapturecli', 'porydrivecli')
+
+# load options
+argc = len(sys.argv)
+if argc >= 2:
+    layers = int(sys.argv[1])
+    print("layers:", layers)
+if argc >= 3:
+    layer_units = int(sys.argv[2])
+    print("layer_units:", layer_units)
+if argc >= 4:
+    batches = int(sys.argv[3])
+    print("batches:", batches)
+if argc >= 5:
+    optimiser = sys.argv[4]
+    print("optimiser:", optimiser)
+if argc >= 6 and sys.argv[5] == '1':
+    os.environ['CUDA_VISIBLE_DEVICES'] = '-1'
+    print("CPU_ONLY: 1")
+if argc >= 7:
+    workers = int(sys.argv[6])
+    print("workers:", workers)
+if argc >= 8:
+    minscore = float(sys.argv[7])
+    print("minscore:", minscore)
+if argc >= 9:
+    reservoir_rows = int(sys.argv[8])
+    print("reservoir_rows:", reservoir_rows)
+if argc >= 10:
+    train_samples = int(sys.argv[9])
+    print("train_samples:", train_samples)
+
+# tensorflow after CUDA_VISIBLE_DEVICES is decided
+from tensorflow import keras
+from tensorflow.keras.models import Sequential
+from tensorflow.keras.layers import Dense
+
+# make sure save dir exists
+if not isdir('models'): mkdir('models')
+model_name = 'models/' + optimiser + '_' + str(layers) + '_' + str(layer_units) + '_' + str(batches) + '_online'
+print("model_name:", model_name)
+
+##########################################
+#   RESERVOIR
+##########################################
+
+class Reservoir:
+    def __init__(self, capacity, min_fill):
+        self.x = np.empty([capacity, inputsize], dtype=np.float32)
+        self.y = np.empty([capacity, outputsize], dtype=np.float32)
+        self.capacity = capacity
+        self.min_fill = min_fill
+        self.count = 0
+        self.rows_in = 0
+        self.rows_out = 0
+        self.closed = False
+        self.producers = 0
+        self.cv = threading.Condition()
+        self.rng = np.random.default_rng()
+
+    # blocks while full
+    def put(self, x, y):
+        i = 0
+        with self.cv:
+            while i < len(x):
+                while self.count == self.capacity and not self.closed:
+                    self.cv.wait()
+                if self.closed:
+                    return
+                n = min(len(x) - i, self.capacity - self.count)
+                self.x[self.count:self.count+n] = x[i:i+n]
+                self.y[self.count:self.count+n] = y[i:i+n]
+                self.count += n
+                self.rows_in += n
+                i += n
+                self.cv.notify_all()
+
+    # blocks until there is enough to shuffle from, removed rows are back-filled from the tail
+    def take(self, n):
+        with self.cv:
+            while self.count < max(n, self.min_fill) and self.producers > 0 and not self.closed:
+                self.cv.wait()
+            if self.closed or self.count < n: # closed, or drained after the last worker went away
+                return None, None
+            idx = np.sort(self.rng.choice(self.count, n, replace=False))[::-1]
+            bx = self.x[idx].copy()
+            by = self.y[idx].copy()
+            for i in idx: # descending, so the tail row moved in is never one we still have to remove
+                self.count -= 1
+                self.x[i] = self.x[self.count]
+                self.y[i] = self.y[self.count]
+            self.rows_out += n
+            self.cv.notify_all()
+            return bx, by
+
+    def producerDone(self):
+        with self.cv:
+            self.producers -= 1
+            self.cv.notify_all()
+
+    def close(self):
+        with self.cv:
+            self.closed = True
+            self.cv.notify_all()
+
+reservoir = Reservoir(reservoir_rows, min(reservoir_rows, max(batches, reservoir_rows // 4)))
+
+##########################################
+#   WORKERS
+##########################################
+
+def readExact(f, n):
+    b = bytearray()
+    while len(b) < n:
+        r = f.read(n - len(b))
+        if not r:
+            return None
+        b += r
+    return bytes(b)
+
+def reader(proc):
+    f = proc.stdout
+    while not reservoir.closed:
+        hdr = readExact(f, 64) # the round's inc/rindex.h record
+        if hdr is None:
+            break
+        rows = unpack_from('<I', hdr, 8)[0]
+        bx = readExact(f, rows * inputsize * 4)
+        by = readExact(f, rows * outputsize * 4)
+        if bx is None or by is None:
+            break
+        reservoir.put(np.frombuffer(bx, dtype=np.float32).reshape([rows, inputsize]),
+                      np.frombuffer(by, dtype=np.float32).reshape([rows, outputsize]))
+    reservoir.producerDone()
+
+procs = []
+threads = []
+reservoir.producers = workers
+for i in range(workers):
+    p = subprocess.Popen([cli, '2147483647', '0', str(minscore), '--stream'], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, bufsize=0)
+    th = threading.Thread(target=reader, args=(p,), daemon=True)
+    th.start()
+    procs.append(p)
+    threads.append(th)
+print("Launched", workers, "simulator workers.")
+
+##########################################
+#   TRAIN
+##########################################
+
+# construct neural network
+model = Sequential()
+
+model.add(Dense(layer_units, activation=activator, input_dim=inputsize))
+if layers > 0: model.add(Dense(layer_units//2, activation=activator))
+if layers > 1: model.add(Dense(layer_units//4, activation=activator))
+if layers > 2: model.add(Dense(layer_units//8, activation=activator))
+if layers > 3: model.add(Dense(layer_units//16, activation=activator))
+model.add(Dense(outputsize, activation='tanh'))
+
+# output summary
+model.summary()
+
+if optimiser == 'adam':
+    optim = keras.optimizers.Adam(learning_rate=0.001)
+elif optimiser == 'sgd':
+    optim = keras.optimizers.SGD(learning_rate=0.01, momentum=0., nesterov=False)
+elif optimiser == 'momentum':
+    optim = keras.optimizers.SGD(learning_rate=0.01, momentum=0.9, nesterov=False)
+elif optimiser == 'nesterov':
+    optim = keras.optimizers.SGD(learning_rate=0.01, momentum=0.9, nesterov=True)
+elif optimiser == 'nadam':
+    optim = keras.optimizers.Nadam(learning_rate=0.001)
+elif optimiser == 'adagrad':
+    optim = keras.optimizers.Adagrad(learning_rate=0.001)
+elif optimiser == 'rmsprop':
+    optim = keras.optimizers.RMSprop(learning_rate=0.001)
+elif optimiser == 'adadelta':
+    optim = keras.optimizers.Adadelta(learning_rate=0.001)
+elif optimiser == 'adamax':
+    optim = keras.optimizers.Adamax(learning_rate=0.001)
+elif optimiser == 'ftrl':
+    optim = keras.optimizers.Ftrl(learning_rate=0.001)
+
+model.compile(optimizer=optim, loss='mean_squared_error')
+
+st = time_ns()
+next_checkpoint = time() + checkpoint_seconds
+next_report = time() + 10
+trained = 0
+loss = 0.
+try:
+    while trained < train_samples:
+        bx, by = reservoir.take(batches)
+        if bx is None:
+            print("All simulator workers have exited.")
+            break
+        loss = model.train_on_batch(bx, by)
+        trained += batches
+
+        now = time()
+        if now > next_report:
+            print("trained: {:,} | loss: {:.6f} | reservoir: {:,}/{:,} | rows in: {:,}".format(trained, float(loss), reservoir.count, reservoir.capacity, reservoir.rows_in))
+            next_report = now + 10
+        if now > next_checkpoint:
+            model.save(model_name)
+            print("Checkpoint saved:", model_name)
+            next_checkpoint = now + checkpoint_seconds
+except KeyboardInterrupt:
+    print("")
+
+reservoir.close()
+for p in procs:
+    p.terminate()
+for p in procs:
+    p.wait()
+
+timetaken = (time_ns()-st)/1e+9
+print("")
+print("Trained on", "{:,}".format(trained), "samples")
+print("Time Taken:", "{:.2f}".format(timetaken), "seconds")
+
+##########################################
+#   EXPORT
+##########################################
+
+# save keras model
+model.save(model_name)
@@ -0,0 +1 @@
+gcc main.c -I ../inc -O3 -lpthread -o pdbdec
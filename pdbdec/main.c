@@ -0,0 +1,287 @@
+/*
+    Info:
+
+        Block dataset decoder.
+
+        Decodes the compressed .pdb block files that porydrivecli --compress
+        writes (see inc/dsblock.h) back into float32 rows, on every core.
+
+        The inputs are memory mapped and indexed first, then decoded a window
+        of blocks at a time with one thread per core, and written out in
+        file order. Blocks that fail their checksum are reported and skipped,
+        a truncated block at the end of a file (a killed writer) is ignored.
+
+        <out_x> <out_y> are dataset_x.dat / dataset_y.dat style float32
+        files, with --stdout the rows go down stdout instead as a sequence of
+        [uint32 rows][f32 x[rows*6]][f32 y[rows*2]] chunks ending with a zero
+        row count, which dataset.py's load_blocks() reads.
+
+    Usage:
+
+        ./pdbdec <out_x> <out_y> <in.pdb>... [--threads n] [--min-score x] [--max-score x]
+        ./pdbdec --stdout <in.pdb>... [--threads n] [--min-score x] [--max-score x]
+        ./pdbdec dataset_x.dat dataset_y.dat 0.8.pdb 0.9.pdb 1.0.pdb
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "../inc/dsblock.h"
+
+#define WINDOW_ROWS (1 << 20)
+#define MAX_THREADS 256
+
+typedef struct
+{
+    const uint8_t* p;  // header
+    dsbheader h;
+    uint64_t row;      // first row within the window
+    int ok;
+} blk;
+
+blk* blocks = NULL;
+uint64_t nblocks = 0;
+
+// the current window
+uint64_t wb0, wb1;
+float* wx;
+float* wy;
+uint64_t next_block;
+pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+double wallTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((double)tv.tv_sec) + (((double)tv.tv_usec)/1000000.0);
+}
+
+void* decodeThread(void* arg)
+{
+    (void)arg;
+    while(1)
+    {
+        pthread_mutex_lock(&next_lock);
+        const uint64_t i = next_block++;
+        pthread_mutex_unlock(&next_lock);
+        if(i >= wb1)
+            break;
+        blk* b = &blocks[i];
+        b->ok = dsbDecode(&b->h, b->p + sizeof(dsbheader), wx + b->row*DSB_XCOLS, wy + b->row*DSB_YCOLS) == 0;
+    }
+    return NULL;
+}
+
+int writeAll(FILE* f, const void* p, const size_t n)
+{
+    return fwrite(p, 1, n, f) == n ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        printf("Usage: ./pdbdec <out_x> <out_y> <in.pdb>... [--threads n] [--min-score x] [--max-score x]\n");
+        printf("       ./pdbdec --stdout <in.pdb>... [--threads n] [--min-score x] [--max-score x]\n");
+        return 0;
+    }
+
+    uint32_t to_stdout = 0;
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    float min_score = -1.f, max_score = 2.f;
+    char* pos[argc];
+    int npos = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--stdout") == 0){to_stdout = 1;}
+        else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc){nthreads = atoi(argv[++i]);}
+        else if(strcmp(argv[i], "--min-score") == 0 && i+1 < argc){min_score = atof(argv[++i]);}
+        else if(strcmp(argv[i], "--max-score") == 0 && i+1 < argc){max_score = atof(argv[++i]);}
+        else{pos[npos++] = argv[i];}
+    }
+    if(nthreads < 1){nthreads = 1;}
+    if(nthreads > MAX_THREADS){nthreads = MAX_THREADS;}
+
+    // the log goes to stderr so that stdout can carry rows
+    FILE* log = to_stdout ? stderr : stdout;
+    FILE* fx = NULL;
+    FILE* fy = NULL;
+    int first_in = 0;
+    if(to_stdout == 0)
+    {
+        if(npos < 3)
+        {
+            printf("Need <out_x> <out_y> and at least one input.\n");
+            return 1;
+        }
+        fx = fopen(pos[0], "wb");
+        fy = fopen(pos[1], "wb");
+        if(fx == NULL || fy == NULL)
+        {
+            printf("Failed to open the outputs.\n");
+            return 1;
+        }
+        first_in = 2;
+    }
+
+    // map and index every input
+    const double st = wallTime();
+    uint64_t cblocks = 0, bytes = 0, truncated = 0;
+    for(int i = first_in; i < npos; i++)
+    {
+        const int fd = open(pos[i], O_RDONLY | O_CLOEXEC);
+        struct stat s;
+        if(fd == -1 || fstat(fd, &s) == -1)
+        {
+            fprintf(log, "Failed to open %s\n", pos[i]);
+            return 1;
+        }
+        if(s.st_size == 0)
+        {
+            close(fd);
+            continue;
+        }
+        const uint8_t* m = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(m == MAP_FAILED)
+        {
+            fprintf(log, "Failed to map %s\n", pos[i]);
+            return 1;
+        }
+        madvise((void*)m, s.st_size, MADV_SEQUENTIAL);
+
+        size_t o = 0;
+        while(o + sizeof(dsbheader) <= (size_t)s.st_size)
+        {
+            dsbheader h;
+            memcpy(&h, m + o, sizeof(h));
+            if(h.magic != DSB_MAGIC)
+            {
+                fprintf(log, "%s: no block at byte %zu, the rest of the file is skipped.\n", pos[i], o);
+                break;
+            }
+            if(o + sizeof(dsbheader) + h.size > (size_t)s.st_size)
+            {
+                truncated++;
+                break;
+            }
+            if(h.score >= min_score && h.score <= max_score)
+            {
+                if(nblocks == cblocks)
+                {
+                    cblocks = cblocks ? cblocks*2 : 4096;
+                    blocks = realloc(blocks, cblocks * sizeof(blk));
+                }
+                blocks[nblocks].p = m + o;
+                blocks[nblocks].h = h;
+                nblocks++;
+                bytes += sizeof(dsbheader) + h.size;
+            }
+            o += sizeof(dsbheader) + h.size;
+        }
+    }
+
+    // largest block decides the smallest window
+    uint64_t wrows = WINDOW_ROWS;
+    for(uint64_t i = 0; i < nblocks; i++)
+        if(blocks[i].h.rows > wrows)
+            wrows = blocks[i].h.rows;
+    wx = malloc(wrows * DSB_XCOLS * sizeof(float));
+    wy = malloc(wrows * DSB_YCOLS * sizeof(float));
+    if(wx == NULL || wy == NULL)
+    {
+        fprintf(log, "Out of memory.\n");
+        return 1;
+    }
+
+    uint64_t rows = 0, corrupt = 0;
+    pthread_t th[MAX_THREADS];
+    wb0 = 0;
+    while(wb0 < nblocks)
+    {
+        // fill a window
+        uint64_t r = 0;
+        wb1 = wb0;
+        while(wb1 < nblocks && r + blocks[wb1].h.rows <= wrows)
+        {
+            blocks[wb1].row = r;
+            r += blocks[wb1].h.rows;
+            wb1++;
+        }
+
+        next_block = wb0;
+        const int nt = (uint64_t)nthreads < wb1-wb0 ? nthreads : (int)(wb1-wb0);
+        for(int i = 0; i < nt; i++)
+            pthread_create(&th[i], NULL, decodeThread, NULL);
+        for(int i = 0; i < nt; i++)
+            pthread_join(th[i], NULL);
+
+        // good blocks only, in order
+        uint64_t wr = 0;
+        for(uint64_t i = wb0; i < wb1; i++)
+            if(blocks[i].ok)
+                wr += blocks[i].h.rows;
+            else
+                corrupt++;
+        if(wr == 0)
+        {
+            wb0 = wb1;
+            continue;
+        }
+        if(to_stdout == 1)
+        {
+            const uint32_t n = wr;
+            if(writeAll(stdout, &n, sizeof(n)) < 0)
+                return 1;
+        }
+        for(int pass = 0; pass < 2; pass++)
+        {
+            FILE* f = to_stdout ? stdout : (pass == 0 ? fx : fy);
+            const uint32_t cols = pass == 0 ? DSB_XCOLS : DSB_YCOLS;
+            const float* src = pass == 0 ? wx : wy;
+            for(uint64_t i = wb0; i < wb1; i++)
+            {
+                if(blocks[i].ok == 0)
+                    continue;
+                if(writeAll(f, src + blocks[i].row*cols, (size_t)blocks[i].h.rows*cols*sizeof(float)) < 0)
+                {
+                    fprintf(log, "Write failed.\n");
+                    return 1;
+                }
+            }
+        }
+        rows += wr;
+        wb0 = wb1;
+    }
+
+    if(to_stdout == 1)
+    {
+        const uint32_t n = 0;
+        writeAll(stdout, &n, sizeof(n));
+        fflush(stdout);
+    }
+    else if(fclose(fx) != 0 || fclose(fy) != 0)
+    {
+        printf("Write failed.\n");
+        return 1;
+    }
+
+    const double el = wallTime() - st;
+    fprintf(log, "%llu rows from %llu blocks (%.1f MB, %.2fx) in %.2f seconds on %d threads, %.0f MB/s.\n",
+        (unsigned long long)rows, (unsigned long long)(nblocks - corrupt), bytes / 1048576.0,
+        bytes ? (double)rows * DSB_COLS * sizeof(float) / bytes : 0.0, el, nthreads, rows * DSB_COLS * sizeof(float) / 1048576.0 / el);
+    if(corrupt > 0)
+        fprintf(log, "%llu blocks failed their checksum and were skipped.\n", (unsigned long long)corrupt);
+    if(truncated > 0)
+        fprintf(log, "%llu truncated blocks at the end of files were ignored.\n", (unsigned long long)truncated);
+    return 0;
+}
@@ -0,0 +1,120 @@
+# Vectorised PoryDrive environments for Python, over porysim/libporysim.so
+# (see inc/psimvec.h). The observation, reward and done arrays are NumPy
+# arrays owned here and filled in place by the library on every step, no
+# copies either way; actions are passed by pointer when they are already a
+# C-contiguous float32 [n, 2] array.
+#
+# import porysim
+# env = porysim.VecEnv(4096)
+# obs = env.reset(seeds=range(4096))
+# obs, reward, done = env.step(actions) # actions [n, 2] of sr, sp, None for the auto drive
+# env = porysim.VecEnv(4096, world='layout=jitter,size=70') # a world spec, see inc/psimworld.h
+import os
+import ctypes
+import numpy as np
+
+NONE = 0
+TIMEOUT = 1
+COLLECTED = 2
+
+class Config(ctypes.Structure):
+    """psimcfg, the car physics and auto drive variables."""
+    _fields_ = [(n, ctypes.c_float) for n in ('maxspeed', 'acceleration', 'inertia', 'drag', 'steeringspeed', 'steerinertia',
+                                               'minsteer', 'maxsteer', 'steering_deadzone', 'steeringtransfer', 'steeringtransferinertia')] + \
+               [('sticky_collisions', ctypes.c_uint)] + \
+               [(n, ctypes.c_float) for n in ('ad_min_dstep', 'ad_max_dstep', 'ad_min_speedswitch', 'ad_maxspeed_reductor')] + \
+               [('world', ctypes.c_void_p)]
+
+class WorldConfig(ctypes.Structure):
+    """psimworldcfg, filled by psimWorldParse()."""
+    _fields_ = [('layout', ctypes.c_uint32), ('size', ctypes.c_float), ('spacing', ctypes.c_float), ('jitter', ctypes.c_float),
+                ('count', ctypes.c_uint32), ('hole', ctypes.c_float), ('seed', ctypes.c_uint32), ('file', ctypes.c_char * 256)]
+
+class World(ctypes.Structure):
+    """psimworld, the arena and its cubes in grid order."""
+    _fields_ = [('size', ctypes.c_float), ('spawn', ctypes.c_float), ('n', ctypes.c_uint32),
+                ('x', ctypes.POINTER(ctypes.c_float)), ('y', ctypes.POINTER(ctypes.c_float)),
+                ('org', ctypes.c_float), ('inv_cell', ctypes.c_float), ('gw', ctypes.c_uint32), ('start', ctypes.POINTER(ctypes.c_uint32)),
+                ('rn', ctypes.c_uint32), ('rx', ctypes.POINTER(ctypes.c_float)), ('ry', ctypes.POINTER(ctypes.c_float)), ('rstart', ctypes.POINTER(ctypes.c_uint32))]
+
+_lib = None
+
+def _load(path):
+    global _lib
+    if _lib is not None:
+        return _lib
+    _lib = ctypes.CDLL(path)
+    f32p = ctypes.POINTER(ctypes.c_float)
+    _lib.psimvecCreate.restype = ctypes.c_void_p
+    _lib.psimvecCreate.argtypes = [ctypes.c_uint32, ctypes.POINTER(Config), ctypes.c_uint32]
+    _lib.psimvecFree.argtypes = [ctypes.c_void_p]
+    _lib.psimvecReset.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint32), f32p]
+    _lib.psimvecStep.argtypes = [ctypes.c_void_p, f32p, ctypes.c_uint32, f32p, f32p, ctypes.POINTER(ctypes.c_uint8)]
+    _lib.psimvecConfig.restype = ctypes.POINTER(Config)
+    _lib.psimvecConfig.argtypes = [ctypes.c_void_p]
+    _lib.psimWorldParse.argtypes = [ctypes.POINTER(WorldConfig), ctypes.c_char_p]
+    _lib.psimWorldCreate.argtypes = [ctypes.POINTER(World), ctypes.POINTER(WorldConfig)]
+    _lib.psimWorldFree.argtypes = [ctypes.POINTER(World)]
+    return _lib
+
+def _ptr(a, t):
+    return a.ctypes.data_as(ctypes.POINTER(t))
+
+class VecEnv:
+    """n PoryDrive environments stepped together, a round is an episode."""
+    def __init__(self, n_envs, threads=0, ticks=1, world=None, lib=os.path.join(os.path.dirname(os.path.abspath(__file__)), 'porysim', 'libporysim.so')):
+        self.lib = _load(lib)
+        self.n = n_envs
+        self.ticks = ticks
+        self.handle = None
+        self.world = None
+        if world is not None:
+            wc = WorldConfig()
+            self.world = World()
+            if self.lib.psimWorldParse(ctypes.byref(wc), world.encode()) != 0 or self.lib.psimWorldCreate(ctypes.byref(self.world), ctypes.byref(wc)) != 0:
+                self.world = None
+                raise ValueError("invalid world: " + world)
+        self.handle = self.lib.psimvecCreate(n_envs, None, threads)
+        if not self.handle:
+            raise MemoryError("psimvecCreate failed")
+        self.config = self.lib.psimvecConfig(self.handle).contents # changes apply from the next step
+        self.obs = np.zeros([n_envs, 6], np.float32)
+        self.reward = np.zeros([n_envs], np.float32)
+        self.done = np.zeros([n_envs], np.uint8)
+        if self.world is not None:
+            self.config.world = ctypes.addressof(self.world)
+            self.reset() # spawned within the world
+
+    def reset(self, seeds=None):
+        """New games, environment i seeded with seeds[i] (1 to n by default); the first observations."""
+        s = None
+        if seeds is not None:
+            seeds = np.ascontiguousarray(np.fromiter(seeds, np.uint32, self.n) if not isinstance(seeds, np.ndarray) else seeds, dtype=np.uint32)
+            if seeds.shape != (self.n,):
+                raise ValueError("need one seed per environment")
+            s = _ptr(seeds, ctypes.c_uint32)
+        self.lib.psimvecReset(self.handle, s, _ptr(self.obs, ctypes.c_float))
+        return self.obs
+
+    def step(self, actions=None):
+        """Holds actions [n, 2] of (sr, sp) for `ticks` ticks; (obs, reward, done), the same arrays every step."""
+        a = None
+        if actions is not None:
+            actions = np.ascontiguousarray(actions, dtype=np.float32)
+            if actions.shape != (self.n, 2):
+                raise ValueError("actions must be [n_envs, 2]")
+            a = _ptr(actions, ctypes.c_float)
+        self.lib.psimvecStep(self.handle, a, self.ticks, _ptr(self.obs, ctypes.c_float),
+                             _ptr(self.reward, ctypes.c_float), _ptr(self.done, ctypes.c_uint8))
+        return self.obs, self.reward, self.done
+
+    def close(self):
+        if self.handle:
+            self.lib.psimvecFree(self.handle)
+            self.handle = None
+        if self.world is not None:
+            self.lib.psimWorldFree(ctypes.byref(self.world))
+            self.world = None
+
+    def __del__(self):
+        self.close()
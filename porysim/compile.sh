@@ -0,0 +1 @@
+gcc porysim.c -I ../inc -Ofast -fPIC -shared -lm -lpthread -o libporysim.so
@@ -0,0 +1,16 @@
+/*
+    Info:
+
+        libporysim.so, the batched simulation core as a shared library
+        (see inc/psimvec.h), for porysim.py and anything else that can call C.
+
+    Usage:
+
+        ./compile.sh
+        python3 -c "import porysim; e = porysim.VecEnv(4096); print(e.step()[0].shape)"
+
+*/
+
+#include "../inc/vec.h"
+#include "../inc/porysim.h"
+#include "../inc/psimvec.h"
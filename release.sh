@@ -1,2 +1,2 @@
-clang main.c glad_gl.c -I inc -Ofast -lglfw -lm -o porydrive
+gcc main.c glad_gl.c -I inc -Ofast -lglfw -lm -o porydrive
 upx porydrive
\ No newline at end of file
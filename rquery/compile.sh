@@ -0,0 +1 @@
+gcc main.c -I ../inc -O2 -lm -o rquery
@@ -0,0 +1,521 @@
+/*
+    Info:
+
+        Round index query tool.
+
+        Reads the <score>.idx round indexes porydrivecli writes next to its
+        bucket files (see inc/rindex.h), selects rounds by their raw score
+        factors and materialises them as a new dataset by copying just their
+        byte extents with copy_file_range (inc/fcopy.h), so nothing is
+        re-captured and on filesystems that share extents nothing is copied.
+        Other .idx files are skipped, the dataset.idx of a dsmerge output in
+        the same directory holds the same rounds again.
+
+        --where takes conditions joined by "and":
+            <field> <|<=|>|>=|==|!= <number>
+        over the fields
+            score       the score, re-computed with --weights if given
+            bucket      the score the round was bucketed by
+            start_dist zs zt time cc rows seed round
+
+        --weights re-weights the five score terms (start distance, porygon
+        speed, twitch radius, round time, collisions), the capture tools use
+        equal weights, so a new scoring formula takes a scan of the indexes.
+
+        Without --out it prints a summary, with --csv every selected round.
+        --out writes float32 or quantized X and Y files, --out-pdb compressed
+        blocks; a selection must be of a single format (--format picks one)
+        and quantized rounds must share the same scales. When every bucket
+        of the selection has a ray sidecar of the same rays (porydrivecli
+        --rays, see inc/psimrays.h) the rays of the rounds go along into the
+        <name>_r.dat beside <out_x>.
+
+    Usage:
+
+        ./rquery [dir] [--where "<conditions>"] [--weights w0,w1,w2,w3,w4] [--format dat|f16|i16|pdb] [--csv]
+                 [--out <out_x> <out_y>] [--out-pdb <out.pdb>]
+        ./rquery ../multicapturecli --where "cc < 5 and start_dist > 20" --out dataset_x.dat dataset_y.dat
+        ./rquery . --weights 2,1,1,1,4 --where "score >= 0.7" --csv
+
+*/
+
+#include "../inc/fcopy.h" // first, it needs _GNU_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../inc/vec.h"
+#include "../inc/mat.h"
+#include "../inc/porysim.h"
+#include "../inc/psimrays.h"
+#include "../inc/qenc.h"
+#include "../inc/dsblock.h"
+#include "../inc/rindex.h"
+
+#define MAX_CONDITIONS 16
+
+typedef struct
+{
+    ridx r;
+    char bucket[16]; // "0.7", the file name prefix
+    float score;     // re-computed
+} round_t;
+
+typedef struct
+{
+    int field;
+    int op;
+    double v;
+} cond;
+
+enum {F_SCORE, F_BUCKET, F_START_DIST, F_ZS, F_ZT, F_TIME, F_CC, F_ROWS, F_SEED, F_ROUND, F_COUNT};
+const char* field_names[F_COUNT] = {"score", "bucket", "start_dist", "zs", "zt", "time", "cc", "rows", "seed", "round"};
+enum {OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE};
+
+round_t* rounds = NULL;
+uint32_t nrounds = 0, crounds = 0;
+cond conds[MAX_CONDITIONS];
+uint32_t nconds = 0;
+float weights[5] = {1.f, 1.f, 1.f, 1.f, 1.f};
+uint32_t reweight = 0;
+
+double fieldValue(const round_t* r, const int f)
+{
+    switch(f)
+    {
+        case F_SCORE:      return r->score;
+        case F_BUCKET:     return r->r.score;
+        case F_START_DIST: return r->r.start_dist;
+        case F_ZS:         return r->r.zs;
+        case F_ZT:         return r->r.zt;
+        case F_TIME:       return r->r.rtime;
+        case F_CC:         return r->r.cc;
+        case F_ROWS:       return r->r.rows;
+        case F_SEED:       return (double)r->r.seed;
+        case F_ROUND:      return r->r.round;
+    }
+    return 0.0;
+}
+
+int match(const round_t* r)
+{
+    for(uint32_t i = 0; i < nconds; i++)
+    {
+        const double a = fieldValue(r, conds[i].field), b = conds[i].v;
+        int m = 0;
+        switch(conds[i].op)
+        {
+            case OP_LT: m = a <  b; break;
+            case OP_LE: m = a <= b; break;
+            case OP_GT: m = a >  b; break;
+            case OP_GE: m = a >= b; break;
+            case OP_EQ: m = a == b; break;
+            case OP_NE: m = a != b; break;
+        }
+        if(m == 0)
+            return 0;
+    }
+    return 1;
+}
+
+// "cc < 5 and start_dist > 20", 0 on success
+int parseWhere(const char* s)
+{
+    const char* p = s;
+    while(*p != 0)
+    {
+        while(*p == ' '){p++;}
+        if(*p == 0)
+            break;
+        if(nconds == MAX_CONDITIONS)
+        {
+            printf("Too many conditions.\n");
+            return -1;
+        }
+
+        // field
+        int f = -1;
+        for(int i = 0; i < F_COUNT; i++)
+        {
+            const size_t l = strlen(field_names[i]);
+            if(strncmp(p, field_names[i], l) == 0 && strchr(" <>=!", p[l]) != NULL)
+            {
+                f = i;
+                p += l;
+                break;
+            }
+        }
+        if(f == -1)
+        {
+            printf("Unknown field at: %s\n", p);
+            return -1;
+        }
+        while(*p == ' '){p++;}
+
+        // operator
+        int op;
+        if(strncmp(p, "<=", 2) == 0){op = OP_LE; p += 2;}
+        else if(strncmp(p, ">=", 2) == 0){op = OP_GE; p += 2;}
+        else if(strncmp(p, "==", 2) == 0){op = OP_EQ; p += 2;}
+        else if(strncmp(p, "!=", 2) == 0){op = OP_NE; p += 2;}
+        else if(*p == '<'){op = OP_LT; p++;}
+        else if(*p == '>'){op = OP_GT; p++;}
+        else if(*p == '='){op = OP_EQ; p++;}
+        else
+        {
+            printf("Expected an operator at: %s\n", p);
+            return -1;
+        }
+
+        // number
+        char* e;
+        const double v = strtod(p, &e);
+        if(e == p)
+        {
+            printf("Expected a number at: %s\n", p);
+            return -1;
+        }
+        p = e;
+        conds[nconds++] = (cond){f, op, v};
+
+        // and
+        while(*p == ' '){p++;}
+        if(strncmp(p, "and", 3) == 0){p += 3;}
+        else if(strncmp(p, "&&", 2) == 0){p += 2;}
+        else if(*p != 0)
+        {
+            printf("Expected \"and\" at: %s\n", p);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+float rescore(const ridx* r)
+{
+    float t[5];
+    const float s = psimScore(r->start_dist, r->zs, r->zt, r->rtime, r->cc, t);
+    if(reweight == 0 || s == 0.f)
+        return reweight == 0 ? r->score : 0.f;
+    float sum = 0.f, ws = 0.f;
+    for(int i = 0; i < 5; i++)
+    {
+        sum += weights[i] * t[i];
+        ws += weights[i];
+    }
+    return ws > 0.f ? sum / ws : 0.f;
+}
+
+// "0.7.idx", the name of a bucket's index, not that of a merged set
+int bucketIndex(const char* name)
+{
+    const size_t l = strlen(name);
+    if(l < 5 || strcmp(name + l - 4, ".idx") != 0)
+        return 0;
+    char* e;
+    strtod(name, &e);
+    return e != name && e == name + l - 4;
+}
+
+void loadIndex(const char* dir, const char* name)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "rb");
+    if(f == NULL)
+        return;
+    ridx r;
+    while(fread(&r, 1, sizeof(r), f) == sizeof(r))
+    {
+        if(r.magic != RIDX_MAGIC)
+        {
+            printf("%s: bad record, the rest of the index is skipped.\n", path);
+            break;
+        }
+        if(nrounds == crounds)
+        {
+            crounds = crounds ? crounds*2 : 4096;
+            rounds = realloc(rounds, crounds * sizeof(round_t));
+        }
+        round_t* o = &rounds[nrounds++];
+        o->r = r;
+        snprintf(o->bucket, sizeof(o->bucket), "%.*s", (int)(strlen(name)-4), name);
+        o->score = rescore(&r);
+    }
+    fclose(f);
+}
+
+// an open source file, the previous one is kept open as consecutive rounds mostly share it
+int openSource(const char* dir, const char* bucket, const char* suffix, char* cur, int* fd)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s%s", dir, bucket, suffix);
+    if(*fd > -1 && strcmp(cur, path) == 0)
+        return *fd;
+    if(*fd > -1)
+        close(*fd);
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    strcpy(cur, path);
+    if(*fd == -1)
+        printf("Failed to open %s\n", path);
+    return *fd;
+}
+
+int main(int argc, char** argv)
+{
+    const char* dir = ".";
+    const char* out_x = NULL;
+    const char* out_y = NULL;
+    const char* out_pdb = NULL;
+    int format = -1;
+    uint32_t csv = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--where") == 0 && i+1 < argc)
+        {
+            if(parseWhere(argv[++i]) < 0)
+                return 1;
+        }
+        else if(strcmp(argv[i], "--weights") == 0 && i+1 < argc)
+        {
+            char* p = argv[++i];
+            for(int j = 0; j < 5 && p != NULL; j++)
+            {
+                weights[j] = atof(p);
+                p = strchr(p, ',');
+                if(p != NULL){p++;}
+            }
+            reweight = 1;
+        }
+        else if(strcmp(argv[i], "--format") == 0 && i+1 < argc)
+        {
+            i++;
+            for(int j = RIDX_F32; j <= RIDX_PDB; j++)
+                if(strcmp(argv[i], ridxExt(j)) == 0)
+                    format = j;
+            if(format == -1)
+            {
+                printf("Unknown format: %s, use dat, f16, i16 or pdb.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--csv") == 0){csv = 1;}
+        else if(strcmp(argv[i], "--out") == 0 && i+2 < argc){out_x = argv[++i]; out_y = argv[++i];}
+        else if(strcmp(argv[i], "--out-pdb") == 0 && i+1 < argc){out_pdb = argv[++i];}
+        else if(strcmp(argv[i], "--help") == 0)
+        {
+            printf("Usage: ./rquery [dir] [--where \"<conditions>\"] [--weights w0,w1,w2,w3,w4] [--format dat|f16|i16|pdb] [--csv]\n");
+            printf("                [--out <out_x> <out_y>] [--out-pdb <out.pdb>]\n");
+            return 0;
+        }
+        else{dir = argv[i];}
+    }
+
+    // every bucket index in the directory
+    DIR* d = opendir(dir);
+    if(d == NULL)
+    {
+        printf("Failed to open %s\n", dir);
+        return 1;
+    }
+    struct dirent* de;
+    while((de = readdir(d)) != NULL)
+    {
+        if(bucketIndex(de->d_name) == 1)
+            loadIndex(dir, de->d_name);
+    }
+    closedir(d);
+
+    // select
+    uint32_t nsel = 0;
+    uint64_t rows = 0;
+    uint32_t formats = 0;
+    for(uint32_t i = 0; i < nrounds; i++)
+    {
+        if((format != -1 && rounds[i].r.format != (uint32_t)format) || match(&rounds[i]) == 0)
+            continue;
+        formats |= 1 << rounds[i].r.format;
+        rows += rounds[i].r.rows;
+        rounds[nsel++] = rounds[i];
+    }
+
+    if(csv == 1)
+    {
+        printf("bucket,format,round,seed,rows,start_dist,zs,zt,time,cc,bucket_score,score,x_off,y_off\n");
+        for(uint32_t i = 0; i < nsel; i++)
+        {
+            const ridx* r = &rounds[i].r;
+            printf("%s,%s,%u,%llu,%u,%g,%g,%g,%g,%u,%g,%g,%llu,%llu\n", rounds[i].bucket, ridxExt(r->format), r->round,
+                (unsigned long long)r->seed, r->rows, r->start_dist, r->zs, r->zt, r->rtime, r->cc, r->score, rounds[i].score,
+                (unsigned long long)r->x_off, (unsigned long long)r->y_off);
+        }
+    }
+    else
+        printf("%u of %u rounds selected, %llu rows.\n", nsel, nrounds, (unsigned long long)rows);
+
+    if(out_x == NULL && out_pdb == NULL)
+        return 0;
+    if(nsel == 0)
+    {
+        printf("Nothing to write.\n");
+        return 1;
+    }
+    if((formats & (formats-1)) != 0)
+    {
+        printf("The selection mixes formats, pick one with --format.\n");
+        return 1;
+    }
+    const uint32_t fmt = rounds[0].r.format;
+    if((fmt == RIDX_PDB) != (out_pdb != NULL))
+    {
+        printf("Compressed rounds need --out-pdb, the others --out.\n");
+        return 1;
+    }
+
+    char cx[4096] = {0}, cy[4096] = {0};
+    int sx = -1, sy = -1;
+    char sfx[16], sfy[16];
+    sprintf(sfx, fmt == RIDX_PDB ? ".pdb" : "_x.%s", ridxExt(fmt));
+    sprintf(sfy, "_y.%s", ridxExt(fmt));
+
+    if(fmt == RIDX_PDB)
+    {
+        const int fo = open(out_pdb, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fo == -1)
+        {
+            printf("Failed to open %s\n", out_pdb);
+            return 1;
+        }
+        for(uint32_t i = 0; i < nsel; i++)
+        {
+            const int f = openSource(dir, rounds[i].bucket, sfx, cx, &sx);
+            dsbheader h;
+            if(f == -1 || pread(f, &h, sizeof(h), rounds[i].r.x_off) != sizeof(h) || h.magic != DSB_MAGIC ||
+               fcopyRange(f, rounds[i].r.x_off, fo, sizeof(h) + h.size) < 0)
+            {
+                printf("Failed to copy round %u of %s\n", rounds[i].r.round, cx);
+                return 1;
+            }
+        }
+        close(fo);
+        printf("Wrote %s\n", out_pdb);
+        return 0;
+    }
+
+    const int fox = open(out_x, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    const int foy = open(out_y, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fox == -1 || foy == -1)
+    {
+        printf("Failed to open the outputs.\n");
+        return 1;
+    }
+
+    // quantized outputs take the header of the sources, which must all agree
+    const size_t vs = qencBytes(fmt);
+    const size_t ho = fmt == RIDX_F32 ? 0 : sizeof(qheader);
+    qheader qh[2];
+    for(uint32_t i = 0; i < nsel && fmt != RIDX_F32; i++)
+    {
+        for(int k = 0; k < 2; k++)
+        {
+            const int f = k == 0 ? openSource(dir, rounds[i].bucket, sfx, cx, &sx) : openSource(dir, rounds[i].bucket, sfy, cy, &sy);
+            qheader h;
+            if(f == -1 || pread(f, &h, sizeof(h), 0) != sizeof(h) || qencCheck(&h) < 0)
+                return 1;
+            if(i == 0)
+                qh[k] = h;
+            else if(memcmp(&h, &qh[k], sizeof(h)) != 0)
+            {
+                printf("%s has different scales, convert the selection with dsconv instead.\n", k == 0 ? cx : cy);
+                return 1;
+            }
+        }
+    }
+    if(ho > 0 && (write(fox, &qh[0], ho) != (ssize_t)ho || write(foy, &qh[1], ho) != (ssize_t)ho))
+    {
+        printf("Failed to write the outputs.\n");
+        return 1;
+    }
+
+    // the rays go along row for row when every bucket of the selection has the same ones
+    psimraysheader rh = {0};
+    char orr[4096], cr[4096] = {0};
+    int sr = -1, fro = -1;
+    uint32_t rays = 1;
+    for(uint32_t i = 0; i < nsel && rays == 1; i++)
+    {
+        if(i > 0 && strcmp(rounds[i].bucket, rounds[i-1].bucket) == 0)
+            continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s_r.dat", dir, rounds[i].bucket);
+        psimraysheader h;
+        int f;
+        if(psimRaysOpen(path, &h, &f) < 0)
+            rays = 0;
+        else
+        {
+            close(f);
+            if(i == 0)
+                rh = h;
+            else if(memcmp(&h, &rh, sizeof(h)) != 0)
+                rays = 0;
+        }
+    }
+    psimRaysPath(out_x, orr, sizeof(orr));
+    if(rays == 1)
+    {
+        fro = open(orr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fro == -1 || write(fro, &rh, sizeof(rh)) != sizeof(rh))
+        {
+            printf("Failed to write %s\n", orr);
+            return 1;
+        }
+    }
+    else
+        unlink(orr); // rays of an earlier query would not line up
+    const size_t rr = rh.k * sizeof(float);
+
+    // extents, merging rounds that sit back to back in the same bucket
+    for(uint32_t i = 0; i < nsel;)
+    {
+        uint32_t j = i + 1;
+        uint64_t n = rounds[i].r.rows;
+        while(j < nsel && strcmp(rounds[j].bucket, rounds[i].bucket) == 0 &&
+              rounds[j].r.x_off == rounds[i].r.x_off + n*6*vs && rounds[j].r.y_off == rounds[i].r.y_off + n*2*vs)
+            n += rounds[j++].r.rows;
+        const int fx = openSource(dir, rounds[i].bucket, sfx, cx, &sx);
+        const int fy = openSource(dir, rounds[i].bucket, sfy, cy, &sy);
+        if(fx == -1 || fy == -1 || fcopyRange(fx, rounds[i].r.x_off, fox, n*6*vs) < 0 || fcopyRange(fy, rounds[i].r.y_off, foy, n*2*vs) < 0)
+        {
+            printf("Failed to copy rounds from %s\n", rounds[i].bucket);
+            return 1;
+        }
+        if(fro > -1)
+        {
+            const uint64_t row = (rounds[i].r.x_off - ho) / (6*vs);
+            const int fr = openSource(dir, rounds[i].bucket, "_r.dat", cr, &sr);
+            if(fr == -1 || fcopyRange(fr, sizeof(rh) + row*rr, fro, n*rr) < 0)
+            {
+                printf("Failed to copy the rays of rounds from %s\n", rounds[i].bucket);
+                return 1;
+            }
+        }
+        i = j;
+    }
+    if(close(fox) != 0 || close(foy) != 0 || (fro > -1 && close(fro) != 0))
+    {
+        printf("Failed to write the outputs.\n");
+        return 1;
+    }
+    printf("Wrote %s and %s\n", out_x, out_y);
+    if(fro > -1)
+        printf("Wrote %u rays a row to %s\n", rh.k, orr);
+    return 0;
+}
@@ -3,6 +3,7 @@
 import sys
 import os
 import numpy as np
+import dataset
 from time import time_ns
 from os import mkdir
 from os.path import isdir
@@ -13,7 +14,7 @@ np.set_printoptions(threshold=sys.maxsize)
 # training set size
 inputsize = 6
 outputsize = 2
-tss = int(os.stat("dataset_y.dat").st_size / 8)
+tss = dataset.rows("dataset_y.dat", outputsize)
 print("Dataset Size:", "{:,}".format(tss))
 
 # helpers (https://stackoverflow.com/questions/4601373/better-way-to-shuffle-two-numpy-arrays-in-unison)
@@ -33,18 +34,14 @@ train_x = []
 train_y = []
 
 print("Loading & Reshaping...")
-with open("dataset_x.dat", 'rb') as f:
-    data = np.fromfile(f, dtype=np.float32)
-    train_x = np.reshape(data, [tss, inputsize])
+train_x = dataset.load("dataset_x.dat", inputsize)
 
-with open("dataset_y.dat", 'rb') as f:
-    data = np.fromfile(f, dtype=np.float32)
-    train_y = np.reshape(data, [tss, outputsize])
+train_y = dataset.load("dataset_y.dat", outputsize)
 
 print("Shuffling...")
 shuffle_in_unison(train_x, train_y)
 
-print("NaN's detected:", np.count_nonzero(np.isnan(data)))
+print("NaN's detected:", np.count_nonzero(np.isnan(train_x)) + np.count_nonzero(np.isnan(train_y)), "(dsscan counts NaN, Inf, denormal and zero values per column)")
 
 print("Saving & Zeroing NaN's...")
 np.save("numpy_x.npy", np.nan_to_num(train_x))
@@ -3,6 +3,7 @@
 import sys
 import os
 import numpy as np
+import dataset
 from tensorflow import keras
 from tensorflow.keras import layers
 from tensorflow.keras.models import Sequential
@@ -41,6 +42,8 @@ activator = 'tanh'
 layers = 4
 layer_units = 384
 batches = 32
+symmetries = 1 # 2, 4 or 8 augments every minibatch with that many symmetries of the arena (see dataset.augment)
+mirror = None # the ray order under a reflection when a ray sidecar is appended (see dataset.rays_mirror)
 # layer_units = 1024
 # batches = 64
 
@@ -61,12 +64,26 @@ if argc >= 5:
 if argc >= 6 and sys.argv[5] == '1':
     os.environ['CUDA_VISIBLE_DEVICES'] = '-1'
     print("CPU_ONLY: 1")
+if argc >= 7:
+    symmetries = int(sys.argv[6])
+    if symmetries not in dataset.SYM_GROUPS:
+        print("symmetries must be 1, 2, 4 or 8")
+        exit()
+    print("symmetries:", symmetries)
 
 # make sure save dir exists
 if not isdir('models'): mkdir('models')
 
-# training set size
-tss = int(os.stat("dataset_y.dat").st_size / 8)
+# training set size, a dsmerge --shards manifest is trained from in place
+reader = None
+if isfile("dataset.manifest") and not isfile("numpy_x.npy"):
+    reader = dataset.ShardReader("dataset.manifest", batches, epochs=training_iterations, symmetries=symmetries)
+    tss = reader.rows
+    if reader.rays is not None:
+        print("Rays:", reader.rays['k'], "after the inputs")
+        inputsize = reader.columns
+else:
+    tss = dataset.rows("dataset_y.dat", outputsize)
 print("Dataset Size:", "{:,}".format(tss))
 
 ##########################################
@@ -84,19 +101,30 @@ if isfile("numpy_x.npy"):
     print("Loaded shuffled numpy arrays")
     model_name = 'models/' + optimiser + '_' + sys.argv[1] + '_' + sys.argv[2] + '_' + sys.argv[3] + '_shuf'
     print("model_name:", model_name)
+elif reader is not None:
+    print("Reading", "{:,}".format(len(reader.shards)), "shards of dataset.manifest")
+    model_name = 'models/' + optimiser + '_' + sys.argv[1] + '_' + sys.argv[2] + '_' + sys.argv[3]
+    print("model_name:", model_name)
 else:
-    with open("dataset_x.dat", 'rb') as f:
-        data = np.fromfile(f, dtype=np.float32)
-        train_x = np.reshape(data, [tss, inputsize])
+    train_x = dataset.load("dataset_x.dat", inputsize)
+
+    train_y = dataset.load("dataset_y.dat", outputsize)
 
-    with open("dataset_y.dat", 'rb') as f:
-        data = np.fromfile(f, dtype=np.float32)
-        train_y = np.reshape(data, [tss, outputsize])
+    # the rays of porydrivecli --rays go after the inputs when dsmerge carried them through
+    if isfile(dataset.rays_path("dataset_x.dat")):
+        rays, meta = dataset.load_rays(dataset.rays_path("dataset_x.dat"))
+        train_x = np.concatenate([train_x, rays[:len(train_x)]], 1)
+        inputsize += meta['k']
+        mirror = dataset.rays_mirror(meta)
+        print("Rays:", meta['k'], "after the inputs")
 
     print("Loaded regular arrays; no shuffle")
     model_name = 'models/' + optimiser + '_' + sys.argv[1] + '_' + sys.argv[2] + '_' + sys.argv[3]
     print("model_name:", model_name)
 
+if symmetries > 1:
+    model_name += '_s' + str(symmetries)
+
 # print(train_x.shape)
 # print(train_x)
 # print(train_y.shape)
@@ -113,7 +141,18 @@ print("Time Taken:", "{:.2f}".format(timetaken), "seconds")
 # construct neural network
 model = Sequential()
 
-model.add(Dense(layer_units, activation=activator, input_dim=inputsize))
+# inputs are normalised with the dsscan statistics when there are some, export.py folds it into the first layer
+if isfile("dataset.stats"):
+    stats = dataset.load_stats("dataset.stats")
+    print("Normalising inputs with dataset.stats")
+    mean, var = dataset.augment_stats(stats['mean'][:6], stats['var'][:6], symmetries)
+    # the rays are already 0-1 over their range
+    mean = np.concatenate([mean, np.zeros(inputsize - 6, np.float32)])
+    var = np.concatenate([var, np.ones(inputsize - 6, np.float32)])
+    model.add(keras.layers.Normalization(mean=mean, variance=var, input_shape=(inputsize,)))
+    model.add(Dense(layer_units, activation=activator))
+else:
+    model.add(Dense(layer_units, activation=activator, input_dim=inputsize))
 if layers > 0: model.add(Dense(layer_units/2, activation=activator))
 if layers > 1: model.add(Dense(layer_units/4, activation=activator))
 if layers > 2: model.add(Dense(layer_units/8, activation=activator))
@@ -148,7 +187,12 @@ elif optimiser == 'ftrl':
 model.compile(optimizer=optim, loss='mean_squared_error')
 
 # train network
-model.fit(train_x, train_y, epochs=training_iterations, batch_size=batches)
+if reader is not None:
+    model.fit(iter(reader), epochs=training_iterations, steps_per_epoch=reader.steps_per_epoch())
+elif symmetries > 1:
+    model.fit(dataset.batches(train_x, train_y, batches, training_iterations, symmetries, mirror=mirror), epochs=training_iterations, steps_per_epoch=(len(train_x) + batches - 1) // batches)
+else:
+    model.fit(train_x, train_y, epochs=training_iterations, batch_size=batches)
 timetaken = (time_ns()-st)/1e+9
 print("")
 print("Time Taken:", "{:.2f}".format(timetaken), "seconds")
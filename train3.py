@@ -3,6 +3,7 @@
 import sys
 import os
 import numpy as np
+import dataset
 from tensorflow import keras
 from tensorflow.keras import layers
 from tensorflow.keras.models import Sequential
@@ -45,6 +46,9 @@ activator = 'tanh'
 layers = 1
 layer_units = 32
 batches = 512
+timesteps = 0 # > 0 trains on windows of that many consecutive ticks of a round, needs dataset.idx (see dataset.Windows)
+symmetries = 1 # 2, 4 or 8 augments every minibatch with that many symmetries of the arena (see dataset.augment)
+mirror = None # the ray order under a reflection when a ray sidecar is appended (see dataset.rays_mirror)
 
 # load options
 argc = len(sys.argv)
@@ -66,12 +70,21 @@ if argc >= 6:
 if argc >= 7 and sys.argv[6] == '1':
     os.environ['CUDA_VISIBLE_DEVICES'] = '-1'
     print("CPU_ONLY: 1")
+if argc >= 8:
+    timesteps = int(sys.argv[7])
+    print("timesteps:", timesteps)
+if argc >= 9:
+    symmetries = int(sys.argv[8])
+    if symmetries not in dataset.SYM_GROUPS:
+        print("symmetries must be 1, 2, 4 or 8")
+        exit()
+    print("symmetries:", symmetries)
 
 # make sure save dir exists
 if not isdir('models'): mkdir('models')
 
 # training set size
-tss = int(os.stat("dataset_y.dat").st_size / 8)
+tss = dataset.rows("dataset_y.dat", outputsize)
 print("Dataset Size:", "{:,}".format(tss))
 
 ##########################################
@@ -83,25 +96,44 @@ st = time_ns()
 train_x = []
 train_y = []
 
-if isfile("numpy_x.npy"):
+windows = None
+if timesteps > 0:
+    if not isfile("dataset.idx"):
+        print("timesteps needs the round index dataset.idx, merge with dsmerge to keep it")
+        exit()
+    windows = dataset.Windows("dataset_x.dat", "dataset_y.dat", timesteps, symmetries=symmetries, rays=isfile(dataset.rays_path("dataset_x.dat")))
+    print("Windows:", "{:,}".format(len(windows)), "of", timesteps, "ticks from", "{:,}".format(windows.rounds), "rounds")
+    if windows.rays is not None:
+        print("Rays:", windows.rays['k'], "after the inputs")
+        inputsize += windows.rays['k']
+    model_name = 'models/' + activator + '_' + optimiser + '_' + sys.argv[1] + '_' + sys.argv[2] + '_' + sys.argv[3] + '_t' + str(timesteps)
+    print("model_name:", model_name)
+elif isfile("numpy_x.npy"):
     train_x = np.load("numpy_x.npy")
     train_y = np.load("numpy_y.npy")
     print("Loaded shuffled numpy arrays")
     model_name = 'models/' + activator + '_' + optimiser + '_' + sys.argv[1] + '_' + sys.argv[2] + '_' + sys.argv[3] + '_shuf'
     print("model_name:", model_name)
 else:
-    with open("dataset_x.dat", 'rb') as f:
-        data = np.fromfile(f, dtype=np.float32)
-        train_x = np.reshape(data, [tss, inputsize])
+    train_x = dataset.load("dataset_x.dat", inputsize)
+
+    train_y = dataset.load("dataset_y.dat", outputsize)
 
-    with open("dataset_y.dat", 'rb') as f:
-        data = np.fromfile(f, dtype=np.float32)
-        train_y = np.reshape(data, [tss, outputsize])
+    # the rays of porydrivecli --rays go after the inputs when dsmerge carried them through
+    if isfile(dataset.rays_path("dataset_x.dat")):
+        rays, meta = dataset.load_rays(dataset.rays_path("dataset_x.dat"))
+        train_x = np.concatenate([train_x, rays[:len(train_x)]], 1)
+        inputsize += meta['k']
+        mirror = dataset.rays_mirror(meta)
+        print("Rays:", meta['k'], "after the inputs")
 
     print("Loaded regular arrays; no shuffle")
     model_name = 'models/' + activator + '_' + optimiser + '_' + sys.argv[1] + '_' + sys.argv[2] + '_' + sys.argv[3]
     print("model_name:", model_name)
 
+if symmetries > 1:
+    model_name += '_s' + str(symmetries)
+
 # print(train_x.shape)
 # print(train_x)
 # print(train_y.shape)
@@ -121,7 +153,10 @@ model = Sequential()
 # model.add(Dense(layer_units, activation=activator, input_dim=inputsize))
 
 # model.add(SimpleRNN((layer_units), batch_input_shape=(None,inputsize,1)))
-model.add(LSTM( (layer_units), batch_input_shape=(None,inputsize,1) )) #, recurrent_dropout=.3))
+if windows is not None:
+    model.add(LSTM( (layer_units), batch_input_shape=(None,timesteps,inputsize) ))
+else:
+    model.add(LSTM( (layer_units), batch_input_shape=(None,inputsize,1) )) #, recurrent_dropout=.3))
 # model.add(GRU((layer_units), batch_input_shape=(None,inputsize,1)))
 
 for x in range(layers):
@@ -158,7 +193,12 @@ elif optimiser == 'ftrl':
 model.compile(optimizer=optim, loss='mean_squared_error')
 
 # train network
-model.fit(train_x, train_y, epochs=training_iterations, batch_size=batches)
+if windows is not None:
+    model.fit(windows.batches(batches, epochs=training_iterations), epochs=training_iterations, steps_per_epoch=windows.steps_per_epoch(batches))
+elif symmetries > 1:
+    model.fit(dataset.batches(train_x, train_y, batches, training_iterations, symmetries, mirror=mirror), epochs=training_iterations, steps_per_epoch=(len(train_x) + batches - 1) // batches)
+else:
+    model.fit(train_x, train_y, epochs=training_iterations, batch_size=batches)
 timetaken = (time_ns()-st)/1e+9
 print("")
 print("Time Taken:", "{:.2f}".format(timetaken), "seconds")